@@ -24,6 +24,7 @@
 #include <gst/rtp/gstrtpbuffer.h>
 #include <gst/rtp/gstrtcpbuffer.h>
 #include "fbrafbproc.h"
+#include "mprtpclock.h"
 #include <math.h>
 #include <string.h>
 #include <stdlib.h>     /* qsort */
@@ -40,7 +41,16 @@
 //#define THIS_WRITELOCK(this)
 //#define THIS_WRITEUNLOCK(this)
 
-#define _now(this) gst_clock_get_time (this->sysclock)
+#define _now(this) mprtp_clock_get_time()
+
+//Below it the long term OWD is approximated by an EWMA of the short term one
+#define LTT_MIN_SAMPLES 5
+
+//The ring starts small and doubles while the packets in flight do not fit
+#define ITEMS_INIT_LENGTH 512
+#define ITEMS_MAX_LENGTH 32768
+#define _item_at(this, seq) (this->items + ((seq) & (this->items_length - 1)))
+#define _items_span(this) ((guint16)(this->items_head - this->acked_tail))
 
 GST_DEBUG_CATEGORY_STATIC (fbrafbprocessor_debug_category);
 #define GST_CAT_DEFAULT fbrafbprocessor_debug_category
@@ -50,187 +60,68 @@ G_DEFINE_TYPE (FBRAFBProcessor, fbrafbprocessor, G_TYPE_OBJECT);
 //----------------------------------------------------------------------
 //-------- Private functions belongs to Scheduler tree object ----------
 //----------------------------------------------------------------------
-typedef struct{
-  gint         ref;
-  gdouble      owd_corr;
-  GstClockTime owd;
-  gint64       owd_in_ms;
-  gdouble      FD;
-  gint32       BiF;
-}FBRAFBStatItem;
-
 static void fbrafbprocessor_finalize (GObject * object);
 static void _process_rle_discvector(FBRAFBProcessor *this, GstMPRTCPXRReportSummary *xr);
 static void _process_statitem(FBRAFBProcessor *this);
 static void _process_afb(FBRAFBProcessor *this, guint32 id, GstRTCPAFB_REPS *remb);
 static void _process_owd(FBRAFBProcessor *this, GstMPRTCPXRReportSummary *xrsummary);
-static void _ref_rtpitem(FBRAFBProcessor * this, FBRAFBProcessorItem* item);
-static void _unref_rtpitem(FBRAFBProcessor * this, FBRAFBProcessorItem* item);
-static FBRAFBProcessorItem* _retrieve_item(FBRAFBProcessor * this, guint16 seq);
-static void _ref_statitem(FBRAFBProcessor * this, FBRAFBStatItem* item);
-static void _unref_statitem(FBRAFBProcessor * this, FBRAFBStatItem* item);
+static void _push_item(FBRAFBProcessor * this, guint payload_len, guint16 sn);
+static FBRAFBProcessorItem* _find_item(FBRAFBProcessor * this, guint16 seq);
+static void _expire_items(FBRAFBProcessor * this);
 //----------------------------------------------------------------------
 //--------- Private functions implementations to SchTree object --------
 //----------------------------------------------------------------------
 
 
-static void owd_logger(gpointer data, gchar* string)
+static void owd_logger(gpointer data)
 {
   FBRAFBProcessor *this = data;
-  THIS_READLOCK(this);
-
-  sprintf(string, "%"G_GINT64_FORMAT",%"G_GINT64_FORMAT",%"G_GINT64_FORMAT",%"G_GINT64_FORMAT"\n",
-               GST_TIME_AS_USECONDS(this->stat.owd_stt),
-               GST_TIME_AS_USECONDS(this->stat.owd_ltt80),
-               GST_TIME_AS_USECONDS(this->stat.RTT),
-               (GstClockTime)this->stat.srtt / 1000
-               );
+  MPRTPStatsRecord *record;
 
+  record = mprtp_stats_begin(MPRTP_STATS_OWD, this->subflow_id);
+  if(!record){
+    return;
+  }
+  THIS_READLOCK(this);
+  record->values[0].integer = GST_TIME_AS_USECONDS(this->stat.owd_stt);
+  record->values[1].integer = GST_TIME_AS_USECONDS(this->stat.owd_ltt80);
+  record->values[2].integer = GST_TIME_AS_USECONDS(this->stat.RTT);
+  record->values[3].integer = (GstClockTime)this->stat.srtt / 1000;
   THIS_READUNLOCK(this);
-
+  mprtp_stats_commit(record);
 }
 
 
-#define _statitem_cmpfnc(field) \
-static gint _statitem_##field##_cmp(gpointer pa, gpointer pb) \
-{ \
-  FBRAFBStatItem *a,*b; \
-  a = pa; b = pb; \
-  if(a->field == b->field) return 0; \
-  return a->field < b->field ? -1 : 1; \
-} \
-
-_statitem_cmpfnc(owd);
-//_statitem_cmpfnc(BiF);
+static void _refresh_ltt_stat(FBRAFBProcessor *this)
+{
+  winstat_snapshot_t owds, fds;
 
+  winstat_get(this->ltt_owds, &owds);
+  winstat_get(this->ltt_fds, &fds);
 
+  this->stat.FD_avg = fds.avg;
+  //The deviation of the long term OWD is measured in milliseconds
+  this->stat.owd_var = owds.var / (gdouble)(GST_MSECOND * GST_MSECOND);
+  this->stat.owd_std = owds.std / (gdouble)GST_MSECOND;
 
-static void _owd_ltt80_percentile_pipe(gpointer udata, swpercentilecandidates_t *candidates)
-{
-  FBRAFBProcessor *this = udata;
-  FBRAFBStatItem *left, *right, *min, *max;
-
-  if(!candidates->processed){
+  if(owds.counter < LTT_MIN_SAMPLES){
       this->owd_ltt_ewma = this->owd_ltt_ewma == 0. ? this->stat.owd_stt : (this->owd_ltt_ewma * .8 + this->stat.owd_stt * .2);
       this->stat.owd_th_dist  = this->owd_ltt_ewma * .2;
       this->stat.owd_th_cng  = this->owd_ltt_ewma * .8;
       this->owd_stat.ltt80th = this->owd_stat.min = this->owd_stat.max = this->owd_ltt_ewma;
-      g_warning("Not enough owd_stt to calculate the ltt80th");
+      GST_DEBUG_OBJECT(this, "Not enough owd_stt to calculate the ltt80th");
     return;
   }
   this->owd_ltt_ewma = 0.;
-  left  = candidates->left;
-  right = candidates->right;
-
-  if(!left){
-    this->owd_stat.ltt80th = right->owd;
-  }else if(!right){
-    this->owd_stat.ltt80th = left->owd;
-  }else{
-    this->owd_stat.ltt80th = left->owd;
-    this->owd_stat.ltt80th += right->owd;
-    this->owd_stat.ltt80th>>=1;
-  }
-  min = candidates->min;
-  max = candidates->max;
-  this->owd_stat.min = min->owd;
-  this->owd_stat.max = max->owd;
-
-//  this->stat.owd_th1  = CONSTRAIN(10 * GST_MSECOND,
-//                                  100 * GST_MSECOND,
-//                                  this->owd_stat.min * .33);
-//
-//  this->stat.owd_th2  = CONSTRAIN(100 * GST_MSECOND,
-//                                  300 * GST_MSECOND,
-//                                  this->owd_stat.ltt80th * .33);
+  this->owd_stat.ltt80th = owds.percentile;
+  this->owd_stat.min     = owds.min;
+  this->owd_stat.max     = owds.max;
 
   this->stat.owd_th_dist  = this->stat.owd_std * 2.;
   this->stat.owd_th_cng  = this->stat.owd_std * 4.;
-
-
-//
-//  this->stat.owd_th2  = CONSTRAIN(100 * GST_MSECOND,
-//                                  300 * GST_MSECOND,
-//                                  this->owd_stat.ltt80th * .33);
 }
 
 
-
-static void _sent_add_pipe(gpointer udata, gpointer itemptr)
-{
-  FBRAFBProcessor *this = udata;
-  FBRAFBProcessorItem *item = itemptr;
-
-  _ref_rtpitem(this, item);
-
-  this->stat.bytes_in_flight += item->payload_bytes;
-  ++this->stat.packets_in_flight;
-
-  this->stat.sent_bytes_in_1s += item->payload_bytes;
-  ++this->stat.sent_packets_in_1s;
-}
-
-static void _sent_rem_pipe(gpointer udata, gpointer itemptr)
-{
-  FBRAFBProcessor *this = udata;
-  FBRAFBProcessorItem *item = itemptr;
-
-  this->stat.sent_bytes_in_1s -= item->payload_bytes;
-  --this->stat.sent_packets_in_1s;
-
-  if(!item->acknowledged){
-    g_warning("sequence number %hu not acknowledged in 1s. Hm????", item->seq_num);
-    this->stat.bytes_in_flight -= item->payload_bytes;
-    --this->stat.packets_in_flight;
-  }
-
-  _unref_rtpitem(this, item);
-}
-
-
-static void _acked_1s_add_pipe(gpointer udata, gpointer itemptr)
-{
-  FBRAFBProcessor *this = udata;
-  FBRAFBProcessorItem *item = itemptr;
-
-  _ref_rtpitem(this, item);
-
-  item->acknowledged = TRUE;
-
-  this->stat.bytes_in_flight -= item->payload_bytes;
-  --this->stat.packets_in_flight;
-
-  ++this->stat.acked_packets_in_1s;
-
-  if(item->discarded){
-    ++this->stat.discarded_packets_in_1s;
-  }else{
-    this->stat.goodput_bytes += item->payload_bytes;
-  }
-
-  return;
-}
-
-static void _acked_1s_rem_pipe(gpointer udata, gpointer itemptr)
-{
-  FBRAFBProcessor *this = udata;
-  FBRAFBProcessorItem *item = itemptr;
-
-  if(item->discarded){
-    --this->stat.discarded_packets_in_1s;
-  }else{
-    this->stat.goodput_bytes -= item->payload_bytes;
-  }
-
-  --this->stat.acked_packets_in_1s;
-
-  _unref_rtpitem(this, item);
-
-}
-
-
-
-
 void
 fbrafbprocessor_class_init (FBRAFBProcessorClass * klass)
 {
@@ -250,85 +141,10 @@ fbrafbprocessor_finalize (GObject * object)
 {
   FBRAFBProcessor *this;
   this = FBRAFBPROCESSOR(object);
-  g_object_unref(this->sysclock);
+  mprtp_logger_rem_stats_fnc(owd_logger, this);
   g_free(this->items);
-}
-
-#include <string.h>
-static void _sent_sprint(gpointer data, gchar *result)
-{
-  FBRAFBProcessorItem *item = data;
-  sprintf(result,"Sent window seq: %hu payload: %d", item->seq_num, item->payload_bytes);
-}
-
-static void _acked_sprint(gpointer data, gchar *result)
-{
-  FBRAFBProcessorItem *item = data;
-  sprintf(result,"Acked window seq: %hu payload: %d", item->seq_num, item->payload_bytes);
-}
-
-static void _statitem_rem_pipe(gpointer udata, gpointer itemptr)
-{
-  FBRAFBProcessor *this = udata;
-  FBRAFBStatItem *item = itemptr;
-
-  _unref_statitem(this, item);
-
-}
-
-static void _statitem_add_pipe(gpointer udata, gpointer itemptr)
-{
-  FBRAFBProcessor *this = udata;
-  FBRAFBStatItem *item = itemptr;
-
-  _ref_statitem(this, item);
-
-}
-
-static void _sw_refresh(FBRAFBProcessor *this)
-{
-  this->stat.FD_avg  = this->swstat.fdsum / (gdouble)this->swstat.num;
-  //Calculate Moving Variance:
-  //V = (N * SX2 - (SX1 * SX1)) / (N * (N - 1))
-  if(1 < this->swstat.num){
-    this->stat.owd_var = (this->swstat.num * this->swstat.owdsqsum) - (this->swstat.owdsum * this->swstat.owdsum);
-    this->stat.owd_var /= this->swstat.num * (this->swstat.num - 1);
-    this->stat.owd_std = sqrt(this->stat.owd_var);
-  }else{
-    this->stat.owd_var = this->stat.owd_std = 0.;
-  }
-
-//  g_print("FD_avg: %1.2f| owd_var: %1.2f| owd_std: %1.2f\n", this->stat.FD_avg, this->stat.owd_var, this->stat.owd_std);
-}
-
-static void _sw_statitem_rem_pipe(gpointer udata, gpointer itemptr)
-{
-  FBRAFBProcessor *this = udata;
-  FBRAFBStatItem *item = itemptr;
-
-  --this->swstat.num;
-  this->swstat.fdsum    -= item->FD;
-  this->swstat.fdsqsum  -= item->FD * item->FD;
-
-  this->swstat.owdsum   -= item->owd_in_ms;
-  this->swstat.owdsqsum -= item->owd_in_ms * item->owd_in_ms;
-  _sw_refresh(this);
-
-  _unref_statitem(this, item);
-}
-
-static void _sw_statitem_add_pipe(gpointer udata, gpointer itemptr)
-{
-  FBRAFBProcessor *this = udata;
-  FBRAFBStatItem *item = itemptr;
-
-  ++this->swstat.num;
-  this->swstat.fdsum    += item->FD;
-  this->swstat.fdsqsum  += item->FD * item->FD;
-
-  this->swstat.owdsum   += item->owd_in_ms;
-  this->swstat.owdsqsum += item->owd_in_ms * item->owd_in_ms;
-  _sw_refresh(this);
+  winstat_dtor(this->ltt_owds);
+  winstat_dtor(this->ltt_fds);
 }
 
 void
@@ -338,52 +154,26 @@ fbrafbprocessor_init (FBRAFBProcessor * this)
   this->sent             = g_queue_new();
   this->sent_in_1s       = g_queue_new();
   this->acked            = g_queue_new();
-  this->sysclock         = gst_system_clock_obtain();
   this->measurements_num = 0;
   this->stat.RTT         = GST_SECOND;
   this->stat.srtt        = 0;
 
-  this->items            = g_malloc0(sizeof(FBRAFBProcessorItem) * 65536);
-  this->stt_sw           = make_slidingwindow(100, 10 * GST_SECOND);
-  this->ltt_sw           = make_slidingwindow(600, 30 * GST_SECOND);
-  this->acked_1s_sw      = make_slidingwindow(2000, GST_SECOND);
-  this->sent_sw          = make_slidingwindow(2000, GST_SECOND);
-
-
-//  this->owd_offs = make_slidingwindow_double(10, GST_SECOND);
-//  slidingwindow_add_pipes(this->owd_offs, _owd_off_rem_pipe, this, _owd_off_add_pipe, this);
-
-  slidingwindow_add_pipes(this->sent_sw, _sent_rem_pipe, this, _sent_add_pipe, this);
-  slidingwindow_add_pipes(this->acked_1s_sw, _acked_1s_rem_pipe, this, _acked_1s_add_pipe, this);
-
-  slidingwindow_add_pipes(this->ltt_sw, _sw_statitem_rem_pipe, this, _sw_statitem_add_pipe, this);
-
-  slidingwindow_add_pipes(this->stt_sw, _statitem_rem_pipe, this, _statitem_add_pipe, this);
-
-  DISABLE_LINE slidingwindow_add_plugin(this->sent_sw, make_swprinter(_sent_sprint));
-  DISABLE_LINE slidingwindow_add_plugin(this->acked_1s_sw, make_swprinter(_acked_sprint));
-
-  slidingwindow_add_plugins(this->ltt_sw,
-                            make_swpercentile(80, _statitem_owd_cmp, _owd_ltt80_percentile_pipe, this),
-                            //make_swpercentile(60, _statitem_BiF_cmp, _owd_BiF_percentile_pipe, this),
-                           NULL);
-
+  this->items_length     = ITEMS_INIT_LENGTH;
+  this->items            = g_malloc0(sizeof(FBRAFBProcessorItem) * this->items_length);
+  this->ltt_owds         = make_winstat(600, 30 * GST_SECOND);
+  this->ltt_fds          = make_winstat(600, 30 * GST_SECOND);
 
   //slidingwindow_add_plugin(this->owd_sw, make_swpercentile(50, bintree3cmp_uint64, _owd_percentile_pipe, this));
 }
 
 
-FBRAFBProcessor *make_fbrafbprocessor(guint8 subflow_id)
+FBRAFBProcessor *make_fbrafbprocessor(guint8 subflow_id, gdouble owd_rel_accuracy)
 {
     FBRAFBProcessor *this;
     this = g_object_new (FBRAFBPROCESSOR_TYPE, NULL);
     this->subflow_id = subflow_id;
-
-    {
-      gchar filename[255];
-      sprintf(filename, "owd_%d.csv", this->subflow_id);
-      mprtp_logger_add_logging_fnc(owd_logger, this, filename);
-    }
+    winstat_enable_percentile(this->ltt_owds, 80, owd_rel_accuracy, 0. < owd_rel_accuracy ? 10. * GST_SECOND : 0.);
+    mprtp_logger_add_stats_fnc(owd_logger, this);
 
     return this;
 }
@@ -396,24 +186,15 @@ void fbrafbprocessor_reset(FBRAFBProcessor *this)
   THIS_WRITEUNLOCK (this);
 }
 
-void fbrafbprocessor_track(gpointer data, guint payload_len, guint16 sn)
+void fbrafbprocessor_track(gpointer data, guint payload_len, guint16 sn, guint32 rtp_timestamp)
 {
   FBRAFBProcessor *this;
-  FBRAFBProcessorItem* item;
   this = data;
   THIS_WRITELOCK (this);
 
-  item = _retrieve_item(this, sn);
-
-  item->payload_bytes = payload_len;
-  item->seq_num       = sn;
+  _push_item(this, payload_len, sn);
+  _expire_items(this);
 
-
-//  ++this->stat.packets_in_flight;
-//  this->stat.bytes_in_flight += payload_len;
-
-  slidingwindow_add_data(this->sent_sw, item);
-  slidingwindow_refresh(this->acked_1s_sw);
   THIS_WRITEUNLOCK (this);
 }
 
@@ -469,8 +250,10 @@ fbrafbprocessor_get_stats (FBRAFBProcessor * this, FBRAFBProcessorStat* result)
 
 static void _refresh_owd_ltt(FBRAFBProcessor *this)
 {
-//  slidingwindow_add_data(this->ltt_sw, &this->stat.owd_stt);
-  slidingwindow_add_data(this->ltt_sw, this->last_statitem);
+  GstClockTime now = _now(this);
+  winstat_add(this->ltt_owds, this->last_sample.owd, now);
+  winstat_add(this->ltt_fds, this->last_sample.FD, now);
+  _refresh_ltt_stat(this);
   this->stat.owd_ltt80 = this->owd_stat.ltt80th;
 }
 
@@ -485,17 +268,8 @@ void fbrafbprocessor_approve_owd_ltt(FBRAFBProcessor *this)
 
 void _process_statitem(FBRAFBProcessor *this)
 {
-  FBRAFBStatItem *item;
-  item = g_slice_new0(FBRAFBStatItem);
-  item->FD        = this->stat.discarded_rate;
-  item->owd       = this->stat.owd_stt;
-  item->owd_in_ms = GST_TIME_AS_MSECONDS(this->stat.owd_stt);
-  item->owd_corr  = this->stat.owd_corr;
-  item->BiF       = this->stat.bytes_in_flight;
-  item->ref       = 1;
-
-  slidingwindow_add_data(this->stt_sw, item);
-  this->last_statitem = item;
+  this->last_sample.owd = this->stat.owd_stt;
+  this->last_sample.FD  = this->stat.discarded_rate;
 }
 
 void _process_afb(FBRAFBProcessor *this, guint32 id, GstRTCPAFB_REPS *reps)
@@ -536,66 +310,183 @@ void _process_rle_discvector(FBRAFBProcessor *this, GstMPRTCPXRReportSummary *xr
 {
   FBRAFBProcessorItem *item;
   guint16 act_seq, end_seq;
-  gint i;
+  gint i, length;
+  GstClockTime now;
 
   act_seq = xr->DiscardedRLE.begin_seq;
   end_seq = xr->DiscardedRLE.end_seq;
   if(act_seq == end_seq){
     goto done;
   }
-  for(i=0; act_seq <= end_seq; ++act_seq, ++i){
-    item = this->items + act_seq;
-    if(item->acknowledged){
-        continue;
-      }
-    item->discarded = !xr->DiscardedRLE.vector[i];
-    slidingwindow_add_data(this->acked_1s_sw, item);
+  now    = _now(this);
+  length = MIN((guint16)(end_seq - act_seq) + 1, 1024);
+  for(i=0; i < length; ++act_seq, ++i){
+    item = _find_item(this, act_seq);
+    if(!item || item->acknowledged){
+      continue;
+    }
+    item->acknowledged = TRUE;
+    item->acked        = now;
+    item->discarded    = !xr->DiscardedRLE.vector[i];
+
+    if(item->in_flight){
+      item->in_flight = FALSE;
+      this->stat.bytes_in_flight -= item->payload_bytes;
+      --this->stat.packets_in_flight;
+    }
+
+    ++this->stat.acked_packets_in_1s;
+    if(item->discarded){
+      ++this->stat.discarded_packets_in_1s;
+    }else{
+      this->stat.goodput_bytes += item->payload_bytes;
+    }
+  }
+done:
+  _expire_items(this);
+}
+
+
+static void _release_sent(FBRAFBProcessor *this, FBRAFBProcessorItem *item)
+{
+  if(!item->used){
+    return;
+  }
+  this->stat.sent_bytes_in_1s -= item->payload_bytes;
+  --this->stat.sent_packets_in_1s;
+
+  if(item->in_flight){
+    g_warning("sequence number %hu not acknowledged in 1s. Hm????", item->seq_num);
+    item->in_flight = FALSE;
+    this->stat.bytes_in_flight -= item->payload_bytes;
+    --this->stat.packets_in_flight;
+  }
+}
+
+static void _release_acked(FBRAFBProcessor *this, FBRAFBProcessorItem *item)
+{
+  if(!item->used || !item->acknowledged){
+    goto done;
+  }
+  if(item->discarded){
+    --this->stat.discarded_packets_in_1s;
+  }else{
+    this->stat.goodput_bytes -= item->payload_bytes;
   }
+  --this->stat.acked_packets_in_1s;
 done:
-  slidingwindow_refresh(this->sent_sw);
+  item->used = FALSE;
 }
 
+static void _drop_oldest(FBRAFBProcessor *this)
+{
+  if(this->sent_tail == this->acked_tail){
+    _release_sent(this, _item_at(this, this->sent_tail));
+    ++this->sent_tail;
+  }
+  _release_acked(this, _item_at(this, this->acked_tail));
+  ++this->acked_tail;
+}
 
-void _ref_rtpitem(FBRAFBProcessor * this, FBRAFBProcessorItem* item)
+static void _grow_items(FBRAFBProcessor *this)
 {
-  ++item->ref;
+  FBRAFBProcessorItem *items;
+  guint32 length;
+  guint16 seq;
+
+  length = this->items_length<<1;
+  items  = g_malloc0(sizeof(FBRAFBProcessorItem) * length);
+  for(seq = this->acked_tail; seq != this->items_head; ++seq){
+    memcpy(items + (seq & (length - 1)), _item_at(this, seq), sizeof(FBRAFBProcessorItem));
+  }
+  g_free(this->items);
+  this->items        = items;
+  this->items_length = length;
 }
 
-void _unref_rtpitem(FBRAFBProcessor * this, FBRAFBProcessorItem* item)
+static void _make_room(FBRAFBProcessor *this)
 {
-  if(0 < item->ref){
-    --item->ref;
+  while(this->items_length <= _items_span(this) + 1){
+    if(this->items_length < ITEMS_MAX_LENGTH){
+      _grow_items(this);
+    }else{
+      _drop_oldest(this);
+    }
   }
 }
 
-FBRAFBProcessorItem* _retrieve_item(FBRAFBProcessor * this, guint16 seq)
+void _push_item(FBRAFBProcessor * this, guint payload_len, guint16 sn)
 {
-  FBRAFBProcessorItem* item;
-  item = this->items + seq;
-  if(!item->ref){
-    goto done;
+  FBRAFBProcessorItem *item;
+
+  if(!this->items_initialized){
+    this->items_head = this->sent_tail = this->acked_tail = sn;
+    this->items_initialized = TRUE;
+  }else if((gint16)(sn - this->items_head) < 0 || this->items_length <= (guint16)(sn - this->items_head)){
+    //The path restarted its numbering, nothing tracked so far can be acked
+    while(this->acked_tail != this->items_head){
+      _drop_oldest(this);
+    }
+    this->items_head = this->sent_tail = this->acked_tail = sn;
   }
 
-  --this->stat.packets_in_flight;
-  this->stat.bytes_in_flight-=item->payload_bytes;
+  //Sequence numbers not sent by us are kept as unused gaps
+  while(this->items_head != sn){
+    _make_room(this);
+    memset(_item_at(this, this->items_head), 0, sizeof(FBRAFBProcessorItem));
+    ++this->items_head;
+  }
 
-done:
+  _make_room(this);
+  item = _item_at(this, sn);
   memset(item, 0, sizeof(FBRAFBProcessorItem));
-  return item;
-}
+  item->seq_num       = sn;
+  item->payload_bytes = payload_len;
+  item->sent          = _now(this);
+  item->used          = TRUE;
+  item->in_flight     = TRUE;
+  ++this->items_head;
 
+  this->stat.bytes_in_flight += payload_len;
+  ++this->stat.packets_in_flight;
+  this->stat.sent_bytes_in_1s += payload_len;
+  ++this->stat.sent_packets_in_1s;
+}
 
-void _ref_statitem(FBRAFBProcessor * this, FBRAFBStatItem* item)
+FBRAFBProcessorItem* _find_item(FBRAFBProcessor * this, guint16 seq)
 {
-  ++item->ref;
+  FBRAFBProcessorItem* item;
+  if(!this->items_initialized || _items_span(this) <= (guint16)(seq - this->acked_tail)){
+    return NULL;
+  }
+  item = _item_at(this, seq);
+  return item->used && item->seq_num == seq ? item : NULL;
 }
 
-void _unref_statitem(FBRAFBProcessor * this, FBRAFBStatItem* item)
+//Moves the packets sent or acknowledged more than 1s ago out of the running counters
+void _expire_items(FBRAFBProcessor * this)
 {
-  if(0 < --item->ref){
-    return;
+  FBRAFBProcessorItem* item;
+  GstClockTime now;
+
+  now = _now(this);
+  while(this->sent_tail != this->items_head){
+    item = _item_at(this, this->sent_tail);
+    if(item->used && now < item->sent + GST_SECOND){
+      break;
+    }
+    _release_sent(this, item);
+    ++this->sent_tail;
+  }
+
+  while(this->acked_tail != this->sent_tail){
+    item = _item_at(this, this->acked_tail);
+    if(item->used && item->acknowledged && now < item->acked + GST_SECOND){
+      break;
+    }
+    _release_acked(this, item);
+    ++this->acked_tail;
   }
-  g_slice_free(FBRAFBStatItem, item);
 }
 
 
@@ -23,11 +23,14 @@ typedef struct _FBRAFBProcessorClass FBRAFBProcessorClass;
 #define FBRAFBPROCESSOR_CAST(src)        ((FBRAFBProcessor *)(src))
 
 typedef struct _FBRAFBProcessorItem{
-  guint        ref;
-  guint16      seq_num;
+  GstClockTime sent;
+  GstClockTime acked;
   guint32      payload_bytes;
-  gboolean     acknowledged;
-  gboolean     discarded;
+  guint16      seq_num;
+  guint8       used;
+  guint8       in_flight;
+  guint8       acknowledged;
+  guint8       discarded;
 }FBRAFBProcessorItem;
 
 typedef struct _FBRAFBProcessorStat
@@ -66,37 +69,37 @@ struct _FBRAFBProcessor
 {
   GObject                  object;
   GRWLock                  rwmutex;
-  GstClock*                sysclock;
   GQueue*                  sent;
   GQueue*                  sent_in_1s;
   GQueue*                  acked;
   guint8                   subflow_id;
 
-  gpointer                 last_statitem;
+  struct{
+    GstClockTime owd;
+    gdouble      FD;
+  }last_sample;
 
   struct{
     GstClockTime ltt80th, /*ltt40th,*/ min,max;
 //    GstClockTime stt_median;
   }owd_stat;
 
-  struct{
-    gdouble fdsum;
-    gdouble fdsqsum;
-    gint64  owdsum;
-    gint64  owdsqsum;
-    gint64  num;
-  }swstat;
-
 //  SlidingWindow* owd_offs;
 
   gint32                   measurements_num;
 
-  SlidingWindow           *stt_sw;
-  SlidingWindow           *ltt_sw;
+  winstat_t               *ltt_owds;
+  winstat_t               *ltt_fds;
 
-  SlidingWindow           *acked_1s_sw;
-  SlidingWindow           *sent_sw;
+  //In-flight ring indexed by the low bits of the subflow sequence number.
+  //It holds the packets from acked_tail up to items_head, sent_tail marks
+  //the oldest packet still counted in the 1s sending window.
   FBRAFBProcessorItem     *items;
+  guint32                  items_length;
+  gboolean                 items_initialized;
+  guint16                  items_head;
+  guint16                  sent_tail;
+  guint16                  acked_tail;
 
 
   gdouble                  owd_ltt_ewma;
@@ -114,10 +117,12 @@ struct _FBRAFBProcessorClass{
 };
 
 GType fbrafbprocessor_get_type (void);
-FBRAFBProcessor *make_fbrafbprocessor(guint8 subflow_id);
+//owd_rel_accuracy: 0 selects the exact long term OWD percentile,
+//otherwise a quantile sketch with the given relative error
+FBRAFBProcessor *make_fbrafbprocessor(guint8 subflow_id, gdouble owd_rel_accuracy);
 
 void fbrafbprocessor_reset(FBRAFBProcessor *this);
-void fbrafbprocessor_track(gpointer data, guint payload_len, guint16 sn);
+void fbrafbprocessor_track(gpointer data, guint payload_len, guint16 sn, guint32 rtp_timestamp);
 void fbrafbprocessor_get_stats (FBRAFBProcessor * this, FBRAFBProcessorStat* result);
 void fbrafbprocessor_approve_owd_ltt(FBRAFBProcessor *this);
 void fbrafbprocessor_update(FBRAFBProcessor *this, GstMPRTCPReportSummary *summary);
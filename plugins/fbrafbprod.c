@@ -24,6 +24,7 @@
 #include <gst/rtp/gstrtpbuffer.h>
 #include <gst/rtp/gstrtcpbuffer.h>
 #include "fbrafbprod.h"
+#include "mprtpclock.h"
 #include "mprtplogger.h"
 #include <math.h>
 #include <stdio.h>
@@ -40,7 +41,7 @@
 //#define THIS_WRITELOCK(this)
 //#define THIS_WRITEUNLOCK(this)
 
-#define _now(this) gst_clock_get_time (this->sysclock)
+#define _now(this) mprtp_clock_get_time()
 
 GST_DEBUG_CATEGORY_STATIC (fbrafbproducer_debug_category);
 #define GST_CAT_DEFAULT fbrafbproducer_debug_category
@@ -98,6 +99,17 @@ static void _owd_percentile_pipe(gpointer data, swpercentilecandidates_t *candid
   this->max_delay = *(GstClockTime*)candidates->max;
 }
 
+static void _owd_quantile_pipe(gpointer data, swquantilestat_t *stat)
+{
+  FBRAFBProducer *this = data;
+  if(!stat->processed){
+    return;
+  }
+  this->median_delay = stat->value;
+  this->min_delay    = stat->min;
+  this->max_delay    = stat->max;
+}
+
 static void _tendency_add_pipe(gpointer udata, gpointer itemptr)
 {
   FBRAFBProducer* this;
@@ -165,7 +177,6 @@ fbrafbproducer_finalize (GObject * object)
 {
   FBRAFBProducer *this;
   this = FBRAFBPRODUCER(object);
-  g_object_unref(this->sysclock);
   mprtp_free(this->vector);
 }
 
@@ -173,7 +184,6 @@ void
 fbrafbproducer_init (FBRAFBProducer * this)
 {
   g_rw_lock_init (&this->rwmutex);
-  this->sysclock = gst_system_clock_obtain();
 
   this->vector   = mprtp_malloc(sizeof(gboolean)  * 1000);
   this->vector_length = 0;
@@ -183,18 +193,22 @@ fbrafbproducer_init (FBRAFBProducer * this)
   this->tendency_sw     = make_slidingwindow_int32(100, GST_SECOND);
   this->payloadbytes_sw = make_slidingwindow_int32(2000, GST_SECOND);
 
-  slidingwindow_add_plugin(this->owds_sw,        make_swpercentile(50, bintree3cmp_uint64, _owd_percentile_pipe, this));
   slidingwindow_add_pipes(this->tendency_sw,     _tendency_rem_pipe, this, _tendency_add_pipe, this);
   slidingwindow_add_pipes(this->payloadbytes_sw, _payloads_rem_pipe, this, _payloads_add_pipe, this);
 
 }
 
-FBRAFBProducer *make_fbrafbproducer(guint32 ssrc, guint8 subflow_id)
+FBRAFBProducer *make_fbrafbproducer(guint32 ssrc, guint8 subflow_id, gdouble owd_rel_accuracy)
 {
     FBRAFBProducer *this;
     this = g_object_new (FBRAFBPRODUCER_TYPE, NULL);
     this->ssrc = ssrc;
     this->subflow_id = subflow_id;
+    if(0. < owd_rel_accuracy){
+      slidingwindow_add_plugin(this->owds_sw, make_swquantile(50, owd_rel_accuracy, 10. * GST_SECOND, swquantile_value_uint64, _owd_quantile_pipe, this));
+    }else{
+      slidingwindow_add_plugin(this->owds_sw, make_swpercentile(50, bintree3cmp_uint64, _owd_percentile_pipe, this));
+    }
     return this;
 }
 
@@ -30,7 +30,6 @@ struct _FBRAFBProducer
 {
   GObject                  object;
   GRWLock                  rwmutex;
-  GstClock*                sysclock;
 
   guint16                  cycle_num;
   gboolean                 initialized;
@@ -69,7 +68,9 @@ struct _FBRAFBProducerClass{
 };
 
 GType fbrafbproducer_get_type (void);
-FBRAFBProducer *make_fbrafbproducer(guint32 ssrc, guint8 subflow_id);
+//owd_rel_accuracy: 0 tracks the exact OWD median, otherwise a quantile sketch
+//with the given relative error does
+FBRAFBProducer *make_fbrafbproducer(guint32 ssrc, guint8 subflow_id, gdouble owd_rel_accuracy);
 void fbrafbproducer_reset(FBRAFBProducer *this);
 void fbrafbproducer_set_owd_treshold(FBRAFBProducer *this, GstClockTime treshold);
 void fbrafbproducer_track(gpointer data, GstMpRTPBuffer *mprtp);
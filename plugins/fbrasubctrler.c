@@ -24,6 +24,7 @@
 #include <gst/rtp/gstrtpbuffer.h>
 #include <gst/rtp/gstrtcpbuffer.h>
 #include "fbrasubctrler.h"
+#include "mprtpclock.h"
 #include "gstmprtcpbuffer.h"
 #include <math.h>
 #include <string.h>
@@ -186,7 +187,7 @@ struct _Private{
 // const gdouble DT_ = 1.5; //Down Treshold
 
 
-#define _now(this) (gst_clock_get_time(this->sysclock))
+#define _now(this) mprtp_clock_get_time()
 
 static void
 _reduce_stage(
@@ -220,6 +221,10 @@ _fire(
     FBRASubController *this,
     Event event);
 
+static void
+_log_rates(
+    gpointer data);
+
 #define _disable_monitoring(this) _set_monitoring_interval(this, 0)
 
 
@@ -247,9 +252,9 @@ fbrasubctrler_finalize (GObject * object)
 {
   FBRASubController *this;
   this = FBRASUBCTRLER(object);
+  mprtp_logger_rem_stats_fnc(_log_rates, this);
   mprtp_free(this->priv);
   g_object_unref(this->fbprocessor);
-  g_object_unref(this->sysclock);
   g_object_unref(this->path);
   g_object_unref(this->targetctrler);
 }
@@ -259,7 +264,6 @@ void
 fbrasubctrler_init (FBRASubController * this)
 {
   this->priv = mprtp_malloc(sizeof(Private));
-  this->sysclock = gst_system_clock_obtain();
   g_rw_lock_init (&this->rwmutex);
 
   //Initial values
@@ -337,7 +341,7 @@ gboolean fbrasubctrler_path_approver(gpointer data, GstRTPBuffer *rtp)
 }
 
 
-FBRASubController *make_fbrasubctrler(MPRTPSPath *path)
+FBRASubController *make_fbrasubctrler(MPRTPSPath *path, gdouble owd_rel_accuracy)
 {
   FBRASubController *result;
   result                      = g_object_new (FBRASUBCTRLER_TYPE, NULL);
@@ -347,11 +351,12 @@ FBRASubController *make_fbrasubctrler(MPRTPSPath *path)
   result->id                  = mprtps_path_get_id(result->path);
   result->monitoring_interval = 3;
   result->made                = _now(result);
-  result->fbprocessor         = make_fbrafbprocessor(result->id);
+  result->fbprocessor         = make_fbrafbprocessor(result->id, owd_rel_accuracy);
 
   _switch_stage_to(result, STAGE_KEEP, FALSE);
   mprtps_path_set_state(result->path, MPRTPS_PATH_STATE_STABLE);
   mprtps_path_set_packetstracker(result->path, fbrafbprocessor_track, result->fbprocessor);
+  mprtp_logger_add_stats_fnc(_log_rates, result);
 
   return result;
 }
@@ -452,6 +457,26 @@ void fbrasubctrler_signal_request(FBRASubController *this, MPRTPSubflowFECBasedR
 
 }
 
+//Called by the logger in every 100ms, the plots count with it
+static void _log_rates(gpointer data)
+{
+  FBRASubController *this = data;
+  MPRTPStatsRecord *record;
+  if(!this->enabled){
+    return;
+  }
+  record = mprtp_stats_begin(MPRTP_STATS_SUBFLOW_RATES, this->id);
+  if(!record){
+    return;
+  }
+  record->values[0].integer = _TR(this) / 1000;
+  record->values[1].integer = _fbstat(this).goodput_bytes * 8 / 1000;
+  record->values[2].integer = _fbstat(this).sent_bytes_in_1s * 8 / 1000;
+  record->values[3].integer = _priv(this)->stage;
+  record->values[4].integer = this->monitored_bitrate / 1000;
+  mprtp_stats_commit(record);
+}
+
 static void _update_fraction_discarded(FBRASubController *this)
 {
   _FD_cong_th(this) = MIN(DISCARD_CONGESTION_MAX_TRESHOLD, this->fbstat.FD_median * 2.);
@@ -481,6 +506,9 @@ void fbrasubctrler_report_update(
   fbrafbprocessor_update(this->fbprocessor, summary);
   fbrafbprocessor_get_stats(this->fbprocessor, &this->fbstat);
   fbratargetctrler_update(this->targetctrler, &this->fbstat);
+  if(_fbstat(this).owd_stt){
+    mprtps_path_set_owd(this->path, _fbstat(this).owd_stt);
+  }
   _update_fraction_discarded(this);
 
   _execute_stage(this);
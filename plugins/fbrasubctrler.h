@@ -38,7 +38,6 @@ struct _FBRASubController
   GObject                   object;
   guint8                    id;
   GRWLock                   rwmutex;
-  GstClock*                 sysclock;
   MPRTPSPath*               path;
 
   GstClockTime              made;
@@ -97,7 +96,8 @@ struct _FBRASubControllerClass{
 
 };
 GType fbrasubctrler_get_type (void);
-FBRASubController *make_fbrasubctrler(MPRTPSPath *path);
+//owd_rel_accuracy is passed to the feedback processor, see make_fbrafbprocessor()
+FBRASubController *make_fbrasubctrler(MPRTPSPath *path, gdouble owd_rel_accuracy);
 
 gboolean fbrasubctrler_path_approver(gpointer data, GstRTPBuffer *buffer);
 
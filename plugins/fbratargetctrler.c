@@ -24,6 +24,7 @@
 #include <gst/rtp/gstrtpbuffer.h>
 #include <gst/rtp/gstrtcpbuffer.h>
 #include "fbratargetctrler.h"
+#include "mprtpclock.h"
 #include "gstmprtcpbuffer.h"
 #include <math.h>
 #include <string.h>
@@ -163,7 +164,7 @@ struct _Private{
 // const gdouble DT_ = 1.5; //Down Treshold
 
 
-#define _now(this) (gst_clock_get_time(this->sysclock))
+#define _now(this) mprtp_clock_get_time()
 
 
  static void _refresh_target_approvement(FBRATargetCtrler* this);
@@ -192,7 +193,6 @@ fbratargetctrler_finalize (GObject * object)
   FBRATargetCtrler *this;
   this = FBRATARGETCTRLER(object);
   mprtp_free(this->priv);
-  g_object_unref(this->sysclock);
   g_object_unref(this->path);
 }
 
@@ -201,7 +201,6 @@ void
 fbratargetctrler_init (FBRATargetCtrler * this)
 {
   this->priv = mprtp_malloc(sizeof(Private));
-  this->sysclock = gst_system_clock_obtain();
   g_rw_lock_init (&this->rwmutex);
 
   //Initial values
@@ -29,7 +29,6 @@ struct _FBRATargetCtrler
   GObject                   object;
   guint8                    id;
   GRWLock                   rwmutex;
-  GstClock*                 sysclock;
   MPRTPSPath*               path;
   SlidingWindow*            items;
 
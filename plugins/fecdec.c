@@ -24,6 +24,7 @@
 #include <gst/rtp/gstrtpbuffer.h>
 #include <gst/rtp/gstrtcpbuffer.h>
 #include "fecdec.h"
+#include "mprtpclock.h"
 #include "gstmprtcpbuffer.h"
 #include <math.h>
 #include <string.h>
@@ -34,7 +35,7 @@
 #define THIS_WRITELOCK(this) g_rw_lock_writer_lock(&this->rwmutex)
 #define THIS_WRITEUNLOCK(this) g_rw_lock_writer_unlock(&this->rwmutex)
 
-#define _now(this) gst_clock_get_time (this->sysclock)
+#define _now(this) mprtp_clock_get_time()
 
 
 
@@ -65,18 +66,25 @@ G_DEFINE_TYPE (FECDecoder, fecdecoder, G_TYPE_OBJECT);
 //-------- Private functions belongs to Scheduler tree object ----------
 //----------------------------------------------------------------------
 
+//A packet is identified by its subflow sequence number in the segments
+typedef struct{
+  guint8  subflow_id;
+  guint16 subflow_seq;
+}SubflowSeq;
 
 static void fecdecoder_finalize (GObject * object);
 static void _add_rtp_packet_to_segment(FECDecoder *this, GstMpRTPBuffer *mprtp, FECDecoderSegment *segment);
-static FECDecoderSegment *_find_segment_by_seq(FECDecoder *this, guint16 seq_num);
+static FECDecoderSegment *_find_segment_by_seq(FECDecoder *this, guint8 subflow_id, guint16 subflow_seq);
 static void _add_rtp_packet_to_items(FECDecoder *this, GstMpRTPBuffer *mprtp);
 static GstBuffer *_repair_rtpbuf_by_segment(FECDecoder *this, FECDecoderSegment *segment, guint16 seq);
 static gint _find_item_by_seq_helper(gconstpointer item_ptr, gconstpointer desired_seq);
-static FECDecoderItem * _find_item_by_seq(GList *items, guint16 seq);
-static FECDecoderItem * _take_item_by_seq(GList **items, guint16 seq);
+static FECDecoderItem * _find_item_by_seq(GList *items, guint8 subflow_id, guint16 subflow_seq);
+static FECDecoderItem * _take_item_by_seq(GList **items, guint8 subflow_id, guint16 subflow_seq);
+
 static void _segment_dtor(FECDecoder *this, FECDecoderSegment *segment);
 static FECDecoderSegment* _segment_ctor(void);
 static FECDecoderItem* _make_item(FECDecoder *this, GstMpRTPBuffer *mprtp);
+static guint8 _get_subflow_id(FECDecoder *this, GstBuffer *buffer, guint8 fallback);
 
 static void
 _print_segment(FECDecoderSegment *segment)
@@ -122,7 +130,6 @@ fecdecoder_finalize (GObject * object)
 {
   FECDecoder *this;
   this = FECDECODER(object);
-  g_object_unref(this->sysclock);
   g_free(this->segments);
 }
 
@@ -130,9 +137,9 @@ void
 fecdecoder_init (FECDecoder * this)
 {
   g_rw_lock_init (&this->rwmutex);
-  this->sysclock = gst_system_clock_obtain();
   this->repair_window_max = 300 * GST_MSECOND;
   this->repair_window_min = 10 * GST_MSECOND;
+  this->mprtp_ext_header_id = MPRTP_DEFAULT_EXTENSION_HEADER_ID;
 
 }
 
@@ -176,6 +183,30 @@ void fecdecoder_get_stat(FECDecoder *this,
   THIS_READUNLOCK(this);
 }
 
+guint32 fecdecoder_get_subflow_recovered(FECDecoder *this, guint8 subflow_id)
+{
+  guint32 result = 0;
+  if(MPRTP_PLUGIN_MAX_SUBFLOW_NUM <= subflow_id){
+    return 0;
+  }
+  THIS_READLOCK(this);
+  result = this->subflow_recovered[subflow_id];
+  THIS_READUNLOCK(this);
+  return result;
+}
+
+guint32 fecdecoder_get_subflow_fec_packets(FECDecoder *this, guint8 subflow_id)
+{
+  guint32 result = 0;
+  if(MPRTP_PLUGIN_MAX_SUBFLOW_NUM <= subflow_id){
+    return 0;
+  }
+  THIS_READLOCK(this);
+  result = this->subflow_fec_packets[subflow_id];
+  THIS_READUNLOCK(this);
+  return result;
+}
+
 FECDecoder *make_fecdecoder(void)
 {
   FECDecoder *this;
@@ -191,32 +222,37 @@ gboolean fecdecoder_has_repaired_rtpbuffer(FECDecoder *this, guint16 hpsn, GstBu
   gboolean result = FALSE;
   THIS_WRITELOCK(this);
   for(segi = this->segments; segi; segi = segi->next){
-    guint16 item_seq;
-    gint32 missing_seq = -1;
+    GList *it;
+    guint16 missing_seq, first_seq;
     segment = segi->data;
     if(segment->missing != 1 || segment->repaired) {
       continue;
     }
-    if(_cmp_uint16(hpsn, segment->base_sn) < 0){
-      continue;
-    }
     if(_now(this) - this->repair_window_min < segment->added){
       continue;
     }
     if(segment->added < _now(this) - this->repair_window_max){
       continue;
     }
-    for(item_seq = segment->base_sn; item_seq != (segment->high_sn+1); ++item_seq){
-      if(_find_item_by_seq(segment->items, item_seq) == NULL){
-        missing_seq = item_seq;
+    //the RTP sequence number of the only one missing is what the others
+    //do not xor out
+    missing_seq = segment->seq_recovery;
+    for(it = segment->items; it; it = it->next){
+      missing_seq ^= ((FECDecoderItem*) it->data)->seq_num;
+    }
+    first_seq = missing_seq;
+    for(it = segment->items; it; it = it->next){
+      if(_cmp_uint16(((FECDecoderItem*) it->data)->seq_num, first_seq) < 0){
+        first_seq = ((FECDecoderItem*) it->data)->seq_num;
       }
     }
-    if(missing_seq == -1){
+    if(_cmp_uint16(hpsn, first_seq) < 0){
       continue;
     }
     *repairedbuf = _repair_rtpbuf_by_segment(this, segment, missing_seq);
     segment->repaired = TRUE;
     result = TRUE;
+    break;
   }
   THIS_WRITEUNLOCK(this);
   return result;
@@ -230,6 +266,13 @@ void fecdecoder_set_payload_type(FECDecoder *this, guint8 payload_type)
   THIS_WRITEUNLOCK(this);
 }
 
+void fecdecoder_set_mprtp_ext_header_id(FECDecoder *this, guint8 mprtp_ext_header_id)
+{
+  THIS_WRITELOCK(this);
+  this->mprtp_ext_header_id = mprtp_ext_header_id;
+  THIS_WRITEUNLOCK(this);
+}
+
 void fecdecoder_set_repair_window(FECDecoder *this, GstClockTime min, GstClockTime max)
 {
   THIS_WRITELOCK(this);
@@ -242,7 +285,7 @@ void fecdecoder_add_rtp_packet(FECDecoder *this, GstMpRTPBuffer *mprtp)
 {
   FECDecoderSegment *segment;
   THIS_WRITELOCK(this);
-  segment =_find_segment_by_seq(this, mprtp->abs_seq);
+  segment =_find_segment_by_seq(this, mprtp->subflow_id, mprtp->subflow_seq);
   if(!segment){
     _add_rtp_packet_to_items(this, mprtp);
     goto done;
@@ -274,10 +317,16 @@ void fecdecoder_add_fec_packet(FECDecoder *this, GstMpRTPBuffer *mprtp)
   segment->added        = _now(this);
   segment->base_sn      = g_ntohs(header->sn_base);
   segment->high_sn      = (guint16)(segment->base_sn + (guint16)(header->N_MASK-1));
+  segment->seq_recovery = header->reserved;
   segment->protected    = header->N_MASK;
   segment->items        = NULL;
   segment->missing      = 0;
   segment->ssrc         = g_ntohl(header->ssrc);
+  segment->subflow_id   = mprtp->subflow_id;
+  segment->repaired_subflow_id = mprtp->subflow_id;
+  if(mprtp->subflow_id < MPRTP_PLUGIN_MAX_SUBFLOW_NUM){
+    ++this->subflow_fec_packets[mprtp->subflow_id];
+  }
 
   memcpy(segment->fecbitstring, payload, 8);
   memcpy(segment->fecbitstring + 8, &header->length_recovery, 2);
@@ -286,7 +335,7 @@ void fecdecoder_add_fec_packet(FECDecoder *this, GstMpRTPBuffer *mprtp)
   //collects the segment already arrived
   for(c = 0, seq = segment->base_sn; seq != (segment->high_sn+1) && c < GST_RTPFEC_MAX_PROTECTION_NUM; ++seq, ++c){
     FECDecoderItem* item;
-    item = _take_item_by_seq(&this->items, seq);
+    item = _take_item_by_seq(&this->items, segment->subflow_id, seq);
     if(!item){
       ++segment->missing;
       continue;
@@ -343,22 +392,26 @@ void fecdecoder_clean(FECDecoder *this)
 
 static gint _find_segment_by_seq_helper(gconstpointer segment_ptr, gconstpointer seq_ptr)
 {
-  const guint16 *seq = seq_ptr;
+  const SubflowSeq *seq = seq_ptr;
   const FECDecoderSegment *segment = segment_ptr;
-  if(_cmp_uint16(*seq, segment->base_sn) < 0){
+  if(segment->subflow_id != seq->subflow_id){
+    return -1;
+  }
+  if(_cmp_uint16(seq->subflow_seq, segment->base_sn) < 0){
     return -1;
   }
-  if(_cmp_uint16(segment->high_sn, *seq) < 0){
+  if(_cmp_uint16(segment->high_sn, seq->subflow_seq) < 0){
     return -1;
   }
   return 0;
 }
 
-FECDecoderSegment *_find_segment_by_seq(FECDecoder *this, guint16 seq_num)
+FECDecoderSegment *_find_segment_by_seq(FECDecoder *this, guint8 subflow_id, guint16 subflow_seq)
 {
   GList *it;
   FECDecoderSegment *result = NULL;
-  it = g_list_find_custom(this->segments, &seq_num, _find_segment_by_seq_helper);
+  SubflowSeq seq = {subflow_id, subflow_seq};
+  it = g_list_find_custom(this->segments, &seq, _find_segment_by_seq_helper);
   if(!it){
     goto done;
   }
@@ -371,7 +424,7 @@ done:
 void _add_rtp_packet_to_items(FECDecoder *this, GstMpRTPBuffer *mprtp)
 {
   FECDecoderItem *item;
-  item = _find_item_by_seq(this->items, mprtp->abs_seq);
+  item = _find_item_by_seq(this->items, mprtp->subflow_id, mprtp->subflow_seq);
   if(item){
       GST_WARNING_OBJECT(this, "Duplicated RTP sequence number found");
       goto done;
@@ -389,7 +442,7 @@ void _add_rtp_packet_to_segment(FECDecoder *this, GstMpRTPBuffer *mprtp, FECDeco
 {
   FECDecoderItem *item = NULL;
   ++this->total_rtp_packets;
-  if(_find_item_by_seq(segment->items, mprtp->abs_seq) != NULL){
+  if(_find_item_by_seq(segment->items, mprtp->subflow_id, mprtp->subflow_seq) != NULL){
       g_warning("Duplicated sequece number %hu for RTP packet", mprtp->abs_seq);
     goto done;
   }
@@ -411,6 +464,7 @@ done:
 
 GstBuffer *_repair_rtpbuf_by_segment(FECDecoder *this, FECDecoderSegment *segment, guint16 seq)
 {
+  GstBuffer *result;
   GList *it;
   gint i;
   guint16            length;
@@ -441,20 +495,45 @@ GstBuffer *_repair_rtpbuf_by_segment(FECDecoder *this, FECDecoderSegment *segmen
   this->total_repaired_bytes += length + 12;
   segment->repaired           = TRUE;
 
-  return gst_buffer_new_wrapped(databed, length + 12);
+  result = gst_buffer_new_wrapped(databed, length + 12);
+  segment->repaired_subflow_id = _get_subflow_id(this, result, segment->subflow_id);
+  return result;
+}
+
+//The header extensions are protected as well, so the repaired packet
+//tells the subflow it was sent and lost on
+guint8 _get_subflow_id(FECDecoder *this, GstBuffer *buffer, guint8 fallback)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  MPRTPSubflowHeaderExtension *subflow_info;
+  gpointer pointer = NULL;
+  guint size = 0;
+  guint8 result = fallback;
+
+  if(!gst_rtp_buffer_map(buffer, GST_MAP_READ, &rtp)){
+    return fallback;
+  }
+  if(gst_rtp_buffer_get_extension_onebyte_header(&rtp, this->mprtp_ext_header_id, 0, &pointer, &size) &&
+     3 <= size){
+    subflow_info = (MPRTPSubflowHeaderExtension *) pointer;
+    result = subflow_info->id;
+  }
+  gst_rtp_buffer_unmap(&rtp);
+  return result;
 }
 
 gint _find_item_by_seq_helper(gconstpointer item_ptr, gconstpointer desired_seq)
 {
-  const guint16 *seq = desired_seq;
+  const SubflowSeq *seq = desired_seq;
   const FECDecoderItem *item = item_ptr;
-  return item->seq_num == *seq ? 0 : -1;
+  return item->subflow_id == seq->subflow_id && item->subflow_seq == seq->subflow_seq ? 0 : -1;
 }
 
-FECDecoderItem * _find_item_by_seq(GList *items, guint16 seq)
+FECDecoderItem * _find_item_by_seq(GList *items, guint8 subflow_id, guint16 subflow_seq)
 {
   FECDecoderItem *result = NULL;
   GList *item;
+  SubflowSeq seq = {subflow_id, subflow_seq};
   item = g_list_find_custom(items, &seq, _find_item_by_seq_helper);
   if(!item){
     goto done;
@@ -464,10 +543,10 @@ done:
   return result;
 }
 
-FECDecoderItem * _take_item_by_seq(GList **items, guint16 seq)
+FECDecoderItem * _take_item_by_seq(GList **items, guint8 subflow_id, guint16 subflow_seq)
 {
   FECDecoderItem *result = NULL;
-  result = _find_item_by_seq(*items, seq);
+  result = _find_item_by_seq(*items, subflow_id, subflow_seq);
   if(result){
     *items = g_list_remove(*items, result);
   }
@@ -479,6 +558,9 @@ void _segment_dtor(FECDecoder *this, FECDecoderSegment *segment)
   if(!segment->complete){
     if(segment->repaired){
       ++this->recovered;
+      if(segment->repaired_subflow_id < MPRTP_PLUGIN_MAX_SUBFLOW_NUM){
+        ++this->subflow_recovered[segment->repaired_subflow_id];
+      }
     }else{
       this->lost+=segment->missing;
     }
@@ -501,8 +583,10 @@ FECDecoderItem* _make_item(FECDecoder *this, GstMpRTPBuffer *mprtp)
   FECDecoderItem* result;
   result = g_malloc0(sizeof(FECDecoderItem));
   rtpfecbuffer_setup_bitstring(mprtp->buffer, result->bitstring, &result->bitstring_length);
-  result->seq_num = mprtp->abs_seq;
-  result->ssrc    = mprtp->ssrc;
+  result->seq_num     = mprtp->abs_seq;
+  result->subflow_id  = mprtp->subflow_id;
+  result->subflow_seq = mprtp->subflow_seq;
+  result->ssrc        = mprtp->ssrc;
   result->added   = _now(this);
   return result;
 }
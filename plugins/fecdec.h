@@ -24,14 +24,22 @@ typedef struct _FECDecoderClass FECDecoderClass;
 
 
 
+//The protected packets are consecutive on the subflow the FEC packet
+//arrived on, the range is of their subflow sequence numbers
 typedef struct _FECDecoderSegment
 {
   GstClockTime         added;
   guint16              base_sn;
   guint16              high_sn;
+  //the xor of the RTP sequence numbers of the protected packets
+  guint16              seq_recovery;
   guint16              protected;
   gint32               missing;
   guint32              ssrc;
+  //the subflow the FEC packet arrived on
+  guint8               subflow_id;
+  //the subflow the repaired packet was sent on
+  guint8               repaired_subflow_id;
   gboolean             complete;
   gboolean             repaired;
   guint8               fecbitstring[GST_RTPFEC_PARITY_BYTES_MAX_LENGTH];
@@ -46,6 +54,8 @@ typedef struct _FECDecoderItem
   guint8               bitstring[GST_RTPFEC_PARITY_BYTES_MAX_LENGTH];
   gint16               bitstring_length;
   guint16              seq_num;
+  guint8               subflow_id;
+  guint16              subflow_seq;
   guint32              ssrc;
 }FECDecoderItem;
 
@@ -53,13 +63,13 @@ typedef struct _FECDecoderItem
 struct _FECDecoder
 {
   GObject                    object;
-  GstClock*                  sysclock;
   GstClockTime               repair_window_min;
   GstClockTime               repair_window_max;
   GstClockTime               made;
   GRWLock                    rwmutex;
 
   guint8                     payload_type;
+  guint8                     mprtp_ext_header_id;
   guint32                    total_early_repaired_bytes;
   guint32                    total_rtp_packets;
   guint32                    total_repaired_bytes;
@@ -70,6 +80,8 @@ struct _FECDecoder
 
   guint32                    lost;
   guint32                    recovered;
+  guint32                    subflow_recovered[MPRTP_PLUGIN_MAX_SUBFLOW_NUM];
+  guint32                    subflow_fec_packets[MPRTP_PLUGIN_MAX_SUBFLOW_NUM];
 };
 
 
@@ -90,9 +102,14 @@ void fecdecoder_get_stat(FECDecoder *this,
                          guint32 *total_repaired_bytes,
                          guint32 *total_recovered_packets,
                          guint32 *total_missed_packets);
+//Packets repaired that were sent on the subflow
+guint32 fecdecoder_get_subflow_recovered(FECDecoder *this, guint8 subflow_id);
+//FEC packets arrived on the subflow
+guint32 fecdecoder_get_subflow_fec_packets(FECDecoder *this, guint8 subflow_id);
 
 gboolean fecdecoder_has_repaired_rtpbuffer(FECDecoder *this, guint16 hpsn, GstBuffer** repairedbuf);
 void fecdecoder_set_payload_type(FECDecoder *this, guint8 fec_payload_type);
+void fecdecoder_set_mprtp_ext_header_id(FECDecoder *this, guint8 mprtp_ext_header_id);
 void fecdecoder_set_repair_window(FECDecoder *this, GstClockTime min, GstClockTime max);
 void fecdecoder_add_rtp_packet(FECDecoder *this, GstMpRTPBuffer* buffer);
 void fecdecoder_add_fec_packet(FECDecoder *this, GstMpRTPBuffer *mprtp);
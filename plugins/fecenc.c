@@ -24,6 +24,7 @@
 #include <gst/rtp/gstrtpbuffer.h>
 #include <gst/rtp/gstrtcpbuffer.h>
 #include "fecenc.h"
+#include "mprtpclock.h"
 #include "gstmprtcpbuffer.h"
 #include <math.h>
 #include <string.h>
@@ -34,7 +35,7 @@
 #define THIS_WRITELOCK(this) g_rw_lock_writer_lock(&this->rwmutex)
 #define THIS_WRITEUNLOCK(this) g_rw_lock_writer_unlock(&this->rwmutex)
 
-#define _now(this) gst_clock_get_time (this->sysclock)
+#define _now(this) mprtp_clock_get_time()
 
 //#define THIS_READLOCK(this)
 //#define THIS_READUNLOCK(this)
@@ -55,6 +56,7 @@ typedef struct _BitString{
   guint8    bytes[GST_RTPFEC_PARITY_BYTES_MAX_LENGTH];
   gint16   length;
   guint16   seq_num;
+  guint16   subflow_seq;
   guint32   ssrc;
 }BitString;
 
@@ -70,6 +72,8 @@ typedef struct _Subflow{
   guint32                    total_packets_sent;
   guint16                    sequence_num;
   guint16                    cycle_num;
+  //the protection window of the subflow
+  GQueue*                    bitstrings;
 }Subflow;
 
 static Subflow *_subflow_ctor (void);
@@ -98,7 +102,6 @@ fecencoder_finalize (GObject * object)
 {
   FECEncoder *this;
   this = FECENCODER(object);
-  g_object_unref(this->sysclock);
 }
 
 void
@@ -108,9 +111,7 @@ fecencoder_init (FECEncoder * this)
   this->subflows = g_hash_table_new_full (NULL, NULL,
       NULL, (GDestroyNotify) _ruin_subflow);
 
-  this->sysclock = gst_system_clock_obtain();
   this->max_protection_num = GST_RTPFEC_MAX_PROTECTION_NUM;
-  this->bitstrings = g_queue_new();
 
 }
 
@@ -156,46 +157,62 @@ done:
   THIS_READUNLOCK(this);
 }
 
-void fecencoder_add_rtpbuffer(FECEncoder *this, GstBuffer *buf)
+void fecencoder_add_rtpbuffer(FECEncoder *this, guint8 subflow_id, guint16 subflow_seq, GstBuffer *buf)
 {
+  Subflow *subflow;
+  BitString *bitstring;
   THIS_WRITELOCK(this);
-  g_queue_push_tail(this->bitstrings, _make_bitstring(buf));
-  while(this->max_protection_num <= g_queue_get_length(this->bitstrings)){
-    mprtp_free(g_queue_pop_head(this->bitstrings));
+  subflow = _get_subflow(this, subflow_id);
+  if(!subflow){
+    goto done;
   }
+  bitstring = _make_bitstring(buf);
+  bitstring->subflow_seq = subflow_seq;
+  g_queue_push_tail(subflow->bitstrings, bitstring);
+  while(this->max_protection_num <= g_queue_get_length(subflow->bitstrings)){
+    mprtp_free(g_queue_pop_head(subflow->bitstrings));
+  }
+done:
   THIS_WRITEUNLOCK(this);
 }
 
 
 
 GstBuffer*
-fecencoder_get_fec_packet(FECEncoder *this)
+fecencoder_get_fec_packet(FECEncoder *this, guint8 subflow_id)
 {
   GstBuffer* result = NULL;
   GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
   guint8* payload;
   gint i;
+  Subflow *subflow;
   BitString *actual = NULL;
   BitString *fecbitstring = NULL;
   GstRTPFECHeader *fecheader;
   gboolean init = FALSE;
   gint n_mask = 0;
+  guint16 seq_recovery = 0;
   THIS_WRITELOCK(this);
+  subflow = _get_subflow(this, subflow_id);
+  if(!subflow){
+    goto done;
+  }
   fecbitstring = mprtp_malloc(sizeof(BitString));
 again:
-  if(g_queue_get_length(this->bitstrings) < 1){
+  if(g_queue_get_length(subflow->bitstrings) < 1){
     goto create;
   }
   ++n_mask;
-  actual = g_queue_pop_head(this->bitstrings);
+  actual = g_queue_pop_head(subflow->bitstrings);
   fecbitstring->length = MAX(fecbitstring->length, actual->length);
   for(i=0; i < fecbitstring->length; ++i){
     fecbitstring->bytes[i] ^= actual->bytes[i];
   }
+  seq_recovery ^= actual->seq_num;
   if(!init){
     init = TRUE;
-    fecbitstring->seq_num = actual->seq_num;
-    fecbitstring->ssrc    = actual->ssrc;
+    fecbitstring->subflow_seq = actual->subflow_seq;
+    fecbitstring->ssrc        = actual->ssrc;
   }
   mprtp_free(actual);
   goto again;
@@ -216,16 +233,18 @@ create:
   memcpy(&fecheader->length_recovery, fecbitstring->bytes + 8, 2);
   fecheader->F          = 1;
   fecheader->R          = 0;
-  fecheader->sn_base    = g_htons(fecbitstring->seq_num);
+  //the protected packets are consecutive on their subflow only
+  fecheader->sn_base    = g_htons(fecbitstring->subflow_seq);
   fecheader->ssrc       = g_htonl(fecbitstring->ssrc);
   fecheader->SSRC_Count = 1;
   fecheader->N_MASK     = n_mask;
   fecheader->M_MASK     = 0;
-  fecheader->reserved   = 0;
+  fecheader->reserved   = seq_recovery;
   memcpy(payload + sizeof(GstRTPFECHeader), fecbitstring->bytes + 10, fecbitstring->length - 10);
   gst_rtp_buffer_unmap(&rtp);
   mprtp_free(fecbitstring);
 
+done:
   THIS_WRITEUNLOCK(this);
   return result;
 }
@@ -236,13 +255,17 @@ fecencoder_add_path (FECEncoder * this, MPRTPSPath *path)
 {
   Subflow *subflow;
   subflow = _make_subflow(path);
+  THIS_WRITELOCK(this);
   g_hash_table_insert (this->subflows, GINT_TO_POINTER (subflow->id), subflow);
+  THIS_WRITEUNLOCK(this);
 }
 
 void
 fecencoder_rem_path (FECEncoder * this, guint8 subflow_id)
 {
+  THIS_WRITELOCK(this);
   g_hash_table_remove (this->subflows, GINT_TO_POINTER (subflow_id));
+  THIS_WRITEUNLOCK(this);
 }
 
 void
@@ -294,6 +317,7 @@ void
 _subflow_dtor (Subflow * this)
 {
   g_return_if_fail (this);
+  g_queue_free_full (this->bitstrings, mprtp_free);
   mprtp_free (this);
 }
 
@@ -315,6 +339,7 @@ _make_subflow (MPRTPSPath * path)
   result                  = _subflow_ctor ();
   result->path            = g_object_ref (path);
   result->id              = mprtps_path_get_id(path);
+  result->bitstrings      = g_queue_new();
 
   _reset_subflow (result);
   return result;
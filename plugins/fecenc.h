@@ -27,7 +27,6 @@ typedef struct _FECEncoderClass FECEncoderClass;
 struct _FECEncoder
 {
   GObject                    object;
-  GstClock*                  sysclock;
   GstClockTime               made;
   GRWLock                    rwmutex;
   GHashTable*                subflows;
@@ -35,8 +34,6 @@ struct _FECEncoder
   gint32                     max_protection_num;
   guint16                    seq_num;
   guint8                     payload_type;
-
-  GQueue*                    bitstrings;
 };
 
 
@@ -52,10 +49,15 @@ FECEncoder *make_fecencoder(void);
 void fecencoder_reset(FECEncoder *this);
 void fecencoder_set_payload_type(FECEncoder *this, guint8 fec_payload_type);
 void fecencoder_get_stats(FECEncoder *this, guint8 subflow_id, guint32 *packets, guint32 *payloads);
-void fecencoder_add_rtpbuffer(FECEncoder *this, GstBuffer *buf);
+//Every subflow has its own protection window, a FEC packet protects the
+//last packets sent on the subflow it is requested for. The FEC header
+//carries the range of their subflow sequence numbers and the xor of
+//their RTP sequence numbers, so the lost one is restored with its own.
+void fecencoder_add_rtpbuffer(FECEncoder *this, guint8 subflow_id, guint16 subflow_seq, GstBuffer *buf);
 void fecencoder_add_path(FECEncoder* this, MPRTPSPath *path);
 void fecencoder_rem_path(FECEncoder* this, guint8 subflow_id);
-GstBuffer* fecencoder_get_fec_packet(FECEncoder *this);
+//NULL if the subflow is not added
+GstBuffer* fecencoder_get_fec_packet(FECEncoder *this, guint8 subflow_id);
 void fecencoder_assign_to_subflow (
     FECEncoder * this, GstBuffer *buf, guint8 mprtp_ext_header_id, guint8 subflow_id);
 #endif /* FECENCODER_H_ */
@@ -0,0 +1,246 @@
+/* GStreamer FEC repair worker
+ * Copyright (C) 2015 Balázs Kreith (contact: balazs.kreith@gmail.com)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include "fecrepairer.h"
+#include "mprtpclock.h"
+
+GST_DEBUG_CATEGORY_STATIC (fecrepairer_debug_category);
+#define GST_CAT_DEFAULT fecrepairer_debug_category
+
+G_DEFINE_TYPE (FECRepairer, fecrepairer, G_TYPE_OBJECT);
+
+#define _now(this) mprtp_clock_get_time()
+
+#define FEC_CLEAN_INTERVAL (200 * GST_MSECOND)
+//Segments become repairable as the playout goes on and the minimum of the
+//repair window passes, so they are rechecked while packets are arriving
+#define REPAIR_RECHECK_INTERVAL (2 * GST_MSECOND)
+#define REPAIR_IDLE_TIMEOUT GST_SECOND
+
+//----------------------------------------------------------------------
+//-------- Private functions belongs to the object ----------
+//----------------------------------------------------------------------
+
+static void
+fecrepairer_finalize (
+    GObject * object);
+
+static void
+_repairer_process_run (
+    void *data);
+
+static void
+_process_arrival(
+    FECRepairer *this,
+    GstMpRTPBuffer *arrival);
+
+static void
+_repair(
+    FECRepairer *this);
+
+static void
+_push_repaired(
+    FECRepairer *this,
+    GstBuffer *buffer);
+
+static void
+_flush(
+    FECRepairer *this);
+
+//----------------------------------------------------------------------
+//--------- Private functions implementations to the object --------
+//----------------------------------------------------------------------
+
+void
+fecrepairer_class_init (FECRepairerClass * klass)
+{
+  GObjectClass *gobject_class;
+
+  gobject_class = (GObjectClass *) klass;
+
+  gobject_class->finalize = fecrepairer_finalize;
+
+  GST_DEBUG_CATEGORY_INIT (fecrepairer_debug_category, "fecrepairer", 0,
+      "MpRTP FEC Repair Worker");
+}
+
+void
+fecrepairer_finalize (GObject * object)
+{
+  FECRepairer *this;
+  this = FECREPAIRER(object);
+  fecrepairer_stop(this);
+  gst_task_join (this->thread);
+  gst_object_unref (this->thread);
+  _flush(this);
+  g_async_queue_unref(this->arrivals);
+  g_object_unref(this->decoder);
+}
+
+void
+fecrepairer_init (FECRepairer * this)
+{
+  this->arrivals   = g_async_queue_new();
+  this->thread     = gst_task_new (_repairer_process_run, this, NULL);
+  this->played_seq = -1;
+  g_rec_mutex_init (&this->thread_mutex);
+  gst_task_set_lock (this->thread, &this->thread_mutex);
+}
+
+FECRepairer *make_fecrepairer(FECDecoder *decoder)
+{
+  FECRepairer *result;
+  result          = g_object_new (FECREPAIRER_TYPE, NULL);
+  result->decoder = g_object_ref(decoder);
+  result->clock   = mprtp_clock_get_binding();
+  return result;
+}
+
+void fecrepairer_start(FECRepairer *this)
+{
+  this->last_clean = _now(this);
+  gst_task_start (this->thread);
+}
+
+void fecrepairer_stop(FECRepairer *this)
+{
+  gst_task_stop (this->thread);
+  //the worker waits for arrivals, the repairer itself is pushed to wake it up
+  g_async_queue_push(this->arrivals, this);
+}
+
+void fecrepairer_add_packet(FECRepairer *this, GstMpRTPBuffer *mprtp)
+{
+  GstMpRTPBuffer *arrival;
+  arrival = g_malloc(sizeof(GstMpRTPBuffer));
+  memcpy(arrival, mprtp, sizeof(GstMpRTPBuffer));
+  gst_buffer_ref(arrival->buffer);
+  g_async_queue_push(this->arrivals, arrival);
+}
+
+void fecrepairer_set_played_seq(FECRepairer *this, guint16 seq)
+{
+  g_atomic_int_set(&this->played_seq, (gint) seq);
+}
+
+GstBuffer *fecrepairer_pop(FECRepairer *this)
+{
+  GstBuffer *result;
+  gint tail;
+
+  tail = g_atomic_int_get(&this->ring_tail);
+  if(tail == g_atomic_int_get(&this->ring_head)){
+    return NULL;
+  }
+  result = this->ring[(guint) tail % FECREPAIRER_RING_LENGTH];
+  this->ring[(guint) tail % FECREPAIRER_RING_LENGTH] = NULL;
+  g_atomic_int_set(&this->ring_tail, (gint)((guint) tail + 1));
+  return result;
+}
+
+void
+_repairer_process_run (void *data)
+{
+  FECRepairer *this;
+  GstMpRTPBuffer *arrival;
+  GstClockTime timeout;
+  MPRTPClockProvider** clock;
+
+  this = (FECRepairer *) data;
+  clock = mprtp_clock_bind(this->clock);
+  timeout = _now(this) < this->last_arrival + REPAIR_IDLE_TIMEOUT ?
+      REPAIR_RECHECK_INTERVAL : FEC_CLEAN_INTERVAL;
+
+  arrival = g_async_queue_timeout_pop(this->arrivals, GST_TIME_AS_USECONDS(timeout));
+  for(; arrival; arrival = g_async_queue_try_pop(this->arrivals)){
+    if(arrival != (gpointer) this){
+      _process_arrival(this, arrival);
+    }
+  }
+  if(this->last_clean + FEC_CLEAN_INTERVAL <= _now(this)){
+    fecdecoder_clean(this->decoder);
+    this->last_clean = _now(this);
+  }
+  _repair(this);
+  mprtp_clock_bind(clock);
+}
+
+void _process_arrival(FECRepairer *this, GstMpRTPBuffer *arrival)
+{
+  this->last_arrival = _now(this);
+  if(arrival->fec_packet){
+    fecdecoder_add_fec_packet(this->decoder, arrival);
+  }else{
+    fecdecoder_add_rtp_packet(this->decoder, arrival);
+  }
+  gst_buffer_unref(arrival->buffer);
+  g_free(arrival);
+}
+
+void _repair(FECRepairer *this)
+{
+  GstBuffer *repaired;
+  gint played_seq;
+
+  played_seq = g_atomic_int_get(&this->played_seq);
+  if(played_seq < 0){
+    return;
+  }
+  while(fecdecoder_has_repaired_rtpbuffer(this->decoder, (guint16) played_seq, &repaired)){
+    _push_repaired(this, repaired);
+  }
+}
+
+void _push_repaired(FECRepairer *this, GstBuffer *buffer)
+{
+  gint head;
+
+  head = g_atomic_int_get(&this->ring_head);
+  //the playout fell behind, the repaired packet would be late anyway
+  if(FECREPAIRER_RING_LENGTH <= (guint) head - (guint) g_atomic_int_get(&this->ring_tail)){
+    GST_WARNING_OBJECT(this, "Repaired packet is dropped, the playout does not merge them");
+    gst_buffer_unref(buffer);
+    ++this->dropped;
+    return;
+  }
+  this->ring[(guint) head % FECREPAIRER_RING_LENGTH] = buffer;
+  g_atomic_int_set(&this->ring_head, (gint)((guint) head + 1));
+  ++this->repaired;
+}
+
+void _flush(FECRepairer *this)
+{
+  GstMpRTPBuffer *arrival;
+  GstBuffer *repaired;
+
+  while((arrival = g_async_queue_try_pop(this->arrivals)) != NULL){
+    if(arrival != (gpointer) this){
+      gst_buffer_unref(arrival->buffer);
+      g_free(arrival);
+    }
+  }
+  while((repaired = fecrepairer_pop(this)) != NULL){
+    gst_buffer_unref(repaired);
+  }
+}
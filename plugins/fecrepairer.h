@@ -0,0 +1,70 @@
+/*
+ * fecrepairer.h
+ *
+ *  Repair worker of the FEC decoder at the receiver. The RTP and FEC
+ *  arrivals are queued to its own thread, which feeds and cleans the
+ *  decoder and xors the missing packets back. The repaired buffers are
+ *  handed over to the playout thread in a lock free single producer,
+ *  single consumer ring, so the playout only merges them in order.
+ */
+
+#ifndef FECREPAIRER_H_
+#define FECREPAIRER_H_
+
+#include <gst/gst.h>
+#include "gstmprtpbuffer.h"
+#include "fecdec.h"
+#include "mprtpclock.h"
+
+typedef struct _FECRepairer FECRepairer;
+typedef struct _FECRepairerClass FECRepairerClass;
+
+#define FECREPAIRER_TYPE             (fecrepairer_get_type())
+#define FECREPAIRER(src)             (G_TYPE_CHECK_INSTANCE_CAST((src),FECREPAIRER_TYPE,FECRepairer))
+#define FECREPAIRER_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST((klass),FECREPAIRER_TYPE,FECRepairerClass))
+#define FECREPAIRER_IS_SOURCE(src)          (G_TYPE_CHECK_INSTANCE_TYPE((src),FECREPAIRER_TYPE))
+#define FECREPAIRER_IS_SOURCE_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE((klass),FECREPAIRER_TYPE))
+#define FECREPAIRER_CAST(src)        ((FECRepairer *)(src))
+
+//repaired buffers not merged by the playout yet, must divide 2^32
+#define FECREPAIRER_RING_LENGTH 256
+
+struct _FECRepairer
+{
+  GObject                   object;
+  FECDecoder*               decoder;
+
+  GstTask*                  thread;
+  GRecMutex                 thread_mutex;
+  //the clock binding of the element the repairer was made by
+  MPRTPClockProvider**      clock;
+  GAsyncQueue*              arrivals;
+  GstClockTime              last_arrival;
+  GstClockTime              last_clean;
+
+  //the next sequence number the playout expects, -1 until it starts
+  gint                      played_seq;
+
+  GstBuffer*                ring[FECREPAIRER_RING_LENGTH];
+  gint                      ring_head;
+  gint                      ring_tail;
+
+  guint32                   repaired;
+  guint32                   dropped;
+};
+
+struct _FECRepairerClass{
+  GObjectClass parent_class;
+};
+
+GType fecrepairer_get_type (void);
+FECRepairer *make_fecrepairer(FECDecoder *decoder);
+void fecrepairer_start(FECRepairer *this);
+void fecrepairer_stop(FECRepairer *this);
+//Called by the receiving thread, the buffer of the packet is referenced
+void fecrepairer_add_packet(FECRepairer *this, GstMpRTPBuffer *mprtp);
+//Called by the playout thread only
+void fecrepairer_set_played_seq(FECRepairer *this, guint16 seq);
+GstBuffer *fecrepairer_pop(FECRepairer *this);
+
+#endif /* FECREPAIRER_H_ */
@@ -0,0 +1,259 @@
+/* GStreamer Loss adaptive FEC subflow controller
+ * Copyright (C) 2015 Balázs Kreith (contact: balazs.kreith@gmail.com)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <string.h>
+#include "fecsubctrler.h"
+#include "rtpfecbuffer.h"
+#include "gstmprtpbuffer.h"
+
+#define THIS_READLOCK(this) g_rw_lock_reader_lock(&this->rwmutex)
+#define THIS_READUNLOCK(this) g_rw_lock_reader_unlock(&this->rwmutex)
+#define THIS_WRITELOCK(this) g_rw_lock_writer_lock(&this->rwmutex)
+#define THIS_WRITEUNLOCK(this) g_rw_lock_writer_unlock(&this->rwmutex)
+
+GST_DEBUG_CATEGORY_STATIC (fecsubctrler_debug_category);
+#define GST_CAT_DEFAULT fecsubctrler_debug_category
+
+G_DEFINE_TYPE (FECSubController, fecsubctrler, G_TYPE_OBJECT);
+
+//The protection is switched on above LOSS_ON and off below LOSS_OFF,
+//so a path around one loss rate does not flap
+#define LOSS_ON 0.01
+#define LOSS_OFF 0.003
+#define MIN_INTERVAL 2
+//the FEC encoder xors at most this many packets into one FEC packet
+#define MAX_INTERVAL (GST_RTPFEC_MAX_PROTECTION_NUM - 1)
+#define SMOOTHING .25
+
+//----------------------------------------------------------------------
+//-------- Private functions belongs to the object ----------
+//----------------------------------------------------------------------
+
+static void
+fecsubctrler_finalize (
+    GObject * object);
+
+static void
+_update_bursts(
+    FECSubController *this,
+    GstMPRTCPReportSummary *summary);
+
+static void
+_update_losses(
+    FECSubController *this,
+    GstMPRTCPReportSummary *summary);
+
+static void
+_refresh_interval(
+    FECSubController *this);
+
+//----------------------------------------------------------------------
+//--------- Private functions implementations to the object --------
+//----------------------------------------------------------------------
+
+void
+fecsubctrler_class_init (FECSubControllerClass * klass)
+{
+  GObjectClass *gobject_class;
+
+  gobject_class = (GObjectClass *) klass;
+
+  gobject_class->finalize = fecsubctrler_finalize;
+
+  GST_DEBUG_CATEGORY_INIT (fecsubctrler_debug_category, "fecsubctrler", 0,
+      "MpRTP Loss Adaptive FEC Controller");
+}
+
+void
+fecsubctrler_finalize (GObject * object)
+{
+  FECSubController *this;
+  this = FECSUBCTRLER(object);
+  g_object_unref(this->path);
+  g_rw_lock_clear(&this->rwmutex);
+}
+
+void
+fecsubctrler_init (FECSubController * this)
+{
+  g_rw_lock_init (&this->rwmutex);
+  this->burst_length = 1.;
+  this->repair_rate  = 1.;
+}
+
+FECSubController *make_fecsubctrler(MPRTPSPath *path)
+{
+  FECSubController *result;
+  result       = g_object_new (FECSUBCTRLER_TYPE, NULL);
+  result->path = g_object_ref(path);
+  result->id   = mprtps_path_get_id(path);
+  return result;
+}
+
+void fecsubctrler_set_budget(FECSubController *this, guint budget)
+{
+  THIS_WRITELOCK(this);
+  this->budget = MIN(budget, 100);
+  _refresh_interval(this);
+  THIS_WRITEUNLOCK(this);
+}
+
+guint fecsubctrler_get_interval(FECSubController *this)
+{
+  guint result;
+  THIS_READLOCK(this);
+  result = this->interval;
+  THIS_READUNLOCK(this);
+  return result;
+}
+
+void fecsubctrler_report_update(FECSubController *this, GstMPRTCPReportSummary *summary)
+{
+  THIS_WRITELOCK(this);
+  _update_bursts(this, summary);
+  if(summary->RR.processed){
+    _update_losses(this, summary);
+    _refresh_interval(this);
+  }
+  THIS_WRITEUNLOCK(this);
+}
+
+//The burst length is the lost packets per loss event in the NACKs (sorted
+//subflow sequence numbers) and in the discarded RLE of FBRA.
+void _update_bursts(FECSubController *this, GstMPRTCPReportSummary *summary)
+{
+  guint i, lost = 0, events = 0;
+
+  if(summary->NACK.processed){
+    for(i = 0; i < summary->NACK.seqs_num; ++i, ++lost){
+      if(!i || (guint16)(summary->NACK.seqs[i - 1] + 1) != summary->NACK.seqs[i]){
+        ++events;
+      }
+    }
+  }else if(summary->XR.DiscardedRLE.processed){
+    for(i = 0; i < summary->XR.DiscardedRLE.vector_length && i < 1024; ++i){
+      if(summary->XR.DiscardedRLE.vector[i]){
+        continue;
+      }
+      ++lost;
+      if(!i || summary->XR.DiscardedRLE.vector[i - 1]){
+        ++events;
+      }
+    }
+  }
+  if(!events){
+    return;
+  }
+  this->burst_length += ((gdouble) lost / (gdouble) events - this->burst_length) * SMOOTHING;
+}
+
+void _update_losses(FECSubController *this, GstMPRTCPReportSummary *summary)
+{
+  guint32 ext_HSSN, expected, lost, unrepaired;
+  gdouble repair_rate;
+
+  ext_HSSN = (((guint32) summary->RR.cycle_num) << 16) | ((guint32) summary->RR.HSSN);
+  if(!this->initialized){
+    this->initialized         = TRUE;
+    this->ext_HSSN            = ext_HSSN;
+    this->cum_packet_lost     = summary->RR.cum_packet_lost;
+    this->unrepaired          = summary->XR.DiscardedPackets.discarded_packets;
+    this->unrepaired_reported = summary->XR.DiscardedPackets.processed;
+    return;
+  }
+  expected = ext_HSSN - this->ext_HSSN;
+  lost     = summary->RR.cum_packet_lost - this->cum_packet_lost;
+  this->ext_HSSN        = ext_HSSN;
+  this->cum_packet_lost = summary->RR.cum_packet_lost;
+  //a reordered or repeated report
+  if(32768 < expected || expected < lost){
+    return;
+  }
+  if(0 < expected){
+    this->loss_rate += ((gdouble) lost / (gdouble) expected - this->loss_rate) * SMOOTHING;
+  }
+
+  //the receiver reports the losses of the subflow the FEC packets could
+  //not repair, only these are waiting for a retransmission
+  if(!summary->XR.DiscardedPackets.processed){
+    this->unrepaired_reported = FALSE;
+    return;
+  }
+  unrepaired = summary->XR.DiscardedPackets.discarded_packets - this->unrepaired;
+  this->unrepaired = summary->XR.DiscardedPackets.discarded_packets;
+  if(!this->unrepaired_reported){
+    this->unrepaired_reported = TRUE;
+    return;
+  }
+  if(!this->interval || !lost || 32768 < unrepaired){
+    return;
+  }
+  repair_rate = 1. - (gdouble) MIN(unrepaired, lost) / (gdouble) lost;
+  this->repair_rate += (repair_rate - this->repair_rate) * SMOOTHING;
+}
+
+void _refresh_interval(FECSubController *this)
+{
+  gdouble interval;
+  guint min_interval, result = 0;
+
+  if(!this->budget){
+    goto done;
+  }
+  if(this->loss_rate < (this->interval ? LOSS_OFF : LOSS_ON)){
+    goto done;
+  }
+  //the FEC packets are about the size of the media packets, so a path
+  //sending one after every interval packets spends 1 / interval of its
+  //target bitrate on FEC
+  min_interval = (guint) ceil(100. / (gdouble) this->budget);
+  if(MAX_INTERVAL < min_interval){
+    goto done;
+  }
+  //a FEC packet repairs one loss of its group, so a group gets half a
+  //loss event on average, and denser if the repairs fail because the
+  //bursts or the FEC packets themselves are lost
+  interval  = MAX(1., this->burst_length) / (2. * this->loss_rate);
+  interval *= CONSTRAIN(.25, 1., this->repair_rate);
+  result    = CONSTRAIN(MAX(MIN_INTERVAL, min_interval), MAX_INTERVAL, (guint) interval);
+done:
+  if(result == this->interval){
+    return;
+  }
+  GST_DEBUG_OBJECT(this, "Protection interval of subflow %d changed from %u to %u "
+      "(loss rate: %f, burst length: %f, repair rate: %f)",
+      this->id, this->interval, result, this->loss_rate, this->burst_length, this->repair_rate);
+  //the repair rate of the new protection is learned from the scratch
+  if(!this->interval){
+    this->repair_rate = 1.;
+  }
+  this->interval = result;
+  mprtps_path_set_protection_interval(this->path, result);
+}
+
+
+#undef THIS_READLOCK
+#undef THIS_READUNLOCK
+#undef THIS_WRITELOCK
+#undef THIS_WRITEUNLOCK
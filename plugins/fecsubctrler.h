@@ -0,0 +1,61 @@
+/*
+ * fecsubctrler.h
+ *
+ *  Loss adaptive FEC protection of a subflow. The protection interval of
+ *  the path (media packets per FEC packet) follows the loss rate and the
+ *  loss bursts of the receiver reports and how many of the losses the FEC
+ *  packets of the subflow repaired. The overhead is kept below a budget of
+ *  the target bitrate, a path without losses carries no FEC.
+ */
+
+#ifndef FECSUBCTRLER_H_
+#define FECSUBCTRLER_H_
+
+#include <gst/gst.h>
+#include "mprtpspath.h"
+#include "reportproc.h"
+
+typedef struct _FECSubController FECSubController;
+typedef struct _FECSubControllerClass FECSubControllerClass;
+
+#define FECSUBCTRLER_TYPE             (fecsubctrler_get_type())
+#define FECSUBCTRLER(src)             (G_TYPE_CHECK_INSTANCE_CAST((src),FECSUBCTRLER_TYPE,FECSubController))
+#define FECSUBCTRLER_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST((klass),FECSUBCTRLER_TYPE,FECSubControllerClass))
+#define FECSUBCTRLER_IS_SOURCE(src)          (G_TYPE_CHECK_INSTANCE_TYPE((src),FECSUBCTRLER_TYPE))
+#define FECSUBCTRLER_IS_SOURCE_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE((klass),FECSUBCTRLER_TYPE))
+#define FECSUBCTRLER_CAST(src)        ((FECSubController *)(src))
+
+struct _FECSubController
+{
+  GObject                   object;
+  GRWLock                   rwmutex;
+  guint8                    id;
+  MPRTPSPath*               path;
+
+  //the FEC overhead allowed in the percent of the target bitrate,
+  //0 disables the protection
+  guint                     budget;
+  guint                     interval;
+
+  gboolean                  initialized;
+  guint32                   ext_HSSN;
+  guint32                   cum_packet_lost;
+  guint32                   unrepaired;
+  gboolean                  unrepaired_reported;
+
+  gdouble                   loss_rate;
+  gdouble                   burst_length;
+  gdouble                   repair_rate;
+};
+
+struct _FECSubControllerClass{
+  GObjectClass parent_class;
+};
+
+GType fecsubctrler_get_type (void);
+FECSubController *make_fecsubctrler(MPRTPSPath *path);
+void fecsubctrler_set_budget(FECSubController *this, guint budget);
+void fecsubctrler_report_update(FECSubController *this, GstMPRTCPReportSummary *summary);
+guint fecsubctrler_get_interval(FECSubController *this);
+
+#endif /* FECSUBCTRLER_H_ */
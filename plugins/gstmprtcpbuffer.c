@@ -23,6 +23,8 @@
 #define RTCPXROWDBLOCK_WORDS (RTCPXROWDBLOCK_BYTES>>2)
 #define RTCPFB_BYTES 12
 #define RTCPFB_WORDS (RTCPFB_BYTES>>2)
+#define RTCPNACK_BYTES 4
+#define RTCPNACK_WORDS (RTCPNACK_BYTES>>2)
 #define RTCPRRBLOCK_BYTES 24
 #define RTCPRRBLOCK_WORDS (RTCPRRBLOCK_BYTES>>2)
 #define MPRTCPBLOCK_BYTES 4
@@ -773,6 +775,77 @@ gst_rtcp_afb_getdown_fci_data(GstRTCPFB * report, gchar *fci_dat, guint *fci_len
   }
 }
 
+void
+gst_rtcp_nack_init (GstRTCPNACK * report)
+{
+  gst_rtcp_header_init (&report->header);
+  gst_rtcp_header_setup (&report->header, FALSE, GST_RTCP_RTPFB_TYPE_NACK,
+      GST_RTCP_TYPE_RTPFB, RTCPHEADER_WORDS - 1 + RTCPNACK_WORDS, 0);
+  report->ssrc = 0;
+}
+
+void
+gst_rtcp_nack_change (GstRTCPNACK * report,
+                      guint32 *packet_source_ssrc,
+                      guint32 *media_source_ssrc)
+{
+  if (packet_source_ssrc) {
+      gst_rtcp_header_change(&report->header, NULL, NULL, NULL, NULL, NULL, packet_source_ssrc);
+  }
+  if (media_source_ssrc) {
+      report->ssrc = g_htonl(*media_source_ssrc);
+  }
+}
+
+void
+gst_rtcp_nack_getdown (GstRTCPNACK * report,
+                       guint32 *packet_source_ssrc,
+                       guint32 *media_source_ssrc)
+{
+  if (packet_source_ssrc) {
+      gst_rtcp_header_getdown(&report->header, NULL, NULL, NULL, NULL, NULL, packet_source_ssrc);
+  }
+  if (media_source_ssrc) {
+      *media_source_ssrc = g_ntohl(report->ssrc);
+  }
+}
+
+void
+gst_rtcp_nack_add_fci (GstRTCPNACK * report, guint16 pid, guint16 blp)
+{
+  guint16 header_length;
+  GstRTCPNACKFCI *fci;
+  fci = &report->fcis + gst_rtcp_nack_get_fcis_num(report);
+  fci->pid = g_htons(pid);
+  fci->blp = g_htons(blp);
+  gst_rtcp_header_getdown(&report->header, NULL, NULL, NULL, NULL, &header_length, NULL);
+  ++header_length;
+  gst_rtcp_header_change(&report->header, NULL, NULL, NULL, NULL, &header_length, NULL);
+}
+
+guint
+gst_rtcp_nack_get_fcis_num (GstRTCPNACK * report)
+{
+  guint16 header_length;
+  gst_rtcp_header_getdown(&report->header, NULL, NULL, NULL, NULL, &header_length, NULL);
+  if(header_length < RTCPHEADER_WORDS - 1 + RTCPNACK_WORDS){
+    return 0;
+  }
+  return header_length - (RTCPHEADER_WORDS - 1) - RTCPNACK_WORDS;
+}
+
+void
+gst_rtcp_nack_getdown_fci (GstRTCPNACK * report, guint index, guint16 *pid, guint16 *blp)
+{
+  GstRTCPNACKFCI *fci = &report->fcis + index;
+  if (pid) {
+    *pid = g_ntohs(fci->pid);
+  }
+  if (blp) {
+    *blp = g_ntohs(fci->blp);
+  }
+}
+
 void
 gst_rtcp_xr_chunk_ntoh_cpy (GstRTCPXRChunk *dst_chunk,
                        GstRTCPXRChunk *src_chunk)
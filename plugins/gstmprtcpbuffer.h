@@ -56,6 +56,7 @@
 #include <gst/rtp/gstrtcpbuffer.h>
 #include "gstmprtpbuffer.h"
 #include "mprtpdefs.h"
+#include "mprtpclock.h"
 
 #define MPRTCP_PACKET_DEFAULT_MTU 1400
 #define MPRTCP_PACKET_TYPE_IDENTIFIER 212
@@ -75,7 +76,7 @@
 #define current_unix_time_in_us g_get_real_time ()
 #define current_unix_time_in_ms (current_unix_time_in_us / 1000L)
 #define current_unix_time_in_s  (current_unix_time_in_ms / 1000L)
-#define epoch_now_in_ns ((guint64)((current_unix_time_in_us + 2208988800000000LL) * 1000))
+#define epoch_now_in_ns mprtp_clock_get_epoch_time()
 #define get_ntp_from_epoch_ns(epoch_in_ns) gst_util_uint64_scale (epoch_in_ns, (1LL << 32), GST_SECOND)
 #define get_epoch_time_from_ntp_in_ns(ntp_time) gst_util_uint64_scale (ntp_time, GST_SECOND, (1LL << 32))
 #define NTP_NOW get_ntp_from_epoch_ns(epoch_now_in_ns)
@@ -290,6 +291,20 @@ typedef struct PACKED _GstRTCPAFB_REPS{
   #endif
 }GstRTCPAFB_REPS;
 
+//Generic NACK (RFC 4585), the lost packets are identified by a packet id
+//and a bitmask of the following 16 packets
+typedef struct PACKED _GstRTCPNACKFCI{
+  guint16               pid;
+  guint16               blp;
+}GstRTCPNACKFCI;
+
+typedef struct PACKED _GstRTCPNACK
+{
+  GstRTCPHeader header;
+  guint32 ssrc;
+  GstRTCPNACKFCI fcis;
+} GstRTCPNACK;
+
 
 
 /*MPRTCP struct polymorphism*/
@@ -323,6 +338,7 @@ typedef struct PACKED _GstMPRTCPSubflowBlock
     GstRTCPSR sender_riport;
     GstRTCPXR xr_header;
     GstRTCPFB feedback;
+    GstRTCPNACK nack;
   };
 } GstMPRTCPSubflowBlock;
 
@@ -500,6 +516,33 @@ gst_rtcp_afb_getdown_fci_data(GstRTCPFB * report,
                               gchar *fci_dat,
                               guint *fci_len);
 
+void
+gst_rtcp_nack_init (GstRTCPNACK * report);
+
+void
+gst_rtcp_nack_change (GstRTCPNACK * report,
+                      guint32 *packet_source_ssrc,
+                      guint32 *media_source_ssrc);
+
+void
+gst_rtcp_nack_getdown (GstRTCPNACK * report,
+                       guint32 *packet_source_ssrc,
+                       guint32 *media_source_ssrc);
+
+void
+gst_rtcp_nack_add_fci (GstRTCPNACK * report,
+                       guint16 pid,
+                       guint16 blp);
+
+guint
+gst_rtcp_nack_get_fcis_num (GstRTCPNACK * report);
+
+void
+gst_rtcp_nack_getdown_fci (GstRTCPNACK * report,
+                           guint index,
+                           guint16 *pid,
+                           guint16 *blp);
+
 void
 gst_rtcp_xr_chunk_ntoh_cpy (GstRTCPXRChunk *dst_chunk,
                        GstRTCPXRChunk *src_chunk);
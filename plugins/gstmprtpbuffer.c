@@ -41,6 +41,12 @@
 #include "gstmprtpbuffer.h"
 #include "gstmprtcpbuffer.h"
 
+/* Evaluates to a mask with n bits set */
+#define BITS_MASK(n) ((1<<(n))-1)
+
+/* Returns len bits, with the LSB at position bit */
+#define BITS_GET(val, bit, len) (((val)>>(bit))&BITS_MASK(len))
+
 gboolean gst_buffer_is_mprtp(GstBuffer *buffer, guint8 mprtp_ext_header_id)
 {
   gpointer pointer = NULL;
@@ -65,6 +71,54 @@ gboolean gst_buffer_is_monitoring_rtp(GstBuffer *buffer, guint8 monitoring_paylo
   return result;
 }
 
+//The VP8 payload descriptor of RFC 7741 comes before the VP8 payload
+//header, which is only in the first packet of the first partition
+static gboolean _vp8_is_keyframe(const guint8 *p, guint len)
+{
+  guint offset = 1;
+  guint8 extensions;
+  /* X|R|N|S|R|PID */
+  if(len < 1 || !BITS_GET(p[0], 4, 1) || BITS_GET(p[0], 0, 3)){
+    return FALSE;
+  }
+  if(BITS_GET(p[0], 7, 1)){
+    if(len < 2){
+      return FALSE;
+    }
+    /* I|L|T|K|RSV */
+    extensions = p[offset++];
+    if(BITS_GET(extensions, 7, 1)){
+      //the M bit marks the 15 bits long picture id
+      offset += offset < len && BITS_GET(p[offset], 7, 1) ? 2 : 1;
+    }
+    if(BITS_GET(extensions, 6, 1)){
+      ++offset;
+    }
+    if(BITS_GET(extensions, 5, 1) || BITS_GET(extensions, 4, 1)){
+      ++offset;
+    }
+  }
+  /* The frame header is defined as a three byte little endian
+  * value, the P bit is 0 for keyframes
+  */
+  if(len < offset + 3){
+    return FALSE;
+  }
+  return !BITS_GET(p[offset], 0, 1);
+}
+
+gboolean gst_mprtp_is_keyframe(GstRTPBuffer *rtp, guint keyframe_filtering)
+{
+  switch(keyframe_filtering){
+    case 1:
+      return _vp8_is_keyframe(gst_rtp_buffer_get_payload(rtp),
+                              gst_rtp_buffer_get_payload_len(rtp));
+    case 0:
+    default:
+      return FALSE;
+  }
+}
+
 void gst_mprtp_buffer_init(GstMpRTPBuffer *mprtp,
                                GstBuffer *buffer,
                                guint8 mprtp_ext_header_id,
@@ -76,6 +76,9 @@ typedef struct{
 
 gboolean gst_buffer_is_mprtp(GstBuffer *buffer, guint8 mprtp_ext_header_id);
 gboolean gst_buffer_is_monitoring_rtp(GstBuffer *buffer, guint8 monitoring_payload_type);
+//The keyframe detection of the mpath-keyframe-filtering modes, 0 - none,
+//1 - vp8
+gboolean gst_mprtp_is_keyframe(GstRTPBuffer *rtp, guint keyframe_filtering);
 void gst_mprtp_buffer_init(GstMpRTPBuffer *mprtp,
                                GstBuffer *buffer,
                                guint8 mprtp_ext_header_id,
@@ -0,0 +1,803 @@
+/* GStreamer
+ * Copyright (C) 2015 Balázs Kreith (contact: balazs.kreith@gmail.com)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+/**
+ * SECTION:element-gstmprtpnetsim
+ *
+ * The mprtpnetsim element emulates one network path in-process. Packets are
+ * passed through a bottleneck of the given bandwidth with a drop-tail or
+ * CoDel queue in front of it, then delayed by the propagation delay plus
+ * jitter. Losses follow a Gilbert-Elliott model. Every random decision is
+ * taken from a generator seeded by the seed property, so runs with the same
+ * input are repeatable without root, namespaces, veth pairs or tc netem.
+ *
+ * The capacity-schedule property changes the bandwidth over time. It is a
+ * comma separated list of second:kbps pairs counted from the first packet,
+ * or one of the presets matching the RMCAT evaluation test cases:
+ * "rmcat-5.1" (variable available capacity with a single flow) and
+ * "rmcat-5.2" (variable available capacity with multiple flows).
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 mprtpsender name=snd mprtpreceiver name=rcv
+ *   snd.src_1 ! mprtpnetsim capacity-schedule=rmcat-5.1 delay=50 ! rcv.sink_1
+ *   snd.src_2 ! mprtpnetsim bandwidth=1000 delay=100 jitter=10 ! rcv.sink_2
+ * ]|
+ * Every subflow gets its own emulated path between the sender and the receiver.
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "gstmprtpnetsim.h"
+#include "mprtpclock.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_mprtpnetsim_debug_category);
+#define GST_CAT_DEFAULT gst_mprtpnetsim_debug_category
+
+#define THIS_LOCK(this) g_mutex_lock(&this->mutex)
+#define THIS_UNLOCK(this) g_mutex_unlock(&this->mutex)
+
+#define _now(this) gst_clock_get_time (this->sysclock)
+
+//RFC 8289 defaults
+#define CODEL_TARGET (5 * GST_MSECOND)
+#define CODEL_INTERVAL (100 * GST_MSECOND)
+
+#define DEFAULT_SEED 1
+#define DEFAULT_BANDWIDTH 0
+#define DEFAULT_QUEUE_LIMIT 300
+#define DEFAULT_QUEUE_TYPE MPRTPNETSIM_QUEUE_DROPTAIL
+#define DEFAULT_DELAY 0
+#define DEFAULT_JITTER 0
+
+typedef struct{
+  GstMiniObject* object;
+  GstClockTime   delivery;
+}NetsimItem;
+
+static const struct{
+  const gchar* name;
+  const gchar* schedule;
+}capacity_presets[] = {
+    {"rmcat-5.1", "0:1000,40:2500,60:600,80:1000"},
+    {"rmcat-5.2", "0:2000,25:1000,50:1750,75:500,100:1000"},
+    {NULL, NULL},
+};
+
+static void gst_mprtpnetsim_set_property (GObject * object,
+    guint property_id, const GValue * value, GParamSpec * pspec);
+static void gst_mprtpnetsim_get_property (GObject * object,
+    guint property_id, GValue * value, GParamSpec * pspec);
+static void gst_mprtpnetsim_finalize (GObject * object);
+static GstStateChangeReturn
+gst_mprtpnetsim_change_state (GstElement * element,
+    GstStateChange transition);
+static gboolean gst_mprtpnetsim_set_clock (GstElement * element, GstClock * clock);
+static GstFlowReturn gst_mprtpnetsim_sink_chain (GstPad * pad,
+    GstObject * parent, GstBuffer * buffer);
+static gboolean gst_mprtpnetsim_sink_event (GstPad * pad, GstObject * parent,
+    GstEvent * event);
+static void _netsim_loop(gpointer udata);
+static void _flush_items(GstMprtpnetsim * this);
+static void _reset_link(GstMprtpnetsim * this);
+static void _setup_schedule(GstMprtpnetsim * this, const gchar *schedule);
+
+enum
+{
+  PROP_0,
+  PROP_SEED,
+  PROP_BANDWIDTH,
+  PROP_QUEUE_LIMIT,
+  PROP_QUEUE_TYPE,
+  PROP_DELAY,
+  PROP_JITTER,
+  PROP_GE_GOOD_TO_BAD,
+  PROP_GE_BAD_TO_GOOD,
+  PROP_GE_LOSS_GOOD,
+  PROP_GE_LOSS_BAD,
+  PROP_CAPACITY_SCHEDULE,
+  PROP_FORWARDED,
+  PROP_QUEUE_DROPPED,
+  PROP_LOST,
+};
+
+/* pad templates */
+
+static GstStaticPadTemplate gst_mprtpnetsim_sink_template =
+GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("ANY")
+    );
+
+static GstStaticPadTemplate gst_mprtpnetsim_src_template =
+GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("ANY")
+    );
+
+/* class initialization */
+
+G_DEFINE_TYPE_WITH_CODE (GstMprtpnetsim, gst_mprtpnetsim, GST_TYPE_ELEMENT,
+    GST_DEBUG_CATEGORY_INIT (gst_mprtpnetsim_debug_category, "mprtpnetsim",
+        0, "debug category for mprtpnetsim element"));
+
+static void
+gst_mprtpnetsim_class_init (GstMprtpnetsimClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&gst_mprtpnetsim_sink_template));
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&gst_mprtpnetsim_src_template));
+
+  gst_element_class_set_static_metadata (GST_ELEMENT_CLASS (klass),
+      "MpRTP Network Simulator", "Generic",
+      "Emulates a bottleneck link with queue, delay, jitter and losses for one subflow",
+      "Balázs Kreith <balazskreith@gmail.com>");
+
+  gobject_class->set_property = gst_mprtpnetsim_set_property;
+  gobject_class->get_property = gst_mprtpnetsim_get_property;
+  gobject_class->finalize = gst_mprtpnetsim_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_SEED,
+      g_param_spec_uint ("seed",
+          "Seed of the random generator",
+          "Seed of the random generator used for jitter and losses",
+          0, G_MAXUINT32, DEFAULT_SEED, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_BANDWIDTH,
+      g_param_spec_uint ("bandwidth",
+          "Bottleneck bandwidth in kbps",
+          "Bottleneck bandwidth in kbps, 0 means unlimited. Overridden by capacity-schedule",
+          0, G_MAXUINT32, DEFAULT_BANDWIDTH, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_QUEUE_LIMIT,
+      g_param_spec_uint ("queue-limit",
+          "Bottleneck queue size in ms",
+          "The time the bottleneck needs to drain a full queue in ms, 0 means unlimited",
+          0, G_MAXUINT32, DEFAULT_QUEUE_LIMIT, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_QUEUE_TYPE,
+      g_param_spec_uint ("queue-type",
+          "Queue management",
+          "Queue management at the bottleneck: 0 - drop tail, 1 - CoDel",
+          0, 1, DEFAULT_QUEUE_TYPE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_DELAY,
+      g_param_spec_uint ("delay",
+          "Propagation delay in ms",
+          "Propagation delay added after the bottleneck in ms",
+          0, G_MAXUINT32, DEFAULT_DELAY, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_JITTER,
+      g_param_spec_uint ("jitter",
+          "Jitter in ms",
+          "Maximal deviation of the propagation delay in ms. Packets are not reordered",
+          0, G_MAXUINT32, DEFAULT_JITTER, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_GE_GOOD_TO_BAD,
+      g_param_spec_double ("ge-good-to-bad",
+          "Gilbert-Elliott p",
+          "Probability of moving from the good state to the bad one per packet",
+          0., 1., 0., G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_GE_BAD_TO_GOOD,
+      g_param_spec_double ("ge-bad-to-good",
+          "Gilbert-Elliott r",
+          "Probability of moving from the bad state to the good one per packet",
+          0., 1., 1., G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_GE_LOSS_GOOD,
+      g_param_spec_double ("ge-loss-good",
+          "Loss probability in the good state",
+          "Loss probability in the good state of the Gilbert-Elliott model",
+          0., 1., 0., G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_GE_LOSS_BAD,
+      g_param_spec_double ("ge-loss-bad",
+          "Loss probability in the bad state",
+          "Loss probability in the bad state of the Gilbert-Elliott model",
+          0., 1., 1., G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CAPACITY_SCHEDULE,
+      g_param_spec_string ("capacity-schedule",
+          "Bandwidth changes over time",
+          "Comma separated second:kbps pairs counted from the first packet, "
+          "or one of the presets rmcat-5.1, rmcat-5.2",
+          NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_FORWARDED,
+      g_param_spec_uint64 ("forwarded",
+          "Forwarded packets",
+          "The number of packets delivered to the src pad",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_QUEUE_DROPPED,
+      g_param_spec_uint64 ("queue-dropped",
+          "Packets dropped by the queue",
+          "The number of packets dropped by the bottleneck queue",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_LOST,
+      g_param_spec_uint64 ("lost",
+          "Lost packets",
+          "The number of packets lost by the Gilbert-Elliott model",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  element_class->change_state =
+      GST_DEBUG_FUNCPTR (gst_mprtpnetsim_change_state);
+  element_class->set_clock = GST_DEBUG_FUNCPTR (gst_mprtpnetsim_set_clock);
+}
+
+static void
+gst_mprtpnetsim_init (GstMprtpnetsim * this)
+{
+  this->sinkpad =
+      gst_pad_new_from_static_template (&gst_mprtpnetsim_sink_template, "sink");
+  gst_pad_set_chain_function (this->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_mprtpnetsim_sink_chain));
+  gst_pad_set_event_function (this->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_mprtpnetsim_sink_event));
+  GST_PAD_SET_PROXY_CAPS (this->sinkpad);
+  GST_PAD_SET_PROXY_ALLOCATION (this->sinkpad);
+  gst_element_add_pad (GST_ELEMENT (this), this->sinkpad);
+
+  this->srcpad =
+      gst_pad_new_from_static_template (&gst_mprtpnetsim_src_template, "src");
+  GST_PAD_SET_PROXY_CAPS (this->srcpad);
+  gst_element_add_pad (GST_ELEMENT (this), this->srcpad);
+
+  g_mutex_init (&this->mutex);
+  g_cond_init (&this->cond);
+  this->sysclock       = mprtp_clock_obtain();
+  this->items          = g_queue_new();
+  this->flushing       = TRUE;
+  this->srcresult      = GST_FLOW_FLUSHING;
+
+  this->seed           = DEFAULT_SEED;
+  this->bandwidth      = DEFAULT_BANDWIDTH;
+  this->queue_limit    = DEFAULT_QUEUE_LIMIT * GST_MSECOND;
+  this->queue_type     = DEFAULT_QUEUE_TYPE;
+  this->delay          = DEFAULT_DELAY * GST_MSECOND;
+  this->jitter         = DEFAULT_JITTER * GST_MSECOND;
+  this->ge_good_to_bad = 0.;
+  this->ge_bad_to_good = 1.;
+  this->ge_loss_good   = 0.;
+  this->ge_loss_bad    = 1.;
+  this->rand           = g_rand_new_with_seed(this->seed);
+}
+
+void
+gst_mprtpnetsim_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstMprtpnetsim *this = GST_MPRTPNETSIM (object);
+  GST_DEBUG_OBJECT (this, "set_property");
+
+  THIS_LOCK (this);
+  switch (property_id) {
+    case PROP_SEED:
+      this->seed = g_value_get_uint (value);
+      g_rand_set_seed (this->rand, this->seed);
+      break;
+    case PROP_BANDWIDTH:
+      this->bandwidth = g_value_get_uint (value);
+      break;
+    case PROP_QUEUE_LIMIT:
+      this->queue_limit = (GstClockTime) g_value_get_uint (value) * GST_MSECOND;
+      break;
+    case PROP_QUEUE_TYPE:
+      this->queue_type = (MprtpNetsimQueueType) g_value_get_uint (value);
+      break;
+    case PROP_DELAY:
+      this->delay = (GstClockTime) g_value_get_uint (value) * GST_MSECOND;
+      break;
+    case PROP_JITTER:
+      this->jitter = (GstClockTime) g_value_get_uint (value) * GST_MSECOND;
+      break;
+    case PROP_GE_GOOD_TO_BAD:
+      this->ge_good_to_bad = g_value_get_double (value);
+      break;
+    case PROP_GE_BAD_TO_GOOD:
+      this->ge_bad_to_good = g_value_get_double (value);
+      break;
+    case PROP_GE_LOSS_GOOD:
+      this->ge_loss_good = g_value_get_double (value);
+      break;
+    case PROP_GE_LOSS_BAD:
+      this->ge_loss_bad = g_value_get_double (value);
+      break;
+    case PROP_CAPACITY_SCHEDULE:
+      _setup_schedule (this, g_value_get_string (value));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+  THIS_UNLOCK (this);
+}
+
+void
+gst_mprtpnetsim_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstMprtpnetsim *this = GST_MPRTPNETSIM (object);
+  GST_DEBUG_OBJECT (this, "get_property");
+
+  THIS_LOCK (this);
+  switch (property_id) {
+    case PROP_SEED:
+      g_value_set_uint (value, this->seed);
+      break;
+    case PROP_BANDWIDTH:
+      g_value_set_uint (value, this->bandwidth);
+      break;
+    case PROP_QUEUE_LIMIT:
+      g_value_set_uint (value, (guint) GST_TIME_AS_MSECONDS (this->queue_limit));
+      break;
+    case PROP_QUEUE_TYPE:
+      g_value_set_uint (value, (guint) this->queue_type);
+      break;
+    case PROP_DELAY:
+      g_value_set_uint (value, (guint) GST_TIME_AS_MSECONDS (this->delay));
+      break;
+    case PROP_JITTER:
+      g_value_set_uint (value, (guint) GST_TIME_AS_MSECONDS (this->jitter));
+      break;
+    case PROP_GE_GOOD_TO_BAD:
+      g_value_set_double (value, this->ge_good_to_bad);
+      break;
+    case PROP_GE_BAD_TO_GOOD:
+      g_value_set_double (value, this->ge_bad_to_good);
+      break;
+    case PROP_GE_LOSS_GOOD:
+      g_value_set_double (value, this->ge_loss_good);
+      break;
+    case PROP_GE_LOSS_BAD:
+      g_value_set_double (value, this->ge_loss_bad);
+      break;
+    case PROP_CAPACITY_SCHEDULE:
+      g_value_set_string (value, this->capacity_schedule);
+      break;
+    case PROP_FORWARDED:
+      g_value_set_uint64 (value, this->forwarded);
+      break;
+    case PROP_QUEUE_DROPPED:
+      g_value_set_uint64 (value, this->queue_dropped);
+      break;
+    case PROP_LOST:
+      g_value_set_uint64 (value, this->lost);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+  THIS_UNLOCK (this);
+}
+
+void
+gst_mprtpnetsim_finalize (GObject * object)
+{
+  GstMprtpnetsim *this = GST_MPRTPNETSIM (object);
+
+  GST_DEBUG_OBJECT (this, "finalize");
+
+  _flush_items (this);
+  g_queue_free (this->items);
+  g_rand_free (this->rand);
+  g_free (this->capacity_schedule);
+  g_free (this->schedule);
+  g_mutex_clear (&this->mutex);
+  g_cond_clear (&this->cond);
+  gst_object_unref (this->sysclock);
+  mprtp_clock_provide (this, &this->clock_provider, NULL);
+  G_OBJECT_CLASS (gst_mprtpnetsim_parent_class)->finalize (object);
+}
+
+static void
+_start (GstMprtpnetsim * this)
+{
+  THIS_LOCK (this);
+  _reset_link (this);
+  this->flushing  = FALSE;
+  this->srcresult = GST_FLOW_OK;
+  THIS_UNLOCK (this);
+  gst_pad_start_task (this->srcpad, _netsim_loop, this, NULL);
+}
+
+static void
+_stop (GstMprtpnetsim * this)
+{
+  THIS_LOCK (this);
+  this->flushing  = TRUE;
+  this->srcresult = GST_FLOW_FLUSHING;
+  if (this->clock_id) {
+    gst_clock_id_unschedule (this->clock_id);
+  }
+  g_cond_signal (&this->cond);
+  THIS_UNLOCK (this);
+  gst_pad_stop_task (this->srcpad);
+  THIS_LOCK (this);
+  _flush_items (this);
+  THIS_UNLOCK (this);
+}
+
+static gboolean
+gst_mprtpnetsim_set_clock (GstElement * element, GstClock * clock)
+{
+  GstMprtpnetsim *this = GST_MPRTPNETSIM (element);
+
+  GST_DEBUG_OBJECT (this, "set_clock %" GST_PTR_FORMAT, clock);
+  mprtp_clock_provide (this, &this->clock_provider, clock);
+  THIS_LOCK (this);
+  gst_object_unref (this->sysclock);
+  this->sysclock = clock ? gst_object_ref (clock) : mprtp_clock_obtain ();
+  THIS_UNLOCK (this);
+
+  return GST_ELEMENT_CLASS (gst_mprtpnetsim_parent_class)->set_clock (element,
+      clock);
+}
+
+static GstStateChangeReturn
+gst_mprtpnetsim_change_state (GstElement * element, GstStateChange transition)
+{
+  GstMprtpnetsim *this = GST_MPRTPNETSIM (element);
+  GstStateChangeReturn ret;
+
+  switch (transition) {
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      _stop (this);
+      break;
+    default:
+      break;
+  }
+
+  ret = GST_ELEMENT_CLASS (gst_mprtpnetsim_parent_class)->change_state (element, transition);
+
+  switch (transition) {
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      _start (this);
+      break;
+    default:
+      break;
+  }
+  return ret;
+}
+
+//----------------------------------------------------------------------
+//------------------------- Link model ---------------------------------
+//----------------------------------------------------------------------
+
+void _setup_schedule(GstMprtpnetsim * this, const gchar *schedule)
+{
+  gchar **tokens;
+  gint i;
+
+  g_free (this->capacity_schedule);
+  g_free (this->schedule);
+  this->capacity_schedule = g_strdup (schedule);
+  this->schedule          = NULL;
+  this->schedule_length   = 0;
+  if (!schedule || !*schedule) {
+    return;
+  }
+
+  for (i = 0; capacity_presets[i].name; ++i) {
+    if (!g_strcmp0 (capacity_presets[i].name, schedule)) {
+      schedule = capacity_presets[i].schedule;
+      break;
+    }
+  }
+
+  tokens = g_strsplit (schedule, ",", -1);
+  this->schedule = g_malloc0 (sizeof (MprtpNetsimCapacity) * g_strv_length (tokens));
+  for (i = 0; tokens[i]; ++i) {
+    gdouble at;
+    guint bandwidth;
+    if (sscanf (tokens[i], "%lf:%u", &at, &bandwidth) != 2) {
+      GST_WARNING_OBJECT (this, "Invalid capacity schedule item: %s", tokens[i]);
+      continue;
+    }
+    this->schedule[this->schedule_length].at        = at * GST_SECOND;
+    this->schedule[this->schedule_length].bandwidth = bandwidth;
+    ++this->schedule_length;
+  }
+  g_strfreev (tokens);
+}
+
+void _reset_link(GstMprtpnetsim * this)
+{
+  this->started        = 0;
+  this->link_free      = 0;
+  this->last_delivery  = 0;
+  this->ge_bad         = FALSE;
+  memset (&this->codel, 0, sizeof (this->codel));
+  g_rand_set_seed (this->rand, this->seed);
+}
+
+static guint _get_bandwidth(GstMprtpnetsim * this, GstClockTime now)
+{
+  guint i, result;
+  if (!this->schedule_length) {
+    return this->bandwidth;
+  }
+  result = this->schedule[0].bandwidth;
+  for (i = 1; i < this->schedule_length && this->schedule[i].at <= now - this->started; ++i) {
+    result = this->schedule[i].bandwidth;
+  }
+  return result;
+}
+
+//The dequeue side of CoDel evaluated at the time the packet would leave
+//the queue. The sojourn time is known in advance as the link is FIFO.
+static gboolean _codel_drop(GstMprtpnetsim * this, GstClockTime sojourn, GstClockTime dequeued)
+{
+  gboolean ok_to_drop = FALSE;
+
+  if (sojourn < CODEL_TARGET) {
+    this->codel.first_above = 0;
+    this->codel.dropping    = FALSE;
+    return FALSE;
+  }
+  if (!this->codel.first_above) {
+    this->codel.first_above = dequeued + CODEL_INTERVAL;
+  } else if (this->codel.first_above <= dequeued) {
+    ok_to_drop = TRUE;
+  }
+
+  if (this->codel.dropping) {
+    if (!ok_to_drop) {
+      this->codel.dropping = FALSE;
+      return FALSE;
+    }
+    if (dequeued < this->codel.drop_next) {
+      return FALSE;
+    }
+    ++this->codel.count;
+    this->codel.drop_next = dequeued + CODEL_INTERVAL / sqrt (this->codel.count);
+    return TRUE;
+  }
+
+  if (!ok_to_drop) {
+    return FALSE;
+  }
+  this->codel.dropping = TRUE;
+  if (2 < this->codel.count && dequeued < this->codel.drop_next + 16 * CODEL_INTERVAL) {
+    this->codel.count -= 2;
+  } else {
+    this->codel.count = 1;
+  }
+  this->codel.drop_next = dequeued + CODEL_INTERVAL / sqrt (this->codel.count);
+  return TRUE;
+}
+
+static gboolean _ge_lost(GstMprtpnetsim * this)
+{
+  if (this->ge_bad) {
+    this->ge_bad = this->ge_bad_to_good <= g_rand_double (this->rand);
+  } else {
+    this->ge_bad = g_rand_double (this->rand) < this->ge_good_to_bad;
+  }
+  return g_rand_double (this->rand) < (this->ge_bad ? this->ge_loss_bad : this->ge_loss_good);
+}
+
+static GstClockTime _get_delivery(GstMprtpnetsim * this, GstClockTime departure)
+{
+  GstClockTime result = departure + this->delay;
+  if (this->jitter) {
+    gdouble deviation = g_rand_double_range (this->rand, -1., 1.) * this->jitter;
+    result = deviation < 0. && result < departure - deviation ? departure : result + deviation;
+  }
+  //Jitter does not reorder packets
+  result = MAX (result, this->last_delivery);
+  this->last_delivery = result;
+  return result;
+}
+
+static void _enqueue(GstMprtpnetsim * this, GstMiniObject * object, GstClockTime delivery)
+{
+  NetsimItem *item = g_slice_new0 (NetsimItem);
+  item->object   = object;
+  item->delivery = delivery;
+  g_queue_push_tail (this->items, item);
+  g_cond_signal (&this->cond);
+}
+
+void _flush_items(GstMprtpnetsim * this)
+{
+  NetsimItem *item;
+  while ((item = g_queue_pop_head (this->items)) != NULL) {
+    gst_mini_object_unref (item->object);
+    g_slice_free (NetsimItem, item);
+  }
+}
+
+static GstFlowReturn
+gst_mprtpnetsim_sink_chain (GstPad * pad, GstObject * parent,
+    GstBuffer * buffer)
+{
+  GstMprtpnetsim *this = GST_MPRTPNETSIM (parent);
+  GstClockTime now, departure, sojourn, transmit;
+  GstFlowReturn result;
+  guint bandwidth;
+
+  now = _now (this);
+  THIS_LOCK (this);
+  result = this->srcresult;
+  if (result != GST_FLOW_OK) {
+    gst_buffer_unref (buffer);
+    goto done;
+  }
+  if (!this->started) {
+    this->started = now;
+  }
+
+  departure = now;
+  bandwidth = _get_bandwidth (this, now);
+  if (bandwidth) {
+    sojourn  = this->link_free <= now ? 0 : this->link_free - now;
+    transmit = gst_util_uint64_scale (gst_buffer_get_size (buffer) * 8, GST_SECOND, (guint64) bandwidth * 1000);
+    if (this->queue_limit && this->queue_limit < sojourn + transmit) {
+      goto queue_drop;
+    }
+    if (this->queue_type == MPRTPNETSIM_QUEUE_CODEL && _codel_drop (this, sojourn, now + sojourn)) {
+      goto queue_drop;
+    }
+    this->link_free = departure = now + sojourn + transmit;
+  }
+
+  //Lost packets still occupied the bottleneck
+  if (_ge_lost (this)) {
+    ++this->lost;
+    gst_buffer_unref (buffer);
+    goto done;
+  }
+
+  _enqueue (this, GST_MINI_OBJECT_CAST (buffer), _get_delivery (this, departure));
+  goto done;
+
+queue_drop:
+  ++this->queue_dropped;
+  gst_buffer_unref (buffer);
+done:
+  THIS_UNLOCK (this);
+  return result;
+}
+
+static gboolean
+gst_mprtpnetsim_sink_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  GstMprtpnetsim *this = GST_MPRTPNETSIM (parent);
+  gboolean result = TRUE;
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_FLUSH_START:
+      result = gst_pad_push_event (this->srcpad, event);
+      THIS_LOCK (this);
+      this->flushing  = TRUE;
+      this->srcresult = GST_FLOW_FLUSHING;
+      if (this->clock_id) {
+        gst_clock_id_unschedule (this->clock_id);
+      }
+      g_cond_signal (&this->cond);
+      THIS_UNLOCK (this);
+      gst_pad_pause_task (this->srcpad);
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      result = gst_pad_push_event (this->srcpad, event);
+      THIS_LOCK (this);
+      _flush_items (this);
+      _reset_link (this);
+      this->flushing  = FALSE;
+      this->srcresult = GST_FLOW_OK;
+      THIS_UNLOCK (this);
+      gst_pad_start_task (this->srcpad, _netsim_loop, this, NULL);
+      break;
+    default:
+      if (!GST_EVENT_IS_SERIALIZED (event)) {
+        result = gst_pad_event_default (pad, parent, event);
+        break;
+      }
+      //Serialized events keep their place among the delayed packets
+      THIS_LOCK (this);
+      if (this->flushing) {
+        gst_event_unref (event);
+        result = FALSE;
+      } else {
+        _enqueue (this, GST_MINI_OBJECT_CAST (event), this->last_delivery);
+      }
+      THIS_UNLOCK (this);
+      break;
+  }
+  return result;
+}
+
+static void
+_netsim_loop (gpointer udata)
+{
+  GstMprtpnetsim *this = udata;
+  NetsimItem *item;
+  GstMiniObject *object;
+  GstFlowReturn result = GST_FLOW_OK;
+  gboolean is_buffer;
+
+  THIS_LOCK (this);
+  while (!this->flushing && g_queue_is_empty (this->items)) {
+    g_cond_wait (&this->cond, &this->mutex);
+  }
+  if (this->flushing) {
+    goto pause;
+  }
+
+  item = g_queue_peek_head (this->items);
+  if (_now (this) < item->delivery) {
+    GstClockID clock_id;
+    this->clock_id = clock_id = gst_clock_new_single_shot_id (this->sysclock, item->delivery);
+    THIS_UNLOCK (this);
+    gst_clock_id_wait (clock_id, NULL);
+    THIS_LOCK (this);
+    this->clock_id = NULL;
+    THIS_UNLOCK (this);
+    gst_clock_id_unref (clock_id);
+    return;
+  }
+  g_queue_pop_head (this->items);
+  object = item->object;
+  g_slice_free (NetsimItem, item);
+  THIS_UNLOCK (this);
+
+  //the object belongs to downstream after the push
+  is_buffer = GST_IS_BUFFER (object);
+  if (is_buffer) {
+    result = gst_pad_push (this->srcpad, GST_BUFFER_CAST (object));
+  } else {
+    GstEvent *event = GST_EVENT_CAST (object);
+    if (GST_EVENT_TYPE (event) == GST_EVENT_EOS) {
+      result = GST_FLOW_EOS;
+    }
+    gst_pad_push_event (this->srcpad, event);
+  }
+
+  THIS_LOCK (this);
+  if (is_buffer && result == GST_FLOW_OK) {
+    ++this->forwarded;
+  }
+  if (result == GST_FLOW_OK || result == GST_FLOW_NOT_LINKED) {
+    THIS_UNLOCK (this);
+    return;
+  }
+  if (result != GST_FLOW_EOS) {
+    GST_WARNING_OBJECT (this, "Pausing task, reason: %s", gst_flow_get_name (result));
+  }
+  this->srcresult = result;
+pause:
+  THIS_UNLOCK (this);
+  gst_pad_pause_task (this->srcpad);
+}
@@ -0,0 +1,102 @@
+/* GStreamer
+ * Copyright (C) 2015 Balázs Kreith (contact: balazs.kreith@gmail.com)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_MPRTPNETSIM_H_
+#define _GST_MPRTPNETSIM_H_
+
+#include <gst/gst.h>
+#include "mprtpclock.h"
+
+G_BEGIN_DECLS
+#define GST_TYPE_MPRTPNETSIM   (gst_mprtpnetsim_get_type())
+#define GST_MPRTPNETSIM(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_MPRTPNETSIM,GstMprtpnetsim))
+#define GST_MPRTPNETSIM_CLASS(klass)   (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_MPRTPNETSIM,GstMprtpnetsimClass))
+#define GST_IS_MPRTPNETSIM(obj)   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_MPRTPNETSIM))
+#define GST_IS_MPRTPNETSIM_CLASS(obj)   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_MPRTPNETSIM))
+typedef struct _GstMprtpnetsim GstMprtpnetsim;
+typedef struct _GstMprtpnetsimClass GstMprtpnetsimClass;
+
+typedef enum{
+  MPRTPNETSIM_QUEUE_DROPTAIL = 0,
+  MPRTPNETSIM_QUEUE_CODEL    = 1,
+}MprtpNetsimQueueType;
+
+typedef struct _MprtpNetsimCapacity{
+  GstClockTime at;
+  guint        bandwidth;
+}MprtpNetsimCapacity;
+
+struct _GstMprtpnetsim
+{
+  GstElement              base_mprtpnetsim;
+  GstClock*               sysclock;
+  MPRTPClockProvider*     clock_provider;
+  GMutex                  mutex;
+  GCond                   cond;
+  GstPad*                 sinkpad;
+  GstPad*                 srcpad;
+
+  //Packets and serialized events waiting for their delivery time
+  GQueue*                 items;
+  GstClockID              clock_id;
+  gboolean                flushing;
+  GstFlowReturn           srcresult;
+  GRand*                  rand;
+
+  //Settings
+  guint32                 seed;
+  guint                   bandwidth;
+  GstClockTime            queue_limit;
+  MprtpNetsimQueueType    queue_type;
+  GstClockTime            delay;
+  GstClockTime            jitter;
+  gdouble                 ge_good_to_bad;
+  gdouble                 ge_bad_to_good;
+  gdouble                 ge_loss_good;
+  gdouble                 ge_loss_bad;
+  gchar*                  capacity_schedule;
+  MprtpNetsimCapacity*    schedule;
+  guint                   schedule_length;
+
+  //Link state
+  GstClockTime            started;
+  GstClockTime            link_free;
+  GstClockTime            last_delivery;
+  gboolean                ge_bad;
+  struct{
+    gboolean              dropping;
+    GstClockTime          first_above;
+    GstClockTime          drop_next;
+    guint32               count;
+  }codel;
+
+  guint64                 forwarded;
+  guint64                 queue_dropped;
+  guint64                 lost;
+};
+
+struct _GstMprtpnetsimClass
+{
+  GstElementClass base_mprtpnetsim_class;
+};
+
+GType gst_mprtpnetsim_get_type (void);
+
+G_END_DECLS
+#endif //_GST_MPRTPNETSIM_H_
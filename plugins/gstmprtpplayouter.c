@@ -40,6 +40,7 @@
 #include <gst/gst.h>
 #include <string.h>
 #include "gstmprtpplayouter.h"
+#include "mprtpclock.h"
 #include "gstmprtcpbuffer.h"
 #include "mprtprpath.h"
 #include "mprtpspath.h"
@@ -73,6 +74,17 @@ GST_DEBUG_CATEGORY_STATIC (gst_mprtpplayouter_debug_category);
 #define MPRTP_PLAYOUTER_DEFAULT_SSRC 0
 #define MPRTP_PLAYOUTER_DEFAULT_CLOCKRATE 90000
 
+//Stages of the latency tracing in the order packets pass them
+enum
+{
+  RCV_TRACE_ARRIVED = 0,
+  RCV_TRACE_RECEIVE,
+  RCV_TRACE_JOINER,
+  RCV_TRACE_RCVQUEUE,
+  RCV_TRACE_FEC,
+  RCV_TRACE_PLAYOUT,
+};
+
 
 static void gst_mprtpplayouter_set_property (GObject * object,
     guint property_id, const GValue * value, GParamSpec * pspec);
@@ -84,6 +96,7 @@ static void gst_mprtpplayouter_finalize (GObject * object);
 static GstStateChangeReturn
 gst_mprtpplayouter_change_state (GstElement * element,
     GstStateChange transition);
+static gboolean gst_mprtpplayouter_set_clock (GstElement * element, GstClock * clock);
 static gboolean gst_mprtpplayouter_query (GstElement * element,
     GstQuery * query);
 static GstFlowReturn gst_mprtpplayouter_mprtp_sink_chain (GstPad * pad,
@@ -99,6 +112,7 @@ static gboolean gst_mprtpplayouter_sink_event (GstPad * pad, GstObject * parent,
 static void
 gst_mprtpplayouter_mprtcp_sender (gpointer ptr, GstBuffer * buf);
 
+static GstBuffer *_restore_rtx_packet (GstMprtpplayouter * this, GstBuffer * buf);
 static void _processing_mprtp_packet (GstMprtpplayouter * mprtpr,
     GstBuffer * buf);
 static GstFlowReturn _processing_mprtcp_packet (GstMprtpplayouter * this,
@@ -117,11 +131,28 @@ _setup_paths_tresholds(
 static GstMpRTPBuffer *_make_mprtp_buffer(GstMprtpplayouter * this, GstBuffer *buffer);
 #define _trash_mprtp_buffer(this, mprtp) mprtp_free(mprtp)
 
-#define _now(this) gst_clock_get_time (this->sysclock)
+#define _now(this) mprtp_clock_get_time()
 
 static void
 _mprtpplayouter_process_run (void *data);
 
+static void
+_mprtpplayouter_wakeup (gpointer data);
+
+static void
+_mprtpplayouter_wakeup_on_arrival (GstMprtpplayouter * this);
+
+static GstBuffer *
+_mprtpplayouter_pop_repaired (GstMprtpplayouter * this, guint16 seq);
+
+static void
+_mprtpplayouter_push_frame (GstMprtpplayouter * this, GstBufferList * frame);
+
+//The playout task is woken up by packet arrivals and by the playout timer
+//armed to the deadline of the next packet in the rcvqueue. While packets are
+//held back in the joiner it is rechecked in this interval.
+#define JOINER_RECHECK_INTERVAL (5 * GST_MSECOND)
+
 enum
 {
   PROP_0,
@@ -149,7 +180,13 @@ enum
   PROP_SPIKE_VAR_TRESHOLD,
   PROP_REPAIR_WINDOW_MIN,
   PROP_REPAIR_WINDOW_MAX,
-
+  PROP_LATENCY_TRACING,
+  PROP_LATENCY_STATS,
+  PROP_JOINER_STATS,
+  PROP_RTX_PAYLOAD_TYPE,
+  PROP_NACK_REORDER_TRESHOLD,
+  PROP_RTX_STATS,
+  PROP_OWD_ACCURACY,
 };
 
 /* pad templates */
@@ -248,6 +285,53 @@ gst_mprtpplayouter_class_init (GstMprtpplayouterClass * klass)
           "Set the repair window maximum treshold for FEC recovery",
           0, 10000, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_LATENCY_TRACING,
+      g_param_spec_boolean ("latency-tracing",
+          "Trace the time packets spend in each stage of the playouter",
+          "Stamps every packet at the receiving, the joiner, the receive queue, the FEC decoder and the playout "
+          "and collects per subflow histograms of the stage latencies. Enabling it resets the histograms.",
+          FALSE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_LATENCY_STATS,
+      g_param_spec_string ("latency-stats",
+          "Stage latency statistics",
+          "CSV lines of subflow,stage,count,min_us,p50_us,p90_us,p99_us,max_us collected by latency-tracing",
+          NULL, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_JOINER_STATS,
+      g_param_spec_string ("joiner-stats",
+          "Reordering statistics of the joiner",
+          "CSV lines of join_delay_us,held_packets_avg,held_packets_max,samples averaged over the packets "
+          "received since the last read. Compares per packet and frame aware splitting of the sender.",
+          NULL, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_RTX_PAYLOAD_TYPE,
+      g_param_spec_uint ("rtx-payload-type",
+          "Set or get the payload type of RTX packets",
+          "Set or get the payload type of the RFC 4588 retransmissions. The default is 125",
+          0, 127, RTX_PAYLOAD_DEFAULT_ID, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_NACK_REORDER_TRESHOLD,
+      g_param_spec_uint ("nack-reorder-treshold",
+          "Reorder treshold of NACKs in ms",
+          "Subflow packets missing for longer than this are reported in generic NACKs and "
+          "the retransmissions are restored. 0 - no NACK",
+          0, 10000, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_RTX_STATS,
+      g_param_spec_string ("rtx-stats",
+          "Retransmission statistics",
+          "CSV of nacked,recovered_in_time,recovered_late,recovered_in_time_ratio packets. A retransmission "
+          "is in time if the joiner could still take it.",
+          NULL, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_OWD_ACCURACY,
+      g_param_spec_double ("owd-accuracy",
+          "Relative error of the OWD median of the feedbacks",
+          "The property value other than 0 tracks the OWD median the FBRA feedbacks report by a quantile sketch "
+          "with the given relative error instead of the exact one. It applies to the controlling modes set afterwards.",
+          0., .5, 0., G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   g_object_class_install_property (gobject_class, PROP_ABS_TIME_EXT_HEADER_ID,
       g_param_spec_uint ("abs-time-ext-header-id",
           "Set or get the id for the absolute time RTP extension",
@@ -327,17 +411,19 @@ gst_mprtpplayouter_class_init (GstMprtpplayouterClass * klass)
 
     g_object_class_install_property (gobject_class, PROP_PLAYOUT_LOW_WATERMARK,
            g_param_spec_uint ("playout-low-watermark",
-                              "set the low watermark at playoutqueue.",
-                              "set the low watermark at playoutqueue.",
+                              "set the minimal playout delay in ms.",
+                              "set the minimal playout delay in ms. Packets are played out when their RTP timestamp is due "
+                              "plus the join delay of the streamjoiner bounded by the low and high watermarks.",
                               0,
                               UINT_MAX, 0, G_PARAM_WRITABLE | G_PARAM_STATIC_STRINGS));
 
       g_object_class_install_property (gobject_class, PROP_PLAYOUT_HIGH_WATERMARK,
            g_param_spec_uint ("playout-high-watermark",
-                              "set the high watermark at playoutqueue.",
-                              "set the high watermark at playoutqueue.",
+                              "set the maximal playout delay in ms.",
+                              "set the maximal playout delay in ms. Packets are played out when their RTP timestamp is due "
+                              "plus the join delay of the streamjoiner bounded by the low and high watermarks. 0 means no bound.",
                               0,
-                              UINT_MAX, 0, G_PARAM_WRITABLE | G_PARAM_STATIC_STRINGS));
+                              UINT_MAX, 200, G_PARAM_WRITABLE | G_PARAM_STATIC_STRINGS));
 
       g_object_class_install_property (gobject_class, PROP_PLAYOUT_DESIRED_FRAMENUM,
            g_param_spec_uint ("playout-desired-framenum",
@@ -374,11 +460,12 @@ gst_mprtpplayouter_class_init (GstMprtpplayouterClass * klass)
       g_param_spec_uint ("setup-controlling-mode",
           "set the controlling mode to the subflow",
           "A 32bit unsigned integer for setup a target. The first 8 bit identifies the subflow, the latter the mode. "
-          "0 - no sending rate controller, 1 - no controlling, but sending SRs, 2 - FBRA with MARC",
+          "0 - no sending rate controller, 1 - no controlling, but sending SRs, 2 - FBRA with MARC, 3 - SCReAM",
           0, UINT_MAX, 0, G_PARAM_WRITABLE | G_PARAM_STATIC_STRINGS));
 
   element_class->change_state =
       GST_DEBUG_FUNCPTR (gst_mprtpplayouter_change_state);
+  element_class->set_clock = GST_DEBUG_FUNCPTR (gst_mprtpplayouter_set_clock);
   element_class->query = GST_DEBUG_FUNCPTR (gst_mprtpplayouter_query);
 }
 
@@ -386,7 +473,10 @@ gst_mprtpplayouter_class_init (GstMprtpplayouterClass * klass)
 static void
 gst_mprtpplayouter_init (GstMprtpplayouter * this)
 {
+  MPRTPClockProvider** clock;
   init_mprtp_logger();
+  //the helpers and timers made here read the clock of the element
+  clock = mprtp_clock_bind(&this->clock_provider);
 
   this->mprtp_sinkpad =
       gst_pad_new_from_static_template (&gst_mprtpplayouter_mprtp_sink_template,
@@ -429,26 +519,41 @@ gst_mprtpplayouter_init (GstMprtpplayouter * this)
   this->rtp_passthrough          = TRUE;
   this->mprtp_ext_header_id      = MPRTP_DEFAULT_EXTENSION_HEADER_ID;
   this->abs_time_ext_header_id   = ABS_TIME_DEFAULT_EXTENSION_HEADER_ID;
-  this->sysclock                 = gst_system_clock_obtain ();
   this->pivot_clock_rate         = MPRTP_PLAYOUTER_DEFAULT_CLOCKRATE;
   this->pivot_ssrc               = MPRTP_PLAYOUTER_DEFAULT_SSRC;
   this->paths                    = g_hash_table_new_full (NULL, NULL, NULL, mprtpr_path_destroy);
   this->rcvqueue                 = make_packetsrcvqueue();
   this->joiner                   = make_stream_joiner(this->rcvqueue);
+  this->tracer                   = make_latencytracer("arrived", "receive", "joiner", "rcvqueue", "fec", "playout", NULL);
   this->controller               = g_object_new(RCVCTRLER_TYPE, NULL);
   this->fec_payload_type         = FEC_PAYLOAD_DEFAULT_ID;
+  this->rtx_payload_type         = RTX_PAYLOAD_DEFAULT_ID;
+  this->rtx_apts                 = g_hash_table_new (NULL, NULL);
+  this->nacktracker              = make_nacktracker();
   this->pivot_address_subflow_id = 0;
   this->pivot_address            = NULL;
   this->fec_decoder              = make_fecdecoder();
+  this->repairer                 = make_fecrepairer(this->fec_decoder);
+  this->repaired                 = g_queue_new();
+  packetsrcvqueue_set_clock_rate(this->rcvqueue, this->pivot_clock_rate);
   this->expected_seq             = 0;
   this->expected_seq_init        = FALSE;
+  this->playout_signaled         = FALSE;
+  this->timerwheel               = timerwheel_obtain();
+  this->playout_timer            = timerwheel_add_oneshot(this->timerwheel,
+      GST_CLOCK_TIME_NONE, _mprtpplayouter_wakeup, this);
+
+  g_mutex_init (&this->playout_mutex);
+  g_cond_init (&this->playout_cond);
 
   rcvctrler_setup(this->controller, this->joiner, this->fec_decoder);
+  rcvctrler_setup_nack_tracker(this->controller, this->nacktracker);
   rcvctrler_setup_callbacks(this->controller, this, gst_mprtpplayouter_mprtcp_sender);
 
   fecdecoder_set_payload_type(this->fec_decoder, this->fec_payload_type);
   packetsrcvqueue_set_playout_allowed(this->rcvqueue, FALSE);
-
+  stream_joiner_set_tracer(this->joiner, this->tracer, RCV_TRACE_JOINER);
+  mprtp_clock_bind(clock);
 }
 
 
@@ -458,14 +563,21 @@ gst_mprtpplayouter_finalize (GObject * object)
   GstMprtpplayouter *this = GST_MPRTPPLAYOUTER (object);
 
   GST_DEBUG_OBJECT (this, "finalize");
+  timerwheel_remove (this->timerwheel, this->playout_timer);
+  g_object_unref (this->timerwheel);
   g_object_unref (this->joiner);
   g_object_unref (this->controller);
-  g_object_unref (this->sysclock);
+  g_object_unref (this->tracer);
+  g_object_unref (this->nacktracker);
 
   /* clean up object here */
   gst_task_join (this->thread);
   gst_object_unref (this->thread);
+  g_object_unref (this->repairer);
+  g_queue_free_full (this->repaired, (GDestroyNotify) gst_buffer_unref);
   g_hash_table_destroy (this->paths);
+  g_hash_table_destroy (this->rtx_apts);
+  mprtp_clock_provide (this, &this->clock_provider, NULL);
   G_OBJECT_CLASS (gst_mprtpplayouter_parent_class)->finalize (object);
 //  while(!g_queue_is_empty(this->mprtp_buffer_pool)){
 //    mprtp_free(g_queue_pop_head(this->mprtp_buffer_pool));
@@ -490,6 +602,7 @@ gst_mprtpplayouter_set_property (GObject * object, guint property_id,
     case PROP_MPRTP_EXT_HEADER_ID:
       THIS_WRITELOCK (this);
       this->mprtp_ext_header_id = (guint8) g_value_get_uint (value);
+      fecdecoder_set_mprtp_ext_header_id(this->fec_decoder, this->mprtp_ext_header_id);
       THIS_WRITEUNLOCK (this);
       break;
     case PROP_ABS_TIME_EXT_HEADER_ID:
@@ -511,6 +624,7 @@ gst_mprtpplayouter_set_property (GObject * object, guint property_id,
     case PROP_PIVOT_CLOCK_RATE:
       THIS_WRITELOCK (this);
       this->pivot_clock_rate = g_value_get_uint (value);
+      packetsrcvqueue_set_clock_rate(this->rcvqueue, this->pivot_clock_rate);
       THIS_WRITEUNLOCK (this);
       break;
     case PROP_JOIN_SUBFLOW:
@@ -637,6 +751,27 @@ gst_mprtpplayouter_set_property (GObject * object, guint property_id,
       fecdecoder_set_repair_window(this->fec_decoder, this->repair_window_min, this->repair_window_max);
       THIS_WRITEUNLOCK (this);
       break;
+    case PROP_LATENCY_TRACING:
+      gboolean_value = g_value_get_boolean (value);
+      if(gboolean_value){
+        latencytracer_reset(this->tracer);
+      }
+      latencytracer_set_enabled(this->tracer, gboolean_value);
+      break;
+    case PROP_RTX_PAYLOAD_TYPE:
+      THIS_WRITELOCK (this);
+      this->rtx_payload_type = (guint8) g_value_get_uint (value);
+      THIS_WRITEUNLOCK (this);
+      break;
+    case PROP_OWD_ACCURACY:
+      THIS_WRITELOCK (this);
+      this->owd_accuracy = g_value_get_double (value);
+      rcvctrler_setup_owd_accuracy(this->controller, this->owd_accuracy);
+      THIS_WRITEUNLOCK (this);
+      break;
+    case PROP_NACK_REORDER_TRESHOLD:
+      nacktracker_set_reorder_treshold(this->nacktracker, g_value_get_uint (value) * GST_MSECOND);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -707,6 +842,31 @@ gst_mprtpplayouter_get_property (GObject * object, guint property_id,
       g_value_set_uint (value, this->repair_window_max / GST_MSECOND);
       THIS_READUNLOCK (this);
       break;
+    case PROP_LATENCY_TRACING:
+      g_value_set_boolean (value, latencytracer_get_enabled(this->tracer));
+      break;
+    case PROP_LATENCY_STATS:
+      g_value_take_string (value, latencytracer_get_stats(this->tracer));
+      break;
+    case PROP_JOINER_STATS:
+      g_value_take_string (value, stream_joiner_get_stats(this->joiner));
+      break;
+    case PROP_RTX_PAYLOAD_TYPE:
+      THIS_READLOCK (this);
+      g_value_set_uint (value, (guint) this->rtx_payload_type);
+      THIS_READUNLOCK (this);
+      break;
+    case PROP_NACK_REORDER_TRESHOLD:
+      g_value_set_uint (value, (guint) GST_TIME_AS_MSECONDS(nacktracker_get_reorder_treshold(this->nacktracker)));
+      break;
+    case PROP_RTX_STATS:
+      g_value_take_string (value, nacktracker_get_stats(this->nacktracker));
+      break;
+    case PROP_OWD_ACCURACY:
+      THIS_READLOCK (this);
+      g_value_set_double (value, this->owd_accuracy);
+      THIS_READUNLOCK (this);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -813,6 +973,7 @@ gst_mprtpplayouter_sink_event (GstPad * pad, GstObject * parent,
       if (gst_structure_has_field (s, "clock-rate")) {
         gst_structure_get_int (s, "clock-rate", &gint_value);
         this->pivot_clock_rate = (guint32) gint_value;
+        packetsrcvqueue_set_clock_rate(this->rcvqueue, this->pivot_clock_rate);
       }
       if (gst_structure_has_field (s, "clock-base")) {
         gst_structure_get_uint (s, "clock-base", &guint_value);
@@ -897,6 +1058,17 @@ exit:
 
 
 
+static gboolean
+gst_mprtpplayouter_set_clock (GstElement * element, GstClock * clock)
+{
+  GST_DEBUG_OBJECT (element, "set_clock %" GST_PTR_FORMAT, clock);
+  //helper objects read the provider of the earliest element registered
+  mprtp_clock_provide (element, &GST_MPRTPPLAYOUTER (element)->clock_provider, clock);
+
+  return GST_ELEMENT_CLASS (gst_mprtpplayouter_parent_class)->set_clock (element,
+      clock);
+}
+
 static GstStateChangeReturn
 gst_mprtpplayouter_change_state (GstElement * element,
     GstStateChange transition)
@@ -916,6 +1088,7 @@ gst_mprtpplayouter_change_state (GstElement * element,
     case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
         gst_task_set_lock (this->thread, &this->thread_mutex);
         gst_task_start (this->thread);
+        fecrepairer_start (this->repairer);
         packetsrcvqueue_set_playout_allowed(this->rcvqueue, TRUE);
         break;
       default:
@@ -930,6 +1103,9 @@ gst_mprtpplayouter_change_state (GstElement * element,
       case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
         packetsrcvqueue_set_playout_allowed(this->rcvqueue, FALSE);
         gst_task_stop (this->thread);
+        fecrepairer_stop (this->repairer);
+        timerwheel_disarm (this->timerwheel, this->playout_timer);
+        _mprtpplayouter_wakeup (this);
         break;
     case GST_STATE_CHANGE_PAUSED_TO_READY:
       break;
@@ -984,10 +1160,12 @@ gst_mprtpplayouter_mprtp_sink_chain (GstPad * pad, GstObject * parent,
   GstMapInfo info;
   guint8 *data;
   GstFlowReturn result = GST_FLOW_OK;
+  MPRTPClockProvider** clock;
 
   this = GST_MPRTPPLAYOUTER (parent);
   GST_DEBUG_OBJECT (this, "RTP/RTCP/MPRTP/MPRTCP sink");
 //  g_print("START PROCESSING RTP\n");
+  clock = mprtp_clock_bind(&this->clock_provider);
   THIS_READLOCK (this);
   if(!GST_IS_BUFFER(buf)){
     GST_WARNING("The arrived buffer is not a buffer.");
@@ -1022,6 +1200,7 @@ gst_mprtpplayouter_mprtp_sink_chain (GstPad * pad, GstObject * parent,
   result = GST_FLOW_OK;
 done:
   THIS_READUNLOCK (this);
+  mprtp_clock_bind(clock);
 //  g_print("END PROCESSING RTP\n");
   return result;
 
@@ -1036,9 +1215,11 @@ gst_mprtpplayouter_mprtcp_sr_sink_chain (GstPad * pad, GstObject * parent,
   GstMapInfo info;
   GstFlowReturn result;
   guint8 *data;
+  MPRTPClockProvider** clock;
 
   this = GST_MPRTPPLAYOUTER (parent);
   GST_DEBUG_OBJECT (this, "RTCP/MPRTCP sink");
+  clock = mprtp_clock_bind(&this->clock_provider);
   THIS_READLOCK (this);
   if (!gst_buffer_map (buf, &info, GST_MAP_READ)) {
     GST_WARNING ("Buffer is not readable");
@@ -1058,6 +1239,7 @@ gst_mprtpplayouter_mprtcp_sr_sink_chain (GstPad * pad, GstObject * parent,
 
 done:
   THIS_READUNLOCK (this);
+  mprtp_clock_bind(clock);
   return result;
 
 }
@@ -1089,7 +1271,12 @@ _processing_mprtp_packet (GstMprtpplayouter * this, GstBuffer * buf)
   MpRTPRPath *path = NULL;
   GstNetAddressMeta *meta;
   GstMpRTPBuffer *mprtp = NULL;
+  guint64 entered = 0;
+  gboolean retransmitted = FALSE, accepted;
 
+  if(latencytracer_get_enabled(this->tracer)){
+    entered = latencytracer_now();
+  }
   mprtp = _make_mprtp_buffer(this, buf);
   if (this->pivot_ssrc != MPRTP_PLAYOUTER_DEFAULT_SSRC &&
       mprtp->ssrc != this->pivot_ssrc) {
@@ -1102,6 +1289,22 @@ _processing_mprtp_packet (GstMprtpplayouter * this, GstBuffer * buf)
     return;
   }
 
+  //RTX packets duplicate the sequence number of the original one, they
+  //must not leave the element unrestored
+  if(mprtp->payload_type == this->rtx_payload_type){
+    _trash_mprtp_buffer(this, mprtp);
+    if(nacktracker_get_reorder_treshold(this->nacktracker) == 0){
+      gst_buffer_unref(buf);
+      return;
+    }
+    buf = _restore_rtx_packet(this, buf);
+    if(!buf){
+      return;
+    }
+    mprtp = _make_mprtp_buffer(this, buf);
+    retransmitted = TRUE;
+  }
+
   //to avoid the check_collision problem in rtpsession.
   meta = gst_buffer_get_net_address_meta (buf);
   if (meta) {
@@ -1128,18 +1331,73 @@ _processing_mprtp_packet (GstMprtpplayouter * this, GstBuffer * buf)
 
   if(mprtp->fec_packet){
     if(0 < this->repair_window_max){
-      fecdecoder_add_fec_packet(this->fec_decoder, mprtp);
+      fecrepairer_add_packet(this->repairer, mprtp);
     }
     _trash_mprtp_buffer(this, mprtp);
   }else{
+    //FEC packets have their own sequence space, only media packets are traced
+    if(entered){
+      latencytracer_begin(this->tracer, mprtp->abs_seq, mprtp->subflow_id, entered);
+    }
     if(0 < this->repair_window_max){
-      fecdecoder_add_rtp_packet(this->fec_decoder, mprtp);
+      fecrepairer_add_packet(this->repairer, mprtp);
+    }
+    if(!retransmitted){
+      g_hash_table_insert(this->rtx_apts, GUINT_TO_POINTER(mprtp->ssrc),
+                          GUINT_TO_POINTER((guint) mprtp->payload_type + 1));
     }
-    stream_joiner_push(this->joiner, mprtp);
+    nacktracker_add(this->nacktracker, mprtp->subflow_id, mprtp->subflow_seq);
+    latencytracer_stamp(this->tracer, mprtp->abs_seq, RCV_TRACE_RECEIVE);
+    accepted = stream_joiner_push(this->joiner, mprtp);
+    if(retransmitted){
+      nacktracker_add_recovered(this->nacktracker, accepted);
+    }
+    _mprtpplayouter_wakeup_on_arrival(this);
   }
   return;
 }
 
+//The RTX payload starts with the original sequence number, the payload
+//type is the one of the media packets of the same SSRC
+GstBuffer *
+_restore_rtx_packet (GstMprtpplayouter * this, GstBuffer * buf)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  guint8 *payload;
+  guint payload_len, apt;
+  guint16 osn;
+
+  buf = gst_buffer_make_writable (buf);
+  if (G_UNLIKELY (!gst_rtp_buffer_map (buf, GST_MAP_READWRITE, &rtp))) {
+    GST_WARNING_OBJECT (this, "The RTX packet is not writeable");
+    gst_buffer_unref (buf);
+    return NULL;
+  }
+  payload_len = gst_rtp_buffer_get_payload_len (&rtp);
+  if (payload_len < 2 || gst_rtp_buffer_get_padding (&rtp)) {
+    GST_WARNING_OBJECT (this, "Malformed RTX packet");
+    gst_rtp_buffer_unmap (&rtp);
+    gst_buffer_unref (buf);
+    return NULL;
+  }
+  apt = GPOINTER_TO_UINT (g_hash_table_lookup (this->rtx_apts,
+          GUINT_TO_POINTER (gst_rtp_buffer_get_ssrc (&rtp))));
+  if (!apt) {
+    GST_DEBUG_OBJECT (this, "No media packet is received of the RTX SSRC yet");
+    gst_rtp_buffer_unmap (&rtp);
+    gst_buffer_unref (buf);
+    return NULL;
+  }
+  payload = gst_rtp_buffer_get_payload (&rtp);
+  memcpy (&osn, payload, 2);
+  memmove (payload, payload + 2, payload_len - 2);
+  gst_rtp_buffer_set_seq (&rtp, g_ntohs (osn));
+  gst_rtp_buffer_set_payload_type (&rtp, apt - 1);
+  gst_rtp_buffer_unmap (&rtp);
+  gst_buffer_set_size (buf, gst_buffer_get_size (buf) - 2);
+  return buf;
+}
+
 gboolean
 _try_get_path (GstMprtpplayouter * this, guint16 subflow_id,
     MpRTPRPath ** result)
@@ -1183,36 +1441,116 @@ _cmp_seq (guint16 x, guint16 y)
   return 0;
 }
 
+void
+_mprtpplayouter_wakeup (gpointer data)
+{
+  GstMprtpplayouter *this = data;
+  g_mutex_lock (&this->playout_mutex);
+  this->playout_signaled = TRUE;
+  g_cond_signal (&this->playout_cond);
+  g_mutex_unlock (&this->playout_mutex);
+}
+
+//The playout thread transfers the joiner in every JOINER_RECHECK_INTERVAL
+//while it is not empty, so an arrival signals it only if the timer is not
+//armed or armed for later. The thread arms the timer under the same lock
+//after it checked the joiner, so an arrival is not missed between them.
+void
+_mprtpplayouter_wakeup_on_arrival (GstMprtpplayouter * this)
+{
+  GstClockTime remaining;
+  g_mutex_lock (&this->playout_mutex);
+  if(!this->playout_signaled){
+    remaining = timerwheel_get_remaining(this->timerwheel, this->playout_timer);
+    if(!GST_CLOCK_TIME_IS_VALID(remaining) || JOINER_RECHECK_INTERVAL < remaining){
+      this->playout_signaled = TRUE;
+      g_cond_signal (&this->playout_cond);
+    }
+  }
+  g_mutex_unlock (&this->playout_mutex);
+}
+
+static guint16
+_buffer_seq (GstBuffer * buffer)
+{
+  guint16 seq = 0;
+  gst_buffer_extract (buffer, 2, &seq, 2);
+  return g_ntohs(seq);
+}
+
+static gint
+_cmp_repaired (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+  return _cmp_seq(_buffer_seq((GstBuffer *) a), _buffer_seq((GstBuffer *) b));
+}
+
+//The repaired packet preceding the one played out next. The repairs come
+//from the worker in the order of the segments, not of the packets.
+GstBuffer *
+_mprtpplayouter_pop_repaired (GstMprtpplayouter * this, guint16 seq)
+{
+  GstBuffer *repaired;
+  guint16 repaired_seq;
+  gint cmp;
+
+  while((repaired = fecrepairer_pop(this->repairer)) != NULL){
+    g_queue_insert_sorted(this->repaired, repaired, _cmp_repaired, NULL);
+  }
+again:
+  repaired = g_queue_peek_head(this->repaired);
+  if(!repaired){
+    return NULL;
+  }
+  repaired_seq = _buffer_seq(repaired);
+  cmp = _cmp_seq(repaired_seq, seq);
+  if(0 < cmp){
+    return NULL;
+  }
+  g_queue_pop_head(this->repaired);
+  //the packet itself arrived after all, or the playout already went past it
+  //with the original or a retransmitted copy
+  if(cmp == 0 || (this->expected_seq_init && _cmp_seq(repaired_seq, this->expected_seq) < 0)){
+    gst_buffer_unref(repaired);
+    goto again;
+  }
+  return repaired;
+}
+
 void
 _mprtpplayouter_process_run (void *data)
 {
   GstMprtpplayouter *this;
-  GstClockID clock_id;
-  GstClockTime next_scheduler_time;
   GstMpRTPBuffer *mprtp;
   GstBuffer *buffer = NULL;
   GstBuffer *repairedbuf = NULL;
-  GstClockTime now;
+  GstBufferList *frame = NULL;
+  guint32 frame_ts = 0;
+  GstClockTime wait;
+  guint16 seq;
+  MPRTPClockProvider** clock;
 
   this = (GstMprtpplayouter *) data;
 
-  THIS_READLOCK (this);
-  now = _now(this);
-  //Todo: we need more time than one msecond, so it will sleep with the rate.
-  next_scheduler_time = _now(this) + 1 * GST_MSECOND;
-  if(this->last_fec_clean < now - 200 * GST_MSECOND){
-    fecdecoder_clean(this->fec_decoder);
-    this->last_fec_clean = now;
+  g_mutex_lock (&this->playout_mutex);
+  while(!this->playout_signaled && gst_task_get_state(this->thread) == GST_TASK_STARTED){
+    g_cond_wait (&this->playout_cond, &this->playout_mutex);
   }
+  this->playout_signaled = FALSE;
+  g_mutex_unlock (&this->playout_mutex);
 
+  clock = mprtp_clock_bind(&this->clock_provider);
+  THIS_READLOCK (this);
   stream_joiner_transfer(this->joiner);
+  packetsrcvqueue_set_target_delay(this->rcvqueue, stream_joiner_get_join_delay(this->joiner));
   //flush the urgent queue
   for(mprtp = packetsrcvqueue_pop_discarded(this->rcvqueue); mprtp;
       mprtp = packetsrcvqueue_pop_discarded(this->rcvqueue)){
       buffer = mprtp->buffer;
+      seq    = mprtp->abs_seq;
       _trash_mprtp_buffer(this, mprtp);
 //      g_print("pushed urgently towards %d-%hu-%hu\n", mprtp->subflow_id, mprtp->subflow_seq, mprtp->abs_seq);
       gst_pad_push (this->mprtp_srcpad, buffer);
+      latencytracer_finish(this->tracer, seq);
   }
 
 again:
@@ -1221,15 +1559,32 @@ again:
     goto done;
   }
   buffer = mprtp->buffer;
+  seq    = mprtp->abs_seq;
+  latencytracer_stamp(this->tracer, seq, RCV_TRACE_RCVQUEUE);
+  //the repair worker made them, they are only merged here
+  while((repairedbuf = _mprtpplayouter_pop_repaired(this, seq)) != NULL){
+    if(!frame){
+      frame    = gst_buffer_list_new();
+      frame_ts = mprtp->timestamp;
+    }
+    gst_buffer_list_add(frame, repairedbuf);
+  }
+  latencytracer_stamp(this->tracer, seq, RCV_TRACE_FEC);
+  //packets of a frame are due together and pushed in one list
+  if(frame && frame_ts != mprtp->timestamp){
+    _mprtpplayouter_push_frame(this, frame);
+    frame = NULL;
+  }
+  if(!frame){
+    frame    = gst_buffer_list_new();
+    frame_ts = mprtp->timestamp;
+  }
 
   if(!this->expected_seq_init){
     this->expected_seq_init = TRUE;
     this->expected_seq = mprtp->abs_seq;
   }
 
-  while(fecdecoder_has_repaired_rtpbuffer(this->fec_decoder, this->expected_seq, &repairedbuf)){
-    gst_pad_push(this->mprtp_srcpad, repairedbuf);
-  }
   if(mprtp->abs_seq != this->expected_seq){
     if(_cmp_seq(this->expected_seq, mprtp->abs_seq) < 0){
       this->expected_seq = mprtp->abs_seq + 1;
@@ -1237,6 +1592,7 @@ again:
   }else{
       ++this->expected_seq;
   }
+  fecrepairer_set_played_seq(this->repairer, this->expected_seq);
 //  g_print("pushed normally towards %d-%hu-%hu\n", mprtp->subflow_id, mprtp->subflow_seq, mprtp->abs_seq);
   _trash_mprtp_buffer(this, mprtp);
   if(!buffer) {
@@ -1246,17 +1602,50 @@ again:
 //    gst_buffer_unref(buffer);
 //  }
 
-  gst_pad_push (this->mprtp_srcpad, buffer);
+  gst_buffer_list_add(frame, buffer);
 //  goto done;
   goto again;
 done:
-  clock_id = gst_clock_new_single_shot_id (this->sysclock, next_scheduler_time);
+  if(frame){
+    _mprtpplayouter_push_frame(this, frame);
+  }
+  //sleep until the next packet is due
+  wait = packetsrcvqueue_get_playout_wait(this->rcvqueue);
+  g_mutex_lock (&this->playout_mutex);
+  if(!stream_joiner_is_empty(this->joiner)){
+    wait = MIN(wait, JOINER_RECHECK_INTERVAL);
+  }
+  if(GST_CLOCK_TIME_IS_VALID(wait)){
+    timerwheel_rearm_in(this->timerwheel, this->playout_timer, wait);
+  }
+  g_mutex_unlock (&this->playout_mutex);
   THIS_READUNLOCK (this);
+  mprtp_clock_bind(clock);
+}
+
+static gboolean
+_finish_traced (GstBuffer ** buffer, guint idx, gpointer user_data)
+{
+  GstMprtpplayouter *this = user_data;
+  latencytracer_finish(this->tracer, _buffer_seq(*buffer));
+  return TRUE;
+}
 
-  if (gst_clock_id_wait (clock_id, NULL) == GST_CLOCK_UNSCHEDULED) {
-    GST_WARNING_OBJECT (this, "The scheduler clock wait is interrupted");
+void
+_mprtpplayouter_push_frame (GstMprtpplayouter * this, GstBufferList * frame)
+{
+  if(!gst_buffer_list_length(frame)){
+    gst_buffer_list_unref(frame);
+    return;
+  }
+  if(!latencytracer_get_enabled(this->tracer)){
+    gst_pad_push_list (this->mprtp_srcpad, frame);
+    return;
   }
-  gst_clock_id_unref (clock_id);
+  gst_buffer_list_ref(frame);
+  gst_pad_push_list (this->mprtp_srcpad, frame);
+  gst_buffer_list_foreach(frame, _finish_traced, this);
+  gst_buffer_list_unref(frame);
 }
 
 #undef THIS_READLOCK
@@ -28,6 +28,11 @@
 #include "gstmprtpbuffer.h"
 #include "rcvctrler.h"
 #include "fecdec.h"
+#include "fecrepairer.h"
+#include "timerwheel.h"
+#include "latencytracer.h"
+#include "nacktracker.h"
+#include "mprtpclock.h"
 
 #if GLIB_CHECK_VERSION (2, 35, 7)
 #include <gio/gnetworking.h>
@@ -72,6 +77,11 @@ struct _GstMprtpplayouter
   GSocketAddress *pivot_address;
   guint8          pivot_address_subflow_id;
   guint8          fec_payload_type;
+  guint8          rtx_payload_type;
+  //payload type + 1 of the media packets per SSRC, the retransmissions
+  //of the SSRC are restored to it
+  GHashTable*     rtx_apts;
+  gdouble         owd_accuracy;
   guint64         clock_base;
   gboolean        auto_rate_and_cc;
   gboolean        rtp_passthrough;
@@ -92,18 +102,28 @@ struct _GstMprtpplayouter
   StreamJoiner*   joiner;
   gboolean          logging;
   RcvController*    controller;
-  GstClock*       sysclock;
 
   guint           subflows_num;
   FECDecoder*     fec_decoder;
-  GstClockTime    last_fec_clean;
+  FECRepairer*    repairer;
+  //repaired packets waiting for the packet they precede, sorted by seq
+  GQueue*         repaired;
   guint16         expected_seq;
   gboolean        expected_seq_init;
   guint32         rtcp_sent_octet_sum;
+  LatencyTracer*  tracer;
+  NACKTracker*    nacktracker;
 
   GstTask*                      thread;
   GRecMutex                     thread_mutex;
+  GMutex                        playout_mutex;
+  GCond                         playout_cond;
+  gboolean                      playout_signaled;
 
+  TimerWheel*                   timerwheel;
+  TimerWheelTimer*              playout_timer;
+
+  MPRTPClockProvider*           clock_provider;
 };
 
 struct _GstMprtpplayouterClass
@@ -50,6 +50,10 @@
 #include "gstmprtpsender.h"
 #include "gstmprtpplayouter.h"
 #include "gstmprtpreceiver.h"
+#include "gstscreamqueue.h"
+#include "gstmprtpnetsim.h"
+#include "gstmprtpudpsink.h"
+#include "gstmprtpudpsrc.h"
 
 static gboolean
 plugin_init (GstPlugin * plugin)
@@ -62,6 +66,14 @@ plugin_init (GstPlugin * plugin)
       GST_TYPE_MPRTPPLAYOUTER);
   gst_element_register (plugin, "mprtpreceiver", GST_RANK_NONE,
       GST_TYPE_MPRTPRECEIVER);
+  gst_element_register (plugin, "screamqueue", GST_RANK_NONE,
+      GST_TYPE_SCREAM_QUEUE);
+  gst_element_register (plugin, "mprtpnetsim", GST_RANK_NONE,
+      GST_TYPE_MPRTPNETSIM);
+  gst_element_register (plugin, "mprtpudpsink", GST_RANK_NONE,
+      GST_TYPE_MPRTPUDPSINK);
+  gst_element_register (plugin, "mprtpudpsrc", GST_RANK_NONE,
+      GST_TYPE_MPRTPUDPSRC);
   return TRUE;
 }
 
@@ -38,6 +38,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "gstmprtpreceiver.h"
+#include "mprtpclock.h"
 #include "mprtpspath.h"
 #include "mprtprpath.h"
 #include "gstmprtcpbuffer.h"
@@ -55,7 +56,7 @@ GST_DEBUG_CATEGORY_STATIC (gst_mprtpreceiver_debug_category);
 #define PACKET_IS_RTCP(b) (b > 192 && b < 223)
 #define PACKET_IS_DTLS(b) (b > 0x13 && b < 0x40)
 
-#define _now(this) gst_clock_get_time (this->sysclock)
+#define _now(this) mprtp_clock_get_time()
 
 typedef struct
 {
@@ -77,6 +78,7 @@ static void gst_mprtpreceiver_release_pad (GstElement * element, GstPad * pad);
 static GstStateChangeReturn
 gst_mprtpreceiver_change_state (GstElement * element,
     GstStateChange transition);
+static gboolean gst_mprtpreceiver_set_clock (GstElement * element, GstClock * clock);
 static gboolean gst_mprtpreceiver_query (GstElement * element,
     GstQuery * query);
 static gboolean gst_mprtpreceiver_sink_query (GstPad * pad, GstObject * parent,
@@ -88,10 +90,12 @@ static gboolean gst_mprtpreceiver_sink_event (GstPad * pad, GstObject * parent,
 static GstPadLinkReturn gst_mprtpreceiver_sink_link (GstPad * pad,
     GstObject * parent, GstPad * peer);
 static void gst_mprtpreceiver_sink_unlink (GstPad * pad, GstObject * parent);
+static GstFlowReturn gst_mprtpreceiver_sink_chain_list (GstPad * pad,
+    GstObject * parent, GstBufferList * list);
 static GstFlowReturn gst_mprtpreceiver_sink_chain (GstPad * pad,
     GstObject * parent, GstBuffer * buffer);
 
-GstFlowReturn _send_mprtcp_buffer (GstMprtpreceiver * this, GstBuffer * buf);
+GstPad *_get_mprtcp_srcpad (GstMprtpreceiver * this, GstBuffer * buf);
 enum
 {
   PROP_0,
@@ -199,6 +203,7 @@ gst_mprtpreceiver_class_init (GstMprtpreceiverClass * klass)
       GST_DEBUG_FUNCPTR (gst_mprtpreceiver_release_pad);
   element_class->change_state =
       GST_DEBUG_FUNCPTR (gst_mprtpreceiver_change_state);
+  element_class->set_clock = GST_DEBUG_FUNCPTR (gst_mprtpreceiver_set_clock);
   element_class->query = GST_DEBUG_FUNCPTR (gst_mprtpreceiver_query);
 
 
@@ -233,7 +238,6 @@ gst_mprtpreceiver_init (GstMprtpreceiver * mprtpreceiver)
   mprtpreceiver->only_report_receiving = FALSE;
   mprtpreceiver->mprtp_ext_header_id = MPRTP_DEFAULT_EXTENSION_HEADER_ID;
   mprtpreceiver->fec_payload_type = FEC_PAYLOAD_DEFAULT_ID;
-  mprtpreceiver->sysclock = gst_system_clock_obtain();
 
 }
 
@@ -316,7 +320,7 @@ gst_mprtpreceiver_finalize (GObject * object)
   GST_DEBUG_OBJECT (mprtpreceiver, "finalize");
 
   /* clean up object here */
-  gst_object_unref(mprtpreceiver->sysclock);
+  mprtp_clock_provide (mprtpreceiver, &mprtpreceiver->clock_provider, NULL);
   G_OBJECT_CLASS (gst_mprtpreceiver_parent_class)->finalize (object);
 }
 
@@ -356,6 +360,8 @@ gst_mprtpreceiver_request_new_pad (GstElement * element, GstPadTemplate * templ,
       GST_DEBUG_FUNCPTR (gst_mprtpreceiver_sink_unlink));
   gst_pad_set_chain_function (sinkpad,
       GST_DEBUG_FUNCPTR (gst_mprtpreceiver_sink_chain));
+  gst_pad_set_chain_list_function (sinkpad,
+      GST_DEBUG_FUNCPTR (gst_mprtpreceiver_sink_chain_list));
 
   for(it = this->subflows; it; it = it->next){
     subflow = it->data;
@@ -477,6 +483,17 @@ gst_mprtpreceiver_release_pad (GstElement * element, GstPad * pad)
 
 }
 
+static gboolean
+gst_mprtpreceiver_set_clock (GstElement * element, GstClock * clock)
+{
+  GST_DEBUG_OBJECT (element, "set_clock %" GST_PTR_FORMAT, clock);
+  //helper objects read the provider of the earliest element registered
+  mprtp_clock_provide (element, &GST_MPRTPRECEIVER (element)->clock_provider, clock);
+
+  return GST_ELEMENT_CLASS (gst_mprtpreceiver_parent_class)->set_clock (element,
+      clock);
+}
+
 static GstStateChangeReturn
 gst_mprtpreceiver_change_state (GstElement * element, GstStateChange transition)
 {
@@ -634,48 +651,108 @@ done:
 }
 
 
-static GstFlowReturn
-gst_mprtpreceiver_sink_chain (GstPad * pad, GstObject * parent, GstBuffer * buf)
+//Selects the srcpad the packet is forwarded on, NULL if it is not readable.
+//Must be called with the read lock held.
+static GstPad *
+_select_srcpad (GstMprtpreceiver * this, GstBuffer * buf)
 {
-  GstMprtpreceiver *this;
-  GstFlowReturn result;
   GstMapInfo map;
   PacketTypes packet_type;
   guint8 subflow_id = 0;
+  GstPad *result;
 
-  this = GST_MPRTPRECEIVER (parent);
-  GST_DEBUG_OBJECT (this, "RTP/MPRTP/OTHER sink");
   if (!gst_buffer_map (buf, &map, GST_MAP_READ)) {
     GST_ERROR_OBJECT (this, "Buffer is not readable");
-    result = GST_FLOW_CUSTOM_ERROR;
-    goto exit;
+    return NULL;
   }
-
-  THIS_READLOCK (this);
-
   packet_type = _get_packet_mptype (this, buf, &map, &subflow_id);
+  gst_buffer_unmap (buf, &map);
   if (packet_type == PACKET_IS_MPRTCP) {
-    result = _send_mprtcp_buffer (this, buf);
+    result = _get_mprtcp_srcpad (this, buf);
   } else if(packet_type == PACKET_IS_MPRTP_MONITORING){
-    gst_buffer_unmap (buf, &map);
-    result = gst_pad_push (this->mprtcp_sr_srcpad, buf);
+    result = this->mprtcp_sr_srcpad;
   }else{
-    gst_buffer_unmap (buf, &map);
-    result = gst_pad_push (this->mprtp_srcpad, buf);
+    result = this->mprtp_srcpad;
+  }
+  return result;
+}
+
+static GstFlowReturn
+gst_mprtpreceiver_sink_chain (GstPad * pad, GstObject * parent, GstBuffer * buf)
+{
+  GstMprtpreceiver *this;
+  GstFlowReturn result;
+  GstPad *srcpad;
+
+  this = GST_MPRTPRECEIVER (parent);
+  GST_DEBUG_OBJECT (this, "RTP/MPRTP/OTHER sink");
+
+  THIS_READLOCK (this);
+  srcpad = _select_srcpad (this, buf);
+  if (!srcpad) {
+    gst_buffer_unref (buf);
+    result = GST_FLOW_CUSTOM_ERROR;
+    goto done;
   }
+  result = gst_pad_push (srcpad, buf);
+done:
+  THIS_READUNLOCK (this);
+  return result;
+}
 
+//The packets of a list, read together from one subflow socket, are
+//classified in one go and forwarded as one list per srcpad.
+static GstFlowReturn
+gst_mprtpreceiver_sink_chain_list (GstPad * pad, GstObject * parent,
+    GstBufferList * list)
+{
+  GstMprtpreceiver *this;
+  GstFlowReturn result = GST_FLOW_OK, flow;
+  GstPad *srcpads[3];
+  GstBufferList *lists[3] = {NULL, NULL, NULL};
+  GstBuffer *buf;
+  GstPad *srcpad;
+  guint i, j, length;
+
+  this = GST_MPRTPRECEIVER (parent);
+  length = gst_buffer_list_length (list);
+
+  THIS_READLOCK (this);
+  srcpads[0] = this->mprtp_srcpad;
+  srcpads[1] = this->mprtcp_sr_srcpad;
+  srcpads[2] = this->mprtcp_rr_srcpad;
+  for (i = 0; i < length; ++i) {
+    buf = gst_buffer_list_get (list, i);
+    srcpad = _select_srcpad (this, buf);
+    if (!srcpad) {
+      continue;
+    }
+    for (j = 0; srcpads[j] != srcpad; ++j);
+    if (!lists[j]) {
+      lists[j] = gst_buffer_list_new_sized (length);
+    }
+    gst_buffer_list_add (lists[j], gst_buffer_ref (buf));
+  }
+  for (j = 0; j < 3; ++j) {
+    if (!lists[j]) {
+      continue;
+    }
+    flow = gst_pad_push_list (srcpads[j], lists[j]);
+    if (j == 0) {
+      result = flow;
+    }
+  }
   THIS_READUNLOCK (this);
-exit:
+  gst_buffer_list_unref (list);
   return result;
 }
 
 
 
 
-GstFlowReturn
-_send_mprtcp_buffer (GstMprtpreceiver * this, GstBuffer * buf)
+GstPad *
+_get_mprtcp_srcpad (GstMprtpreceiver * this, GstBuffer * buf)
 {
-  GstFlowReturn result = GST_FLOW_OK;
   GstPad *outpad;
   GstRTCPBuffer rtcp = { NULL, };
   GstRTCPHeader *header;
@@ -689,7 +766,7 @@ _send_mprtcp_buffer (GstMprtpreceiver * this, GstBuffer * buf)
 
   if (G_UNLIKELY (!gst_rtcp_buffer_map (buf, GST_MAP_READ, &rtcp))) {
     GST_WARNING_OBJECT (this, "The RTCP packet is not readable");
-    return result;
+    return this->mprtcp_rr_srcpad;
   }
   report = (GstMPRTCPSubflowReport *) gst_rtcp_get_first_header (&rtcp);
   block = gst_mprtcp_get_first_block (report);
@@ -706,8 +783,8 @@ _send_mprtcp_buffer (GstMprtpreceiver * this, GstBuffer * buf)
       processed_length +=actual_length + 1;
       header = actual = processed_length * 4 + (gchar*)databed;
   }
-  result = gst_pad_push (outpad, buf);
-  return result;
+  gst_rtcp_buffer_unmap (&rtcp);
+  return outpad;
 }
 
 
@@ -21,6 +21,7 @@
 #define _GST_MPRTPRECEIVER_H_
 
 #include <gst/gst.h>
+#include "mprtpclock.h"
 
 G_BEGIN_DECLS
 #define GST_TYPE_MPRTPRECEIVER   (gst_mprtpreceiver_get_type())
@@ -34,7 +35,6 @@ typedef struct _GstMprtpreceiverClass GstMprtpreceiverClass;
 struct _GstMprtpreceiver
 {
   GstElement base_mprtpreceiver;
-  GstClock *sysclock;
   GRWLock rwmutex;
   GList*  subflows;
   GstPad* mprtp_srcpad;
@@ -45,6 +45,7 @@ struct _GstMprtpreceiver
   guint8  mprtp_ext_header_id;
   guint8  fec_payload_type;
 
+  MPRTPClockProvider* clock_provider;
 };
 
 struct _GstMprtpreceiverClass
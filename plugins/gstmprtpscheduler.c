@@ -39,10 +39,12 @@
 #include <string.h>
 #include <gst/gst.h>
 #include "gstmprtpscheduler.h"
+#include "mprtpclock.h"
 #include "mprtpspath.h"
 #include "streamsplitter.h"
 #include "gstmprtcpbuffer.h"
 #include "sndctrler.h"
+#include "mprtptxtime.h"
 #ifdef __APPLE__
 #include <sys/time.h>
 #else
@@ -59,7 +61,7 @@ GST_DEBUG_CATEGORY_STATIC (gst_mprtpscheduler_debug_category);
 #define THIS_READLOCK(this) (g_rw_lock_reader_lock(&this->rwmutex))
 #define THIS_READUNLOCK(this) (g_rw_lock_reader_unlock(&this->rwmutex))
 
-#define _now(this) gst_clock_get_time (this->sysclock)
+#define _now(this) mprtp_clock_get_time()
 
 static void gst_mprtpscheduler_set_property (GObject * object,
     guint property_id, const GValue * value, GParamSpec * pspec);
@@ -71,6 +73,7 @@ static void gst_mprtpscheduler_finalize (GObject * object);
 static GstStateChangeReturn
 gst_mprtpscheduler_change_state (GstElement * element,
     GstStateChange transition);
+static gboolean gst_mprtpscheduler_set_clock (GstElement * element, GstClock * clock);
 static gboolean gst_mprtpscheduler_query (GstElement * element,
     GstQuery * query);
 static void
@@ -104,8 +107,28 @@ static gboolean gst_mprtpscheduler_mprtp_src_event (GstPad * pad,
 static gboolean gst_mprtpscheduler_sink_eventfunc (GstPad * srckpad, GstObject * parent,
                                                    GstEvent * event);
 static void _setup_paths (GstMprtpscheduler * this);
+static void _setup_streams (GstMprtpscheduler * this, const gchar *streams);
 static gboolean _mprtpscheduler_send_buffer (GstMprtpscheduler * this, GstBuffer *buffer);
-static void _mprtpscheduler_process_run(void *data);
+static gboolean _mprtpscheduler_drain (GstMprtpscheduler * this);
+static void _mprtpscheduler_retry_wakeup (gpointer data);
+static void _mprtpscheduler_retry_run (void *data);
+static void _mprtpscheduler_retransmit (GstMprtpscheduler * this);
+static void _mprtpscheduler_push (GstMprtpscheduler * this, GstBuffer *buffer);
+static void _mprtpscheduler_flush (GstMprtpscheduler * this);
+
+//Retry interval for packets the splitter refused to send
+#define SNDQUEUE_RETRY_INTERVAL (500 * GST_USECOND)
+
+//Stages of the latency tracing in the order packets pass them
+enum
+{
+  SND_TRACE_ARRIVED = 0,
+  SND_TRACE_SNDQUEUE,
+  SND_TRACE_SPLITTER,
+  SND_TRACE_PATH,
+  SND_TRACE_FEC,
+  SND_TRACE_PUSH,
+};
 
 static guint _subflows_utilization;
 
@@ -117,6 +140,8 @@ enum
   PROP_ABS_TIME_EXT_HEADER_ID,
   PROP_FEC_PAYLOAD_TYPE,
   PROP_MPATH_KEYFRAME_FILTERING,
+  PROP_MPATH_FRAME_CHUNK_SIZE,
+  PROP_MPATH_EARLIEST_DELIVERY,
   PROP_PACKET_OBSOLATION_TRESHOLD,
   PROP_JOIN_SUBFLOW,
   PROP_DETACH_SUBFLOW,
@@ -128,9 +153,20 @@ enum
   PROP_KEEP_ALIVE_PERIOD,
   PROP_SETUP_REPORT_TIMEOUT,
   PROP_FEC_INTERVAL,
+  PROP_FEC_BUDGET,
   PROP_LOG_ENABLED,
   PROP_LOG_PATH,
   PROP_TEST_SEQ,
+  PROP_LATENCY_TRACING,
+  PROP_LATENCY_STATS,
+  PROP_STREAMS,
+  PROP_STREAM_TARGETS,
+  PROP_RTX_PAYLOAD_TYPE,
+  PROP_RTX_DEADLINE,
+  PROP_RTX_STATS,
+  PROP_TXTIME_OFFLOAD,
+  PROP_SNDQUEUE_STATS,
+  PROP_OWD_ACCURACY,
 };
 
 /* signals and args */
@@ -220,6 +256,7 @@ gst_mprtpscheduler_class_init (GstMprtpschedulerClass * klass)
   gobject_class->finalize = gst_mprtpscheduler_finalize;
   element_class->change_state =
       GST_DEBUG_FUNCPTR (gst_mprtpscheduler_change_state);
+  element_class->set_clock = GST_DEBUG_FUNCPTR (gst_mprtpscheduler_set_clock);
   element_class->query = GST_DEBUG_FUNCPTR (gst_mprtpscheduler_query);
 
 
@@ -233,7 +270,23 @@ gst_mprtpscheduler_class_init (GstMprtpschedulerClass * klass)
       g_param_spec_uint ("mprtp-ssrc-filter",
           "Sets or gets the ssrc of the RTP packets splitted into several subflows. 0 - means all RTP packets are assigned",
           "Sets or gets the ssrc of the RTP packets splitted into several subflows. 0 - means all RTP packets are assigned",
-          0, 1<<31, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+          0, G_MAXUINT32, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STREAMS,
+      g_param_spec_string ("streams",
+          "Set the streams sharing the subflows",
+          "Comma separated list of ssrc:priority:weight[:lowdelay] entries. Streams of lower priority values are "
+          "sent first, streams of the same priority share the sending by their weights, lowdelay streams are sent "
+          "on the path having the lowest RTT. RTP packets of other SSRCs are forwarded unscheduled. "
+          "If no stream is set, mprtp-ssrc-filter decides.",
+          NULL, G_PARAM_WRITABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STREAM_TARGETS,
+      g_param_spec_string ("stream-targets",
+          "Target bitrates of the streams",
+          "Lines of ssrc:priority:weight:target_bitrate, the target bitrate of the subflows shared between the streams "
+          "at every mprtp-subflows-utilization signal.",
+          NULL, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 
   g_object_class_install_property (gobject_class, PROP_ABS_TIME_EXT_HEADER_ID,
       g_param_spec_uint ("abs-time-ext-header-id",
@@ -253,10 +306,27 @@ gst_mprtpscheduler_class_init (GstMprtpschedulerClass * klass)
           "Set or get the keyframe filtering for multiple path. 0 - no keyframe filtering, 1 - vp8 enc/dec filtering",
           0, 255, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_MPATH_FRAME_CHUNK_SIZE,
+      g_param_spec_uint ("mpath-frame-chunk-size",
+          "Set or get the frame aware splitting for multiple path",
+          "0 - packets are split between the subflows one by one, otherwise packets of the same frame "
+          "(RTP timestamp, until the marker bit) are sent on the same subflow in chunks of at most the given "
+          "payload bytes, so the receiver joins less frames from several paths.",
+          0, G_MAXUINT32, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MPATH_EARLIEST_DELIVERY,
+      g_param_spec_boolean ("mpath-earliest-delivery",
+          "Send every packet on the path it arrives first",
+          "Predicts the arrival of every packet on each subflow from the OWD of the subflow, the bytes already "
+          "sent on it and its target bitrate, and selects the earliest one instead of splitting by the weights. "
+          "A subflow is not selected above its target bitrate. mpath-frame-chunk-size is not applied in this mode.",
+          FALSE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   g_object_class_install_property (gobject_class, PROP_PACKET_OBSOLATION_TRESHOLD,
       g_param_spec_uint ("obsolation-treshold",
           "Set the obsolation treshold at the packet sender queue.",
-          "Set the obsolation treshold at the packet sender queue.",
+          "The deadline of a frame in ms from its first packet queued. Frames not sent by then at the target "
+          "bitrate of their stream are dropped as a whole, keyframes (see mpath-keyframe-filtering) after the others.",
           0, 10000, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
   g_object_class_install_property (gobject_class, PROP_JOIN_SUBFLOW,
@@ -310,7 +380,7 @@ gst_mprtpscheduler_class_init (GstMprtpschedulerClass * klass)
       g_param_spec_uint ("setup-controlling-mode",
           "set the controlling mode to the subflow",
           "A 32bit unsigned integer for setup a target. The first 8 bit identifies the subflow, the latter the mode. "
-          "0 - no sending rate controller, 1 - no controlling, but sending SRs, 2 - FBRA with MARC",
+          "0 - no sending rate controller, 1 - no controlling, but sending SRs, 2 - FBRA with MARC, 3 - SCReAM",
           0, UINT_MAX, 0, G_PARAM_WRITABLE | G_PARAM_STATIC_STRINGS));
 
   g_object_class_install_property (gobject_class, PROP_FEC_INTERVAL,
@@ -320,6 +390,13 @@ gst_mprtpscheduler_class_init (GstMprtpschedulerClass * klass)
           "The newly created FEC packet is going to be sent on the path actually selected if the plugin uses multipath.",
           0, 15, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_FEC_BUDGET,
+      g_param_spec_uint ("fec-budget",
+          "Set the FEC overhead allowed against the losses of the subflows",
+          "The property value other than 0 protects every lossy subflow by FEC packets adapted to its losses, "
+          "spending at most the given percent of its target bitrate. Subflows without losses carry no FEC.",
+          0, 100, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   g_object_class_install_property (gobject_class, PROP_LOG_ENABLED,
       g_param_spec_boolean ("logging",
           "Indicate weather a log for subflow is enabled or not",
@@ -339,6 +416,61 @@ gst_mprtpscheduler_class_init (GstMprtpschedulerClass * klass)
             "Determines the path for test sequence",
             "NULL", G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_LATENCY_TRACING,
+      g_param_spec_boolean ("latency-tracing",
+          "Trace the time packets spend in each stage of the scheduler",
+          "Stamps every packet at the send queue, the splitter, the path, the FEC encoder and the pad push "
+          "and collects per subflow histograms of the stage latencies. Enabling it resets the histograms.",
+          FALSE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_LATENCY_STATS,
+      g_param_spec_string ("latency-stats",
+          "Stage latency statistics",
+          "CSV lines of subflow,stage,count,min_us,p50_us,p90_us,p99_us,max_us collected by latency-tracing",
+          NULL, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_RTX_PAYLOAD_TYPE,
+      g_param_spec_uint ("rtx-payload-type",
+          "Set or get the payload type of RTX packets",
+          "Set or get the payload type of the RFC 4588 retransmissions. The default is 125",
+          0, 127, RTX_PAYLOAD_DEFAULT_ID, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_RTX_DEADLINE,
+      g_param_spec_uint ("rtx-deadline",
+          "Retransmission deadline in ms",
+          "Packets NACKed by the receiver are retransmitted on the path having the lowest RTT, if the "
+          "retransmission arrives within this time after the original was sent. Set it to the playout "
+          "delay of the receiver. 0 - no retransmission",
+          0, 10000, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_RTX_STATS,
+      g_param_spec_string ("rtx-stats",
+          "Retransmission statistics",
+          "CSV of requested,retransmitted,missing,expired,refused packets since the element is made",
+          NULL, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_TXTIME_OFFLOAD,
+      g_param_spec_boolean ("txtime-offload",
+          "Leave the pacing to the kernel",
+          "Every packet gets an earliest departure time paced at the target bitrate of its subflow. "
+          "mprtpudpsink with txtime enabled hands it to the kernel (SO_TXTIME on the fq qdisc), "
+          "the absolute sending time extension carries the departure time",
+          FALSE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_OWD_ACCURACY,
+      g_param_spec_double ("owd-accuracy",
+          "Relative error of the long term OWD of the rate controllers",
+          "The property value other than 0 tracks the long term OWD percentile of the subflows by a quantile sketch "
+          "with the given relative error instead of the exact one. It applies to the controllers set up afterwards.",
+          0., .5, 0., G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_SNDQUEUE_STATS,
+      g_param_spec_string ("sndqueue-stats",
+          "Sending queue statistics",
+          "CSV of the smoothed and the maximal queueing delay, the dropped frames, keyframes and bytes, "
+          "and the bytes sent of the frames dropped later",
+          NULL, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
   _subflows_utilization =
       g_signal_new ("mprtp-subflows-utilization", G_TYPE_FROM_CLASS (klass),
       G_SIGNAL_RUN_LAST, G_STRUCT_OFFSET (GstMprtpschedulerClass, mprtp_media_rate_utilization),
@@ -351,10 +483,13 @@ gst_mprtpscheduler_class_init (GstMprtpschedulerClass * klass)
 static void
 gst_mprtpscheduler_init (GstMprtpscheduler * this)
 {
+  MPRTPClockProvider** clock;
 //  GstMprtpschedulerPrivate *priv;
 //  priv = this->priv = GST_MPRTPSCHEDULER_GET_PRIVATE (this);
 
   init_mprtp_logger();
+  //the helpers and timers made here read the clock of the element
+  clock = mprtp_clock_bind(&this->clock_provider);
 
   this->rtp_sinkpad =
       gst_pad_new_from_static_template (&gst_mprtpscheduler_rtp_sink_template,
@@ -405,9 +540,17 @@ gst_mprtpscheduler_init (GstMprtpscheduler * this)
   gst_element_add_pad (GST_ELEMENT (this), this->mprtp_srcpad);
 
 
-  this->sysclock = gst_system_clock_obtain ();
-  this->thread = gst_task_new (_mprtpscheduler_process_run, this, NULL);
+  this->timerwheel = timerwheel_obtain ();
+  this->retry_timer = timerwheel_add_oneshot (this->timerwheel,
+      GST_CLOCK_TIME_NONE, _mprtpscheduler_retry_wakeup, this);
+  this->retry_thread = gst_task_new (_mprtpscheduler_retry_run, this, NULL);
+  g_rec_mutex_init (&this->retry_thread_mutex);
+  gst_task_set_lock (this->retry_thread, &this->retry_thread_mutex);
+  g_mutex_init (&this->retry_mutex);
+  g_cond_init (&this->retry_cond);
+  this->retry_signaled = FALSE;
   g_rw_lock_init (&this->rwmutex);
+  g_mutex_init (&this->drain_mutex);
   this->ssrc_filter = 0;
   this->paths = g_hash_table_new_full (NULL, NULL, NULL, mprtp_free);
   this->mprtp_ext_header_id = MPRTP_DEFAULT_EXTENSION_HEADER_ID;
@@ -418,7 +561,10 @@ gst_mprtpscheduler_init (GstMprtpscheduler * this)
   this->sndqueue = make_packetssndqueue();
   this->splitter = make_stream_splitter(this->sndqueue);
   this->sndrates = make_sndrate_distor(this->splitter);
+  this->tracer = make_latencytracer("arrived", "sndqueue", "splitter", "path", "fec", "push", NULL);
+  this->rtxhistory = make_rtxhistory();
   sndctrler_setup(this->controller, this->splitter, this->sndrates, this->fec_encoder);
+  sndctrler_setup_rtx_history(this->controller, this->rtxhistory);
   sndctrler_setup_callbacks(this->controller,
                             this, gst_mprtpscheduler_mprtcp_sender,
                             this, gst_mprtpscheduler_emit_signal
@@ -441,6 +587,7 @@ gst_mprtpscheduler_init (GstMprtpscheduler * this)
   _setup_paths(this);
 
   DISABLE_LINE {enable_mprtp_logger();  swperctest();}
+  mprtp_clock_bind(clock);
 }
 
 
@@ -464,11 +611,15 @@ gst_mprtpscheduler_finalize (GObject * object)
   GST_DEBUG_OBJECT (this, "finalize");
 
   /* clean up object here */
-  gst_task_join (this->thread);
-  gst_object_unref (this->thread);
+  timerwheel_remove (this->timerwheel, this->retry_timer);
+  g_object_unref (this->timerwheel);
+  gst_task_join (this->retry_thread);
+  gst_object_unref (this->retry_thread);
 
   g_hash_table_destroy(this->paths);
-  g_object_unref (this->sysclock);
+  g_object_unref (this->tracer);
+  g_object_unref (this->rtxhistory);
+  mprtp_clock_provide (this, &this->clock_provider, NULL);
   G_OBJECT_CLASS (gst_mprtpscheduler_parent_class)->finalize (object);
 }
 
@@ -500,7 +651,7 @@ gst_mprtpscheduler_set_property (GObject * object, guint property_id,
   switch (property_id) {
     case PROP_MPRTP_SSRC_FILTER:
       THIS_WRITELOCK (this);
-      this->ssrc_filter = (guint8) g_value_get_uint (value);
+      this->ssrc_filter = (guint32) g_value_get_uint (value);
       _setup_paths(this);
       THIS_WRITEUNLOCK (this);
       break;
@@ -530,6 +681,19 @@ gst_mprtpscheduler_set_property (GObject * object, guint property_id,
       THIS_WRITELOCK (this);
       this->mpath_keyframe_filtering = g_value_get_uint (value);
       stream_splitter_set_mpath_keyframe_filtering(this->splitter, this->mpath_keyframe_filtering);
+      packetssndqueue_set_keyframe_filtering(this->sndqueue, this->mpath_keyframe_filtering);
+      THIS_WRITEUNLOCK (this);
+      break;
+    case PROP_MPATH_FRAME_CHUNK_SIZE:
+      THIS_WRITELOCK (this);
+      this->mpath_frame_chunk_size = g_value_get_uint (value);
+      stream_splitter_set_frame_chunk_size(this->splitter, this->mpath_frame_chunk_size);
+      THIS_WRITEUNLOCK (this);
+      break;
+    case PROP_MPATH_EARLIEST_DELIVERY:
+      THIS_WRITELOCK (this);
+      this->mpath_earliest_delivery = g_value_get_boolean (value);
+      stream_splitter_set_earliest_delivery(this->splitter, this->mpath_earliest_delivery);
       THIS_WRITEUNLOCK (this);
       break;
     case PROP_PACKET_OBSOLATION_TRESHOLD:
@@ -559,6 +723,12 @@ gst_mprtpscheduler_set_property (GObject * object, guint property_id,
       this->fec_interval = g_value_get_uint (value);
       THIS_WRITEUNLOCK (this);
       break;
+    case PROP_FEC_BUDGET:
+      THIS_WRITELOCK (this);
+      this->fec_budget = g_value_get_uint (value);
+      sndctrler_setup_fec_budget(this->controller, this->fec_budget);
+      THIS_WRITEUNLOCK (this);
+      break;
     case PROP_SET_SENDING_TARGET:
       THIS_WRITELOCK (this);
       guint_value = g_value_get_uint (value);
@@ -614,6 +784,33 @@ gst_mprtpscheduler_set_property (GObject * object, guint property_id,
       this->test_enabled = TRUE;
       THIS_WRITEUNLOCK (this);
       break;
+    case PROP_STREAMS:
+      _setup_streams (this, g_value_get_string (value));
+      break;
+    case PROP_TXTIME_OFFLOAD:
+      THIS_WRITELOCK (this);
+      this->txtime_offload = g_value_get_boolean (value);
+      THIS_WRITEUNLOCK (this);
+      break;
+    case PROP_OWD_ACCURACY:
+      THIS_WRITELOCK (this);
+      this->owd_accuracy = g_value_get_double (value);
+      sndctrler_setup_owd_accuracy(this->controller, this->owd_accuracy);
+      THIS_WRITEUNLOCK (this);
+      break;
+    case PROP_LATENCY_TRACING:
+      gboolean_value = g_value_get_boolean (value);
+      if(gboolean_value){
+        latencytracer_reset(this->tracer);
+      }
+      latencytracer_set_enabled(this->tracer, gboolean_value);
+      break;
+    case PROP_RTX_PAYLOAD_TYPE:
+      rtxhistory_set_payload_type(this->rtxhistory, (guint8) g_value_get_uint (value));
+      break;
+    case PROP_RTX_DEADLINE:
+      rtxhistory_set_deadline(this->rtxhistory, g_value_get_uint (value) * GST_MSECOND);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -664,6 +861,16 @@ gst_mprtpscheduler_get_property (GObject * object, guint property_id,
       g_value_set_uint (value, (guint) this->mpath_keyframe_filtering);
       THIS_READUNLOCK (this);
       break;
+    case PROP_MPATH_FRAME_CHUNK_SIZE:
+      THIS_READLOCK (this);
+      g_value_set_uint (value, this->mpath_frame_chunk_size);
+      THIS_READUNLOCK (this);
+      break;
+    case PROP_MPATH_EARLIEST_DELIVERY:
+      THIS_READLOCK (this);
+      g_value_set_boolean (value, this->mpath_earliest_delivery);
+      THIS_READUNLOCK (this);
+      break;
     case PROP_FEC_PAYLOAD_TYPE:
       THIS_READLOCK (this);
       g_value_set_uint (value, (guint) this->fec_payload_type);
@@ -684,6 +891,42 @@ gst_mprtpscheduler_get_property (GObject * object, guint property_id,
       g_value_set_uint (value, (guint) this->fec_interval);
       THIS_READUNLOCK (this);
       break;
+    case PROP_FEC_BUDGET:
+      THIS_READLOCK (this);
+      g_value_set_uint (value, (guint) this->fec_budget);
+      THIS_READUNLOCK (this);
+      break;
+    case PROP_TXTIME_OFFLOAD:
+      THIS_READLOCK (this);
+      g_value_set_boolean (value, this->txtime_offload);
+      THIS_READUNLOCK (this);
+      break;
+    case PROP_OWD_ACCURACY:
+      THIS_READLOCK (this);
+      g_value_set_double (value, this->owd_accuracy);
+      THIS_READUNLOCK (this);
+      break;
+    case PROP_LATENCY_TRACING:
+      g_value_set_boolean (value, latencytracer_get_enabled(this->tracer));
+      break;
+    case PROP_LATENCY_STATS:
+      g_value_take_string (value, latencytracer_get_stats(this->tracer));
+      break;
+    case PROP_RTX_PAYLOAD_TYPE:
+      g_value_set_uint (value, (guint) this->rtxhistory->payload_type);
+      break;
+    case PROP_RTX_DEADLINE:
+      g_value_set_uint (value, (guint) GST_TIME_AS_MSECONDS(this->rtxhistory->deadline));
+      break;
+    case PROP_RTX_STATS:
+      g_value_take_string (value, rtxhistory_get_stats(this->rtxhistory));
+      break;
+    case PROP_SNDQUEUE_STATS:
+      g_value_take_string (value, packetssndqueue_get_stats(this->sndqueue));
+      break;
+    case PROP_STREAM_TARGETS:
+      g_value_take_string (value, packetssndqueue_get_streams_string(this->sndqueue));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -706,6 +949,43 @@ _setup_paths (GstMprtpscheduler * this)
   fecencoder_set_payload_type(this->fec_encoder, this->fec_payload_type);
 }
 
+void
+_setup_streams (GstMprtpscheduler * this, const gchar *streams)
+{
+  gchar **entries, **fields;
+  guint i, fields_num;
+  guint32 ssrc, priority, weight;
+  gboolean lowdelay;
+  GArray *setups;
+  PacketsSndStreamSetup setup;
+
+  setups = g_array_new(FALSE, TRUE, sizeof(PacketsSndStreamSetup));
+  entries = g_strsplit(streams ? streams : "", ",", -1);
+  for(i = 0; entries[i]; ++i){
+    fields = g_strsplit(g_strstrip(entries[i]), ":", -1);
+    fields_num = g_strv_length(fields);
+    if(!fields_num || !*fields[0]){
+      goto next;
+    }
+    ssrc     = (guint32) g_ascii_strtoull(fields[0], NULL, 0);
+    priority = 1 < fields_num ? (guint32) g_ascii_strtoull(fields[1], NULL, 10) : 0;
+    weight   = 2 < fields_num ? (guint32) g_ascii_strtoull(fields[2], NULL, 10) : 1;
+    lowdelay = 3 < fields_num && !g_strcmp0(fields[3], "lowdelay");
+    setup.ssrc     = ssrc;
+    setup.priority = priority;
+    setup.weight   = MAX(1, weight);
+    setup.lowdelay = lowdelay;
+    g_array_append_val(setups, setup);
+    GST_DEBUG_OBJECT(this, "Stream %u is scheduled with priority %u, weight %u%s",
+                     ssrc, priority, weight, lowdelay ? ", lowdelay" : "");
+  next:
+    g_strfreev(fields);
+  }
+  g_strfreev(entries);
+  packetssndqueue_setup_streams(this->sndqueue, (PacketsSndStreamSetup*) setups->data, setups->len);
+  g_array_free(setups, TRUE);
+}
+
 
 gboolean
 gst_mprtpscheduler_mprtp_src_event (GstPad * pad, GstObject * parent,
@@ -773,6 +1053,17 @@ _detach_subflow (GstMprtpscheduler * this, guint subflow_id)
 
 
 
+static gboolean
+gst_mprtpscheduler_set_clock (GstElement * element, GstClock * clock)
+{
+  GST_DEBUG_OBJECT (element, "set_clock %" GST_PTR_FORMAT, clock);
+  //helper objects read the provider of the earliest element registered
+  mprtp_clock_provide (element, &GST_MPRTPSCHEDULER (element)->clock_provider, clock);
+
+  return GST_ELEMENT_CLASS (gst_mprtpscheduler_parent_class)->set_clock (element,
+      clock);
+}
+
 static GstStateChangeReturn
 gst_mprtpscheduler_change_state (GstElement * element,
     GstStateChange transition)
@@ -790,8 +1081,7 @@ gst_mprtpscheduler_change_state (GstElement * element,
     case GST_STATE_CHANGE_READY_TO_PAUSED:
       break;
     case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
-       gst_task_set_lock (this->thread, &this->thread_mutex);
-//       gst_task_start (this->thread);//Fixme elliminate if doesn't want this.
+       gst_task_start (this->retry_thread);
        break;
      default:
        break;
@@ -803,7 +1093,9 @@ gst_mprtpscheduler_change_state (GstElement * element,
 
    switch (transition) {
      case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
-       gst_task_stop (this->thread);
+       gst_task_stop (this->retry_thread);
+       timerwheel_disarm (this->timerwheel, this->retry_timer);
+       _mprtpscheduler_retry_wakeup (this);
        break;
     case GST_STATE_CHANGE_PAUSED_TO_READY:
       break;
@@ -851,8 +1143,43 @@ gst_mprtpscheduler_query (GstElement * element, GstQuery * query)
 
   return ret;
 }
-static void _setup_timestamp(GstMprtpscheduler *this, GstBuffer *buffer);
-void _setup_timestamp(GstMprtpscheduler *this, GstBuffer *buffer)
+static void _setup_timestamp(GstMprtpscheduler *this, GstBuffer *buffer, GstClockTime delay);
+static GstClockTime _setup_departure(GstMprtpscheduler *this, MPRTPSPath *path, GstBuffer *buffer);
+static GstClockTime _process_on_path(GstMprtpscheduler *this, MPRTPSPath *path, GstBuffer *buffer, gboolean *fec_request);
+static guint16 _get_rtp_seq(GstBuffer *buffer);
+guint16 _get_rtp_seq(GstBuffer *buffer)
+{
+  guint16 seq = 0;
+  gst_buffer_extract (buffer, 2, &seq, 2);
+  return g_ntohs(seq);
+}
+
+static guint32 _get_rtp_ssrc(GstBuffer *buffer);
+guint32 _get_rtp_ssrc(GstBuffer *buffer)
+{
+  guint32 ssrc = 0;
+  gst_buffer_extract (buffer, 8, &ssrc, 4);
+  return g_ntohl(ssrc);
+}
+
+//Streams in the table are scheduled, without a table the ssrc filter decides
+static gboolean _mprtpscheduler_is_scheduled(GstMprtpscheduler *this, GstBuffer *buffer);
+gboolean _mprtpscheduler_is_scheduled(GstMprtpscheduler *this, GstBuffer *buffer)
+{
+  gboolean result;
+  guint32 ssrc;
+  ssrc = _get_rtp_ssrc(buffer);
+  if(0 < packetssndqueue_get_streams_num(this->sndqueue)){
+    return packetssndqueue_has_stream(this->sndqueue, ssrc);
+  }
+  THIS_READLOCK (this);
+  result = !this->ssrc_filter || ssrc == this->ssrc_filter;
+  THIS_READUNLOCK (this);
+  return result;
+}
+
+//The packet leaves the delay later than now
+void _setup_timestamp(GstMprtpscheduler *this, GstBuffer *buffer, GstClockTime delay)
 {
   RTPAbsTimeExtension data;
   guint32 time;
@@ -865,13 +1192,42 @@ void _setup_timestamp(GstMprtpscheduler *this, GstBuffer *buffer)
 
   //Absolute sending time +0x83AA7E80
   //https://tools.ietf.org/html/draft-alvestrand-rmcat-remb-03
-  time = (NTP_NOW >> 14) & 0x00ffffff;
+  time = ((NTP_NOW + get_ntp_from_epoch_ns(delay)) >> 14) & 0x00ffffff;
   memcpy (&data, &time, 3);
   gst_rtp_buffer_add_extension_onebyte_header (&rtp,
       this->abs_time_ext_header_id, (gpointer) &data, sizeof (data));
   gst_rtp_buffer_unmap(&rtp);
 }
 
+//Attaches the earliest departure time of the packet on the path if the
+//pacing is offloaded, returns the time the packet waits until that.
+GstClockTime _setup_departure(GstMprtpscheduler *this, MPRTPSPath *path, GstBuffer *buffer)
+{
+  GstClockTime now, departure;
+  if(!this->txtime_offload){
+    return 0;
+  }
+  now       = mprtp_txtime_now();
+  departure = mprtps_path_get_departure_time(path, now, gst_buffer_get_size(buffer));
+  gst_buffer_add_mprtp_txtime_meta(buffer, departure);
+  return departure - now;
+}
+
+//Processes the packet on the path and paces it in the same pass if the
+//pacing is offloaded, returns the time the packet waits until departure.
+GstClockTime _process_on_path(GstMprtpscheduler *this, MPRTPSPath *path, GstBuffer *buffer, gboolean *fec_request)
+{
+  GstClockTime now, departure;
+  if(!this->txtime_offload){
+    mprtps_path_process_rtp_packet(path, buffer, fec_request, 0, NULL);
+    return 0;
+  }
+  now = mprtp_txtime_now();
+  mprtps_path_process_rtp_packet(path, buffer, fec_request, now, &departure);
+  gst_buffer_add_mprtp_txtime_meta(buffer, departure);
+  return departure - now;
+}
+
 
 
 
@@ -879,6 +1235,8 @@ void
 gst_mprtpscheduler_emit_signal(gpointer ptr, gpointer data)
 {
   GstMprtpscheduler *this = ptr;
+  MPRTPPluginSignalData *signal_data = data;
+  packetssndqueue_setup_stream_targets(this->sndqueue, signal_data->target_media_rate);
 //  g_signal_emit (this,_subflows_utilization, 0 /* details */, 1);
   g_signal_emit (this,_subflows_utilization, 0 /* details */, data);
 }
@@ -891,70 +1249,54 @@ gst_mprtpscheduler_rtp_sink_chain (GstPad * pad, GstObject * parent,
   GstFlowReturn result;
   guint8 first_byte;
   guint8 second_byte;
+  MPRTPClockProvider** clock;
 //  gboolean suggest_to_skip = FALSE;
 //  GstBuffer *outbuf;
   result = GST_FLOW_OK;
 
   this = GST_MPRTPSCHEDULER (parent);
+  clock = mprtp_clock_bind(&this->clock_provider);
 
-//  g_print("Sent: %lu\n", GST_TIME_AS_MSECONDS(gst_clock_get_time(this->sysclock)-prev));
-//  prev = gst_clock_get_time(this->sysclock);
+//  g_print("Sent: %lu\n", GST_TIME_AS_MSECONDS(_now(this)-prev));
+//  prev = _now(this);
   if (gst_buffer_extract (buffer, 0, &first_byte, 1) != 1 ||
       gst_buffer_extract (buffer, 1, &second_byte, 1) != 1) {
     GST_WARNING_OBJECT (this, "could not extract first byte from buffer");
     gst_buffer_unref (buffer);
-    return GST_FLOW_OK;
+    goto done;
   }
 
   if (!PACKET_IS_RTP_OR_RTCP (first_byte)) {
     GST_DEBUG_OBJECT (this, "Not RTP Packet arrived at rtp_sink");
-    return gst_pad_push (this->mprtp_srcpad, buffer);
+    result = gst_pad_push (this->mprtp_srcpad, buffer);
+    goto done;
   }
   if(PACKET_IS_RTCP(second_byte)){
       GST_DEBUG_OBJECT (this, "RTCP Packet arrived on rtp sink");
-    return gst_pad_push (this->mprtp_srcpad, buffer);
+    result = gst_pad_push (this->mprtp_srcpad, buffer);
+    goto done;
+  }
+  if(!_mprtpscheduler_is_scheduled(this, buffer)){
+    result = gst_pad_push (this->mprtp_srcpad, buffer);
+    goto done;
   }
-  if(this->ssrc_filter != 0){
-    GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
-    GstFlowReturn result;
-
-    THIS_READLOCK (this);
-    if (G_UNLIKELY (!gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp))) {
-      GST_WARNING_OBJECT (this, "The RTP packet is not writeable");
-      result = gst_pad_push (this->mprtp_srcpad, buffer);
-      THIS_READUNLOCK (this);
-      return result;
-    }
 
-    if(gst_rtp_buffer_get_ssrc(&rtp) != this->ssrc_filter){
-      result = gst_pad_push (this->mprtp_srcpad, buffer);
-      THIS_READUNLOCK (this);
-      return result;
-    }
-    THIS_READUNLOCK (this);
+  if(latencytracer_get_enabled(this->tracer)){
+    latencytracer_begin(this->tracer, _get_rtp_seq(buffer), 0, latencytracer_now());
   }
 
   //approve from stream splitter
-  again:
-  {
-    GstBuffer *item;
-    if((item = packetssndqueue_peek(this->sndqueue)) != NULL){
-      if(!_mprtpscheduler_send_buffer(this, item)){
-        packetssndqueue_push(this->sndqueue, buffer);
-        goto done;
-      }
-      item = packetssndqueue_pop(this->sndqueue);
-      goto again;
-    }
-  }
-  if(!_mprtpscheduler_send_buffer(this, buffer)){
+  g_mutex_lock (&this->drain_mutex);
+  if(!_mprtpscheduler_drain(this) || !_mprtpscheduler_send_buffer(this, buffer)){
     packetssndqueue_push(this->sndqueue, buffer);
+    timerwheel_rearm_in(this->timerwheel, this->retry_timer, SNDQUEUE_RETRY_INTERVAL);
   }
+  _mprtpscheduler_flush(this);
+  g_mutex_unlock (&this->drain_mutex);
 
-
-//  packetssndqueue_push(this->sndqueue, buffer);
-done:
   result = GST_FLOW_OK;
+done:
+  mprtp_clock_bind(clock);
   return result;
 }
 
@@ -994,14 +1336,24 @@ gst_mprtpscheduler_mprtcp_rr_sink_chain (GstPad * pad, GstObject * parent,
 {
   GstMprtpscheduler *this;
   GstFlowReturn result;
+  MPRTPClockProvider** clock;
 
   this = GST_MPRTPSCHEDULER (parent);
   GST_DEBUG_OBJECT (this, "RTCP/MPRTCP sink");
+  clock = mprtp_clock_bind(&this->clock_provider);
   THIS_READLOCK (this);
   sndctrler_receive_mprtcp(this->controller, buf);
 
   result = GST_FLOW_OK;
   THIS_READUNLOCK (this);
+
+  if(rtxhistory_has_requests(this->rtxhistory)){
+    g_mutex_lock (&this->drain_mutex);
+    _mprtpscheduler_retransmit(this);
+    _mprtpscheduler_flush(this);
+    g_mutex_unlock (&this->drain_mutex);
+  }
+  mprtp_clock_bind(clock);
   return result;
 
 }
@@ -1184,40 +1536,62 @@ _mprtpscheduler_send_buffer (GstMprtpscheduler * this, GstBuffer *buffer)
   MPRTPSPath *path = NULL;
   GstBuffer *rtpfecbuf = NULL;
   gboolean fec_request = FALSE;
+  guint16 seq = 0;
 
   THIS_READLOCK (this);
-  if(!stream_splitter_approve_buffer(this->splitter, buffer, &path)){
+  if(latencytracer_get_enabled(this->tracer)){
+    seq = _get_rtp_seq(buffer);
+    latencytracer_stamp(this->tracer, seq, SND_TRACE_SNDQUEUE);
+  }
+  if(packetssndqueue_is_lowdelay_stream(this->sndqueue, _get_rtp_ssrc(buffer))){
+    if(!stream_splitter_approve_lowdelay_buffer(this->splitter, buffer, &path)){
+      goto done;
+    }
+  }else if(!stream_splitter_approve_buffer(this->splitter, buffer, &path)){
     goto done;
   }
   if(!path){
     GST_WARNING_OBJECT(this, "No active subflow");
     goto done;
   }
+  latencytracer_set_subflow(this->tracer, seq, mprtps_path_get_id(path));
+  latencytracer_stamp(this->tracer, seq, SND_TRACE_SPLITTER);
 
   result = TRUE;
   ++this->sent_packets;
   buffer = gst_buffer_make_writable (buffer);
-  mprtps_path_process_rtp_packet(path, buffer, &fec_request);
-  _setup_timestamp(this, buffer);
+  _setup_timestamp(this, buffer, _process_on_path(this, path, buffer, &fec_request));
+  latencytracer_stamp(this->tracer, seq, SND_TRACE_PATH);
 
 //  g_print("sent on: %d\n", path->id);
   fec_request |= mprtps_path_request_keep_alive(path);
-  if(this->enable_fec || 0 < this->fec_interval){
-    fecencoder_add_rtpbuffer(this->fec_encoder, buffer);
+  //the paths request FEC packets for FBRA and for the loss adaptive FEC
+  if(this->enable_fec || 0 < this->fec_interval || 0 < this->fec_budget){
+    fecencoder_add_rtpbuffer(this->fec_encoder, mprtps_path_get_id(path),
+                             mprtps_path_get_actual_seq(path), buffer);
     fec_request |= (0 < this->fec_interval) && (this->sent_packets % this->fec_interval == 0);
+    //protects the packets of the path that requested it
     if(fec_request){
-      rtpfecbuf = fecencoder_get_fec_packet(this->fec_encoder);
+      rtpfecbuf = fecencoder_get_fec_packet(this->fec_encoder, mprtps_path_get_id(path));
+    }
+    if(rtpfecbuf){
       fecencoder_assign_to_subflow(this->fec_encoder,
                                    rtpfecbuf,
                                    this->mprtp_ext_header_id,
                                    mprtps_path_get_id(path));
+      _setup_departure(this, path, rtpfecbuf);
     }
   }
+  latencytracer_stamp(this->tracer, seq, SND_TRACE_FEC);
 
-
-  gst_pad_push (this->mprtp_srcpad, buffer);
+  if(rtxhistory_is_enabled(this->rtxhistory)){
+    rtxhistory_add(this->rtxhistory, mprtps_path_get_id(path),
+                   mprtps_path_get_actual_seq(path), buffer, _now(this));
+  }
+  _mprtpscheduler_push (this, buffer);
+  latencytracer_finish(this->tracer, seq);
   if(rtpfecbuf){
-    gst_pad_push (this->mprtp_srcpad, rtpfecbuf);
+    _mprtpscheduler_push (this, rtpfecbuf);
     rtpfecbuf = NULL;
   }
   if (!this->riport_flow_signal_sent) {
@@ -1229,38 +1603,130 @@ done:
   return result;
 }
 
+//Sends the queued packets in order, returns TRUE if the queue is emptied.
+//Must be called with drain_mutex held.
+gboolean
+_mprtpscheduler_drain (GstMprtpscheduler * this)
+{
+  GstBuffer *item;
+  while((item = packetssndqueue_peek(this->sndqueue)) != NULL){
+    if(!_mprtpscheduler_send_buffer(this, item)){
+      return FALSE;
+    }
+    packetssndqueue_pop(this->sndqueue);
+  }
+  return TRUE;
+}
+
+//Runs on the thread of the shared timer wheel, so it must not block
+void
+_mprtpscheduler_retry_wakeup (gpointer data)
+{
+  GstMprtpscheduler *this = data;
+  g_mutex_lock (&this->retry_mutex);
+  this->retry_signaled = TRUE;
+  g_cond_signal (&this->retry_cond);
+  g_mutex_unlock (&this->retry_mutex);
+}
+
 void
-_mprtpscheduler_process_run (void *data)
+_mprtpscheduler_retry_run (void *data)
 {
   GstMprtpscheduler *this;
-  GstClockID clock_id;
-  GstClockTime next_scheduler_time;
-  GstBuffer *item;
+  MPRTPClockProvider** clock;
 
   this = (GstMprtpscheduler *) data;
 
-  packetssndqueue_wait_until_item(this->sndqueue);
-again:
-  item = packetssndqueue_peek(this->sndqueue);
-  if(!item){
-    goto exit;
+  g_mutex_lock (&this->retry_mutex);
+  while(!this->retry_signaled && gst_task_get_state(this->retry_thread) == GST_TASK_STARTED){
+    g_cond_wait (&this->retry_cond, &this->retry_mutex);
+  }
+  this->retry_signaled = FALSE;
+  g_mutex_unlock (&this->retry_mutex);
+  if(gst_task_get_state(this->retry_thread) != GST_TASK_STARTED){
+    return;
   }
 
-  if(!_mprtpscheduler_send_buffer(this, item)){
-    next_scheduler_time = _now(this) + 500 * GST_USECOND;
-    goto done;
+  clock = mprtp_clock_bind(&this->clock_provider);
+  g_mutex_lock (&this->drain_mutex);
+  if(!_mprtpscheduler_drain(this)){
+    timerwheel_rearm_in(this->timerwheel, this->retry_timer, SNDQUEUE_RETRY_INTERVAL);
   }
-  item = packetssndqueue_pop(this->sndqueue);
-  goto again;
-done:
-  clock_id = gst_clock_new_single_shot_id (this->sysclock, next_scheduler_time);
+  _mprtpscheduler_flush(this);
+  g_mutex_unlock (&this->drain_mutex);
+  mprtp_clock_bind(clock);
+}
+
+//The packets released at one scheduling decision are pushed downstream as
+//one buffer list, so a batching sink keeps the pacing of the scheduler.
+//Must be called with drain_mutex held.
+void
+_mprtpscheduler_push (GstMprtpscheduler * this, GstBuffer *buffer)
+{
+  if(!this->burst_first){
+    this->burst_first = buffer;
+    return;
+  }
+  if(!this->burst){
+    this->burst = gst_buffer_list_new();
+    gst_buffer_list_add(this->burst, this->burst_first);
+  }
+  gst_buffer_list_add(this->burst, buffer);
+}
 
-  if (gst_clock_id_wait (clock_id, NULL) == GST_CLOCK_UNSCHEDULED) {
-    GST_WARNING_OBJECT (this, "The scheduler clock wait is interrupted");
+void
+_mprtpscheduler_flush (GstMprtpscheduler * this)
+{
+  GstBuffer *first;
+  GstBufferList *burst;
+
+  first = this->burst_first;
+  burst = this->burst;
+  this->burst_first = NULL;
+  this->burst = NULL;
+  if(burst){
+    gst_pad_push_list (this->mprtp_srcpad, burst);
+  }else if(first){
+    gst_pad_push (this->mprtp_srcpad, first);
   }
-  gst_clock_id_unref (clock_id);
-exit:
-  return;
+}
+
+//Sends the retransmissions requested by the receiver on the path having the
+//lowest RTT. Must be called with drain_mutex held.
+void
+_mprtpscheduler_retransmit (GstMprtpscheduler * this)
+{
+  GstBuffer *original, *rtx;
+  MPRTPSPath *path;
+  GstClockTime sent, owd;
+  gboolean fec_request = FALSE;
+
+  THIS_READLOCK (this);
+  while((original = rtxhistory_pop(this->rtxhistory, &sent)) != NULL){
+    rtx = rtxhistory_make_rtx_packet(this->rtxhistory, original);
+    path = NULL;
+    if(!rtx || !stream_splitter_approve_lowdelay_buffer(this->splitter, rtx, &path) || !path){
+      rtxhistory_approve(this->rtxhistory, sent, GST_CLOCK_TIME_NONE);
+      goto next;
+    }
+    owd = mprtps_path_get_owd(path);
+    owd = owd ? owd : mprtps_path_get_rtt(path) / 2;
+    if(!rtxhistory_approve(this->rtxhistory, sent, owd)){
+      goto next;
+    }
+    _setup_timestamp(this, rtx, _process_on_path(this, path, rtx, &fec_request));
+    //a lost retransmission can be requested again until the deadline
+    rtxhistory_add(this->rtxhistory, mprtps_path_get_id(path),
+                   mprtps_path_get_actual_seq(path), original, sent);
+    _mprtpscheduler_push (this, rtx);
+    rtx = NULL;
+  next:
+    if(rtx){
+      gst_buffer_unref(rtx);
+    }
+    gst_buffer_unref(original);
+  }
+  THIS_READUNLOCK (this);
 }
 
 #undef THIS_WRITELOCK
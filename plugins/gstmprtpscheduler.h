@@ -28,6 +28,10 @@
 #include "streamsplitter.h"
 #include "mprtplogger.h"
 #include "fecenc.h"
+#include "timerwheel.h"
+#include "latencytracer.h"
+#include "rtxhistory.h"
+#include "mprtpclock.h"
 
 G_BEGIN_DECLS
 #define GST_TYPE_MPRTPSCHEDULER   (gst_mprtpscheduler_get_type())
@@ -65,20 +69,39 @@ struct _GstMprtpscheduler
   gboolean                      riport_flow_signal_sent;
   guint                         active_subflows_num;
   guint                         mpath_keyframe_filtering;
+  guint                         mpath_frame_chunk_size;
+  gboolean                      mpath_earliest_delivery;
+  gboolean                      txtime_offload;
   GstSegment                    segment;
   GstClockTime                  position_out;
 
   guint8                        fec_payload_type;
 
-  GstClock*                     sysclock;
 
   guint32                       rtcp_sent_octet_sum;
 
-  GstTask*                      thread;
-  GRecMutex                     thread_mutex;
+  TimerWheel*                   timerwheel;
+  TimerWheelTimer*              retry_timer;
+  //the queue is drained on the own thread of the element, the timer of
+  //the shared wheel only wakes it up
+  GstTask*                      retry_thread;
+  GRecMutex                     retry_thread_mutex;
+  GMutex                        retry_mutex;
+  GCond                         retry_cond;
+  gboolean                      retry_signaled;
+  GMutex                        drain_mutex;
+  //packets released while drain_mutex is held, pushed as one list
+  GstBuffer*                    burst_first;
+  GstBufferList*                burst;
   FECEncoder*                   fec_encoder;
   guint32                       fec_interval;
+  guint32                       fec_budget;
+  gdouble                       owd_accuracy;
   guint32                       sent_packets;
+  LatencyTracer*                tracer;
+  RTXHistory*                   rtxhistory;
+
+  MPRTPClockProvider*           clock_provider;
 
   GstMprtpschedulerPrivate*     priv;
 
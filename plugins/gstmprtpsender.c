@@ -37,6 +37,7 @@
 #include <stdio.h>
 #include <gst/gst.h>
 #include "gstmprtpsender.h"
+#include "mprtpclock.h"
 #include "mprtpspath.h"
 #include "gstmprtcpbuffer.h"
 #include <string.h>
@@ -66,6 +67,7 @@ static GstPad *gst_mprtpsender_request_new_pad (GstElement * element,
 static void gst_mprtpsender_release_pad (GstElement * element, GstPad * pad);
 static GstStateChangeReturn
 gst_mprtpsender_change_state (GstElement * element, GstStateChange transition);
+static gboolean gst_mprtpsender_set_clock (GstElement * element, GstClock * clock);
 //static void gst_mprtpsender_eventing_run (void *data);
 static gboolean gst_mprtpsender_query (GstElement * element, GstQuery * query);
 
@@ -75,6 +77,8 @@ static void gst_mprtpsender_src_unlink (GstPad * pad, GstObject * parent);
 static gboolean
 gst_mprtpsender_src_query (GstPad * sinkpad, GstObject * parent,
     GstQuery * query);
+static GstFlowReturn gst_mprtpsender_mprtp_sink_chain_list (GstPad * pad,
+    GstObject * parent, GstBufferList * list);
 static GstFlowReturn gst_mprtpsender_mprtp_sink_chain (GstPad * pad,
     GstObject * parent, GstBuffer * buffer);
 
@@ -94,7 +98,6 @@ typedef struct
   GstPad    *async_outpad;
   guint8     id;
   gboolean   initialized;
-  GstClock  *sysclock;
 } Subflow;
 
 
@@ -315,6 +318,7 @@ gst_mprtpsender_class_init (GstMprtpsenderClass * klass)
   element_class->release_pad = GST_DEBUG_FUNCPTR (gst_mprtpsender_release_pad);
   element_class->change_state =
       GST_DEBUG_FUNCPTR (gst_mprtpsender_change_state);
+  element_class->set_clock = GST_DEBUG_FUNCPTR (gst_mprtpsender_set_clock);
   element_class->query = GST_DEBUG_FUNCPTR (gst_mprtpsender_query);
 
   g_object_class_install_property (gobject_class, PROP_MPRTP_EXT_HEADER_ID,
@@ -374,6 +378,8 @@ gst_mprtpsender_init (GstMprtpsender * mprtpsender)
       "mprtp_sink");
   gst_pad_set_chain_function (mprtpsender->mprtp_sinkpad,
       GST_DEBUG_FUNCPTR (gst_mprtpsender_mprtp_sink_chain));
+  gst_pad_set_chain_list_function (mprtpsender->mprtp_sinkpad,
+      GST_DEBUG_FUNCPTR (gst_mprtpsender_mprtp_sink_chain_list));
   gst_pad_set_event_function (mprtpsender->mprtp_sinkpad,
       GST_DEBUG_FUNCPTR (gst_mprtpsender_mprtp_sink_event_handler));
   gst_pad_set_query_function (mprtpsender->mprtp_sinkpad,
@@ -488,6 +494,7 @@ gst_mprtpsender_finalize (GObject * object)
   GST_DEBUG_OBJECT (mprtpsender, "finalize");
 
   /* clean up object here */
+  mprtp_clock_provide (mprtpsender, &mprtpsender->clock_provider, NULL);
   G_OBJECT_CLASS (gst_mprtpsender_parent_class)->finalize (object);
 }
 
@@ -571,7 +578,6 @@ gst_mprtpsender_request_new_pad (GstElement * element, GstPadTemplate * templ,
   if(!subflow) {
       subflow = (Subflow *) g_malloc0 (sizeof (Subflow));
       subflow->id           = subflow_id;
-      subflow->sysclock     = gst_system_clock_obtain ();
       subflow->async_outpad = subflow->outpad = NULL;
       this->subflows        = g_list_prepend (this->subflows, subflow);
   }
@@ -616,6 +622,17 @@ gst_mprtpsender_release_pad (GstElement * element, GstPad * pad)
 
 
 
+static gboolean
+gst_mprtpsender_set_clock (GstElement * element, GstClock * clock)
+{
+  GST_DEBUG_OBJECT (element, "set_clock %" GST_PTR_FORMAT, clock);
+  //helper objects read the provider of the earliest element registered
+  mprtp_clock_provide (element, &GST_MPRTPSENDER (element)->clock_provider, clock);
+
+  return GST_ELEMENT_CLASS (gst_mprtpsender_parent_class)->set_clock (element,
+      clock);
+}
+
 static GstStateChangeReturn
 gst_mprtpsender_change_state (GstElement * element, GstStateChange transition)
 {
@@ -763,7 +780,6 @@ gst_mprtpsender_src_unlink (GstPad * pad, GstObject * parent)
   if (subflow == NULL) {
     goto gst_mprtpsender_src_unlink_done;
   }
-  gst_object_unref (subflow->sysclock);
   mprtpsender->subflows = g_list_remove (mprtpsender->subflows, subflow);
 gst_mprtpsender_src_unlink_done:
   THIS_WRITEUNLOCK (mprtpsender);
@@ -899,12 +915,11 @@ static void _init_all_subflows(GstMprtpsender *this, GstBuffer *buf)
   return;
 }
 
-static GstFlowReturn
-gst_mprtpsender_mprtp_sink_chain (GstPad * pad, GstObject * parent,
-    GstBuffer * buf)
+//Selects the outpad of the packet and keeps track of the segment position.
+//Must be called with the read lock held.
+static GstPad *
+_select_outpad (GstMprtpsender * this, GstBuffer * buf)
 {
-  GstMprtpsender *this;
-  GstFlowReturn result;
   GstMapInfo map;
   PacketTypes packet_type;
   guint8 subflow_id;
@@ -913,27 +928,15 @@ gst_mprtpsender_mprtp_sink_chain (GstPad * pad, GstObject * parent,
   GstPad *outpad;
   GstClockTime position, duration;
 
-
-  this = GST_MPRTPSENDER (parent);
-  GST_DEBUG_OBJECT (this, "RTP/MPRTP/OTHER sink");
   if (!gst_buffer_map (buf, &map, GST_MAP_READ)) {
     GST_ERROR_OBJECT (this, "Buffer is not readable");
-    result = GST_FLOW_CUSTOM_ERROR;
-    goto exit;
+    return NULL;
   }
-  THIS_READLOCK (this);
-  if(this->dirty) {
-    _init_all_subflows(this, buf);
-    this->dirty = FALSE;
-  }
-
-
   n = g_list_length (this->subflows);
   if (n < 1) {
     GST_ERROR_OBJECT (this, "No appropiate subflow");
     gst_buffer_unmap (buf, &map);
-    result = GST_FLOW_CUSTOM_ERROR;
-    goto done;
+    return NULL;
   }
   packet_type = _get_packet_mptype (this, buf, &map, &subflow_id);
   if (packet_type != PACKET_IS_NOT_MP && _select_subflow (this, subflow_id, &subflow) != FALSE) {
@@ -972,14 +975,86 @@ gst_mprtpsender_mprtp_sink_chain (GstPad * pad, GstObject * parent,
         GST_TIME_ARGS (position));
     this->segment.position = position;
   }
+  return outpad;
+}
+
+static GstFlowReturn
+gst_mprtpsender_mprtp_sink_chain (GstPad * pad, GstObject * parent,
+    GstBuffer * buf)
+{
+  GstMprtpsender *this;
+  GstFlowReturn result;
+  GstPad *outpad;
+
+  this = GST_MPRTPSENDER (parent);
+  GST_DEBUG_OBJECT (this, "RTP/MPRTP/OTHER sink");
+  THIS_READLOCK (this);
+  if(this->dirty) {
+    _init_all_subflows(this, buf);
+    this->dirty = FALSE;
+  }
+  outpad = _select_outpad (this, buf);
+  if (!outpad) {
+    result = GST_FLOW_CUSTOM_ERROR;
+    goto done;
+  }
   result = gst_pad_push (outpad, buf);
 done:
   THIS_READUNLOCK (this);
-exit:
   return result;
 
 }
 
+//The packets of a list are forwarded as one list per outpad, so a batching
+//sink can send the burst of the scheduler with a few syscalls.
+static GstFlowReturn
+gst_mprtpsender_mprtp_sink_chain_list (GstPad * pad, GstObject * parent,
+    GstBufferList * list)
+{
+  GstMprtpsender *this;
+  GstFlowReturn result = GST_FLOW_OK;
+  GstPad *outpads[MPRTP_PLUGIN_MAX_SUBFLOW_NUM + 1];
+  GstBufferList *lists[MPRTP_PLUGIN_MAX_SUBFLOW_NUM + 1];
+  GstBuffer *buf;
+  GstPad *outpad;
+  guint i, j, length, outpads_num = 0;
+
+  this = GST_MPRTPSENDER (parent);
+  length = gst_buffer_list_length (list);
+  if (!length) {
+    gst_buffer_list_unref (list);
+    return GST_FLOW_OK;
+  }
+  THIS_READLOCK (this);
+  if(this->dirty) {
+    _init_all_subflows(this, gst_buffer_list_get (list, 0));
+    this->dirty = FALSE;
+  }
+  for (i = 0; i < length; ++i) {
+    buf = gst_buffer_list_get (list, i);
+    outpad = _select_outpad (this, buf);
+    if (!outpad) {
+      continue;
+    }
+    for (j = 0; j < outpads_num && outpads[j] != outpad; ++j);
+    if (j == outpads_num) {
+      if (outpads_num == MPRTP_PLUGIN_MAX_SUBFLOW_NUM + 1) {
+        continue;
+      }
+      outpads[j] = outpad;
+      lists[j] = gst_buffer_list_new_sized (length);
+      ++outpads_num;
+    }
+    gst_buffer_list_add (lists[j], gst_buffer_ref (buf));
+  }
+  for (j = 0; j < outpads_num; ++j) {
+    result = gst_pad_push_list (outpads[j], lists[j]);
+  }
+  THIS_READUNLOCK (this);
+  gst_buffer_list_unref (list);
+  return result;
+}
+
 
 static GstFlowReturn
 gst_mprtpsender_mprtcp_sink_chain (GstPad * pad, GstObject * parent,
@@ -21,6 +21,7 @@
 #define _GST_MPRTPSENDER_H_
 
 #include <gst/gst.h>
+#include "mprtpclock.h"
 
 G_BEGIN_DECLS
 #define GST_TYPE_MPRTPSENDER   (gst_mprtpsender_get_type())
@@ -51,7 +52,8 @@ struct _GstMprtpsender
   GstEvent *event_segment;
   GstEvent *event_caps;
 
-  GstClock *sysclock;
+  MPRTPClockProvider *clock_provider;
+
   GstMprtpsenderPrivate *priv;
 };
 
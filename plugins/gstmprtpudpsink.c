@@ -0,0 +1,522 @@
+/* GStreamer
+ * Copyright (C) 2015 Balázs Kreith (contact: balazs.kreith@gmail.com)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+/**
+ * SECTION:element-gstmprtpudpsink
+ *
+ * The mprtpudpsink element sends the packets of every subflow through its
+ * own UDP socket, replacing one udpsink per mprtpsender outpad. Buffer
+ * lists, which the scheduler pushes for every paced burst, are sent
+ * together: by one sendmmsg call, or by UDP GSO when the packets of the
+ * burst have equal sizes, so the kernel is entered once per burst instead
+ * of once per packet. A single buffer is sent alone, so the pacing of the
+ * scheduler is kept.
+ *
+ * The subflows property lists the destination of each subflow as comma
+ * separated id:host:port[:bind_port] entries. The mode property selects
+ * the sending method, mode 0 sends one packet per syscall like udpsink and
+ * is the baseline of the stats property.
+ *
+ * With the txtime property the earliest departure time the scheduler
+ * attached to the packets (txtime-offload) is handed to the kernel by
+ * SO_TXTIME, and the fq qdisc of the interface releases the packets at
+ * that time, so the pacing does not depend on the wakeups of the
+ * scheduler thread.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 ... ! mprtpsender name=snd
+ *   mprtpudpsink name=out subflows="1:10.0.0.2:5000,2:10.0.1.2:5002" mode=2
+ *   snd.src_1 ! out.sink_1
+ *   snd.src_2 ! out.sink_2
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <stdio.h>
+#include <string.h>
+#include "gstmprtpudpsink.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_mprtpudpsink_debug_category);
+#define GST_CAT_DEFAULT gst_mprtpudpsink_debug_category
+
+#define THIS_LOCK(this) g_mutex_lock(&this->mutex)
+#define THIS_UNLOCK(this) g_mutex_unlock(&this->mutex)
+
+#define DEFAULT_MODE UDPEGRESS_MODE_GSO
+
+static void gst_mprtpudpsink_set_property (GObject * object,
+    guint property_id, const GValue * value, GParamSpec * pspec);
+static void gst_mprtpudpsink_get_property (GObject * object,
+    guint property_id, GValue * value, GParamSpec * pspec);
+static void gst_mprtpudpsink_finalize (GObject * object);
+static GstStateChangeReturn
+gst_mprtpudpsink_change_state (GstElement * element,
+    GstStateChange transition);
+static GstPad *gst_mprtpudpsink_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps);
+static void gst_mprtpudpsink_release_pad (GstElement * element, GstPad * pad);
+static GstFlowReturn gst_mprtpudpsink_sink_chain (GstPad * pad,
+    GstObject * parent, GstBuffer * buffer);
+static GstFlowReturn gst_mprtpudpsink_sink_chain_list (GstPad * pad,
+    GstObject * parent, GstBufferList * list);
+static gboolean gst_mprtpudpsink_sink_event (GstPad * pad, GstObject * parent,
+    GstEvent * event);
+static void _setup_subflows(GstMprtpudpsink * this, const gchar *setting);
+static gboolean _open_sockets(GstMprtpudpsink * this);
+static void _close_sockets(GstMprtpudpsink * this);
+static gchar *_get_stats(GstMprtpudpsink * this);
+
+enum
+{
+  PROP_0,
+  PROP_SUBFLOWS,
+  PROP_MODE,
+  PROP_STATS,
+  PROP_TXTIME,
+};
+
+/* pad templates */
+
+static GstStaticPadTemplate gst_mprtpudpsink_sink_template =
+GST_STATIC_PAD_TEMPLATE ("sink_%u",
+    GST_PAD_SINK,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS_ANY);
+
+/* class initialization */
+
+G_DEFINE_TYPE_WITH_CODE (GstMprtpudpsink, gst_mprtpudpsink, GST_TYPE_ELEMENT,
+    GST_DEBUG_CATEGORY_INIT (gst_mprtpudpsink_debug_category, "mprtpudpsink",
+        0, "debug category for mprtpudpsink element"));
+
+static void
+gst_mprtpudpsink_class_init (GstMprtpudpsinkClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&gst_mprtpudpsink_sink_template));
+
+  gst_element_class_set_static_metadata (GST_ELEMENT_CLASS (klass),
+      "MpRTP UDP Sink", "Sink/Network",
+      "Sends the packets of every subflow through its own UDP socket in batches",
+      "Balázs Kreith <balazskreith@gmail.com>");
+
+  gobject_class->set_property = gst_mprtpudpsink_set_property;
+  gobject_class->get_property = gst_mprtpudpsink_get_property;
+  gobject_class->finalize = gst_mprtpudpsink_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_SUBFLOWS,
+      g_param_spec_string ("subflows",
+          "Destinations of the subflows",
+          "Comma separated id:host:port[:bind_port] entries, applied when the "
+          "element goes to READY",
+          NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MODE,
+      g_param_spec_uint ("mode",
+          "Sending method",
+          "Sending method: 0 - one sendto per packet, 1 - sendmmsg per buffer list, "
+          "2 - UDP GSO for equal sized packets and sendmmsg for the rest",
+          0, 2, DEFAULT_MODE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_string ("stats",
+          "Egress statistics",
+          "CSV lines: subflow,packets,bytes,syscalls,syscalls_per_packet,errors,txtime_packets",
+          NULL, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_TXTIME,
+      g_param_spec_boolean ("txtime",
+          "Departure time offload",
+          "Send the packets at the departure time attached by the scheduler using SO_TXTIME, "
+          "applied when the element goes to READY. Needs the fq qdisc on the interface",
+          FALSE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  element_class->change_state =
+      GST_DEBUG_FUNCPTR (gst_mprtpudpsink_change_state);
+  element_class->request_new_pad =
+      GST_DEBUG_FUNCPTR (gst_mprtpudpsink_request_new_pad);
+  element_class->release_pad =
+      GST_DEBUG_FUNCPTR (gst_mprtpudpsink_release_pad);
+}
+
+static void
+gst_mprtpudpsink_init (GstMprtpudpsink * this)
+{
+  g_mutex_init (&this->mutex);
+  this->mode = DEFAULT_MODE;
+  GST_OBJECT_FLAG_SET (this, GST_ELEMENT_FLAG_SINK);
+}
+
+void
+gst_mprtpudpsink_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstMprtpudpsink *this = GST_MPRTPUDPSINK (object);
+  guint i;
+  GST_DEBUG_OBJECT (this, "set_property");
+
+  THIS_LOCK (this);
+  switch (property_id) {
+    case PROP_SUBFLOWS:
+      _setup_subflows (this, g_value_get_string (value));
+      break;
+    case PROP_MODE:
+      this->mode = (UDPEgressMode) g_value_get_uint (value);
+      for (i = 0; i < MPRTP_PLUGIN_MAX_SUBFLOW_NUM; ++i) {
+        if (this->subflows[i].egress) {
+          udpegress_set_mode (this->subflows[i].egress, this->mode);
+        }
+      }
+      break;
+    case PROP_TXTIME:
+      this->txtime = g_value_get_boolean (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+  THIS_UNLOCK (this);
+}
+
+void
+gst_mprtpudpsink_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstMprtpudpsink *this = GST_MPRTPUDPSINK (object);
+  GST_DEBUG_OBJECT (this, "get_property");
+
+  THIS_LOCK (this);
+  switch (property_id) {
+    case PROP_SUBFLOWS:
+      g_value_set_string (value, this->subflows_setting);
+      break;
+    case PROP_MODE:
+      g_value_set_uint (value, (guint) this->mode);
+      break;
+    case PROP_STATS:
+      g_value_take_string (value, _get_stats (this));
+      break;
+    case PROP_TXTIME:
+      g_value_set_boolean (value, this->txtime);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+  THIS_UNLOCK (this);
+}
+
+void
+gst_mprtpudpsink_finalize (GObject * object)
+{
+  GstMprtpudpsink *this = GST_MPRTPUDPSINK (object);
+  guint i;
+
+  GST_DEBUG_OBJECT (this, "finalize");
+
+  for (i = 0; i < MPRTP_PLUGIN_MAX_SUBFLOW_NUM; ++i) {
+    if (this->subflows[i].egress) {
+      g_object_unref (this->subflows[i].egress);
+    }
+    g_free (this->subflows[i].host);
+  }
+  g_free (this->subflows_setting);
+  g_mutex_clear (&this->mutex);
+  G_OBJECT_CLASS (gst_mprtpudpsink_parent_class)->finalize (object);
+}
+
+static GstPad *
+gst_mprtpudpsink_request_new_pad (GstElement * element, GstPadTemplate * templ,
+    const gchar * name, const GstCaps * caps)
+{
+  GstMprtpudpsink *this = GST_MPRTPUDPSINK (element);
+  GstPad *sinkpad;
+  guint subflow_id;
+
+  GST_DEBUG_OBJECT (this, "requesting pad");
+  if (!name || sscanf (name, "sink_%u", &subflow_id) != 1 ||
+      MPRTP_PLUGIN_MAX_SUBFLOW_NUM <= subflow_id) {
+    GST_WARNING_OBJECT (this, "Invalid pad name %s", GST_STR_NULL (name));
+    return NULL;
+  }
+
+  THIS_LOCK (this);
+  if (this->subflows[subflow_id].sinkpad) {
+    THIS_UNLOCK (this);
+    GST_WARNING_OBJECT (this, "Pad %s is already requested", name);
+    return NULL;
+  }
+  sinkpad = gst_pad_new_from_template (templ, name);
+  gst_pad_set_chain_function (sinkpad,
+      GST_DEBUG_FUNCPTR (gst_mprtpudpsink_sink_chain));
+  gst_pad_set_chain_list_function (sinkpad,
+      GST_DEBUG_FUNCPTR (gst_mprtpudpsink_sink_chain_list));
+  gst_pad_set_event_function (sinkpad,
+      GST_DEBUG_FUNCPTR (gst_mprtpudpsink_sink_event));
+  gst_pad_set_element_private (sinkpad, this->subflows + subflow_id);
+  this->subflows[subflow_id].sinkpad = sinkpad;
+  this->subflows[subflow_id].eos     = FALSE;
+  THIS_UNLOCK (this);
+
+  gst_pad_set_active (sinkpad, TRUE);
+  gst_element_add_pad (element, sinkpad);
+  return sinkpad;
+}
+
+static void
+gst_mprtpudpsink_release_pad (GstElement * element, GstPad * pad)
+{
+  GstMprtpudpsink *this = GST_MPRTPUDPSINK (element);
+  MprtpUDPSinkSubflow *subflow = gst_pad_get_element_private (pad);
+
+  THIS_LOCK (this);
+  subflow->sinkpad = NULL;
+  THIS_UNLOCK (this);
+  gst_pad_set_active (pad, FALSE);
+  gst_element_remove_pad (element, pad);
+}
+
+static GstStateChangeReturn
+gst_mprtpudpsink_change_state (GstElement * element, GstStateChange transition)
+{
+  GstMprtpudpsink *this = GST_MPRTPUDPSINK (element);
+  GstStateChangeReturn ret;
+
+  switch (transition) {
+    case GST_STATE_CHANGE_NULL_TO_READY:
+      if (!_open_sockets (this)) {
+        return GST_STATE_CHANGE_FAILURE;
+      }
+      break;
+    default:
+      break;
+  }
+
+  ret = GST_ELEMENT_CLASS (gst_mprtpudpsink_parent_class)->change_state (element, transition);
+
+  switch (transition) {
+    case GST_STATE_CHANGE_READY_TO_NULL:
+      _close_sockets (this);
+      break;
+    default:
+      break;
+  }
+  return ret;
+}
+
+static GstFlowReturn
+gst_mprtpudpsink_sink_chain (GstPad * pad, GstObject * parent,
+    GstBuffer * buffer)
+{
+  MprtpUDPSinkSubflow *subflow = gst_pad_get_element_private (pad);
+
+  if (G_LIKELY (subflow->egress)) {
+    udpegress_send (subflow->egress, &buffer, 1);
+  }
+  gst_buffer_unref (buffer);
+  return GST_FLOW_OK;
+}
+
+static GstFlowReturn
+gst_mprtpudpsink_sink_chain_list (GstPad * pad, GstObject * parent,
+    GstBufferList * list)
+{
+  MprtpUDPSinkSubflow *subflow = gst_pad_get_element_private (pad);
+  GstBuffer *buffers[UDPEGRESS_BATCH_LENGTH];
+  guint i, length, num = 0;
+
+  if (G_UNLIKELY (!subflow->egress)) {
+    goto done;
+  }
+  length = gst_buffer_list_length (list);
+  for (i = 0; i < length; ++i) {
+    buffers[num++] = gst_buffer_list_get (list, i);
+    if (num == UDPEGRESS_BATCH_LENGTH) {
+      udpegress_send (subflow->egress, buffers, num);
+      num = 0;
+    }
+  }
+  if (num) {
+    udpegress_send (subflow->egress, buffers, num);
+  }
+done:
+  gst_buffer_list_unref (list);
+  return GST_FLOW_OK;
+}
+
+static gboolean
+gst_mprtpudpsink_sink_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  GstMprtpudpsink *this = GST_MPRTPUDPSINK (parent);
+  MprtpUDPSinkSubflow *subflow = gst_pad_get_element_private (pad);
+  gboolean all_eos = TRUE;
+  guint i;
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_EOS:
+      THIS_LOCK (this);
+      subflow->eos = TRUE;
+      for (i = 0; i < MPRTP_PLUGIN_MAX_SUBFLOW_NUM; ++i) {
+        if (this->subflows[i].sinkpad && !this->subflows[i].eos) {
+          all_eos = FALSE;
+        }
+      }
+      THIS_UNLOCK (this);
+      //as a sink the element finishes the stream when every subflow did
+      if (all_eos) {
+        gst_element_post_message (GST_ELEMENT (this),
+            gst_message_new_eos (GST_OBJECT (this)));
+      }
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      THIS_LOCK (this);
+      subflow->eos = FALSE;
+      THIS_UNLOCK (this);
+      break;
+    default:
+      break;
+  }
+  gst_event_unref (event);
+  return TRUE;
+}
+
+//----------------------------------------------------------------------
+//------------------------- Sockets -----------------------------------
+//----------------------------------------------------------------------
+
+void _setup_subflows(GstMprtpudpsink * this, const gchar *setting)
+{
+  MprtpUDPSinkSubflow *subflow;
+  gchar **entries, **tokens;
+  guint i, subflow_id;
+
+  g_free (this->subflows_setting);
+  this->subflows_setting = g_strdup (setting);
+  for (i = 0; i < MPRTP_PLUGIN_MAX_SUBFLOW_NUM; ++i) {
+    g_free (this->subflows[i].host);
+    this->subflows[i].host = NULL;
+  }
+  if (!setting) {
+    return;
+  }
+
+  entries = g_strsplit (setting, ",", -1);
+  for (i = 0; entries[i]; ++i) {
+    tokens = g_strsplit (g_strstrip (entries[i]), ":", -1);
+    if (g_strv_length (tokens) < 3) {
+      GST_WARNING_OBJECT (this, "Invalid subflow entry: %s", entries[i]);
+      goto next;
+    }
+    subflow_id = (guint) g_ascii_strtoull (tokens[0], NULL, 10);
+    if (MPRTP_PLUGIN_MAX_SUBFLOW_NUM <= subflow_id) {
+      GST_WARNING_OBJECT (this, "Invalid subflow id: %s", tokens[0]);
+      goto next;
+    }
+    subflow            = this->subflows + subflow_id;
+    subflow->host      = g_strdup (tokens[1]);
+    subflow->port      = (guint16) g_ascii_strtoull (tokens[2], NULL, 10);
+    subflow->bind_port = tokens[3] ? (guint16) g_ascii_strtoull (tokens[3], NULL, 10) : 0;
+  next:
+    g_strfreev (tokens);
+  }
+  g_strfreev (entries);
+}
+
+gboolean _open_sockets(GstMprtpudpsink * this)
+{
+  MprtpUDPSinkSubflow *subflow;
+  GError *error = NULL;
+  gboolean result = TRUE;
+  guint i;
+
+  THIS_LOCK (this);
+  for (i = 0; i < MPRTP_PLUGIN_MAX_SUBFLOW_NUM; ++i) {
+    subflow = this->subflows + i;
+    if (!subflow->host) {
+      continue;
+    }
+    if (!subflow->egress) {
+      subflow->egress = make_udpegress ();
+    }
+    udpegress_set_mode (subflow->egress, this->mode);
+    if (!udpegress_open (subflow->egress, subflow->host, subflow->port,
+            subflow->bind_port, &error)) {
+      GST_ELEMENT_ERROR (this, RESOURCE, OPEN_WRITE, (NULL),
+          ("Could not open the socket of subflow %u: %s", i, error->message));
+      g_clear_error (&error);
+      result = FALSE;
+      break;
+    }
+    if (this->txtime && !udpegress_set_txtime (subflow->egress, TRUE)) {
+      GST_WARNING_OBJECT (this, "SO_TXTIME is not supported on subflow %u, "
+          "the packets are sent without departure time", i);
+    }
+  }
+  THIS_UNLOCK (this);
+  if (!result) {
+    _close_sockets (this);
+  }
+  return result;
+}
+
+void _close_sockets(GstMprtpudpsink * this)
+{
+  guint i;
+  THIS_LOCK (this);
+  for (i = 0; i < MPRTP_PLUGIN_MAX_SUBFLOW_NUM; ++i) {
+    if (this->subflows[i].egress) {
+      udpegress_close (this->subflows[i].egress);
+    }
+  }
+  THIS_UNLOCK (this);
+}
+
+gchar *_get_stats(GstMprtpudpsink * this)
+{
+  GString *result;
+  guint64 packets, bytes, syscalls, errors;
+  guint i;
+
+  result = g_string_new ("subflow,packets,bytes,syscalls,syscalls_per_packet,errors,txtime_packets\n");
+  for (i = 0; i < MPRTP_PLUGIN_MAX_SUBFLOW_NUM; ++i) {
+    if (!this->subflows[i].egress) {
+      continue;
+    }
+    udpegress_get_counters (this->subflows[i].egress, &packets, &bytes,
+        &syscalls, &errors);
+    g_string_append_printf (result, "%u,%"G_GUINT64_FORMAT",%"G_GUINT64_FORMAT
+        ",%"G_GUINT64_FORMAT",%.3f,%"G_GUINT64_FORMAT",%"G_GUINT64_FORMAT"\n",
+        i, packets, bytes, syscalls,
+        packets ? (gdouble) syscalls / packets : 0., errors,
+        udpegress_get_txtime_packets (this->subflows[i].egress));
+  }
+  return g_string_free (result, FALSE);
+}
+
+#undef THIS_LOCK
+#undef THIS_UNLOCK
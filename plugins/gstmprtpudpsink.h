@@ -0,0 +1,65 @@
+/* GStreamer
+ * Copyright (C) 2015 Balázs Kreith (contact: balazs.kreith@gmail.com)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_MPRTPUDPSINK_H_
+#define _GST_MPRTPUDPSINK_H_
+
+#include <gst/gst.h>
+#include "mprtpdefs.h"
+#include "udpegress.h"
+
+G_BEGIN_DECLS
+#define GST_TYPE_MPRTPUDPSINK   (gst_mprtpudpsink_get_type())
+#define GST_MPRTPUDPSINK(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_MPRTPUDPSINK,GstMprtpudpsink))
+#define GST_MPRTPUDPSINK_CLASS(klass)   (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_MPRTPUDPSINK,GstMprtpudpsinkClass))
+#define GST_IS_MPRTPUDPSINK(obj)   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_MPRTPUDPSINK))
+#define GST_IS_MPRTPUDPSINK_CLASS(obj)   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_MPRTPUDPSINK))
+typedef struct _GstMprtpudpsink GstMprtpudpsink;
+typedef struct _GstMprtpudpsinkClass GstMprtpudpsinkClass;
+
+typedef struct _MprtpUDPSinkSubflow{
+  GstPad*                 sinkpad;
+  UDPEgress*              egress;
+  gchar*                  host;
+  guint16                 port;
+  guint16                 bind_port;
+  gboolean                eos;
+}MprtpUDPSinkSubflow;
+
+struct _GstMprtpudpsink
+{
+  GstElement              base_mprtpudpsink;
+  GMutex                  mutex;
+
+  //indexed by the subflow id, the sink pad sink_%u belongs to subflow %u
+  MprtpUDPSinkSubflow     subflows[MPRTP_PLUGIN_MAX_SUBFLOW_NUM];
+  gchar*                  subflows_setting;
+  UDPEgressMode           mode;
+  gboolean                txtime;
+};
+
+struct _GstMprtpudpsinkClass
+{
+  GstElementClass base_mprtpudpsink_class;
+};
+
+GType gst_mprtpudpsink_get_type (void);
+
+G_END_DECLS
+#endif //_GST_MPRTPUDPSINK_H_
@@ -0,0 +1,704 @@
+/* GStreamer
+ * Copyright (C) 2015 Balázs Kreith (contact: balazs.kreith@gmail.com)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+/**
+ * SECTION:element-gstmprtpudpsrc
+ *
+ * The mprtpudpsrc element receives the packets of every subflow from its
+ * own UDP socket, replacing one udpsrc per mprtpreceiver sink pad. One
+ * thread waits on all the sockets at once (epoll on Linux), and reads the
+ * datagrams ready on a socket by one recvmmsg call into pooled buffers, or
+ * with UDP GRO as coalesced reads split into sub-buffers. The packets of
+ * one read are pushed as a buffer list, which mprtpreceiver classifies in
+ * one go, so there is one streaming thread and one wakeup per burst
+ * instead of one per subflow and per packet.
+ *
+ * The subflows property lists the local port of each subflow as comma
+ * separated id:port[:address] entries. The mode property selects the
+ * reading method, mode 0 reads one packet per syscall like udpsrc and is
+ * the baseline of the stats property.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 mprtpudpsrc name=in subflows="1:5000,2:5002" caps="application/x-rtp"
+ *   mprtpreceiver name=rcv ! mprtpplayouter ! ...
+ *   in.src_1 ! rcv.sink_1
+ *   in.src_2 ! rcv.sink_2
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "gstmprtpudpsrc.h"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <unistd.h>
+#endif
+
+GST_DEBUG_CATEGORY_STATIC (gst_mprtpudpsrc_debug_category);
+#define GST_CAT_DEFAULT gst_mprtpudpsrc_debug_category
+
+#define THIS_LOCK(this) g_mutex_lock(&this->mutex)
+#define THIS_UNLOCK(this) g_mutex_unlock(&this->mutex)
+
+#define DEFAULT_MODE UDPINGRESS_MODE_GRO
+//the poll token of the cancellable stopping the loop
+#define CANCEL_TOKEN MPRTP_PLUGIN_MAX_SUBFLOW_NUM
+
+static void gst_mprtpudpsrc_set_property (GObject * object,
+    guint property_id, const GValue * value, GParamSpec * pspec);
+static void gst_mprtpudpsrc_get_property (GObject * object,
+    guint property_id, GValue * value, GParamSpec * pspec);
+static void gst_mprtpudpsrc_finalize (GObject * object);
+static GstStateChangeReturn
+gst_mprtpudpsrc_change_state (GstElement * element,
+    GstStateChange transition);
+static GstPad *gst_mprtpudpsrc_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps);
+static void gst_mprtpudpsrc_release_pad (GstElement * element, GstPad * pad);
+static void _ingress_loop(gpointer udata);
+static void _setup_subflows(GstMprtpudpsrc * this, const gchar *setting);
+static gboolean _open_sockets(GstMprtpudpsrc * this);
+static void _close_sockets(GstMprtpudpsrc * this);
+static gboolean _start(GstMprtpudpsrc * this);
+static void _reset_streams(GstMprtpudpsrc * this);
+static void _stop(GstMprtpudpsrc * this);
+static gchar *_get_stats(GstMprtpudpsrc * this);
+
+enum
+{
+  PROP_0,
+  PROP_SUBFLOWS,
+  PROP_CAPS,
+  PROP_MODE,
+  PROP_STATS,
+  PROP_WAKEUPS,
+};
+
+/* pad templates */
+
+static GstStaticPadTemplate gst_mprtpudpsrc_src_template =
+GST_STATIC_PAD_TEMPLATE ("src_%u",
+    GST_PAD_SRC,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS_ANY);
+
+/* class initialization */
+
+G_DEFINE_TYPE_WITH_CODE (GstMprtpudpsrc, gst_mprtpudpsrc, GST_TYPE_ELEMENT,
+    GST_DEBUG_CATEGORY_INIT (gst_mprtpudpsrc_debug_category, "mprtpudpsrc",
+        0, "debug category for mprtpudpsrc element"));
+
+static void
+gst_mprtpudpsrc_class_init (GstMprtpudpsrcClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&gst_mprtpudpsrc_src_template));
+
+  gst_element_class_set_static_metadata (GST_ELEMENT_CLASS (klass),
+      "MpRTP UDP Source", "Source/Network",
+      "Receives the packets of every subflow from its own UDP socket in batches",
+      "Balázs Kreith <balazskreith@gmail.com>");
+
+  gobject_class->set_property = gst_mprtpudpsrc_set_property;
+  gobject_class->get_property = gst_mprtpudpsrc_get_property;
+  gobject_class->finalize = gst_mprtpudpsrc_finalize;
+
+  g_object_class_install_property (gobject_class, PROP_SUBFLOWS,
+      g_param_spec_string ("subflows",
+          "Local ports of the subflows",
+          "Comma separated id:port[:address] entries, applied when the "
+          "element goes to READY",
+          NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_CAPS,
+      g_param_spec_boxed ("caps",
+          "Caps",
+          "The caps of the packets pushed on every src pad",
+          GST_TYPE_CAPS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MODE,
+      g_param_spec_uint ("mode",
+          "Reading method",
+          "Reading method: 0 - one recvfrom per packet, 1 - recvmmsg, "
+          "2 - recvmmsg with UDP GRO",
+          0, 2, DEFAULT_MODE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_string ("stats",
+          "Ingress statistics",
+          "CSV lines: subflow,packets,bytes,syscalls,packets_per_syscall,errors",
+          NULL, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_WAKEUPS,
+      g_param_spec_uint64 ("wakeups",
+          "Wakeups of the receiving thread",
+          "The number of times the receiving thread woke up for packets",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  element_class->change_state =
+      GST_DEBUG_FUNCPTR (gst_mprtpudpsrc_change_state);
+  element_class->request_new_pad =
+      GST_DEBUG_FUNCPTR (gst_mprtpudpsrc_request_new_pad);
+  element_class->release_pad =
+      GST_DEBUG_FUNCPTR (gst_mprtpudpsrc_release_pad);
+}
+
+static void
+gst_mprtpudpsrc_init (GstMprtpudpsrc * this)
+{
+  g_mutex_init (&this->mutex);
+  g_rec_mutex_init (&this->task_lock);
+  this->task = gst_task_new (_ingress_loop, this, NULL);
+  gst_task_set_lock (this->task, &this->task_lock);
+  this->cancellable = g_cancellable_new ();
+  this->epoll_fd    = -1;
+  this->mode        = DEFAULT_MODE;
+  GST_OBJECT_FLAG_SET (this, GST_ELEMENT_FLAG_SOURCE);
+}
+
+void
+gst_mprtpudpsrc_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstMprtpudpsrc *this = GST_MPRTPUDPSRC (object);
+  guint i;
+  GST_DEBUG_OBJECT (this, "set_property");
+
+  THIS_LOCK (this);
+  switch (property_id) {
+    case PROP_SUBFLOWS:
+      _setup_subflows (this, g_value_get_string (value));
+      break;
+    case PROP_CAPS:
+      gst_caps_replace (&this->caps, (GstCaps *) gst_value_get_caps (value));
+      break;
+    case PROP_MODE:
+      this->mode = (UDPIngressMode) g_value_get_uint (value);
+      for (i = 0; i < MPRTP_PLUGIN_MAX_SUBFLOW_NUM; ++i) {
+        if (this->subflows[i].ingress) {
+          udpingress_set_mode (this->subflows[i].ingress, this->mode);
+        }
+      }
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+  THIS_UNLOCK (this);
+}
+
+void
+gst_mprtpudpsrc_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstMprtpudpsrc *this = GST_MPRTPUDPSRC (object);
+  GST_DEBUG_OBJECT (this, "get_property");
+
+  THIS_LOCK (this);
+  switch (property_id) {
+    case PROP_SUBFLOWS:
+      g_value_set_string (value, this->subflows_setting);
+      break;
+    case PROP_CAPS:
+      gst_value_set_caps (value, this->caps);
+      break;
+    case PROP_MODE:
+      g_value_set_uint (value, (guint) this->mode);
+      break;
+    case PROP_STATS:
+      g_value_take_string (value, _get_stats (this));
+      break;
+    case PROP_WAKEUPS:
+      g_value_set_uint64 (value, this->wakeups);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+  THIS_UNLOCK (this);
+}
+
+void
+gst_mprtpudpsrc_finalize (GObject * object)
+{
+  GstMprtpudpsrc *this = GST_MPRTPUDPSRC (object);
+  guint i;
+
+  GST_DEBUG_OBJECT (this, "finalize");
+
+  for (i = 0; i < MPRTP_PLUGIN_MAX_SUBFLOW_NUM; ++i) {
+    if (this->subflows[i].ingress) {
+      g_object_unref (this->subflows[i].ingress);
+    }
+    g_free (this->subflows[i].address);
+  }
+  gst_object_unref (this->task);
+  g_rec_mutex_clear (&this->task_lock);
+  g_object_unref (this->cancellable);
+  gst_caps_replace (&this->caps, NULL);
+  g_free (this->subflows_setting);
+  g_mutex_clear (&this->mutex);
+  G_OBJECT_CLASS (gst_mprtpudpsrc_parent_class)->finalize (object);
+}
+
+static GstPad *
+gst_mprtpudpsrc_request_new_pad (GstElement * element, GstPadTemplate * templ,
+    const gchar * name, const GstCaps * caps)
+{
+  GstMprtpudpsrc *this = GST_MPRTPUDPSRC (element);
+  GstPad *srcpad;
+  guint subflow_id;
+
+  GST_DEBUG_OBJECT (this, "requesting pad");
+  if (!name || sscanf (name, "src_%u", &subflow_id) != 1 ||
+      MPRTP_PLUGIN_MAX_SUBFLOW_NUM <= subflow_id) {
+    GST_WARNING_OBJECT (this, "Invalid pad name %s", GST_STR_NULL (name));
+    return NULL;
+  }
+
+  THIS_LOCK (this);
+  if (this->subflows[subflow_id].srcpad) {
+    THIS_UNLOCK (this);
+    GST_WARNING_OBJECT (this, "Pad %s is already requested", name);
+    return NULL;
+  }
+  srcpad = gst_pad_new_from_template (templ, name);
+  gst_pad_use_fixed_caps (srcpad);
+  this->subflows[subflow_id].srcpad  = srcpad;
+  this->subflows[subflow_id].started = FALSE;
+  THIS_UNLOCK (this);
+
+  gst_pad_set_active (srcpad, TRUE);
+  gst_element_add_pad (element, srcpad);
+  return srcpad;
+}
+
+static void
+gst_mprtpudpsrc_release_pad (GstElement * element, GstPad * pad)
+{
+  GstMprtpudpsrc *this = GST_MPRTPUDPSRC (element);
+  guint i;
+
+  THIS_LOCK (this);
+  for (i = 0; i < MPRTP_PLUGIN_MAX_SUBFLOW_NUM; ++i) {
+    if (this->subflows[i].srcpad == pad) {
+      this->subflows[i].srcpad = NULL;
+    }
+  }
+  THIS_UNLOCK (this);
+  gst_pad_set_active (pad, FALSE);
+  gst_element_remove_pad (element, pad);
+}
+
+static GstStateChangeReturn
+gst_mprtpudpsrc_change_state (GstElement * element, GstStateChange transition)
+{
+  GstMprtpudpsrc *this = GST_MPRTPUDPSRC (element);
+  GstStateChangeReturn ret;
+
+  switch (transition) {
+    case GST_STATE_CHANGE_NULL_TO_READY:
+      if (!_open_sockets (this)) {
+        return GST_STATE_CHANGE_FAILURE;
+      }
+      break;
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      _reset_streams (this);
+      break;
+    case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
+      if (!_start (this)) {
+        return GST_STATE_CHANGE_FAILURE;
+      }
+      break;
+    case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
+      _stop (this);
+      break;
+    default:
+      break;
+  }
+
+  ret = GST_ELEMENT_CLASS (gst_mprtpudpsrc_parent_class)->change_state (element, transition);
+
+  switch (transition) {
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+    case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
+      //live source, packets are only produced in PLAYING
+      if (ret == GST_STATE_CHANGE_SUCCESS) {
+        ret = GST_STATE_CHANGE_NO_PREROLL;
+      }
+      break;
+    case GST_STATE_CHANGE_READY_TO_NULL:
+      _close_sockets (this);
+      break;
+    default:
+      break;
+  }
+  return ret;
+}
+
+//----------------------------------------------------------------------
+//------------------------- Receiving ---------------------------------
+//----------------------------------------------------------------------
+
+gboolean _start(GstMprtpudpsrc * this)
+{
+#ifdef __linux__
+  struct epoll_event event;
+  gint fd;
+  guint i;
+#endif
+
+  g_cancellable_make_pollfd (this->cancellable, &this->cancel_fd);
+  this->polling = TRUE;
+#ifdef __linux__
+  this->epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+  if (this->epoll_fd < 0) {
+    GST_ELEMENT_ERROR (this, RESOURCE, OPEN_READ, (NULL),
+        ("epoll_create1 failed: %s", g_strerror (errno)));
+    g_cancellable_release_fd (this->cancellable);
+    this->polling = FALSE;
+    return FALSE;
+  }
+  memset (&event, 0, sizeof (event));
+  event.events   = EPOLLIN;
+  event.data.u32 = CANCEL_TOKEN;
+  epoll_ctl (this->epoll_fd, EPOLL_CTL_ADD, this->cancel_fd.fd, &event);
+  for (i = 0; i < MPRTP_PLUGIN_MAX_SUBFLOW_NUM; ++i) {
+    if (!this->subflows[i].ingress ||
+        (fd = udpingress_get_fd (this->subflows[i].ingress)) < 0) {
+      continue;
+    }
+    event.data.u32 = i;
+    epoll_ctl (this->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+  }
+#endif
+  return gst_task_start (this->task);
+}
+
+//Sticky events are cleared when the pads are deactivated
+void _reset_streams(GstMprtpudpsrc * this)
+{
+  guint i;
+  THIS_LOCK (this);
+  for (i = 0; i < MPRTP_PLUGIN_MAX_SUBFLOW_NUM; ++i) {
+    this->subflows[i].started = FALSE;
+  }
+  THIS_UNLOCK (this);
+}
+
+void _stop(GstMprtpudpsrc * this)
+{
+  g_cancellable_cancel (this->cancellable);
+  gst_task_stop (this->task);
+  gst_task_join (this->task);
+  if (this->polling) {
+    g_cancellable_release_fd (this->cancellable);
+    this->polling = FALSE;
+  }
+  g_cancellable_reset (this->cancellable);
+#ifdef __linux__
+  if (0 <= this->epoll_fd) {
+    close (this->epoll_fd);
+    this->epoll_fd = -1;
+  }
+#endif
+}
+
+//Blocks until packets arrive or the loop is cancelled, fills the ids of
+//the subflows having packets
+static guint _wait(GstMprtpudpsrc * this, guint *ready)
+{
+  guint i, result = 0;
+#ifdef __linux__
+  struct epoll_event events[MPRTP_PLUGIN_MAX_SUBFLOW_NUM + 1];
+  gint n;
+
+  n = epoll_wait (this->epoll_fd, events, G_N_ELEMENTS (events), -1);
+  if (n < 0) {
+    if (errno != EINTR) {
+      GST_ELEMENT_ERROR (this, RESOURCE, READ, (NULL),
+          ("epoll_wait failed: %s", g_strerror (errno)));
+      gst_task_pause (this->task);
+    }
+    return 0;
+  }
+  for (i = 0; i < (guint) n; ++i) {
+    if (events[i].data.u32 < CANCEL_TOKEN) {
+      ready[result++] = events[i].data.u32;
+    }
+  }
+#else
+  GPollFD fds[MPRTP_PLUGIN_MAX_SUBFLOW_NUM + 1];
+  guint ids[MPRTP_PLUGIN_MAX_SUBFLOW_NUM];
+  guint fds_num = 1;
+  gint fd;
+
+  fds[0] = this->cancel_fd;
+  for (i = 0; i < MPRTP_PLUGIN_MAX_SUBFLOW_NUM; ++i) {
+    if (!this->subflows[i].ingress ||
+        (fd = udpingress_get_fd (this->subflows[i].ingress)) < 0) {
+      continue;
+    }
+    fds[fds_num].fd      = fd;
+    fds[fds_num].events  = G_IO_IN;
+    fds[fds_num].revents = 0;
+    ids[fds_num - 1]     = i;
+    ++fds_num;
+  }
+  if (g_poll (fds, fds_num, -1) < 0) {
+    return 0;
+  }
+  for (i = 1; i < fds_num; ++i) {
+    if (fds[i].revents & G_IO_IN) {
+      ready[result++] = ids[i - 1];
+    }
+  }
+#endif
+  return result;
+}
+
+static gboolean
+_set_timestamp (GstBuffer ** buffer, guint idx, gpointer data)
+{
+  GST_BUFFER_PTS (*buffer) = GST_BUFFER_DTS (*buffer) = *(GstClockTime *) data;
+  return TRUE;
+}
+
+//Packets are timestamped with the running time of their arrival, as a
+//live udpsrc does
+static GstClockTime _running_time(GstMprtpudpsrc * this)
+{
+  GstClock *clock;
+  GstClockTime result;
+
+  clock = gst_element_get_clock (GST_ELEMENT (this));
+  if (!clock) {
+    return GST_CLOCK_TIME_NONE;
+  }
+  result = gst_clock_get_time (clock) - gst_element_get_base_time (GST_ELEMENT (this));
+  gst_object_unref (clock);
+  return result;
+}
+
+static void _start_stream(GstMprtpudpsrc * this, guint8 subflow_id, GstPad * srcpad)
+{
+  GstSegment segment;
+  GstCaps *caps = NULL;
+  gchar *stream_id;
+
+  stream_id = gst_pad_create_stream_id_printf (srcpad, GST_ELEMENT (this), "%u", subflow_id);
+  gst_pad_push_event (srcpad, gst_event_new_stream_start (stream_id));
+  g_free (stream_id);
+  THIS_LOCK (this);
+  if (this->caps) {
+    caps = gst_caps_ref (this->caps);
+  }
+  THIS_UNLOCK (this);
+  if (caps) {
+    gst_pad_push_event (srcpad, gst_event_new_caps (caps));
+    gst_caps_unref (caps);
+  }
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  gst_pad_push_event (srcpad, gst_event_new_segment (&segment));
+}
+
+static void _receive(GstMprtpudpsrc * this, guint8 subflow_id)
+{
+  MprtpUDPSrcSubflow *subflow = this->subflows + subflow_id;
+  GstBufferList *list;
+  GstClockTime timestamp;
+  GstFlowReturn flow;
+  GstPad *srcpad = NULL;
+  gboolean started;
+
+  list = gst_buffer_list_new_sized (UDPINGRESS_BATCH_LENGTH);
+  if (!udpingress_receive (subflow->ingress, list)) {
+    goto done;
+  }
+  THIS_LOCK (this);
+  if (subflow->srcpad) {
+    srcpad = gst_object_ref (subflow->srcpad);
+  }
+  started = subflow->started;
+  subflow->started = srcpad != NULL;
+  THIS_UNLOCK (this);
+  //packets of subflows not linked to the receiver are dropped
+  if (!srcpad) {
+    goto done;
+  }
+  if (!started) {
+    _start_stream (this, subflow_id, srcpad);
+  }
+  timestamp = _running_time (this);
+  gst_buffer_list_foreach (list, _set_timestamp, &timestamp);
+  flow = gst_pad_push_list (srcpad, list);
+  list = NULL;
+  gst_object_unref (srcpad);
+  if (flow < GST_FLOW_EOS) {
+    GST_ELEMENT_ERROR (this, STREAM, FAILED, (NULL),
+        ("Subflow %u: streaming stopped, reason %s", subflow_id,
+            gst_flow_get_name (flow)));
+    gst_task_pause (this->task);
+  }
+done:
+  if (list) {
+    gst_buffer_list_unref (list);
+  }
+}
+
+void _ingress_loop(gpointer udata)
+{
+  GstMprtpudpsrc *this = udata;
+  guint ready[MPRTP_PLUGIN_MAX_SUBFLOW_NUM];
+  guint i, ready_num;
+
+  ready_num = _wait (this, ready);
+  if (g_cancellable_is_cancelled (this->cancellable)) {
+    return;
+  }
+  THIS_LOCK (this);
+  ++this->wakeups;
+  THIS_UNLOCK (this);
+  for (i = 0; i < ready_num; ++i) {
+    _receive (this, ready[i]);
+  }
+}
+
+//----------------------------------------------------------------------
+//------------------------- Sockets -----------------------------------
+//----------------------------------------------------------------------
+
+void _setup_subflows(GstMprtpudpsrc * this, const gchar *setting)
+{
+  MprtpUDPSrcSubflow *subflow;
+  gchar **entries, **tokens;
+  guint i, subflow_id;
+
+  g_free (this->subflows_setting);
+  this->subflows_setting = g_strdup (setting);
+  for (i = 0; i < MPRTP_PLUGIN_MAX_SUBFLOW_NUM; ++i) {
+    g_free (this->subflows[i].address);
+    this->subflows[i].address = NULL;
+    this->subflows[i].port    = 0;
+  }
+  if (!setting) {
+    return;
+  }
+
+  entries = g_strsplit (setting, ",", -1);
+  for (i = 0; entries[i]; ++i) {
+    tokens = g_strsplit (g_strstrip (entries[i]), ":", -1);
+    if (g_strv_length (tokens) < 2) {
+      GST_WARNING_OBJECT (this, "Invalid subflow entry: %s", entries[i]);
+      goto next;
+    }
+    subflow_id = (guint) g_ascii_strtoull (tokens[0], NULL, 10);
+    if (MPRTP_PLUGIN_MAX_SUBFLOW_NUM <= subflow_id) {
+      GST_WARNING_OBJECT (this, "Invalid subflow id: %s", tokens[0]);
+      goto next;
+    }
+    subflow          = this->subflows + subflow_id;
+    subflow->port    = (guint16) g_ascii_strtoull (tokens[1], NULL, 10);
+    subflow->address = g_strdup (tokens[2]);
+  next:
+    g_strfreev (tokens);
+  }
+  g_strfreev (entries);
+}
+
+gboolean _open_sockets(GstMprtpudpsrc * this)
+{
+  MprtpUDPSrcSubflow *subflow;
+  GError *error = NULL;
+  gboolean result = TRUE;
+  guint i;
+
+  THIS_LOCK (this);
+  for (i = 0; i < MPRTP_PLUGIN_MAX_SUBFLOW_NUM; ++i) {
+    subflow = this->subflows + i;
+    if (!subflow->port) {
+      continue;
+    }
+    if (!subflow->ingress) {
+      subflow->ingress = make_udpingress ();
+    }
+    udpingress_set_mode (subflow->ingress, this->mode);
+    if (!udpingress_open (subflow->ingress, subflow->address, subflow->port, &error)) {
+      GST_ELEMENT_ERROR (this, RESOURCE, OPEN_READ, (NULL),
+          ("Could not open the socket of subflow %u: %s", i, error->message));
+      g_clear_error (&error);
+      result = FALSE;
+      break;
+    }
+  }
+  THIS_UNLOCK (this);
+  if (!result) {
+    _close_sockets (this);
+  }
+  return result;
+}
+
+void _close_sockets(GstMprtpudpsrc * this)
+{
+  guint i;
+  THIS_LOCK (this);
+  for (i = 0; i < MPRTP_PLUGIN_MAX_SUBFLOW_NUM; ++i) {
+    if (this->subflows[i].ingress) {
+      udpingress_close (this->subflows[i].ingress);
+    }
+  }
+  THIS_UNLOCK (this);
+}
+
+gchar *_get_stats(GstMprtpudpsrc * this)
+{
+  GString *result;
+  guint64 packets, bytes, syscalls, errors;
+  guint i;
+
+  result = g_string_new ("subflow,packets,bytes,syscalls,packets_per_syscall,errors\n");
+  for (i = 0; i < MPRTP_PLUGIN_MAX_SUBFLOW_NUM; ++i) {
+    if (!this->subflows[i].ingress) {
+      continue;
+    }
+    udpingress_get_counters (this->subflows[i].ingress, &packets, &bytes,
+        &syscalls, &errors);
+    g_string_append_printf (result, "%u,%"G_GUINT64_FORMAT",%"G_GUINT64_FORMAT
+        ",%"G_GUINT64_FORMAT",%.3f,%"G_GUINT64_FORMAT"\n",
+        i, packets, bytes, syscalls,
+        syscalls ? (gdouble) packets / syscalls : 0., errors);
+  }
+  return g_string_free (result, FALSE);
+}
+
+#undef CANCEL_TOKEN
+#undef THIS_LOCK
+#undef THIS_UNLOCK
@@ -0,0 +1,74 @@
+/* GStreamer
+ * Copyright (C) 2015 Balázs Kreith (contact: balazs.kreith@gmail.com)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_MPRTPUDPSRC_H_
+#define _GST_MPRTPUDPSRC_H_
+
+#include <gst/gst.h>
+#include "mprtpdefs.h"
+#include "udpingress.h"
+
+G_BEGIN_DECLS
+#define GST_TYPE_MPRTPUDPSRC   (gst_mprtpudpsrc_get_type())
+#define GST_MPRTPUDPSRC(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_MPRTPUDPSRC,GstMprtpudpsrc))
+#define GST_MPRTPUDPSRC_CLASS(klass)   (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_MPRTPUDPSRC,GstMprtpudpsrcClass))
+#define GST_IS_MPRTPUDPSRC(obj)   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_MPRTPUDPSRC))
+#define GST_IS_MPRTPUDPSRC_CLASS(obj)   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_MPRTPUDPSRC))
+typedef struct _GstMprtpudpsrc GstMprtpudpsrc;
+typedef struct _GstMprtpudpsrcClass GstMprtpudpsrcClass;
+
+typedef struct _MprtpUDPSrcSubflow{
+  GstPad*                 srcpad;
+  UDPIngress*             ingress;
+  gchar*                  address;
+  guint16                 port;
+  //stream-start, caps and segment are pushed before the first packets
+  gboolean                started;
+}MprtpUDPSrcSubflow;
+
+struct _GstMprtpudpsrc
+{
+  GstElement              base_mprtpudpsrc;
+  GMutex                  mutex;
+
+  //one thread polls the sockets of every subflow
+  GstTask*                task;
+  GRecMutex               task_lock;
+  GCancellable*           cancellable;
+  GPollFD                 cancel_fd;
+  gboolean                polling;
+  gint                    epoll_fd;
+
+  //indexed by the subflow id, the src pad src_%u belongs to subflow %u
+  MprtpUDPSrcSubflow      subflows[MPRTP_PLUGIN_MAX_SUBFLOW_NUM];
+  gchar*                  subflows_setting;
+  GstCaps*                caps;
+  UDPIngressMode          mode;
+  guint64                 wakeups;
+};
+
+struct _GstMprtpudpsrcClass
+{
+  GstElementClass base_mprtpudpsrc_class;
+};
+
+GType gst_mprtpudpsrc_get_type (void);
+
+G_END_DECLS
+#endif //_GST_MPRTPUDPSRC_H_
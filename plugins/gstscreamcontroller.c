@@ -141,6 +141,7 @@ enum {
 
 #define RATE_RTP_HIST_SIZE 21
 #define RATE_UPDATE_SIZE 4
+#define TX_RING_MASK (MAX_TX_PACKETS - 1)
 
 typedef struct {
     guint id;
@@ -187,6 +188,16 @@ typedef struct {
     guint64 last_target_bitrate_i_adjust_us;
 
     guint64 t_start_us;
+
+    /*
+     * In-flight packets, slot is seq & TX_RING_MASK.
+     * tx_head_seq is the oldest not yet acked sequence number,
+     * tx_tail_seq is one past the highest transmitted one.
+     */
+    TransmittedRtpPacket tx_ring[MAX_TX_PACKETS];
+    guint16 tx_head_seq;
+    guint16 tx_tail_seq;
+    gboolean tx_ring_initialized;
 } ScreamStream;
 
 typedef struct {
@@ -214,6 +225,11 @@ static void subtract_credit(ScreamStream *served_stream,
     int transmitted_bytes);
 
 static guint bytes_in_flight(GstScreamController *self);
+static ScreamStream *get_stream(GstScreamController *self, guint stream_id);
+static void tx_ring_add(GstScreamController *self, ScreamStream *stream,
+    guint size, guint16 seq, guint64 transmit_time_us);
+static void tx_ring_ack(GstScreamController *self, ScreamStream *stream,
+    guint64 time_us, guint timestamp, guint16 highest_seq);
 static void update_bytes_in_flight_history(GstScreamController *self, guint64 time_us);
 static void update_rate(ScreamStream *stream, float t_delta);
 
@@ -250,9 +266,7 @@ static void gst_scream_controller_init (GstScreamController *self)
     gint n;
 
     self->approve_timer_running = FALSE;
-
-    for (n=0; n < MAX_TX_PACKETS; n++)
-        self->transmitted_packets[n].is_used = FALSE;
+    self->bytes_in_flight = 0;
 
     for (n=0; n < BASE_OWD_HIST_SIZE; n++)
         self->base_owd_hist[n] = G_MAXUINT32;
@@ -320,7 +334,7 @@ static void gst_scream_controller_init (GstScreamController *self)
     self->last_rate_update_t_us = 0;
     self->last_congestion_detected_t_us = 0;
 
-    self->streams = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)g_free);
+    self->streams = g_ptr_array_new_with_free_func((GDestroyNotify)g_free);
 
 
     g_mutex_init(&self->lock);
@@ -330,7 +344,7 @@ static void gst_scream_controller_init (GstScreamController *self)
 static void gst_scream_controller_finalize(GObject *object)
 {
     GstScreamController *self = GST_SCREAM_CONTROLLER(object);
-    g_hash_table_unref(self->streams);
+    g_ptr_array_unref(self->streams);
     G_OBJECT_CLASS(gst_scream_controller_parent_class)->finalize(object);
 }
 
@@ -395,7 +409,7 @@ gboolean gst_scream_controller_register_new_stream(GstScreamController *controll
     gboolean ret = FALSE;
 
     g_mutex_lock(&controller->lock);
-    if (g_hash_table_contains(controller->streams, GUINT_TO_POINTER(stream_id))) {
+    if (get_stream(controller, stream_id)) {
         GST_WARNING("Failed to register new scream stream. The session id needs to be unique.");
         goto end;
     }
@@ -416,7 +430,7 @@ gboolean gst_scream_controller_register_new_stream(GstScreamController *controll
     stream->loss_event_flag = FALSE;
     /* Everything else is already zero-initialised */
 
-    g_hash_table_insert(controller->streams, GUINT_TO_POINTER(stream_id), stream);
+    g_ptr_array_add(controller->streams, stream);
     ret = TRUE;
 end:
     g_mutex_unlock(&controller->lock);
@@ -426,44 +440,17 @@ end:
 guint64 gst_scream_controller_packet_transmitted(GstScreamController *self, guint stream_id,
     guint size, guint16 seq, guint64 transmit_time_us)
 {
-    int k = 0;
-    int ix = -1;
-    TransmittedRtpPacket *packet;
-
-    while (k < MAX_TX_PACKETS) {
-        if (self->transmitted_packets[k].is_used == FALSE) {
-          ix = k;
-          break;
-        }
-        k++;
-    }
-    if (ix == -1) {
-        /*
-         * One should not really end up here, MAX_TX_PACKETS is set quite high
-         * For example if mss = 1200byte and RTT=200ms then 1000 RTP packets in flight
-         * corresponds to a bitrate of 8*1000*1200/0.2 = 48Mbps
-         */
-
-        /*
-         * Pick any used entry
-         */
-        ix = 0;
-        GST_WARNING("Max number of transmitted_packets allocated, consider increasing MAX_TX_PACKETS %u\n", MAX_TX_PACKETS);
-    }
-
-    packet = &self->transmitted_packets[ix];
-    packet->stream_id = stream_id;
-    packet->size = size;
-    packet->seq = seq;
-    packet->transmit_time_us = transmit_time_us;
-    packet->is_used = TRUE;
-
     gfloat pace_interval = MIN_PACE_INTERVAL;
     guint64 time_next_transmit_us;
     guint64 time_until_approve_transmits_us = DONT_APPROVE_TRANSMIT_TIME;
     ScreamStream *stream;
 
-    stream = g_hash_table_lookup(self->streams, GUINT_TO_POINTER(stream_id));
+    stream = get_stream(self, stream_id);
+    if (!stream) {
+        GST_WARNING("Transmitted packet for an unknown stream %u", stream_id);
+        goto end;
+    }
+    tx_ring_add(self, stream, size, seq, transmit_time_us);
     stream->bytes_transmitted += size;
 
     if (OPEN_CWND) {
@@ -509,7 +496,7 @@ guint64 gst_scream_controller_approve_transmits(GstScreamController *self, guint
     ScreamStream *stream;
     guint size_of_next_rtp;
     gboolean exit;
-    GList *it, *list;
+    guint i;
     guint64 next_approve_time = DONT_APPROVE_TRANSMIT_TIME;
 
     /*
@@ -518,16 +505,12 @@ guint64 gst_scream_controller_approve_transmits(GstScreamController *self, guint
      */
     if (time_us - self->last_rate_update_t_us >= RATE_UPDATE_INTERVAL) {
         float t_delta = (time_us - self->last_rate_update_t_us)/1e6;
-        list = it = g_hash_table_get_values(self->streams);
         self->rate_transmitted = 0.0f;
-        while (it) {
-            ScreamStream *stream  = (ScreamStream *)it->data;
+        for (i = 0; i < self->streams->len; i++) {
+            ScreamStream *stream  = g_ptr_array_index(self->streams, i);
             update_rate(stream, t_delta);
             self->rate_transmitted += stream->rate_transmitted;
-            it = g_list_next(it);
-
         }
-        g_list_free(list);
         self->last_rate_update_t_us = time_us;
     }
 
@@ -609,6 +592,22 @@ end:
     return next_approve_time;
 }
 
+/*
+ * Updates the queue of a stream without accounting an RTP packet,
+ * used by callers asking for an approval before the packet is sent
+ */
+void gst_scream_controller_set_bytes_in_queue(GstScreamController *self, guint stream_id,
+    guint bytes_in_queue)
+{
+    ScreamStream *stream;
+
+    stream = get_stream(self, stream_id);
+    if (!stream) {
+        return;
+    }
+    stream->bytes_in_queue = bytes_in_queue;
+}
+
 void gst_scream_controller_new_rtp_packet(GstScreamController *self, guint stream_id,
     guint rtp_timestamp, guint64 time_us, guint bytes_in_queue, guint rtp_size)
 {
@@ -619,7 +618,7 @@ void gst_scream_controller_new_rtp_packet(GstScreamController *self, guint strea
         initialize(self, time_us);
     }
 
-    stream = g_hash_table_lookup(self->streams, GUINT_TO_POINTER(stream_id));
+    stream = get_stream(self, stream_id);
     if (!stream) {
         GST_WARNING("Scream controller received an RTP packet that did not belong to a registered\n"
         "stream. stream_id is  %u\n", stream_id);
@@ -665,7 +664,7 @@ static void initialize(GstScreamController *self, guint64 time_us) {
 static ScreamStream * get_prioritized_stream(GstScreamController *self)
 {
     ScreamStream *it_stream, *stream = NULL;
-    GList *it, *list;
+    guint i;
     guint next_packet_size;
     float max_prio = 0.0, max_credit = 1.0, priority;
 
@@ -673,9 +672,8 @@ static ScreamStream * get_prioritized_stream(GstScreamController *self)
      * Pick a stream with credit higher or equal to
      * the next RTP packet in queue for the given stream.
      */
-    list = it = g_hash_table_get_values(self->streams);
-    while (it) {
-        it_stream = (ScreamStream *)it->data;
+    for (i = 0; i < self->streams->len; i++) {
+        it_stream = g_ptr_array_index(self->streams, i);
         if (it_stream->bytes_in_queue) {
             /*
              * Pick stream if it has the highest credit so far
@@ -686,9 +684,7 @@ static ScreamStream * get_prioritized_stream(GstScreamController *self)
                 max_credit = stream->credit;
             }
         }
-        it = g_list_next(it);
     }
-    g_list_free(list);
     if (stream)
         goto end;
 
@@ -699,17 +695,14 @@ static ScreamStream * get_prioritized_stream(GstScreamController *self)
      * add credit to streams with RTP packets in queue that did not
      * get served.
      */
-    list = it = g_hash_table_get_values(self->streams);
-    while (it) {
-        it_stream = (ScreamStream *)it->data;
+    for (i = 0; i < self->streams->len; i++) {
+        it_stream = g_ptr_array_index(self->streams, i);
         priority = it_stream->priority;
         if (it_stream->bytes_in_queue > 0 && priority > max_prio) {
             max_prio = priority;
             stream = it_stream;
         }
-        it = g_list_next(it);
     }
-    g_list_free(list);
 end:
     return stream;
 
@@ -718,14 +711,13 @@ end:
 static void add_credit(GstScreamController *self, ScreamStream *served_stream,
     int transmitted_bytes)
 {
-    GList *it, *list;
+    guint i;
     ScreamStream *stream_it;
     gfloat credit;
     guint next_packet_size;
 
-    list = it = g_hash_table_get_values(self->streams);
-    while (it) {
-        stream_it = (ScreamStream *)it->data;
+    for (i = 0; i < self->streams->len; i++) {
+        stream_it = g_ptr_array_index(self->streams, i);
         if (stream_it->id != served_stream->id) {
             credit = transmitted_bytes * stream_it->priority / served_stream->priority;
             next_packet_size = get_next_packet_size(stream_it);
@@ -734,9 +726,7 @@ static void add_credit(GstScreamController *self, ScreamStream *served_stream,
             else
                 stream_it->credit = MIN((float) (2*self->mss), stream_it->credit + credit);
             }
-        it = g_list_next(it);
     }
-    g_list_free(list);
 }
 
 static void subtract_credit(ScreamStream *served_stream,
@@ -747,12 +737,109 @@ static void subtract_credit(ScreamStream *served_stream,
 
 static guint bytes_in_flight(GstScreamController *self)
 {
-    gint ret = 0, n;
-    for (n=0; n < MAX_TX_PACKETS; n++) {
-        if (self->transmitted_packets[n].is_used)
-            ret += self->transmitted_packets[n].size;
+    return self->bytes_in_flight;
+}
+
+static ScreamStream *get_stream(GstScreamController *self, guint stream_id)
+{
+    ScreamStream *stream;
+    guint i;
+    for (i = 0; i < self->streams->len; i++) {
+        stream = g_ptr_array_index(self->streams, i);
+        if (stream->id == stream_id)
+            return stream;
+    }
+    return NULL;
+}
+
+static void tx_ring_add(GstScreamController *self, ScreamStream *stream,
+    guint size, guint16 seq, guint64 transmit_time_us)
+{
+    TransmittedRtpPacket *packet;
+
+    if (!stream->tx_ring_initialized) {
+        stream->tx_head_seq = stream->tx_tail_seq = seq;
+        stream->tx_ring_initialized = TRUE;
+    }
+    if ((gint16)(seq - stream->tx_head_seq) < 0) {
+        /* Older than anything tracked, it can not be acked anymore */
+        return;
+    }
+    if ((gint16)(seq - stream->tx_tail_seq) >= 0) {
+        stream->tx_tail_seq = seq + 1;
+    }
+
+    /*
+     * One should not really end up here, MAX_TX_PACKETS is set quite high
+     * For example if mss = 1200byte and RTT=200ms then 1000 RTP packets in flight
+     * corresponds to a bitrate of 8*1000*1200/0.2 = 48Mbps
+     * The oldest packets are forgotten to make room.
+     */
+    if ((guint16)(stream->tx_tail_seq - stream->tx_head_seq) > MAX_TX_PACKETS) {
+        GST_WARNING("Max number of transmitted packets reached, consider increasing MAX_TX_PACKETS %u",
+            MAX_TX_PACKETS);
+        while ((guint16)(stream->tx_tail_seq - stream->tx_head_seq) > MAX_TX_PACKETS) {
+            packet = &stream->tx_ring[stream->tx_head_seq & TX_RING_MASK];
+            if (packet->is_used && packet->seq == stream->tx_head_seq) {
+                self->bytes_in_flight -= packet->size;
+                packet->is_used = FALSE;
+            }
+            stream->tx_head_seq++;
+        }
+    }
+
+    packet = &stream->tx_ring[seq & TX_RING_MASK];
+    if (packet->is_used) {
+        /* Retransmission of the same sequence number */
+        self->bytes_in_flight -= packet->size;
+    }
+    packet->stream_id = stream->id;
+    packet->size = size;
+    packet->seq = seq;
+    packet->transmit_time_us = transmit_time_us;
+    packet->is_used = TRUE;
+    self->bytes_in_flight += size;
+}
+
+static void tx_ring_ack(GstScreamController *self, ScreamStream *stream,
+    guint64 time_us, guint timestamp, guint16 highest_seq)
+{
+    TransmittedRtpPacket *packet;
+    guint64 rtt_us;
+
+    if (!stream->tx_ring_initialized) {
+        return;
+    }
+
+    packet = &stream->tx_ring[highest_seq & TX_RING_MASK];
+    if (packet->is_used && packet->seq == highest_seq) {
+        self->acked_owd = timestamp - (guint)(packet->transmit_time_us / 1000);
+        rtt_us = time_us - packet->transmit_time_us;
+        self->srtt_sh_us = (7 * self->srtt_sh_us + rtt_us) / 8;
+        if (time_us - self->last_srtt_update_t_us > self->srtt_sh_us) {
+            self->srtt_us = (7 * self->srtt_us + self->srtt_sh_us) / 8;
+            self->last_srtt_update_t_us = time_us;
+        }
+    }
+
+    /*
+     * RTP packets with a sequence number lower
+     * than or equal to the highest received sequence number
+     * are treated as received even though they are not
+     * This advances the send window, similar to what
+     * SACK does in TCP
+     */
+    while (stream->tx_head_seq != stream->tx_tail_seq &&
+        (gint16)(highest_seq - stream->tx_head_seq) >= 0) {
+        packet = &stream->tx_ring[stream->tx_head_seq & TX_RING_MASK];
+        if (packet->is_used && packet->seq == stream->tx_head_seq) {
+            self->bytes_newly_acked += packet->size;
+            stream->bytes_acked += packet->size;
+            self->bytes_in_flight -= packet->size;
+            packet->is_used = FALSE;
+        }
+        stream->tx_head_seq++;
     }
-    return ret;
 }
 
 static void update_bytes_in_flight_history(GstScreamController *self, guint64 time_us)
@@ -879,7 +966,7 @@ static void update_target_stream_bitrate(GstScreamController *self, ScreamStream
 {
     gfloat br = 0, scl_i, priority_sum, priority_scale, increment, scl, tmp, ramp_up_speed;
     guint tx_size_bits = 0;
-    GList *it, *list;
+    guint i;
 
     if (stream->t_start_us == 0) {
         stream->t_start_us = time_us;
@@ -924,12 +1011,9 @@ static void update_target_stream_bitrate(GstScreamController *self, ScreamStream
          *  achieve a bitrate differentiation
          */
         priority_sum = 0.0;
-        list = it = g_hash_table_get_values(self->streams);
-        while (it) {
-            priority_sum += ((ScreamStream *)it->data)->priority;
-            it = g_list_next(it);
+        for (i = 0; i < self->streams->len; i++) {
+            priority_sum += ((ScreamStream *)g_ptr_array_index(self->streams, i))->priority;
         }
-        g_list_free(list);
         priority_scale = sqrt(priority_sum / (stream->priority)) / priority_sum;
         /*
          * TODO This needs to be done differently
@@ -1103,17 +1187,13 @@ static void update_target_stream_bitrate(GstScreamController *self, ScreamStream
 void gst_scream_controller_incoming_feedback(GstScreamController *self, guint stream_id,
     guint64 time_us, guint timestamp, guint highest_seq, guint n_loss, guint n_ecn, gboolean q_bit)
 {
-    GList *it, *list;
-    TransmittedRtpPacket *packet;
-    guint64 rtt_us;
     ScreamStream *stream;
-    guint32 highest_seq_ext, seq_ext;
-    gint n;
+    guint i;
 
     SCREAM_UNUSED(n_ecn);
     SCREAM_UNUSED(q_bit);
 
-    stream = g_hash_table_lookup(self->streams, GUINT_TO_POINTER(stream_id));
+    stream = get_stream(self, stream_id);
     if (!stream) {
         GST_WARNING("Received feedback for an unknown stream.");
         goto end;
@@ -1124,46 +1204,7 @@ void gst_scream_controller_incoming_feedback(GstScreamController *self, guint st
     /*
      * Remove all acked packets
      */
-    for (n=0; n < MAX_TX_PACKETS; n++) {
-        packet = &self->transmitted_packets[n];
-
-        if (packet->is_used==TRUE) {
-            if (stream_id == packet->stream_id) {
-                if (packet->seq == highest_seq) {
-                    self->acked_owd = timestamp - (guint)(packet->transmit_time_us / 1000);
-                    rtt_us = time_us - packet->transmit_time_us;
-                    self->srtt_sh_us = (7 * self->srtt_sh_us + rtt_us) / 8;
-                    if (time_us - self->last_srtt_update_t_us > self->srtt_sh_us) {
-                        self->srtt_us = (7 * self->srtt_us + self->srtt_sh_us) / 8;
-                        self->last_srtt_update_t_us = time_us;
-                    }
-                }
-
-                /*
-                 * Wrap-around safety net
-                 */
-                seq_ext = packet->seq;
-                highest_seq_ext = highest_seq;
-                if (seq_ext < highest_seq_ext && highest_seq_ext-seq_ext > 20000)
-                    seq_ext += 65536;
-                else if (seq_ext > highest_seq_ext && seq_ext - highest_seq_ext > 20000)
-                    highest_seq_ext += 65536;
-
-                /*
-                 * RTP packets with a sequence number lower
-                 * than or equal to the highest received sequence number
-                 * are treated as received even though they are not
-                 * This advances the send window, similar to what
-                 * SACK does in TCP
-                 */
-                if (seq_ext <= highest_seq_ext) {
-                    self->bytes_newly_acked += packet->size;
-                    stream->bytes_acked += packet->size;
-                    packet->is_used = FALSE;
-                }
-            }
-        }
-    }
+    tx_ring_ack(self, stream, time_us, timestamp, (guint16)highest_seq);
     self->delta_t =time_us- self->lastfb;
     self->lastfb = time_us;
 
@@ -1185,12 +1226,9 @@ void gst_scream_controller_incoming_feedback(GstScreamController *self, guint st
             self->loss_event = TRUE;
             self->last_loss_event_t_us = time_us;
 
-            list = it = g_hash_table_get_values(self->streams);
-            while (it) {
-                ((ScreamStream *)it->data)->loss_event_flag = TRUE;
-                it = g_list_next(it);
+            for (i = 0; i < self->streams->len; i++) {
+                ((ScreamStream *)g_ptr_array_index(self->streams, i))->loss_event_flag = TRUE;
             }
-            g_list_free(list);
         }
     }
     update_cwnd(self, time_us);
@@ -1199,6 +1237,28 @@ end:
 
 }
 
+/*
+ * Returns the transmit time of a packet that is still in flight,
+ * used by callers deriving the feedback timestamp from a one way delay
+ */
+gboolean gst_scream_controller_get_transmit_time(GstScreamController *self, guint stream_id,
+    guint16 seq, guint64 *transmit_time_us)
+{
+    ScreamStream *stream;
+    TransmittedRtpPacket *packet;
+
+    stream = get_stream(self, stream_id);
+    if (!stream || !stream->tx_ring_initialized) {
+        return FALSE;
+    }
+    packet = &stream->tx_ring[seq & TX_RING_MASK];
+    if (!packet->is_used || packet->seq != seq) {
+        return FALSE;
+    }
+    *transmit_time_us = packet->transmit_time_us;
+    return TRUE;
+}
+
 static void update_cwnd(GstScreamController *self, guint64 time_us)
 {
     gfloat off_target;
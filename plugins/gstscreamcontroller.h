@@ -60,7 +60,9 @@ typedef guint (*GstScreamQueueNextPacketSizeCb) (guint stream_id, gpointer user_
 typedef void (*GstScreamQueueApproveTransmitCb) (guint stream_id, gpointer user_data);
 typedef void (*GstScreamQueueClearQueueCb) (guint stream_id, gpointer user_data);
 
-#define MAX_TX_PACKETS 1000
+/* Per-stream in-flight ring, indexed by the low bits of the RTP sequence number.
+ * Must be a power of two. */
+#define MAX_TX_PACKETS 1024
 #define BASE_OWD_HIST_SIZE 50
 #define OWD_FRACTION_HIST_SIZE 20
 #define OWD_NORM_HIST_SIZE 100
@@ -71,12 +73,10 @@ struct _GstScreamController
     GObject parent_instance;
 
     GMutex lock;
-    GHashTable *streams;
+    GPtrArray *streams;
 
-    gint maxTxPackets;
     gboolean approve_timer_running;
-    /*guint transmitted_packets_size;*/
-    TransmittedRtpPacket transmitted_packets[MAX_TX_PACKETS];
+    guint bytes_in_flight; /* Sum of the unacked packet sizes over all streams */
 
     guint64 srtt_sh_us;
     guint64 srtt_us;
@@ -167,8 +167,14 @@ void gst_scream_controller_new_rtp_packet(GstScreamController *self, guint strea
 
 guint64 gst_scream_controller_approve_transmits(GstScreamController *self, guint64 time_us);
 
+void gst_scream_controller_set_bytes_in_queue(GstScreamController *self, guint stream_id,
+    guint bytes_in_queue);
+
 void gst_scream_controller_incoming_feedback(GstScreamController *self, guint stream_id,
     guint64 time_us, guint timestamp, guint highest_seq, guint n_loss, guint n_ecn, gboolean q_bit);
 
+gboolean gst_scream_controller_get_transmit_time(GstScreamController *self, guint stream_id,
+    guint16 seq, guint64 *transmit_time_us);
+
 
 #endif /* __GST_SCREAM_CONTROLLER_H__ */
@@ -43,51 +43,65 @@ static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE("sink", GST_
 static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE("src", GST_PAD_SRC,
     GST_PAD_ALWAYS, GST_STATIC_CAPS("application/x-rtp"));
 
-typedef enum
-{
-    GST_SCREAM_DATA_QUEUE_ITEM_TYPE_RTP,
-    GST_SCREAM_DATA_QUEUE_ITEM_TYPE_RTCP
-} GstScreamDataQueueItemType;
-
-typedef struct {
-    GstDataQueueItem item;
-    GstScreamDataQueueItemType type;
-
-    guint32 rtp_ssrc;
-
-} GstScreamDataQueueItem;
+/* Both sizes must be a power of two */
+#define GST_SCREAM_RING_SIZE 1024
+#define GST_SCREAM_RING_MASK (GST_SCREAM_RING_SIZE - 1)
+#define GST_SCREAM_FEEDBACK_LANE_SIZE 64
+#define GST_SCREAM_FEEDBACK_LANE_MASK (GST_SCREAM_FEEDBACK_LANE_SIZE - 1)
+/* Upper limit of packets pushed downstream in one buffer list */
+#define GST_SCREAM_BATCH_SIZE 64
+/* Matches the controller's "don't approve" answer */
+#define GST_SCREAM_MAX_WAIT_US 10000000
 
 typedef struct {
-    GstScreamDataQueueItem item;
-
-    guint64 gst_ts;
-    gboolean adapted;
+    GstBuffer *buffer;
     guint8 rtp_pt;
     guint16 rtp_seq;
     guint32 rtp_ts;
-    gboolean rtp_marker;
     guint rtp_payload_size;
     guint64 enqueued_time;
-} GstScreamDataQueueRtpItem;
+} GstScreamRingSlot;
 
-typedef struct {
-    GstScreamDataQueueItem item;
+/*
+ * Single producer, single consumer ring.
+ * head is only advanced by the sink chain, tail only by the src loop.
+ */
+struct _GstScreamRing {
+    GstScreamRingSlot slots[GST_SCREAM_RING_SIZE];
+    gint head;
+    gint tail;
+};
 
-    gboolean adapted;
+typedef struct {
+    guint ssrc;
     guint timestamp;
     guint highest_seq;
     guint n_loss;
     guint n_ecn;
     gboolean qbit;
-} GstScreamDataQueueRtcpItem;
+} GstScreamFeedback;
 
+/* Feedback may be emitted from any thread, so producers serialize on feedback_lock */
+struct _GstScreamFeedbackLane {
+    GstScreamFeedback items[GST_SCREAM_FEEDBACK_LANE_SIZE];
+    gint head;
+    gint tail;
+};
 
-typedef struct {
+/*
+ * The slots of a stream ring are walked by three indexes on the consumer side:
+ * tail <= approved <= announced <= head. Announced packets are known by the
+ * controller, approved ones wait to be pushed. These are only touched under
+ * the controller lock, as a shared controller may approve from another queue.
+ */
+struct _GstScreamStream {
     guint ssrc, pt;
-    GstAtomicQueue *packet_queue;
+    GstScreamRing ring;
+    guint announced;
+    guint approved;
     guint enqueued_payload_size;
     guint enqueued_packets;
-} GstScreamStream;
+};
 
 enum {
     SIGNAL_BITRATE_CHANGE,
@@ -126,6 +140,10 @@ static GstFlowReturn gst_scream_queue_sink_chain(GstPad *pad, GstObject *parent,
 
 static void gst_scream_queue_srcpad_loop(GstScreamQueue *self);
 static GstScreamStream * get_stream(GstScreamQueue *self, guint ssrc, guint pt);
+static GstScreamStream * lookup_stream(GstScreamQueue *self, guint ssrc);
+static gboolean ring_push(GstScreamRing *ring, GstBuffer *buffer, GstRTPBuffer *rtp_buffer,
+    guint64 enqueued_time);
+static void wakeup_srcpad_loop(GstScreamQueue *self);
 
 static guint get_next_packet_rtp_payload_size(guint stream_id, GstScreamQueue *self);
 
@@ -201,45 +219,25 @@ static void gst_scream_queue_class_init(GstScreamQueueClass *klass)
         "Daniel Lindström <daniel.lindstrom@ericsson.com>");
 }
 
-static gboolean fake_queue_check_full_cb(GstDataQueue *queue, guint visible, guint bytes,
-    guint64 time, gpointer user_data)
-{
-    SCREAM_UNUSED(queue);
-    SCREAM_UNUSED(visible);
-    SCREAM_UNUSED(bytes);
-    SCREAM_UNUSED(time);
-    SCREAM_UNUSED(user_data);
-
-    return FALSE;
-}
-
-static void gst_scream_data_queue_rtp_item_free(GstScreamDataQueueRtpItem *item)
-{
-    if (((GstDataQueueItem *)item)->object) {
-        gst_mini_object_unref(((GstDataQueueItem *)item)->object);
-    }
-    g_slice_free(GstScreamDataQueueRtpItem, item);
-}
-
-static void gst_scream_data_queue_rtcp_item_free(GstScreamDataQueueRtcpItem *item)
+static void clear_ring(GstScreamRing *ring)
 {
-    g_slice_free(GstScreamDataQueueRtcpItem, item);
-}
-
-static void clear_packet_queue(GstAtomicQueue *queue)
-{
-    GstDataQueueItem *item;
-
-    while ((item = gst_atomic_queue_pop(queue))) {
-        item->destroy(item);
+    GstScreamRingSlot *slot;
+    guint tail, head;
+
+    head = (guint)g_atomic_int_get(&ring->head);
+    for (tail = (guint)g_atomic_int_get(&ring->tail); tail != head; tail++) {
+        slot = &ring->slots[tail & GST_SCREAM_RING_MASK];
+        if (slot->buffer) {
+            gst_buffer_unref(slot->buffer);
+            slot->buffer = NULL;
+        }
     }
+    g_atomic_int_set(&ring->tail, (gint)head);
 }
 
 static void destroy_stream(GstScreamStream *stream)
 {
-    clear_packet_queue(stream->packet_queue);
-    gst_atomic_queue_unref(stream->packet_queue);
-
+    clear_ring(&stream->ring);
     g_free(stream);
 }
 
@@ -254,43 +252,43 @@ static void gst_scream_queue_init(GstScreamQueue *self)
     GST_PAD_SET_PROXY_CAPS(self->src_pad);
     gst_element_add_pad(GST_ELEMENT(self), self->src_pad);
 
-    g_rw_lock_init(&self->lock);
-    self->streams = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify) destroy_stream);
-    self->adapted_stream_ids = g_hash_table_new(NULL, NULL);
+    self->streams_num = 0;
     self->ignored_stream_ids = g_hash_table_new(NULL, NULL);
 
     self->scream_controller_id = DEFAULT_GST_SCREAM_CONTROLLER_ID;
     self->scream_controller = NULL;
-    self->approved_packets = gst_data_queue_new(
-        (GstDataQueueCheckFullFunction)fake_queue_check_full_cb,
-        NULL, NULL, self);
 
-    self->incoming_packets = g_async_queue_new();
+    self->bypass_lane = g_new0(GstScreamRing, 1);
+    self->feedback_lane = g_new0(GstScreamFeedbackLane, 1);
+    g_mutex_init(&self->feedback_lock);
+    g_mutex_init(&self->wait_lock);
+    g_cond_init(&self->wait_cond);
+    self->waiting = 0;
+    self->signaled = FALSE;
+    self->flushing = 0;
 
     self->priority = DEFAULT_PRIORITY;
     self->pass_through = DEFAULT_PASS_THROUGH;
+    self->approved_num = 0;
     self->next_approve_time = 0;
+    self->dropped_num = 0;
 }
 
 static void gst_scream_queue_finalize(GObject *object)
 {
     GstScreamQueue *self = GST_SCREAM_QUEUE(object);
-    GstDataQueueItem *item;
-
-    while (!gst_data_queue_is_empty(self->approved_packets)) {
-        gst_data_queue_pop(self->approved_packets, &item);
-        item->destroy(item);
-    }
-    gst_object_unref(self->approved_packets);
+    gint i;
 
-    while ((item = (GstDataQueueItem *)g_async_queue_try_pop(self->incoming_packets))) {
-        item->destroy(item);
+    for (i = 0; i < self->streams_num; i++) {
+        destroy_stream(self->streams[i]);
     }
+    clear_ring(self->bypass_lane);
+    g_free(self->bypass_lane);
+    g_free(self->feedback_lane);
+    g_mutex_clear(&self->feedback_lock);
+    g_mutex_clear(&self->wait_lock);
+    g_cond_clear(&self->wait_cond);
 
-    g_async_queue_unref(self->incoming_packets);
-
-    g_hash_table_unref(self->streams);
-    g_hash_table_unref(self->adapted_stream_ids);
     g_hash_table_unref(self->ignored_stream_ids);
 
     if (self->scream_controller) {
@@ -313,6 +311,7 @@ static GstStateChangeReturn gst_scream_queue_change_state(GstElement *element,
 
     case GST_STATE_CHANGE_READY_TO_PAUSED:
         if (configure(GST_SCREAM_QUEUE(element))) {
+            g_atomic_int_set(&self->flushing, 0);
             gst_pad_start_task(self->src_pad, (GstTaskFunction)gst_scream_queue_srcpad_loop,
             self, NULL);
 
@@ -326,6 +325,15 @@ static GstStateChangeReturn gst_scream_queue_change_state(GstElement *element,
         break;
 
     case GST_STATE_CHANGE_PAUSED_TO_READY:
+        g_atomic_int_set(&self->flushing, 1);
+        g_mutex_lock(&self->wait_lock);
+        self->signaled = TRUE;
+        g_cond_signal(&self->wait_cond);
+        g_mutex_unlock(&self->wait_lock);
+        gst_pad_stop_task(self->src_pad);
+        if (self->dropped_num) {
+            GST_WARNING_OBJECT(self, "%u packets were dropped on full queues", self->dropped_num);
+        }
         break;
 
     case GST_STATE_CHANGE_READY_TO_NULL:
@@ -346,148 +354,296 @@ static GstFlowReturn gst_scream_queue_sink_chain(GstPad *pad, GstObject *parent,
     GstScreamQueue *self = GST_SCREAM_QUEUE(parent);
     GstRTPBuffer rtp_buffer = GST_RTP_BUFFER_INIT;
     GstFlowReturn flow_ret = GST_FLOW_OK;
-    GstScreamDataQueueRtpItem *rtp_item;
+    GstScreamStream *stream = NULL;
+    GstScreamRing *ring;
 
     if (GST_PAD_IS_FLUSHING(pad)) {
         flow_ret = GST_FLOW_FLUSHING;
+        gst_buffer_unref(buffer);
         goto end;
     }
 
     if (!gst_rtp_buffer_map(buffer, GST_MAP_READ, &rtp_buffer)) {
         flow_ret = GST_FLOW_ERROR;
+        gst_buffer_unref(buffer);
         goto end;
     }
 
-    rtp_item = g_slice_new(GstScreamDataQueueRtpItem);
-    ((GstDataQueueItem *)rtp_item)->object = GST_MINI_OBJECT(buffer);
-    ((GstDataQueueItem *)rtp_item)->size = gst_buffer_get_size(buffer);
-    ((GstDataQueueItem *)rtp_item)->visible = TRUE;
-    ((GstDataQueueItem *)rtp_item)->duration = GST_BUFFER_DURATION(buffer);
-    ((GstDataQueueItem *)rtp_item)->destroy = (GDestroyNotify) gst_scream_data_queue_rtp_item_free;
-
-    ((GstScreamDataQueueItem *)rtp_item)->type = GST_SCREAM_DATA_QUEUE_ITEM_TYPE_RTP;
-    ((GstScreamDataQueueItem *)rtp_item)->rtp_ssrc = gst_rtp_buffer_get_ssrc(&rtp_buffer);
-    rtp_item->rtp_pt = gst_rtp_buffer_get_payload_type(&rtp_buffer);
-    rtp_item->gst_ts = GST_BUFFER_PTS(buffer);
-    rtp_item->rtp_seq = gst_rtp_buffer_get_seq(&rtp_buffer);
-    rtp_item->rtp_ts = gst_rtp_buffer_get_timestamp(&rtp_buffer);
-    rtp_item->rtp_marker = gst_rtp_buffer_get_marker(&rtp_buffer);
-    rtp_item->rtp_payload_size = gst_rtp_buffer_get_payload_len(&rtp_buffer);
-    rtp_item->enqueued_time = get_gst_time_us(self);
-    gst_rtp_buffer_unmap(&rtp_buffer);
-
-    if (self->pass_through) {
-        rtp_item->adapted = FALSE;
-        GST_LOG_OBJECT(self, "passing through: pt = %u, seq: %u, pass: %u", rtp_item->rtp_pt, rtp_item->rtp_seq, self->pass_through);
-        gst_data_queue_push(self->approved_packets, (GstDataQueueItem *)rtp_item);
+    if (!self->pass_through) {
+        stream = get_stream(self, gst_rtp_buffer_get_ssrc(&rtp_buffer),
+            gst_rtp_buffer_get_payload_type(&rtp_buffer));
+    }
+    ring = stream ? &stream->ring : self->bypass_lane;
+
+    GST_LOG_OBJECT(self, "%s: pt = %u, seq: %u, pass: %u", stream ? "queuing" : "passing through",
+        gst_rtp_buffer_get_payload_type(&rtp_buffer), gst_rtp_buffer_get_seq(&rtp_buffer),
+        self->pass_through);
+
+    if (!ring_push(ring, buffer, &rtp_buffer, get_gst_time_us(self))) {
+        ++self->dropped_num;
+        GST_WARNING_OBJECT(self, "Queue of ssrc %u is full, dropping seq %u (%u dropped so far)",
+            gst_rtp_buffer_get_ssrc(&rtp_buffer), gst_rtp_buffer_get_seq(&rtp_buffer),
+            self->dropped_num);
+        gst_rtp_buffer_unmap(&rtp_buffer);
+        gst_buffer_unref(buffer);
         goto end;
     }
-
-    GST_LOG_OBJECT(self, "queuing: pt = %u, seq: %u, pass: %u", rtp_item->rtp_pt, rtp_item->rtp_seq, self->pass_through);
-    g_async_queue_push(self->incoming_packets, (gpointer)rtp_item);
+    gst_rtp_buffer_unmap(&rtp_buffer);
+    wakeup_srcpad_loop(self);
 
 end:
     return flow_ret;
 }
 
 
-static void gst_scream_queue_srcpad_loop(GstScreamQueue *self)
+static gboolean ring_push(GstScreamRing *ring, GstBuffer *buffer, GstRTPBuffer *rtp_buffer,
+    guint64 enqueued_time)
 {
-    GstScreamDataQueueItem *item;
-    GstScreamDataQueueRtpItem *rtp_item;
-    GstScreamStream *stream;
-    guint stream_id;
-    guint64 time_now_us, time_until_next_approve = 0;
-    GstBuffer *buffer;
+    GstScreamRingSlot *slot;
+    guint head;
 
-    time_now_us = get_gst_time_us(self);
-    if (G_UNLIKELY(time_now_us == 0)) {
-        goto end;
+    head = (guint)g_atomic_int_get(&ring->head);
+    if (head - (guint)g_atomic_int_get(&ring->tail) >= GST_SCREAM_RING_SIZE) {
+        return FALSE;
     }
+    slot = &ring->slots[head & GST_SCREAM_RING_MASK];
+    slot->buffer = buffer;
+    slot->rtp_pt = gst_rtp_buffer_get_payload_type(rtp_buffer);
+    slot->rtp_seq = gst_rtp_buffer_get_seq(rtp_buffer);
+    slot->rtp_ts = gst_rtp_buffer_get_timestamp(rtp_buffer);
+    slot->rtp_payload_size = gst_rtp_buffer_get_payload_len(rtp_buffer);
+    slot->enqueued_time = enqueued_time;
+
+    /* Publishes the slot to the src loop */
+    g_atomic_int_set(&ring->head, (gint)(head + 1));
+    return TRUE;
+}
 
-    if (time_now_us >= self->next_approve_time) {
-        time_until_next_approve = gst_scream_controller_approve_transmits(self->scream_controller,
-            time_now_us);
-    } else {
-        GST_LOG_OBJECT(self, "Time is %" G_GUINT64_FORMAT ", waiting %" G_GUINT64_FORMAT,
-            time_now_us, self->next_approve_time);
+
+static void wakeup_srcpad_loop(GstScreamQueue *self)
+{
+    if (!g_atomic_int_get(&self->waiting)) {
+        return;
     }
+    g_mutex_lock(&self->wait_lock);
+    self->signaled = TRUE;
+    g_cond_signal(&self->wait_cond);
+    g_mutex_unlock(&self->wait_lock);
+}
 
-    /* Send all approved packets */
-    while (!gst_data_queue_is_empty(self->approved_packets)) {
-        if (G_UNLIKELY(!gst_data_queue_pop(self->approved_packets,
-            (GstDataQueueItem **)&rtp_item))) {
-            GST_WARNING_OBJECT(self, "Failed to pop from approved packets queue. Flushing?");
-            goto end; /* flushing */
-        }
 
-        buffer = GST_BUFFER(((GstDataQueueItem *)rtp_item)->object);
-        gst_pad_push(self->src_pad, buffer);
+static gboolean has_pending_work(GstScreamQueue *self)
+{
+    GstScreamStream *stream;
+    gint i, streams_num;
+
+    if (g_atomic_int_get(&self->bypass_lane->head) != self->bypass_lane->tail ||
+        g_atomic_int_get(&self->feedback_lane->head) != self->feedback_lane->tail) {
+        return TRUE;
+    }
+    streams_num = g_atomic_int_get(&self->streams_num);
+    for (i = 0; i < streams_num; i++) {
+        stream = self->streams[i];
+        if ((guint)g_atomic_int_get(&stream->ring.head) != stream->announced ||
+            (guint)g_atomic_int_get(&stream->ring.tail) != stream->approved) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
 
-        GST_LOG_OBJECT(self, "pushing: pt = %u, seq: %u, pass: %u", rtp_item->rtp_pt, rtp_item->rtp_seq, self->pass_through);
 
-        if (rtp_item->adapted) {
-            guint tmp_time;
-            stream_id = ((GstScreamDataQueueItem *)rtp_item)->rtp_ssrc;
-            tmp_time = gst_scream_controller_packet_transmitted(self->scream_controller, stream_id,
-                rtp_item->rtp_payload_size, rtp_item->rtp_seq, time_now_us);
-            time_until_next_approve = MIN(time_until_next_approve, tmp_time);
+static void wait_for_work(GstScreamQueue *self, guint64 timeout_us)
+{
+    gint64 end_time = g_get_monotonic_time() + MIN(timeout_us, GST_SCREAM_MAX_WAIT_US);
+
+    g_mutex_lock(&self->wait_lock);
+    /* The producers check waiting after publishing, so announce it before
+     * looking at the rings for the last time */
+    g_atomic_int_set(&self->waiting, 1);
+    while (!self->signaled && !g_atomic_int_get(&self->flushing) && !has_pending_work(self)) {
+        if (!g_cond_wait_until(&self->wait_cond, &self->wait_lock, end_time)) {
+            break;
         }
-        g_slice_free(GstScreamDataQueueRtpItem, rtp_item);
     }
-    self->next_approve_time = time_now_us + time_until_next_approve;
+    self->signaled = FALSE;
+    g_atomic_int_set(&self->waiting, 0);
+    g_mutex_unlock(&self->wait_lock);
+}
 
-    GST_LOG_OBJECT(self, "Popping or waiting %" G_GUINT64_FORMAT, time_until_next_approve);
-    item = (GstScreamDataQueueItem *)g_async_queue_timeout_pop(self->incoming_packets, time_until_next_approve);
-    if (!item) {
-        goto end;
+
+static void drain_bypass_lane(GstScreamQueue *self, GstBufferList *batch)
+{
+    GstScreamRing *ring = self->bypass_lane;
+    GstScreamRingSlot *slot;
+    guint tail, head;
+
+    head = (guint)g_atomic_int_get(&ring->head);
+    for (tail = (guint)ring->tail; tail != head; tail++) {
+        slot = &ring->slots[tail & GST_SCREAM_RING_MASK];
+        gst_buffer_list_add(batch, slot->buffer);
+        slot->buffer = NULL;
     }
+    g_atomic_int_set(&ring->tail, (gint)head);
+}
 
-    stream_id = item->rtp_ssrc;
-    if (item->type == GST_SCREAM_DATA_QUEUE_ITEM_TYPE_RTP) {
-        GstScreamDataQueueRtpItem *rtp_item = (GstScreamDataQueueRtpItem *)item;
-        stream = get_stream(self, item->rtp_ssrc, rtp_item->rtp_pt);
-        if (!stream) {
-            rtp_item->adapted = FALSE;
-            GST_LOG_OBJECT(self, "!adapted, approving: pt = %u, seq: %u, pass: %u",
-                    rtp_item->rtp_pt, rtp_item->rtp_seq, self->pass_through);
-            gst_data_queue_push(self->approved_packets, (GstDataQueueItem *)item);
-        } else {
-            gst_atomic_queue_push(stream->packet_queue, rtp_item);
-            stream->enqueued_payload_size += rtp_item->rtp_payload_size;
+
+static void drain_feedback_lane(GstScreamQueue *self, guint64 time_now_us)
+{
+    GstScreamFeedbackLane *lane = self->feedback_lane;
+    GstScreamFeedback *feedback;
+    guint tail, head;
+
+    head = (guint)g_atomic_int_get(&lane->head);
+    for (tail = (guint)lane->tail; tail != head; tail++) {
+        feedback = &lane->items[tail & GST_SCREAM_FEEDBACK_LANE_MASK];
+        gst_scream_controller_incoming_feedback(self->scream_controller, feedback->ssrc, time_now_us,
+            feedback->timestamp, feedback->highest_seq, feedback->n_loss, feedback->n_ecn, feedback->qbit);
+    }
+    g_atomic_int_set(&lane->tail, (gint)head);
+}
+
+
+/* Hands the packets arrived since the last round over to the controller */
+static gboolean announce_new_packets(GstScreamQueue *self)
+{
+    GstScreamStream *stream;
+    GstScreamRingSlot *slot;
+    gint i, streams_num;
+    guint head;
+    gboolean result = FALSE;
+
+    streams_num = g_atomic_int_get(&self->streams_num);
+    for (i = 0; i < streams_num; i++) {
+        stream = self->streams[i];
+        head = (guint)g_atomic_int_get(&stream->ring.head);
+        for (; stream->announced != head; stream->announced++) {
+            slot = &stream->ring.slots[stream->announced & GST_SCREAM_RING_MASK];
+            stream->enqueued_payload_size += slot->rtp_payload_size;
             stream->enqueued_packets++;
-            rtp_item->adapted = TRUE;
-            self->next_approve_time = 0;
-            gst_scream_controller_new_rtp_packet(self->scream_controller, stream_id, rtp_item->rtp_ts,
-                rtp_item->enqueued_time, stream->enqueued_payload_size, rtp_item->rtp_payload_size);
+            gst_scream_controller_new_rtp_packet(self->scream_controller, stream->ssrc, slot->rtp_ts,
+                slot->enqueued_time, stream->enqueued_payload_size, slot->rtp_payload_size);
+            result = TRUE;
+        }
+    }
+    return result;
+}
+
+
+static void collect_approved_packets(GstScreamQueue *self, GstBufferList *batch)
+{
+    GstScreamStream *stream;
+    GstScreamRingSlot *slot;
+    gint i, streams_num;
+    guint tail;
+
+    streams_num = g_atomic_int_get(&self->streams_num);
+    for (i = 0; i < streams_num; i++) {
+        stream = self->streams[i];
+        for (tail = (guint)stream->ring.tail; tail != stream->approved; tail++) {
+            slot = &stream->ring.slots[tail & GST_SCREAM_RING_MASK];
+            if (!slot->buffer) {
+                /* Dropped by clear_queue */
+                continue;
+            }
+            GST_LOG_OBJECT(self, "pushing: pt = %u, seq: %u, pass: %u", slot->rtp_pt, slot->rtp_seq,
+                self->pass_through);
+            gst_buffer_list_add(batch, slot->buffer);
+            slot->buffer = NULL;
         }
-    } else { /* item->type == GST_SCREAM_DATA_QUEUE_ITEM_TYPE_RTCP */
-        GstScreamDataQueueRtcpItem *rtcp_item = (GstScreamDataQueueRtcpItem *)item;
+        g_atomic_int_set(&stream->ring.tail, (gint)tail);
+    }
+}
 
-        gst_scream_controller_incoming_feedback(self->scream_controller, stream_id, time_now_us,
-            rtcp_item->timestamp, rtcp_item->highest_seq, rtcp_item->n_loss, rtcp_item->n_ecn, rtcp_item->qbit);
 
-        ((GstDataQueueItem *)item)->destroy(item);
+static void gst_scream_queue_srcpad_loop(GstScreamQueue *self)
+{
+    GstScreamController *controller = self->scream_controller;
+    GstBufferList *batch;
+    guint64 time_now_us, time_until_next_approve;
+    guint approved_num, approved_start;
+
+    if (g_atomic_int_get(&self->flushing)) {
+        gst_pad_pause_task(self->src_pad);
+        goto end;
     }
 
+    time_now_us = get_gst_time_us(self);
+    if (G_UNLIKELY(time_now_us == 0)) {
+        wait_for_work(self, 1000);
+        goto end;
+    }
+
+    batch = gst_buffer_list_new_sized(GST_SCREAM_BATCH_SIZE);
+    drain_bypass_lane(self, batch);
+
+    g_mutex_lock(&controller->lock);
+    drain_feedback_lane(self, time_now_us);
+    if (announce_new_packets(self)) {
+        self->next_approve_time = 0;
+    }
+
+    if (time_now_us >= self->next_approve_time) {
+        /* Each call approves at most one packet, keep asking while the window allows */
+        approved_start = self->approved_num;
+        do {
+            approved_num = self->approved_num;
+            time_until_next_approve = gst_scream_controller_approve_transmits(controller,
+                time_now_us);
+        } while (approved_num != self->approved_num &&
+            self->approved_num - approved_start < GST_SCREAM_BATCH_SIZE);
+        self->next_approve_time = time_now_us + time_until_next_approve;
+    } else {
+        time_until_next_approve = self->next_approve_time - time_now_us;
+        GST_LOG_OBJECT(self, "Time is %" G_GUINT64_FORMAT ", waiting %" G_GUINT64_FORMAT,
+            time_now_us, self->next_approve_time);
+    }
+
+    collect_approved_packets(self, batch);
+    g_mutex_unlock(&controller->lock);
+
+    if (gst_buffer_list_length(batch)) {
+        gst_pad_push_list(self->src_pad, batch);
+    } else {
+        gst_buffer_list_unref(batch);
+    }
+
+    GST_LOG_OBJECT(self, "Waiting %" G_GUINT64_FORMAT, time_until_next_approve);
+    wait_for_work(self, time_until_next_approve);
+
 end:
     return;
 
 }
 
 
+static GstScreamStream * lookup_stream(GstScreamQueue *self, guint ssrc)
+{
+    gint i, streams_num;
+
+    streams_num = g_atomic_int_get(&self->streams_num);
+    for (i = 0; i < streams_num; i++) {
+        if (self->streams[i]->ssrc == ssrc) {
+            return self->streams[i];
+        }
+    }
+    return NULL;
+}
+
+
 static GstScreamStream * get_stream(GstScreamQueue *self, guint ssrc, guint pt)
 {
     GstScreamStream *stream = NULL;
     gboolean adapt_stream = FALSE;
     guint stream_id = ssrc;
 
-    if (G_LIKELY(g_hash_table_contains(self->adapted_stream_ids, GUINT_TO_POINTER(stream_id)))) {
-        g_rw_lock_reader_lock(&self->lock);
-        stream = g_hash_table_lookup(self->streams, GUINT_TO_POINTER(stream_id));
-        g_rw_lock_reader_unlock(&self->lock);
+    if (G_LIKELY((stream = lookup_stream(self, stream_id)))) {
+        /* DO NOTHING */
     } else if (g_hash_table_contains(self->ignored_stream_ids, GUINT_TO_POINTER(stream_id))) {
         /* DO NOTHING */
+    } else if (self->streams_num == GST_SCREAM_QUEUE_MAX_STREAMS) {
+        GST_WARNING_OBJECT(self, "Too many streams, ssrc %u is not adapted", stream_id);
+        g_hash_table_add(self->ignored_stream_ids, GUINT_TO_POINTER(stream_id));
     } else {
         g_signal_emit_by_name(self, "on-payload-adaptation-request", pt, &adapt_stream);
         if (!adapt_stream) {
@@ -502,16 +658,13 @@ static GstScreamStream * get_stream(GstScreamQueue *self, guint ssrc, guint pt)
                     (GstScreamQueueClearQueueCb)clear_queue,
                     (gpointer)self)) {
 
+                /* The controller calls back only after the first packet is
+                 * announced, so publishing after the registration is safe */
                 stream = g_new0(GstScreamStream, 1);
                 stream->ssrc = ssrc;
                 stream->pt = pt;
-                stream->packet_queue = gst_atomic_queue_new(0);
-                stream->enqueued_payload_size = 0;
-                stream->enqueued_packets = 0;
-                g_rw_lock_writer_lock(&self->lock);
-                g_hash_table_insert(self->streams, GUINT_TO_POINTER(stream_id), stream);
-                g_rw_lock_writer_unlock(&self->lock);
-                g_hash_table_add(self->adapted_stream_ids, GUINT_TO_POINTER(stream_id));
+                self->streams[self->streams_num] = stream;
+                g_atomic_int_set(&self->streams_num, self->streams_num + 1);
             } else {
                 GST_WARNING_OBJECT(self, "Failed to register new stream\n");
             }
@@ -524,15 +677,12 @@ static GstScreamStream * get_stream(GstScreamQueue *self, guint ssrc, guint pt)
 
 static guint get_next_packet_rtp_payload_size(guint stream_id, GstScreamQueue *self)
 {
-    GstScreamDataQueueRtpItem *item;
     GstScreamStream *stream;
     guint size = 0;
 
-    g_rw_lock_reader_lock(&self->lock);
-    stream = g_hash_table_lookup(self->streams, GUINT_TO_POINTER(stream_id));
-    g_rw_lock_reader_unlock(&self->lock);
-    if ((item = gst_atomic_queue_peek(stream->packet_queue))) {
-        size = item->rtp_payload_size;
+    stream = lookup_stream(self, stream_id);
+    if (stream && stream->approved != stream->announced) {
+        size = stream->ring.slots[stream->approved & GST_SCREAM_RING_MASK].rtp_payload_size;
     }
     return size;
 }
@@ -558,39 +708,48 @@ static void on_bitrate_change(guint bitrate, guint stream_id, GstScreamQueue *se
 
     GST_DEBUG_OBJECT(self, "Updating bitrate of stream %u to %u bps", stream_id, bitrate);
 
-    g_rw_lock_reader_lock(&self->lock);
-    stream = g_hash_table_lookup(self->streams, GUINT_TO_POINTER(stream_id));
-    g_rw_lock_reader_unlock(&self->lock);
-
+    stream = lookup_stream(self, stream_id);
     g_signal_emit_by_name(self, "on-bitrate-change", bitrate, stream->ssrc, stream->pt);
 }
 
 
 static void approve_transmit_cb(guint stream_id, GstScreamQueue *self) {
-    GstScreamDataQueueRtpItem *item;
+    GstScreamRingSlot *slot;
     GstScreamStream *stream;
 
-    g_rw_lock_reader_lock(&self->lock);
-    stream = g_hash_table_lookup(self->streams, GUINT_TO_POINTER(stream_id));
-    g_rw_lock_reader_unlock(&self->lock);
-
-    if ((item = gst_atomic_queue_pop(stream->packet_queue))) {
-        stream->enqueued_payload_size -= item->rtp_payload_size;
-        stream->enqueued_packets--;
-        GST_LOG_OBJECT(self, "approving: pt = %u, seq: %u, pass: %u",
-                item->rtp_pt, item->rtp_seq, self->pass_through);
-        gst_data_queue_push(self->approved_packets, (GstDataQueueItem *)item);
-    } else
+    stream = lookup_stream(self, stream_id);
+    if (!stream || stream->approved == stream->announced) {
         GST_LOG_OBJECT(self, "Got approve callback on an empty queue, or flushing");
+        return;
+    }
+
+    slot = &stream->ring.slots[stream->approved & GST_SCREAM_RING_MASK];
+    stream->approved++;
+    stream->enqueued_payload_size -= slot->rtp_payload_size;
+    stream->enqueued_packets--;
+    self->approved_num++;
+    GST_LOG_OBJECT(self, "approving: pt = %u, seq: %u, pass: %u",
+            slot->rtp_pt, slot->rtp_seq, self->pass_through);
+
+    /* The packet leaves with the batch of the current round */
+    gst_scream_controller_packet_transmitted(self->scream_controller, stream_id,
+        slot->rtp_payload_size, slot->rtp_seq, get_gst_time_us(self));
+
+    /* A shared controller may approve our packets from another queue's loop */
+    wakeup_srcpad_loop(self);
 }
 
 static void clear_queue(guint stream_id, GstScreamQueue *self)
 {
+    GstScreamRingSlot *slot;
     GstScreamStream *stream;
-    g_rw_lock_reader_lock(&self->lock);
-    stream = g_hash_table_lookup(self->streams, GUINT_TO_POINTER(stream_id));
-    g_rw_lock_reader_unlock(&self->lock);
-    clear_packet_queue(stream->packet_queue);
+
+    stream = lookup_stream(self, stream_id);
+    for (; stream->approved != stream->announced; stream->approved++) {
+        slot = &stream->ring.slots[stream->approved & GST_SCREAM_RING_MASK];
+        gst_buffer_unref(slot->buffer);
+        slot->buffer = NULL;
+    }
     stream->enqueued_payload_size = 0;
     stream->enqueued_packets = 0;
     gst_pad_push_event(self->sink_pad,
@@ -601,22 +760,29 @@ static void clear_queue(guint stream_id, GstScreamQueue *self)
 static void gst_scream_queue_incoming_feedback(GstScreamQueue *self, guint ssrc,
     guint timestamp, guint highest_seq, guint n_loss, guint n_ecn, gboolean qbit)
 {
-    GstScreamDataQueueRtcpItem *rtcp_item;
-    rtcp_item = g_slice_new(GstScreamDataQueueRtcpItem);
-    ((GstDataQueueItem *)rtcp_item)->object = NULL;
-    ((GstDataQueueItem *)rtcp_item)->size = 0;
-    ((GstDataQueueItem *)rtcp_item)->visible = TRUE;
-    ((GstDataQueueItem *)rtcp_item)->duration = 0;
-    ((GstDataQueueItem *)rtcp_item)->destroy = (GDestroyNotify)gst_scream_data_queue_rtcp_item_free;
-    ((GstScreamDataQueueItem *)rtcp_item)->type = GST_SCREAM_DATA_QUEUE_ITEM_TYPE_RTCP;
-    ((GstScreamDataQueueItem *)rtcp_item)->rtp_ssrc = ssrc;
-    rtcp_item->highest_seq = highest_seq;
-    rtcp_item->n_loss = n_loss;
-    rtcp_item->n_ecn = n_ecn;
-    rtcp_item->timestamp = timestamp;
-    rtcp_item->qbit = qbit;
-
-    g_async_queue_push(self->incoming_packets, (gpointer)rtcp_item);
+    GstScreamFeedbackLane *lane = self->feedback_lane;
+    GstScreamFeedback *feedback;
+    guint head;
+
+    g_mutex_lock(&self->feedback_lock);
+    head = (guint)g_atomic_int_get(&lane->head);
+    if (head - (guint)g_atomic_int_get(&lane->tail) >= GST_SCREAM_FEEDBACK_LANE_SIZE) {
+        /* The counters in the feedback are cumulative, the next one covers this */
+        GST_DEBUG_OBJECT(self, "Feedback lane is full, dropping feedback for ssrc %u", ssrc);
+        g_mutex_unlock(&self->feedback_lock);
+        return;
+    }
+    feedback = &lane->items[head & GST_SCREAM_FEEDBACK_LANE_MASK];
+    feedback->ssrc = ssrc;
+    feedback->timestamp = timestamp;
+    feedback->highest_seq = highest_seq;
+    feedback->n_loss = n_loss;
+    feedback->n_ecn = n_ecn;
+    feedback->qbit = qbit;
+    g_atomic_int_set(&lane->head, (gint)(head + 1));
+    g_mutex_unlock(&self->feedback_lock);
+
+    wakeup_srcpad_loop(self);
 }
 
 static guint64 get_gst_time_us(GstScreamQueue *self)
@@ -627,6 +793,7 @@ static guint64 get_gst_time_us(GstScreamQueue *self)
     clock = gst_element_get_clock(GST_ELEMENT(self));
     if (G_LIKELY(clock)) {
         time = gst_clock_get_time(clock);
+        gst_object_unref(clock);
     }
     return time / 1000;
 }
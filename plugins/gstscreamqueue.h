@@ -41,6 +41,11 @@ G_BEGIN_DECLS
 typedef struct _GstScreamQueue GstScreamQueue;
 typedef struct _GstScreamQueueClass GstScreamQueueClass;
 typedef struct _GstScreamQueuePrivate GstScreamQueuePrivate;
+typedef struct _GstScreamStream GstScreamStream;
+typedef struct _GstScreamRing GstScreamRing;
+typedef struct _GstScreamFeedbackLane GstScreamFeedbackLane;
+
+#define GST_SCREAM_QUEUE_MAX_STREAMS 16
 
 struct _GstScreamQueue {
     GstElement element;
@@ -53,15 +58,28 @@ struct _GstScreamQueue {
     GstScreamController *scream_controller;
     guint priority;
 
-    GRWLock lock;
-    GHashTable *streams;
-    GHashTable *adapted_stream_ids;
+    /* Streams are only added by the sink chain and published through
+     * streams_num, so the src loop can walk them without locking */
+    GstScreamStream *streams[GST_SCREAM_QUEUE_MAX_STREAMS];
+    gint streams_num;
     GHashTable *ignored_stream_ids;
 
-    /*GstDataQueue *incoming_packets;*/
-    GAsyncQueue *incoming_packets;
-    GstDataQueue *approved_packets;
+    /* Packets of not adapted streams and of pass through mode */
+    GstScreamRing *bypass_lane;
+    GstScreamFeedbackLane *feedback_lane;
+    GMutex feedback_lock;
+
+    GMutex wait_lock;
+    GCond wait_cond;
+    gint waiting;
+    gboolean signaled;
+    gint flushing;
+
+    guint approved_num;
     guint64 next_approve_time;
+
+    /* Packets dropped by the sink chain as their ring was full */
+    guint dropped_num;
 };
 
 struct _GstScreamQueueClass {
@@ -0,0 +1,290 @@
+/* GStreamer Latency tracer
+ * Copyright (C) 2015 Balázs Kreith (contact: balazs.kreith@gmail.com)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "latencytracer.h"
+#include <string.h>
+#include <time.h>
+
+#define THIS_LOCK(this) g_mutex_lock(&this->mutex)
+#define THIS_UNLOCK(this) g_mutex_unlock(&this->mutex)
+
+#define _record_of(this, seq) (this->records + ((seq) % LATENCYTRACER_RECORDS_NUM))
+#define _histogram_of(this, subflow_id, stage) (this->histograms + (subflow_id) * this->stages_num + (stage))
+
+GST_DEBUG_CATEGORY_STATIC (latencytracer_debug_category);
+#define GST_CAT_DEFAULT latencytracer_debug_category
+
+G_DEFINE_TYPE (LatencyTracer, latencytracer, G_TYPE_OBJECT);
+
+//----------------------------------------------------------------------
+//-------- Private functions belongs to the object ----------
+//----------------------------------------------------------------------
+
+static void latencytracer_finalize (GObject * object);
+static void _histogram_add(LatencyHistogram *histogram, guint64 value);
+static guint64 _histogram_percentile(LatencyHistogram *histogram, gdouble percentile);
+
+//----------------------------------------------------------------------
+//--------- Private functions implementations to the object --------
+//----------------------------------------------------------------------
+
+void
+latencytracer_class_init (LatencyTracerClass * klass)
+{
+  GObjectClass *gobject_class;
+
+  gobject_class = (GObjectClass *) klass;
+
+  gobject_class->finalize = latencytracer_finalize;
+
+  GST_DEBUG_CATEGORY_INIT (latencytracer_debug_category, "latencytracer", 0,
+      "MpRTP Latency Tracer");
+}
+
+void
+latencytracer_finalize (GObject * object)
+{
+  LatencyTracer *this = LATENCYTRACER (object);
+  g_free(this->records);
+  g_free(this->histograms);
+  g_mutex_clear(&this->mutex);
+}
+
+void
+latencytracer_init (LatencyTracer * this)
+{
+  g_mutex_init(&this->mutex);
+  this->enabled = FALSE;
+}
+
+LatencyTracer *make_latencytracer(const gchar *stage, ...)
+{
+  LatencyTracer *result;
+  va_list args;
+
+  result = g_object_new (LATENCYTRACER_TYPE, NULL);
+  va_start(args, stage);
+  for(; stage && result->stages_num < LATENCYTRACER_MAX_STAGES; stage = va_arg(args, const gchar*)){
+    result->stages[result->stages_num++] = stage;
+  }
+  va_end(args);
+  return result;
+}
+
+void latencytracer_set_enabled(LatencyTracer *this, gboolean enabled)
+{
+  THIS_LOCK(this);
+  if(enabled && !this->records){
+    this->records    = g_malloc0(sizeof(LatencyTracerRecord) * LATENCYTRACER_RECORDS_NUM);
+    this->histograms = g_malloc0(sizeof(LatencyHistogram) * MPRTP_PLUGIN_MAX_SUBFLOW_NUM * this->stages_num);
+  }
+  this->enabled = enabled;
+  THIS_UNLOCK(this);
+}
+
+gboolean latencytracer_get_enabled(LatencyTracer *this)
+{
+  return this->enabled;
+}
+
+void latencytracer_reset(LatencyTracer *this)
+{
+  THIS_LOCK(this);
+  if(this->records){
+    memset(this->records, 0, sizeof(LatencyTracerRecord) * LATENCYTRACER_RECORDS_NUM);
+    memset(this->histograms, 0, sizeof(LatencyHistogram) * MPRTP_PLUGIN_MAX_SUBFLOW_NUM * this->stages_num);
+  }
+  THIS_UNLOCK(this);
+}
+
+guint64 latencytracer_now(void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (guint64) ts.tv_sec * GST_SECOND + ts.tv_nsec;
+}
+
+void latencytracer_begin(LatencyTracer *this, guint16 seq, guint8 subflow_id, guint64 entered)
+{
+  LatencyTracerRecord *record;
+  if(G_LIKELY(!this->enabled)){
+    return;
+  }
+  record = _record_of(this, seq);
+  memset(record->stamps, 0, sizeof(record->stamps));
+  record->seq        = seq;
+  record->subflow_id = subflow_id;
+  record->stamps[0]  = entered;
+}
+
+void latencytracer_set_subflow(LatencyTracer *this, guint16 seq, guint8 subflow_id)
+{
+  LatencyTracerRecord *record;
+  if(G_LIKELY(!this->enabled)){
+    return;
+  }
+  record = _record_of(this, seq);
+  if(record->seq == seq){
+    record->subflow_id = subflow_id;
+  }
+}
+
+void latencytracer_stamp(LatencyTracer *this, guint16 seq, guint stage)
+{
+  LatencyTracerRecord *record;
+  if(G_LIKELY(!this->enabled)){
+    return;
+  }
+  record = _record_of(this, seq);
+  if(record->seq != seq || !record->stamps[0] || this->stages_num <= stage){
+    return;
+  }
+  record->stamps[stage] = latencytracer_now();
+}
+
+void latencytracer_finish(LatencyTracer *this, guint16 seq)
+{
+  LatencyTracerRecord *record;
+  guint64 stamp, prev;
+  guint i;
+
+  if(G_LIKELY(!this->enabled)){
+    return;
+  }
+  record = _record_of(this, seq);
+  if(record->seq != seq || !record->stamps[0]){
+    return;
+  }
+  record->stamps[this->stages_num - 1] = latencytracer_now();
+  if(MPRTP_PLUGIN_MAX_SUBFLOW_NUM <= record->subflow_id){
+    goto done;
+  }
+
+  THIS_LOCK(this);
+  prev = record->stamps[0];
+  for(i = 1; i < this->stages_num; ++i){
+    //a stage the packet skipped took no time
+    stamp = MAX(prev, record->stamps[i]);
+    _histogram_add(_histogram_of(this, record->subflow_id, i), stamp - prev);
+    prev = stamp;
+  }
+  _histogram_add(_histogram_of(this, record->subflow_id, 0), prev - record->stamps[0]);
+  THIS_UNLOCK(this);
+done:
+  record->stamps[0] = 0;
+}
+
+gchar *latencytracer_get_stats(LatencyTracer *this)
+{
+  GString *result;
+  LatencyHistogram *histogram;
+  guint subflow_id, i;
+
+  result = g_string_new("subflow,stage,count,min_us,p50_us,p90_us,p99_us,max_us\n");
+  THIS_LOCK(this);
+  if(!this->histograms){
+    goto done;
+  }
+  for(subflow_id = 0; subflow_id < MPRTP_PLUGIN_MAX_SUBFLOW_NUM; ++subflow_id){
+    if(!_histogram_of(this, subflow_id, 0)->counter){
+      continue;
+    }
+    for(i = 0; i < this->stages_num; ++i){
+      histogram = _histogram_of(this, subflow_id, i);
+      g_string_append_printf(result, "%u,%s,%"G_GUINT64_FORMAT",%.1f,%.1f,%.1f,%.1f,%.1f\n",
+          subflow_id,
+          i ? this->stages[i] : "total",
+          histogram->counter,
+          (gdouble) histogram->min / GST_USECOND,
+          (gdouble) _histogram_percentile(histogram, .5) / GST_USECOND,
+          (gdouble) _histogram_percentile(histogram, .9) / GST_USECOND,
+          (gdouble) _histogram_percentile(histogram, .99) / GST_USECOND,
+          (gdouble) histogram->max / GST_USECOND);
+    }
+  }
+done:
+  THIS_UNLOCK(this);
+  return g_string_free(result, FALSE);
+}
+
+static guint _bucket_of(guint64 value)
+{
+  guint msb, shift;
+  if(value < LATENCYHISTOGRAM_LINEAR){
+    return value;
+  }
+  msb = g_bit_storage(value) - 1;
+  if(LATENCYHISTOGRAM_MAX_BITS <= msb){
+    return LATENCYHISTOGRAM_BUCKETS_NUM - 1;
+  }
+  shift = msb - LATENCYHISTOGRAM_SUB_BITS;
+  return LATENCYHISTOGRAM_LINEAR +
+         (msb - LATENCYHISTOGRAM_SUB_BITS - 1) * (1 << LATENCYHISTOGRAM_SUB_BITS) +
+         (guint)(value >> shift) - (1 << LATENCYHISTOGRAM_SUB_BITS);
+}
+
+//The middle of the bucket
+static guint64 _value_of(guint bucket)
+{
+  guint msb, shift, sub;
+  if(bucket < LATENCYHISTOGRAM_LINEAR){
+    return bucket;
+  }
+  bucket -= LATENCYHISTOGRAM_LINEAR;
+  msb   = bucket / (1 << LATENCYHISTOGRAM_SUB_BITS) + LATENCYHISTOGRAM_SUB_BITS + 1;
+  sub   = bucket % (1 << LATENCYHISTOGRAM_SUB_BITS) + (1 << LATENCYHISTOGRAM_SUB_BITS);
+  shift = msb - LATENCYHISTOGRAM_SUB_BITS;
+  return ((guint64) sub << shift) + ((G_GUINT64_CONSTANT(1) << shift) >> 1);
+}
+
+void _histogram_add(LatencyHistogram *histogram, guint64 value)
+{
+  if(!histogram->counter || value < histogram->min){
+    histogram->min = value;
+  }
+  histogram->max = MAX(histogram->max, value);
+  ++histogram->buckets[_bucket_of(value)];
+  ++histogram->counter;
+}
+
+guint64 _histogram_percentile(LatencyHistogram *histogram, gdouble percentile)
+{
+  guint64 rank, sum = 0;
+  guint i;
+  if(!histogram->counter){
+    return 0;
+  }
+  rank = MAX(1, (guint64)(percentile * histogram->counter + .5));
+  for(i = 0; i < LATENCYHISTOGRAM_BUCKETS_NUM; ++i){
+    sum += histogram->buckets[i];
+    if(rank <= sum){
+      return CONSTRAIN(histogram->min, histogram->max, _value_of(i));
+    }
+  }
+  return histogram->max;
+}
+
+#undef _record_of
+#undef _histogram_of
+#undef THIS_LOCK
+#undef THIS_UNLOCK
@@ -0,0 +1,98 @@
+/*
+ * latencytracer.h
+ *
+ *  Per stage latency tracing of packets inside an MPRTP element. Every
+ *  packet is stamped with the monotonic clock when it passes a stage, and
+ *  the time spent between two stages is aggregated into per subflow HDR
+ *  histograms when the packet leaves the element. The records and the
+ *  histograms are allocated when the tracing is enabled, so stamping does
+ *  not allocate. Disabled tracers return at the first check.
+ */
+
+#ifndef LATENCYTRACER_H_
+#define LATENCYTRACER_H_
+
+#include <gst/gst.h>
+#include "gstmprtpbuffer.h"
+
+typedef struct _LatencyTracer LatencyTracer;
+typedef struct _LatencyTracerClass LatencyTracerClass;
+typedef struct _LatencyTracerRecord LatencyTracerRecord;
+typedef struct _LatencyHistogram LatencyHistogram;
+
+#define LATENCYTRACER_TYPE             (latencytracer_get_type())
+#define LATENCYTRACER(src)             (G_TYPE_CHECK_INSTANCE_CAST((src),LATENCYTRACER_TYPE,LatencyTracer))
+#define LATENCYTRACER_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST((klass),LATENCYTRACER_TYPE,LatencyTracerClass))
+#define LATENCYTRACER_IS_SOURCE(src)          (G_TYPE_CHECK_INSTANCE_TYPE((src),LATENCYTRACER_TYPE))
+#define LATENCYTRACER_IS_SOURCE_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE((klass),LATENCYTRACER_TYPE))
+#define LATENCYTRACER_CAST(src)        ((LatencyTracer *)(src))
+
+#define LATENCYTRACER_MAX_STAGES 8
+//Packets are identified by their sequence number, records are reused
+//after this many packets.
+#define LATENCYTRACER_RECORDS_NUM 4096
+
+//Values below 32ns are counted exactly, above that every power of two is
+//split into 16 buckets (3% relative error), up to 2^40ns (~18 minutes).
+#define LATENCYHISTOGRAM_SUB_BITS 4
+#define LATENCYHISTOGRAM_LINEAR (2 << LATENCYHISTOGRAM_SUB_BITS)
+#define LATENCYHISTOGRAM_MAX_BITS 40
+#define LATENCYHISTOGRAM_BUCKETS_NUM \
+  (LATENCYHISTOGRAM_LINEAR + (LATENCYHISTOGRAM_MAX_BITS - LATENCYHISTOGRAM_SUB_BITS - 1) * (1 << LATENCYHISTOGRAM_SUB_BITS))
+
+struct _LatencyHistogram
+{
+  guint64                  counter;
+  guint64                  min;
+  guint64                  max;
+  guint32                  buckets[LATENCYHISTOGRAM_BUCKETS_NUM];
+};
+
+struct _LatencyTracerRecord
+{
+  guint16                  seq;
+  guint8                   subflow_id;
+  guint64                  stamps[LATENCYTRACER_MAX_STAGES];
+};
+
+struct _LatencyTracer
+{
+  GObject                  object;
+  GMutex                   mutex;
+  gboolean                 enabled;
+
+  const gchar*             stages[LATENCYTRACER_MAX_STAGES];
+  guint                    stages_num;
+
+  LatencyTracerRecord*     records;
+  //one histogram for the whole element time and one for each stage
+  //after the first, per subflow
+  LatencyHistogram*        histograms;
+};
+
+struct _LatencyTracerClass{
+  GObjectClass parent_class;
+};
+
+GType latencytracer_get_type (void);
+
+//The stages are named in the order packets pass them, NULL terminated.
+//The first stage is where the packet enters the element, the last one is
+//where it leaves.
+LatencyTracer *make_latencytracer(const gchar *stage, ...) G_GNUC_NULL_TERMINATED;
+void latencytracer_set_enabled(LatencyTracer *this, gboolean enabled);
+gboolean latencytracer_get_enabled(LatencyTracer *this);
+void latencytracer_reset(LatencyTracer *this);
+
+guint64 latencytracer_now(void);
+//Opens the record of the packet with the time it entered the element
+void latencytracer_begin(LatencyTracer *this, guint16 seq, guint8 subflow_id, guint64 entered);
+void latencytracer_set_subflow(LatencyTracer *this, guint16 seq, guint8 subflow_id);
+void latencytracer_stamp(LatencyTracer *this, guint16 seq, guint stage);
+//Stamps the last stage and aggregates the record
+void latencytracer_finish(LatencyTracer *this, guint16 seq);
+
+//CSV lines: subflow,stage,count,min_us,p50_us,p90_us,p99_us,max_us
+gchar *latencytracer_get_stats(LatencyTracer *this);
+
+#endif /* LATENCYTRACER_H_ */
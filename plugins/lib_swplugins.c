@@ -1,6 +1,7 @@
 #include "lib_swplugins.h"
 #include "gstmprtpbuffer.h"
 #include <math.h>
+#include <stdio.h>
 
 #define now (gst_clock_get_time (sysclock))
 static GstClock* sysclock;
@@ -86,7 +87,7 @@ void swperctest(void)
       //profile 2 - perc
       _median_test_with_perc(filename, sw, &array[j], &elapsed2);
 
-      mprtp_logger(filename, "%u,%lu,%u,%lu\n", result1, elapsed1, result2, elapsed2);
+      mprtp_logger(filename, "%u,%" G_GUINT64_FORMAT ",%u,%" G_GUINT64_FORMAT "\n", result1, elapsed1, result2, elapsed2);
     }
 
     slidingwindow_clear(sw);
@@ -97,6 +98,127 @@ void swperctest(void)
   g_free(array);
   g_free(array2);
 }
+//Accuracy and cost of make_swquantile against make_swpercentile.
+//The trace is an owd_<subflow>.csv written by the FBRA feedback processor,
+//its first column is the short term OWD in microseconds.
+static void _quantiletest_exact_pipe(gpointer udata, swpercentilecandidates_t *candidates)
+{
+  guint64 *result = udata;
+  if(!candidates->processed){
+    return;
+  }
+  if(!candidates->left){
+    *result = *(guint64*)candidates->right;
+  }else if(!candidates->right){
+    *result = *(guint64*)candidates->left;
+  }else{
+    *result  = *(guint64*)candidates->left;
+    *result += *(guint64*)candidates->right;
+    *result >>= 1;
+  }
+}
+
+static void _quantiletest_sketch_pipe(gpointer udata, swquantilestat_t *stat)
+{
+  guint64 *result = udata;
+  if(!stat->processed){
+    return;
+  }
+  *result = stat->value;
+}
+
+static guint64* _quantiletest_load_trace(const gchar *tracefile, gint *length)
+{
+  FILE *fp;
+  guint64 *result;
+  gint size = 1024;
+  gchar line[255];
+
+  *length = 0;
+  result  = g_malloc0(sizeof(guint64) * size);
+  fp      = tracefile ? fopen(tracefile, "r") : NULL;
+  if(!fp){
+    //Without a recorded trace a heavy tailed synthetic OWD is used
+    for(*length = 0; *length < 100000; ++*length){
+      if(size <= *length){
+        size <<= 1;
+        result = g_realloc(result, sizeof(guint64) * size);
+      }
+      result[*length] = 20000 + (guint64)(5000. * exp(g_random_double_range(0., 3.)));
+    }
+    return result;
+  }
+  while(fgets(line, 255, fp)){
+    if(size <= *length){
+      size <<= 1;
+      result = g_realloc(result, sizeof(guint64) * size);
+    }
+    result[*length] = g_ascii_strtoull(line, NULL, 10);
+    ++*length;
+  }
+  fclose(fp);
+  return result;
+}
+
+void swquantiletest(const gchar *tracefile)
+{
+  guint64 *trace;
+  guint64 exact = 0, sketch = 0;
+  GstClockTime elapsed_exact, elapsed_sketch, sum_exact, sum_sketch;
+  gdouble err, max_err;
+  gchar filename[255];
+  gint i, j, k, length;
+  gint32 percentiles[2] = {50, 80};
+  guint32 num_limits[4] = {50, 600, 6000, 60000};
+
+  sysclock = gst_system_clock_obtain();
+  trace = _quantiletest_load_trace(tracefile, &length);
+
+  for(i = 0; i < 2; ++i){
+    for(j = 0; j < 4; ++j){
+      SlidingWindow *exact_sw, *sketch_sw;
+      exact_sw  = make_slidingwindow_uint64(num_limits[j], 0);
+      sketch_sw = make_slidingwindow_uint64(num_limits[j], 0);
+      slidingwindow_add_plugin(exact_sw,
+          make_swpercentile(percentiles[i], bintree3cmp_uint64, _quantiletest_exact_pipe, &exact));
+      slidingwindow_add_plugin(sketch_sw,
+          make_swquantile(percentiles[i], .01, 10. * GST_SECOND / GST_USECOND, swquantile_value_uint64,
+                          _quantiletest_sketch_pipe, &sketch));
+
+      sprintf(filename, "quantiletest_%d_%d.csv", percentiles[i], num_limits[j]);
+      sum_exact = sum_sketch = 0;
+      max_err = 0.;
+      for(k = 0; k < length; ++k){
+        elapsed_exact = now;
+        slidingwindow_add_data(exact_sw, &trace[k]);
+        elapsed_exact = now - elapsed_exact;
+
+        elapsed_sketch = now;
+        slidingwindow_add_data(sketch_sw, &trace[k]);
+        elapsed_sketch = now - elapsed_sketch;
+
+        err = exact ? fabs((gdouble)sketch - (gdouble)exact) / (gdouble)exact : 0.;
+        max_err = MAX(max_err, err);
+        sum_exact += elapsed_exact;
+        sum_sketch += elapsed_sketch;
+        mprtp_logger(filename, "%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT ",%f,%"
+            G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT "\n", exact, sketch, err, elapsed_exact, elapsed_sketch);
+      }
+      g_printerr("percentile: %d window: %u max rel. error: %f avg ns exact: %"
+              G_GUINT64_FORMAT " sketch: %" G_GUINT64_FORMAT "\n",
+              percentiles[i], num_limits[j], max_err,
+              length ? sum_exact / length : 0, length ? sum_sketch / length : 0);
+
+      slidingwindow_clear(exact_sw);
+      slidingwindow_clear(sketch_sw);
+      g_object_unref(exact_sw);
+      g_object_unref(sketch_sw);
+    }
+  }
+
+  g_object_unref(sysclock);
+  g_free(trace);
+}
 //----------------- SWPrinter plugin --------------------------------------
 
 void swprinter_int32(gpointer data, gchar* string)
@@ -484,6 +606,132 @@ SlidingWindowPlugin* make_swpercentile(
 
 
 
+//-----------------------------------------------------------------------------------
+
+typedef struct _swquantile{
+  gdouble         (*value)(gpointer);
+  void            (*quantile_pipe)(gpointer,swquantilestat_t*);
+  gpointer          quantile_data;
+  quantilesketch_t *sketch;
+  swquantilestat_t  stat;
+}swquantile_t;
+
+gdouble swquantile_value_int32(gpointer item)
+{
+  return *(gint32*)item;
+}
+
+gdouble swquantile_value_uint32(gpointer item)
+{
+  return *(guint32*)item;
+}
+
+gdouble swquantile_value_int64(gpointer item)
+{
+  return *(gint64*)item;
+}
+
+gdouble swquantile_value_uint64(gpointer item)
+{
+  return *(guint64*)item;
+}
+
+static swquantile_t* _swquantilepriv_ctor(gint32    percentile,
+                                          gdouble   rel_accuracy,
+                                          gdouble   max_value,
+                                          gdouble (*value)(gpointer),
+                                          void    (*quantile_pipe)(gpointer,swquantilestat_t*),
+                                          gpointer  quantile_data)
+{
+  swquantile_t* this;
+  this = malloc(sizeof(swquantile_t));
+  memset(this, 0, sizeof(swquantile_t));
+
+  this->sketch          = make_quantilesketch(percentile, rel_accuracy, max_value);
+  this->value           = value;
+  this->quantile_pipe   = quantile_pipe;
+  this->quantile_data   = quantile_data;
+  return this;
+}
+
+static void _swquantilepriv_disposer(gpointer target)
+{
+  swquantile_t* this = target;
+  if(!target){
+    return;
+  }
+  quantilesketch_dtor(this->sketch);
+  free(this);
+}
+
+static void _swquantile_disposer(gpointer target)
+{
+  SlidingWindowPlugin* this = target;
+  if(!target){
+    return;
+  }
+
+  _swquantilepriv_disposer(this->priv);
+  this->priv = NULL;
+  free(this);
+}
+
+static void _swquantile_pipe(swquantile_t *this)
+{
+  this->stat.processed = quantilesketch_get(this->sketch,
+                                            &this->stat.value,
+                                            &this->stat.min,
+                                            &this->stat.max);
+  this->stat.counter = this->sketch->counter;
+  if(this->quantile_pipe){
+    this->quantile_pipe(this->quantile_data, &this->stat);
+  }
+}
+
+static void _swquantile_add_pipe(gpointer dataptr, gpointer itemptr)
+{
+  swquantile_t* this = dataptr;
+  quantilesketch_add(this->sketch, this->value(itemptr));
+  _swquantile_pipe(this);
+}
+
+static void _swquantile_rem_pipe(gpointer dataptr, gpointer itemptr)
+{
+  swquantile_t* this = dataptr;
+  if(!quantilesketch_rem(this->sketch, this->value(itemptr))){
+    GST_WARNING("No data with value %f registered by swquantile", this->value(itemptr));
+    return;
+  }
+  _swquantile_pipe(this);
+}
+
+SlidingWindowPlugin* make_swquantile(
+                              gint32     percentile,
+                              gdouble    rel_accuracy,
+                              gdouble    max_value,
+                              gdouble  (*value)(gpointer),
+                              void     (*quantile_pipe)(gpointer,swquantilestat_t*),
+                              gpointer   quantile_data
+                              )
+{
+  SlidingWindowPlugin* this;
+  this = swplugin_ctor();
+  this->priv = _swquantilepriv_ctor(percentile,
+                                    rel_accuracy,
+                                    max_value,
+                                    value,
+                                    quantile_pipe,
+                                    quantile_data);
+
+  this->add_pipe          = _swquantile_add_pipe;
+  this->add_data          = this->priv;
+  this->rem_pipe          = _swquantile_rem_pipe;
+  this->rem_data          = this->priv;
+  this->disposer          = _swquantile_disposer;
+  return this;
+}
+
+
 typedef struct _swint32stater{
   void          (*pipe)(gpointer,swint32stat_t*);
   gpointer        pipe_data;
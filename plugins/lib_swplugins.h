@@ -7,9 +7,11 @@
 #include <string.h>
 #include <assert.h>
 #include "slidingwindow.h"
+#include "lib_winstat.h"
 #include "lib_bintree.h"
 
 void swperctest(void);
+void swquantiletest(const gchar *tracefile);
 void swprinter_int32(gpointer data, gchar* string);
 void swprinter_uint32(gpointer data, gchar* string);
 void swprinter_int64(gpointer data, gchar* string);
@@ -60,6 +62,31 @@ SlidingWindowPlugin* make_swpercentile(
                               gpointer       percentile_data
                               );
 
+typedef struct swquantilestat_struct_t{
+  gboolean  processed;
+  gdouble   value;
+  gdouble   min;
+  gdouble   max;
+  gint32    counter;
+}swquantilestat_t;
+
+gdouble swquantile_value_int32(gpointer item);
+gdouble swquantile_value_uint32(gpointer item);
+gdouble swquantile_value_int64(gpointer item);
+gdouble swquantile_value_uint64(gpointer item);
+
+//Bounded error alternative of swpercentile. Values are counted in
+//logarithmic buckets, so the memory does not depend on the window size and
+//the returned percentile is within rel_accuracy of the exact one.
+SlidingWindowPlugin* make_swquantile(
+                              gint32     percentile,
+                              gdouble    rel_accuracy,
+                              gdouble    max_value,
+                              gdouble  (*value)(gpointer),
+                              void     (*quantile_pipe)(gpointer,swquantilestat_t*),
+                              gpointer   quantile_data
+                              );
+
 SlidingWindowPlugin* make_swint32_stater(void (*pipe)(gpointer,swint32stat_t*),gpointer pipe_data);
 
 #endif /* INCGUARD_NTRT_LIBRARY_SWPLUGINS_H_ */
@@ -0,0 +1,346 @@
+#include "lib_winstat.h"
+#include "gstmprtpbuffer.h"
+#include <math.h>
+#include <string.h>
+#include <stdlib.h>
+
+//----------------- Quantile sketch ------------------------------------------------
+
+quantilesketch_t* make_quantilesketch(gint32 percentile, gdouble rel_accuracy, gdouble max_value)
+{
+  quantilesketch_t* this;
+  this = malloc(sizeof(quantilesketch_t));
+  memset(this, 0, sizeof(quantilesketch_t));
+
+  rel_accuracy          = CONSTRAIN(.0001, .5, rel_accuracy);
+  this->percentile      = CONSTRAIN(1, 99, percentile);
+  this->gamma           = (1. + rel_accuracy) / (1. - rel_accuracy);
+  this->log_gamma       = log(this->gamma);
+  //bucket 0 collects every value below 1, bucket i covers (gamma^(i-2), gamma^(i-1)]
+  this->length          = (gint32)ceil(log(MAX(max_value, 2.)) / this->log_gamma) + 2;
+  this->buckets         = malloc(sizeof(gint32) * this->length);
+  memset(this->buckets, 0, sizeof(gint32) * this->length);
+  return this;
+}
+
+void quantilesketch_dtor(gpointer target)
+{
+  quantilesketch_t* this = target;
+  if(!target){
+    return;
+  }
+  free(this->buckets);
+  free(this);
+}
+
+void quantilesketch_reset(quantilesketch_t* this)
+{
+  memset(this->buckets, 0, sizeof(gint32) * this->length);
+  this->counter = this->cursor = this->below = 0;
+  this->lowest  = this->highest = 0;
+}
+
+static gint32 _quantilesketch_index(quantilesketch_t *this, gdouble value)
+{
+  if(value < 1.){
+    return 0;
+  }
+  return CONSTRAIN(1, this->length - 1, (gint32)ceil(log(value) / this->log_gamma) + 1);
+}
+
+static gdouble _quantilesketch_estimate(quantilesketch_t *this, gint32 index)
+{
+  if(!index){
+    return 0.;
+  }
+  //The midpoint of the bucket in relative terms
+  return 2. * pow(this->gamma, index - 1) / (this->gamma + 1.);
+}
+
+void quantilesketch_add(quantilesketch_t* this, gdouble value)
+{
+  gint32 index;
+  index = _quantilesketch_index(this, value);
+
+  if(!this->counter){
+    this->lowest = this->highest = index;
+  }else{
+    this->lowest  = MIN(this->lowest, index);
+    this->highest = MAX(this->highest, index);
+  }
+  ++this->buckets[index];
+  ++this->counter;
+  if(index < this->cursor){
+    ++this->below;
+  }
+}
+
+gboolean quantilesketch_rem(quantilesketch_t* this, gdouble value)
+{
+  gint32 index;
+  index = _quantilesketch_index(this, value);
+
+  if(!this->buckets[index]){
+    return FALSE;
+  }
+  --this->buckets[index];
+  --this->counter;
+  if(index < this->cursor){
+    --this->below;
+  }
+  return TRUE;
+}
+
+gboolean quantilesketch_get(quantilesketch_t* this, gdouble *value, gdouble *min, gdouble *max)
+{
+  gint32 rank;
+
+  if(!this->counter){
+    this->cursor = this->below = 0;
+    return FALSE;
+  }
+
+  rank = MAX(1, (gint32)ceil((gdouble)(this->percentile * this->counter) / 100.));
+  while(rank <= this->below){
+    --this->cursor;
+    this->below -= this->buckets[this->cursor];
+  }
+  while(this->below + this->buckets[this->cursor] < rank){
+    this->below += this->buckets[this->cursor];
+    ++this->cursor;
+  }
+
+  while(!this->buckets[this->lowest]) ++this->lowest;
+  while(!this->buckets[this->highest]) --this->highest;
+
+  if(value) *value = _quantilesketch_estimate(this, this->cursor);
+  if(min)   *min   = _quantilesketch_estimate(this, this->lowest);
+  if(max)   *max   = _quantilesketch_estimate(this, this->highest);
+  return TRUE;
+}
+
+//----------------- Window statistics ----------------------------------------------
+
+#define _item_at(this, seq) (this->items + ((seq) % this->length))
+#define _deque_at(deque, this, pos) (deque[(pos) % this->length])
+
+winstat_t* make_winstat(gint32 num_limit, GstClockTime treshold)
+{
+  winstat_t* this;
+  this = malloc(sizeof(winstat_t));
+  memset(this, 0, sizeof(winstat_t));
+  this->length   = MAX(1, num_limit);
+  this->treshold = treshold;
+  this->items    = malloc(sizeof(winstat_item_t) * this->length);
+  this->mins     = malloc(sizeof(guint64) * this->length);
+  this->maxs     = malloc(sizeof(guint64) * this->length);
+  return this;
+}
+
+void winstat_dtor(gpointer target)
+{
+  winstat_t* this = target;
+  if(!target){
+    return;
+  }
+  quantilesketch_dtor(this->sketch);
+  free(this->selection);
+  free(this->items);
+  free(this->mins);
+  free(this->maxs);
+  free(this);
+}
+
+void winstat_reset(winstat_t* this)
+{
+  this->head = this->tail = 0;
+  this->offset = this->sum = this->sqsum = 0.;
+  this->mins_head = this->mins_tail = 0;
+  this->maxs_head = this->maxs_tail = 0;
+  this->ewma = 0.;
+  this->ewma_initialized = FALSE;
+  if(this->sketch){
+    quantilesketch_reset(this->sketch);
+  }
+}
+
+void winstat_set_treshold(winstat_t* this, GstClockTime treshold)
+{
+  this->treshold = treshold;
+}
+
+void winstat_enable_ewma(winstat_t* this, gdouble factor)
+{
+  this->ewma_factor = CONSTRAIN(0., 1., factor);
+}
+
+void winstat_enable_percentile(winstat_t* this, gint32 percentile, gdouble rel_accuracy, gdouble max_value)
+{
+  gint32 i;
+  quantilesketch_dtor(this->sketch);
+  this->sketch = NULL;
+  if(rel_accuracy <= 0.){
+    this->exact_percentile = CONSTRAIN(1, 99, percentile);
+    if(!this->selection){
+      this->selection = malloc(sizeof(gdouble) * this->length);
+    }
+    return;
+  }
+  this->exact_percentile = 0;
+  this->sketch = make_quantilesketch(percentile, rel_accuracy, max_value);
+  for(i = 0; i < (gint32)(this->head - this->tail); ++i){
+    quantilesketch_add(this->sketch, _item_at(this, this->tail + i)->value);
+  }
+}
+
+static void _winstat_pop(winstat_t* this)
+{
+  winstat_item_t *item;
+  gdouble diff;
+
+  item  = _item_at(this, this->tail);
+  diff  = item->value - this->offset;
+  this->sum   -= diff;
+  this->sqsum -= diff * diff;
+
+  if(this->mins_tail < this->mins_head && _deque_at(this->mins, this, this->mins_tail) == this->tail){
+    ++this->mins_tail;
+  }
+  if(this->maxs_tail < this->maxs_head && _deque_at(this->maxs, this, this->maxs_tail) == this->tail){
+    ++this->maxs_tail;
+  }
+  if(this->sketch){
+    quantilesketch_rem(this->sketch, item->value);
+  }
+  if(++this->tail == this->head){
+    this->sum = this->sqsum = 0.;
+  }
+}
+
+void winstat_add(winstat_t* this, gdouble value, GstClockTime now)
+{
+  winstat_item_t *item;
+  gdouble diff;
+
+  if(this->head - this->tail == (guint64)this->length){
+    _winstat_pop(this);
+  }
+  if(this->head == this->tail){
+    this->offset = value;
+  }
+
+  item        = _item_at(this, this->head);
+  item->value = value;
+  item->added = now;
+
+  diff = value - this->offset;
+  this->sum   += diff;
+  this->sqsum += diff * diff;
+
+  while(this->mins_tail < this->mins_head &&
+        value <= _item_at(this, _deque_at(this->mins, this, this->mins_head - 1))->value){
+    --this->mins_head;
+  }
+  _deque_at(this->mins, this, this->mins_head++) = this->head;
+
+  while(this->maxs_tail < this->maxs_head &&
+        _item_at(this, _deque_at(this->maxs, this, this->maxs_head - 1))->value <= value){
+    --this->maxs_head;
+  }
+  _deque_at(this->maxs, this, this->maxs_head++) = this->head;
+
+  if(this->sketch){
+    quantilesketch_add(this->sketch, value);
+  }
+
+  if(0. < this->ewma_factor){
+    this->ewma = !this->ewma_initialized ? value : this->ewma_factor * value + (1. - this->ewma_factor) * this->ewma;
+    this->ewma_initialized = TRUE;
+  }
+
+  ++this->head;
+  winstat_refresh(this, now);
+}
+
+void winstat_refresh(winstat_t* this, GstClockTime now)
+{
+  if(!this->treshold){
+    return;
+  }
+  //The latest sample is kept regardless of its age
+  while(this->head - this->tail > 1 && _item_at(this, this->tail)->added + this->treshold < now){
+    _winstat_pop(this);
+  }
+}
+
+//Hoare's selection, the window is copied so the items keep their order
+static gdouble _winstat_select(winstat_t* this, gint32 rank)
+{
+  gdouble *values = this->selection;
+  gdouble pivot, tmp;
+  gint32 counter, left, right, i, j;
+
+  counter = this->head - this->tail;
+  for(i = 0; i < counter; ++i){
+    values[i] = _item_at(this, this->tail + i)->value;
+  }
+  left  = 0;
+  right = counter - 1;
+  while(left < right){
+    pivot = values[(left + right) / 2];
+    i = left;
+    j = right;
+    while(i <= j){
+      while(values[i] < pivot) ++i;
+      while(pivot < values[j]) --j;
+      if(i <= j){
+        tmp = values[i]; values[i] = values[j]; values[j] = tmp;
+        ++i; --j;
+      }
+    }
+    if(rank <= j){
+      right = j;
+    }else if(i <= rank){
+      left = i;
+    }else{
+      break;
+    }
+  }
+  return values[rank];
+}
+
+gint32 winstat_get_counter(winstat_t* this)
+{
+  return this->head - this->tail;
+}
+
+void winstat_get(winstat_t* this, winstat_snapshot_t* result)
+{
+  gdouble n;
+
+  memset(result, 0, sizeof(winstat_snapshot_t));
+  result->ewma    = this->ewma;
+  result->counter = this->head - this->tail;
+  if(!result->counter){
+    return;
+  }
+  n = result->counter;
+  result->sum = this->sum + n * this->offset;
+  result->avg = this->offset + this->sum / n;
+  //Moving sample variance: V = (SX2 - SX1 * SX1 / N) / (N - 1)
+  if(1 < result->counter){
+    result->var = MAX(0., (this->sqsum - this->sum * this->sum / n) / (n - 1.));
+    result->std = sqrt(result->var);
+  }
+  result->min = _item_at(this, _deque_at(this->mins, this, this->mins_tail))->value;
+  result->max = _item_at(this, _deque_at(this->maxs, this, this->maxs_tail))->value;
+  if(this->sketch){
+    quantilesketch_get(this->sketch, &result->percentile, NULL, NULL);
+  }else if(this->exact_percentile){
+    result->percentile = _winstat_select(this,
+        MAX(1, (gint32)ceil((gdouble)(this->exact_percentile * result->counter) / 100.)) - 1);
+  }
+}
+
+#undef _item_at
+#undef _deque_at
@@ -0,0 +1,94 @@
+#ifndef INCGUARD_NTRT_LIBRARY_WINSTAT_H_
+#define INCGUARD_NTRT_LIBRARY_WINSTAT_H_
+
+#include <gst/gst.h>
+
+//Logarithmic bucket histogram. Values are counted in buckets growing by
+//gamma = (1+a)/(1-a), so a percentile is returned within the relative
+//accuracy a and the memory depends on the value range only.
+typedef struct _quantilesketch{
+  gint32            percentile;
+  gdouble           gamma;
+  gdouble           log_gamma;
+  gint32           *buckets;
+  gint32            length;
+  gint32            counter;
+  //The bucket holding the percentile and the number of values below it
+  gint32            cursor;
+  gint32            below;
+  gint32            lowest;
+  gint32            highest;
+}quantilesketch_t;
+
+quantilesketch_t* make_quantilesketch(gint32 percentile, gdouble rel_accuracy, gdouble max_value);
+void quantilesketch_dtor(gpointer target);
+void quantilesketch_reset(quantilesketch_t* this);
+void quantilesketch_add(quantilesketch_t* this, gdouble value);
+gboolean quantilesketch_rem(quantilesketch_t* this, gdouble value);
+gboolean quantilesketch_get(quantilesketch_t* this, gdouble *value, gdouble *min, gdouble *max);
+
+typedef struct winstat_snapshot_struct_t{
+  gint32    counter;
+  gdouble   sum;
+  gdouble   avg;
+  gdouble   var;
+  gdouble   std;
+  gdouble   min;
+  gdouble   max;
+  gdouble   ewma;
+  gdouble   percentile;
+}winstat_snapshot_t;
+
+typedef struct _winstat_item{
+  gdouble       value;
+  GstClockTime  added;
+}winstat_item_t;
+
+//Window statistics updated in one pass per sample. Count, sum, variance,
+//min/max (monotonic deques), EWMA and optionally a percentile are kept
+//together, so the owner needs no plugin chain and no extra locking;
+//every call is expected to be made under the owner's lock.
+typedef struct _winstat{
+  winstat_item_t   *items;
+  gint32            length;
+  GstClockTime      treshold;
+  //Sequence of the next and the oldest sample in the window
+  guint64           head;
+  guint64           tail;
+
+  //Sums are taken relative to the first sample of the window,
+  //so the variance does not cancel out on large values.
+  gdouble           offset;
+  gdouble           sum;
+  gdouble           sqsum;
+
+  //Sample sequences with increasing (mins) and decreasing (maxs) values
+  guint64          *mins;
+  guint64           mins_head, mins_tail;
+  guint64          *maxs;
+  guint64           maxs_head, maxs_tail;
+
+  gdouble           ewma_factor;
+  gdouble           ewma;
+  gboolean          ewma_initialized;
+
+  quantilesketch_t *sketch;
+  //The exact percentile is selected from a copy of the window on read
+  gint32            exact_percentile;
+  gdouble          *selection;
+}winstat_t;
+
+winstat_t* make_winstat(gint32 num_limit, GstClockTime treshold);
+void winstat_dtor(gpointer target);
+void winstat_reset(winstat_t* this);
+void winstat_set_treshold(winstat_t* this, GstClockTime treshold);
+void winstat_enable_ewma(winstat_t* this, gdouble factor);
+//A rel_accuracy of 0 selects the exact percentile, otherwise it is
+//taken from a quantile sketch with the given relative accuracy
+void winstat_enable_percentile(winstat_t* this, gint32 percentile, gdouble rel_accuracy, gdouble max_value);
+void winstat_add(winstat_t* this, gdouble value, GstClockTime now);
+void winstat_refresh(winstat_t* this, GstClockTime now);
+gint32 winstat_get_counter(winstat_t* this);
+void winstat_get(winstat_t* this, winstat_snapshot_t* result);
+
+#endif /* INCGUARD_NTRT_LIBRARY_WINSTAT_H_ */
@@ -0,0 +1,1587 @@
+/* GStreamer MPRTP microbenchmarks
+ * Copyright (C) 2015 Balázs Kreith (contact: balazs.kreith@gmail.com)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Microbenchmarks of the per packet data structures of the plugin, run by
+ * 'make bench'. Every benchmark drives the same calls the elements make
+ * on their hot path with deterministic input, and reports the median and
+ * the minimum ns/op of several runs together with the heap allocations
+ * and bytes made per operation by the benchmarking thread.
+ *
+ * The results are printed as CSV to stdout (or to --output), a readable
+ * summary goes to stderr:
+ *
+ *   benchmark,runs,ops,ns_per_op,ns_per_op_min,allocs_per_op,bytes_per_op
+ *
+ * The swquantile_accuracy run is not timed as the others, it replays an OWD
+ * trace (--quantile-trace, the owd_<subflow>.csv of a test run, or a
+ * synthetic one) through the quantile sketch and the exact percentile and
+ * reports the relative error of the sketch next to the cost of both.
+ *
+ * Allocations are counted by interposing malloc and friends, which needs
+ * glibc. Elsewhere the allocation columns are -1. GLib older than 2.76
+ * serves g_slice from its own magazines, the bench target sets
+ * G_SLICE=always-malloc so those are counted as well.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/rtp/gstrtpbuffer.h>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "gstmprtpbuffer.h"
+#include "gstmprtcpbuffer.h"
+#include "mprtpdefs.h"
+#include "mprtplogger.h"
+#include "mprtpspath.h"
+#include "mprtprpath.h"
+#include "packetssndqueue.h"
+#include "packetsrcvqueue.h"
+#include "streamsplitter.h"
+#include "streamjoiner.h"
+#include "fecenc.h"
+#include "fecdec.h"
+#include "fecrepairer.h"
+#include "reportprod.h"
+#include "reportproc.h"
+#include "slidingwindow.h"
+#include "lib_swplugins.h"
+#include "udpegress.h"
+#include "udpingress.h"
+#include "mprtptxtime.h"
+
+#define BENCH_DEFAULT_RUNS 5
+#define BENCH_SEED 1
+#define BENCH_SSRC 0x4D505254
+#define BENCH_PAYLOAD_TYPE 96
+#define BENCH_PAYLOAD_LENGTH 1200
+#define BENCH_POOL_LENGTH 1024
+#define BENCH_VALUES_LENGTH 4096
+#define BENCH_FEC_BLOCK 10
+#define BENCH_SUBFLOWS_NUM 4
+//Packets the scheduler releases together in one paced burst
+#define BENCH_BURST_LENGTH 16
+//target bitrate of the paced subflow of the pacing benchmarks
+#define BENCH_PACING_BITRATE (50 * 1000 * 1000)
+//Packets played out at 10000 packet/s, about 100 Mbps
+#define BENCH_PLAYOUT_PERIOD (100 * GST_USECOND)
+
+//----------------------------------------------------------------------
+//-------------------------- Allocation counter ------------------------
+//----------------------------------------------------------------------
+
+//Only the benchmarking thread counts, so the logger and timer threads of
+//the plugin do not add noise to the results.
+static __thread gboolean _count_allocs = FALSE;
+static __thread guint64 _allocs = 0;
+static __thread guint64 _alloc_bytes = 0;
+
+#ifdef __GLIBC__
+#define BENCH_COUNTS_ALLOCS TRUE
+
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t nmemb, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+extern void *__libc_memalign (size_t alignment, size_t size);
+extern void __libc_free (void *ptr);
+
+#define _count(bytes) if(_count_allocs){ ++_allocs; _alloc_bytes += (bytes); }
+
+void *malloc (size_t size)
+{
+  _count(size);
+  return __libc_malloc (size);
+}
+
+void *calloc (size_t nmemb, size_t size)
+{
+  _count(nmemb * size);
+  return __libc_calloc (nmemb, size);
+}
+
+void *realloc (void *ptr, size_t size)
+{
+  _count(size);
+  return __libc_realloc (ptr, size);
+}
+
+int posix_memalign (void **memptr, size_t alignment, size_t size)
+{
+  void *result;
+  _count(size);
+  result = __libc_memalign (alignment, size);
+  if(!result){
+    return ENOMEM;
+  }
+  *memptr = result;
+  return 0;
+}
+
+void *memalign (size_t alignment, size_t size)
+{
+  _count(size);
+  return __libc_memalign (alignment, size);
+}
+
+void *aligned_alloc (size_t alignment, size_t size)
+{
+  _count(size);
+  return __libc_memalign (alignment, size);
+}
+
+void free (void *ptr)
+{
+  __libc_free (ptr);
+}
+
+#undef _count
+#else
+#define BENCH_COUNTS_ALLOCS FALSE
+#endif
+
+//----------------------------------------------------------------------
+//-------------------------- Benchmark harness -------------------------
+//----------------------------------------------------------------------
+
+typedef struct _Bench Bench;
+
+struct _Bench{
+  const gchar*   name;
+  guint32        ops;
+  void         (*run)(Bench* bench, guint32 ops);
+
+  //measurement of the actual run, accumulated between resume and pause
+  guint64        started;
+  guint64        elapsed;
+  guint64        allocs;
+  guint64        alloc_bytes;
+};
+
+static guint64 _monotonic_ns(void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (guint64) ts.tv_sec * GST_SECOND + ts.tv_nsec;
+}
+
+//Setup and cleanup done between the two are not measured
+static void _bench_resume(Bench* bench)
+{
+  bench->allocs      -= _allocs;
+  bench->alloc_bytes -= _alloc_bytes;
+  _count_allocs       = TRUE;
+  bench->started      = _monotonic_ns();
+}
+
+static void _bench_pause(Bench* bench)
+{
+  bench->elapsed     += _monotonic_ns() - bench->started;
+  _count_allocs       = FALSE;
+  bench->allocs      += _allocs;
+  bench->alloc_bytes += _alloc_bytes;
+}
+
+static guint64 _values[BENCH_VALUES_LENGTH];
+static guint64 _sink;
+
+static gint _cmp_uint64(gconstpointer a, gconstpointer b);
+
+static GstBuffer* _make_rtp_packet(guint16 seq, guint payload_length, MPRTPSPath *path)
+{
+  GstBuffer *result;
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  RTPAbsTimeExtension abs_time;
+  guint32 time;
+  guint8 *payload;
+  guint i;
+
+  result = gst_rtp_buffer_new_allocate (payload_length, 0, 0);
+  gst_rtp_buffer_map (result, GST_MAP_READWRITE, &rtp);
+  gst_rtp_buffer_set_payload_type (&rtp, BENCH_PAYLOAD_TYPE);
+  gst_rtp_buffer_set_seq (&rtp, seq);
+  gst_rtp_buffer_set_timestamp (&rtp, (seq / BENCH_FEC_BLOCK) * 3000);
+  gst_rtp_buffer_set_ssrc (&rtp, BENCH_SSRC);
+  gst_rtp_buffer_set_marker (&rtp, seq % BENCH_FEC_BLOCK == BENCH_FEC_BLOCK - 1);
+  payload = gst_rtp_buffer_get_payload (&rtp);
+  for(i = 0; i < payload_length; ++i){
+    payload[i] = (guint8)(seq + i);
+  }
+
+  time = (NTP_NOW >> 14) & 0x00ffffff;
+  memcpy (&abs_time, &time, 3);
+  gst_rtp_buffer_add_extension_onebyte_header (&rtp,
+      ABS_TIME_DEFAULT_EXTENSION_HEADER_ID, (gpointer) &abs_time, sizeof (abs_time));
+  gst_rtp_buffer_unmap (&rtp);
+
+  if(path){
+    mprtps_path_process_rtp_packet(path, result, NULL, 0, NULL);
+  }
+  return result;
+}
+
+static MPRTPSPath* _make_sending_path(guint8 id)
+{
+  MPRTPSPath *result;
+  result = make_mprtps_path (id);
+  mprtps_path_set_mprtp_ext_header_id(result, MPRTP_DEFAULT_EXTENSION_HEADER_ID);
+  mprtps_path_set_active (result);
+  mprtps_path_set_non_lossy (result);
+  mprtps_path_set_non_congested (result);
+  return result;
+}
+
+static GstMpRTPBuffer* _make_mprtp(GstBuffer *buffer)
+{
+  GstMpRTPBuffer *result;
+  result = g_malloc0(sizeof(GstMpRTPBuffer));
+  gst_mprtp_buffer_init(result,
+                        buffer,
+                        MPRTP_DEFAULT_EXTENSION_HEADER_ID,
+                        ABS_TIME_DEFAULT_EXTENSION_HEADER_ID,
+                        FEC_PAYLOAD_DEFAULT_ID);
+  return result;
+}
+
+//----------------------------------------------------------------------
+//----------------------------- Benchmarks -----------------------------
+//----------------------------------------------------------------------
+
+static void _run_splitter_approve(Bench* bench, guint32 ops, guint frame_chunk_size)
+{
+  PacketsSndQueue *sndqueue;
+  StreamSplitter *splitter;
+  MPRTPSPath *paths[3];
+  MPRTPSPath *selected;
+  GstBuffer *pool[BENCH_POOL_LENGTH];
+  guint32 i;
+
+  sndqueue = make_packetssndqueue();
+  splitter = make_stream_splitter(sndqueue);
+  for(i = 0; i < 3; ++i){
+    paths[i] = _make_sending_path(i + 1);
+    stream_splitter_add_path(splitter, i + 1, paths[i], (i + 1) * 500000);
+  }
+  stream_splitter_set_frame_chunk_size(splitter, frame_chunk_size);
+  stream_splitter_commit_changes(splitter);
+  for(i = 0; i < BENCH_POOL_LENGTH; ++i){
+    pool[i] = _make_rtp_packet(i, BENCH_PAYLOAD_LENGTH, NULL);
+  }
+
+  _bench_resume(bench);
+  for(i = 0; i < ops; ++i){
+    stream_splitter_approve_buffer(splitter, pool[i % BENCH_POOL_LENGTH], &selected);
+    _sink += GPOINTER_TO_SIZE(selected);
+  }
+  _bench_pause(bench);
+
+  for(i = 0; i < BENCH_POOL_LENGTH; ++i){
+    gst_buffer_unref(pool[i]);
+  }
+  for(i = 0; i < 3; ++i){
+    stream_splitter_rem_path(splitter, i + 1);
+    g_object_unref(paths[i]);
+  }
+  g_object_unref(splitter);
+  g_object_unref(sndqueue);
+}
+
+static void _bench_splitter_approve(Bench* bench, guint32 ops)
+{
+  _run_splitter_approve(bench, ops, 0);
+}
+
+//Frames of BENCH_FEC_BLOCK packets kept on one path
+static void _bench_splitter_approve_frames(Bench* bench, guint32 ops)
+{
+  _run_splitter_approve(bench, ops, G_MAXUINT);
+}
+
+//Two subflows with every 8th packet pair swapped, so the joiner sorts.
+//The join delay is kept at zero to make the transfer deterministic.
+static void _bench_joiner_push_transfer(Bench* bench, guint32 ops)
+{
+  PacketsRcvQueue *rcvqueue;
+  StreamJoiner *joiner;
+  MPRTPSPath *snd_paths[2];
+  MpRTPRPath *rcv_paths[2];
+  GstMpRTPBuffer *pool[BENCH_POOL_LENGTH];
+  GstMpRTPBuffer *mprtp;
+  guint32 i, j, batch;
+  guint16 seq = 0;
+
+  rcvqueue = make_packetsrcvqueue();
+  packetsrcvqueue_set_playout_allowed(rcvqueue, TRUE);
+  joiner = make_stream_joiner(rcvqueue);
+  stream_joiner_set_min_treshold(joiner, 0);
+  stream_joiner_set_max_treshold(joiner, 0);
+  for(i = 0; i < 2; ++i){
+    snd_paths[i] = _make_sending_path(i + 1);
+    rcv_paths[i] = make_mprtpr_path(i + 1);
+    stream_joiner_add_path(joiner, i + 1, rcv_paths[i]);
+  }
+
+  for(i = 0; i < ops; i += batch){
+    batch = MIN(BENCH_POOL_LENGTH, ops - i);
+    for(j = 0; j < batch; ++j, ++seq){
+      pool[j] = _make_mprtp(_make_rtp_packet(seq, BENCH_PAYLOAD_LENGTH, snd_paths[seq & 1]));
+    }
+    for(j = 7; j < batch; j += 8){
+      mprtp = pool[j]; pool[j] = pool[j-1]; pool[j-1] = mprtp;
+    }
+
+    _bench_resume(bench);
+    for(j = 0; j < batch; ++j){
+      stream_joiner_push(joiner, pool[j]);
+      if((j & 15) != 15 && j != batch - 1){
+        continue;
+      }
+      stream_joiner_transfer(joiner);
+      while((mprtp = packetsrcvqueue_pop(rcvqueue)) != NULL){
+        _sink += mprtp->abs_seq;
+      }
+      while((mprtp = packetsrcvqueue_pop_discarded(rcvqueue)) != NULL){
+        _sink += mprtp->abs_seq;
+      }
+    }
+    _bench_pause(bench);
+
+    for(j = 0; j < batch; ++j){
+      //one reference is taken by the joiner
+      gst_buffer_unref(pool[j]->buffer);
+      gst_buffer_unref(pool[j]->buffer);
+      g_free(pool[j]);
+    }
+  }
+
+  for(i = 0; i < 2; ++i){
+    stream_joiner_rem_path(joiner, i + 1);
+    g_object_unref(rcv_paths[i]);
+    g_object_unref(snd_paths[i]);
+  }
+  g_object_unref(joiner);
+  g_object_unref(rcvqueue);
+}
+
+static void _bench_fec_encode(Bench* bench, guint32 ops)
+{
+  FECEncoder *encoder;
+  MPRTPSPath *path;
+  GstBuffer *pool[BENCH_POOL_LENGTH];
+  GstBuffer *fec;
+  guint32 i;
+
+  encoder = make_fecencoder();
+  fecencoder_set_payload_type(encoder, FEC_PAYLOAD_DEFAULT_ID);
+  path = _make_sending_path(1);
+  fecencoder_add_path(encoder, path);
+  for(i = 0; i < BENCH_POOL_LENGTH; ++i){
+    pool[i] = _make_rtp_packet(i, BENCH_PAYLOAD_LENGTH, path);
+  }
+
+  _bench_resume(bench);
+  for(i = 0; i < ops; ++i){
+    fecencoder_add_rtpbuffer(encoder, 1, (guint16) i, pool[i % BENCH_POOL_LENGTH]);
+    if(i % BENCH_FEC_BLOCK != BENCH_FEC_BLOCK - 1){
+      continue;
+    }
+    fec = fecencoder_get_fec_packet(encoder, 1);
+    fecencoder_assign_to_subflow(encoder, fec, MPRTP_DEFAULT_EXTENSION_HEADER_ID, 1);
+    gst_buffer_unref(fec);
+  }
+  _bench_pause(bench);
+
+  for(i = 0; i < BENCH_POOL_LENGTH; ++i){
+    gst_buffer_unref(pool[i]);
+  }
+  fecencoder_rem_path(encoder, 1);
+  g_object_unref(encoder);
+  g_object_unref(path);
+}
+
+//One packet of every FEC block is lost and repaired. Ops are the packets
+//sent, the FEC packets are not counted. The repair window is short, so
+//the segment list stays at the size of a real-time stream.
+static void _bench_fec_repair(Bench* bench, guint32 ops)
+{
+  FECEncoder *encoder;
+  FECDecoder *decoder;
+  MPRTPSPath *path;
+  GstBuffer *buffers[BENCH_FEC_BLOCK];
+  GstMpRTPBuffer *mprtps[BENCH_FEC_BLOCK];
+  GstMpRTPBuffer *fec;
+  GstBuffer *fecbuf;
+  GstBuffer *repaired;
+  guint32 i, j, lost;
+  guint16 seq = 0;
+
+  encoder = make_fecencoder();
+  fecencoder_set_payload_type(encoder, FEC_PAYLOAD_DEFAULT_ID);
+  decoder = make_fecdecoder();
+  fecdecoder_set_payload_type(decoder, FEC_PAYLOAD_DEFAULT_ID);
+  fecdecoder_set_repair_window(decoder, 0, 10 * GST_MSECOND);
+  path = _make_sending_path(1);
+  fecencoder_add_path(encoder, path);
+
+  for(i = 0; i < ops; i += BENCH_FEC_BLOCK){
+    lost = (i / BENCH_FEC_BLOCK) % BENCH_FEC_BLOCK;
+    for(j = 0; j < BENCH_FEC_BLOCK; ++j, ++seq){
+      buffers[j] = _make_rtp_packet(seq, BENCH_PAYLOAD_LENGTH, path);
+      fecencoder_add_rtpbuffer(encoder, 1, mprtps_path_get_actual_seq(path), buffers[j]);
+      mprtps[j] = _make_mprtp(buffers[j]);
+    }
+    fecbuf = fecencoder_get_fec_packet(encoder, 1);
+    fecencoder_assign_to_subflow(encoder, fecbuf, MPRTP_DEFAULT_EXTENSION_HEADER_ID, 1);
+    fec = _make_mprtp(fecbuf);
+
+    _bench_resume(bench);
+    for(j = 0; j < BENCH_FEC_BLOCK; ++j){
+      if(j != lost){
+        fecdecoder_add_rtp_packet(decoder, mprtps[j]);
+      }
+    }
+    fecdecoder_add_fec_packet(decoder, fec);
+    while(fecdecoder_has_repaired_rtpbuffer(decoder, seq - 1, &repaired)){
+      gst_buffer_unref(repaired);
+    }
+    fecdecoder_clean(decoder);
+    _bench_pause(bench);
+
+    for(j = 0; j < BENCH_FEC_BLOCK; ++j){
+      gst_buffer_unref(buffers[j]);
+      g_free(mprtps[j]);
+    }
+    gst_buffer_unref(fec->buffer);
+    g_free(fec);
+  }
+
+  fecencoder_rem_path(encoder, 1);
+  g_object_unref(encoder);
+  g_object_unref(decoder);
+  g_object_unref(path);
+}
+
+//The packets are sent on two paths in turn and every path protects its
+//own packets, one packet of the second path is lost in every round. The
+//repaired packets per kop are reported, a FEC packet mixing the packets
+//of the other path would not restore it.
+static void _bench_fec_repair_multipath(Bench* bench, guint32 ops)
+{
+  static const gchar *reported = NULL;
+  FECEncoder *encoder;
+  FECDecoder *decoder;
+  MPRTPSPath *paths[2];
+  GstBuffer *buffers[2 * BENCH_FEC_BLOCK];
+  GstMpRTPBuffer *mprtps[2 * BENCH_FEC_BLOCK];
+  GstMpRTPBuffer *fecs[2];
+  GstBuffer *fecbuf;
+  GstBuffer *repaired;
+  guint32 i, j, k, lost;
+  guint64 recovered = 0;
+  guint16 seq = 0;
+
+  encoder = make_fecencoder();
+  fecencoder_set_payload_type(encoder, FEC_PAYLOAD_DEFAULT_ID);
+  decoder = make_fecdecoder();
+  fecdecoder_set_payload_type(decoder, FEC_PAYLOAD_DEFAULT_ID);
+  fecdecoder_set_repair_window(decoder, 0, 10 * GST_MSECOND);
+  for(k = 0; k < 2; ++k){
+    paths[k] = _make_sending_path(k + 1);
+    fecencoder_add_path(encoder, paths[k]);
+  }
+
+  for(i = 0; i < ops; i += 2 * BENCH_FEC_BLOCK){
+    lost = 2 * ((i / (2 * BENCH_FEC_BLOCK)) % BENCH_FEC_BLOCK) + 1;
+    for(j = 0; j < 2 * BENCH_FEC_BLOCK; ++j, ++seq){
+      k = j % 2;
+      buffers[j] = _make_rtp_packet(seq, BENCH_PAYLOAD_LENGTH, paths[k]);
+      fecencoder_add_rtpbuffer(encoder, k + 1, mprtps_path_get_actual_seq(paths[k]), buffers[j]);
+      mprtps[j] = _make_mprtp(buffers[j]);
+    }
+    for(k = 0; k < 2; ++k){
+      fecbuf = fecencoder_get_fec_packet(encoder, k + 1);
+      fecencoder_assign_to_subflow(encoder, fecbuf, MPRTP_DEFAULT_EXTENSION_HEADER_ID, k + 1);
+      fecs[k] = _make_mprtp(fecbuf);
+    }
+
+    _bench_resume(bench);
+    for(j = 0; j < 2 * BENCH_FEC_BLOCK; ++j){
+      if(j != lost){
+        fecdecoder_add_rtp_packet(decoder, mprtps[j]);
+      }
+    }
+    for(k = 0; k < 2; ++k){
+      fecdecoder_add_fec_packet(decoder, fecs[k]);
+    }
+    while(fecdecoder_has_repaired_rtpbuffer(decoder, seq - 1, &repaired)){
+      gst_buffer_unref(repaired);
+      ++recovered;
+    }
+    fecdecoder_clean(decoder);
+    _bench_pause(bench);
+
+    for(j = 0; j < 2 * BENCH_FEC_BLOCK; ++j){
+      gst_buffer_unref(buffers[j]);
+      g_free(mprtps[j]);
+    }
+    for(k = 0; k < 2; ++k){
+      gst_buffer_unref(fecs[k]->buffer);
+      g_free(fecs[k]);
+    }
+  }
+
+  if(reported != bench->name && BENCH_POOL_LENGTH < ops){
+    reported = bench->name;
+    g_printerr("%-26s %10.1f repaired/kop\n", bench->name, recovered * 1000. / ops);
+  }
+  for(k = 0; k < 2; ++k){
+    fecencoder_rem_path(encoder, k + 1);
+    g_object_unref(paths[k]);
+  }
+  g_object_unref(encoder);
+  g_object_unref(decoder);
+}
+
+//Packets of FEC blocks played out at the pace of a real stream, while
+//the given permille of them is lost. The FEC is repaired on the playout
+//thread with the decoder cleaned there in every 200ms, or by the repair
+//worker and only merged at the playout. Besides the ns/op the median and
+//the 99th percentile of the playout steps are reported, their gap is the
+//jitter the repair adds to the playout.
+static void _run_fec_playout(Bench* bench, guint32 ops, guint32 loss, gboolean worker)
+{
+  static const gchar *reported = NULL;
+  FECEncoder *encoder;
+  FECDecoder *decoder;
+  FECRepairer *repairer = NULL;
+  MPRTPSPath *path;
+  GstBuffer *buffers[BENCH_FEC_BLOCK + 1];
+  GstMpRTPBuffer *mprtps[BENCH_FEC_BLOCK + 1];
+  gboolean lost[BENCH_FEC_BLOCK + 1];
+  GstBuffer *repaired;
+  GRand *rand;
+  guint64 *steps, started, next, last_clean, steps_num = 0, recovered = 0;
+  guint32 i, j;
+  guint16 seq = 0, played;
+
+  encoder = make_fecencoder();
+  fecencoder_set_payload_type(encoder, FEC_PAYLOAD_DEFAULT_ID);
+  decoder = make_fecdecoder();
+  fecdecoder_set_payload_type(decoder, FEC_PAYLOAD_DEFAULT_ID);
+  fecdecoder_set_repair_window(decoder, 0, 10 * GST_MSECOND);
+  path = _make_sending_path(1);
+  fecencoder_add_path(encoder, path);
+  rand = g_rand_new_with_seed(BENCH_SEED);
+  steps = g_malloc0(sizeof(guint64) * (ops + ops / BENCH_FEC_BLOCK + BENCH_FEC_BLOCK + 1));
+  if(worker){
+    repairer = make_fecrepairer(decoder);
+    fecrepairer_start(repairer);
+  }
+  last_clean = next = _monotonic_ns();
+
+  for(i = 0; i < ops; i += BENCH_FEC_BLOCK){
+    for(j = 0; j < BENCH_FEC_BLOCK; ++j){
+      buffers[j] = _make_rtp_packet(seq + j, BENCH_PAYLOAD_LENGTH, path);
+      fecencoder_add_rtpbuffer(encoder, 1, mprtps_path_get_actual_seq(path), buffers[j]);
+    }
+    buffers[j] = fecencoder_get_fec_packet(encoder, 1);
+    fecencoder_assign_to_subflow(encoder, buffers[j], MPRTP_DEFAULT_EXTENSION_HEADER_ID, 1);
+    for(j = 0; j <= BENCH_FEC_BLOCK; ++j){
+      mprtps[j] = _make_mprtp(buffers[j]);
+      lost[j]   = (guint32) g_rand_int_range(rand, 0, 1000) < loss;
+    }
+
+    //the FEC packet arrives after its block
+    for(j = 0; j <= BENCH_FEC_BLOCK; ++j){
+      while(_monotonic_ns() < next);
+      next += BENCH_PLAYOUT_PERIOD;
+      played = seq + MIN(j + 1, BENCH_FEC_BLOCK);
+
+      _bench_resume(bench);
+      if(lost[j]){
+        //nothing arrives
+      }else if(worker){
+        fecrepairer_add_packet(repairer, mprtps[j]);
+      }else if(mprtps[j]->fec_packet){
+        fecdecoder_add_fec_packet(decoder, mprtps[j]);
+      }else{
+        fecdecoder_add_rtp_packet(decoder, mprtps[j]);
+      }
+      started = _monotonic_ns();
+      if(worker){
+        fecrepairer_set_played_seq(repairer, played);
+        while((repaired = fecrepairer_pop(repairer)) != NULL){
+          gst_buffer_unref(repaired);
+          ++recovered;
+        }
+      }else{
+        while(fecdecoder_has_repaired_rtpbuffer(decoder, played, &repaired)){
+          gst_buffer_unref(repaired);
+          ++recovered;
+        }
+        if(last_clean + 200 * GST_MSECOND <= started){
+          fecdecoder_clean(decoder);
+          last_clean = started;
+        }
+      }
+      steps[steps_num++] = _monotonic_ns() - started;
+      _bench_pause(bench);
+    }
+    seq += BENCH_FEC_BLOCK;
+
+    for(j = 0; j <= BENCH_FEC_BLOCK; ++j){
+      gst_buffer_unref(buffers[j]);
+      g_free(mprtps[j]);
+    }
+  }
+
+  if(worker){
+    g_object_unref(repairer);
+  }
+  qsort(steps, steps_num, sizeof(guint64), _cmp_uint64);
+  if(reported != bench->name && BENCH_POOL_LENGTH < ops){
+    reported = bench->name;
+    g_printerr("%-26s %10"G_GUINT64_FORMAT" ns step p50 %10"G_GUINT64_FORMAT" ns step p99 %10.1f repaired/kop\n",
+               bench->name, steps[steps_num / 2], steps[steps_num * 99 / 100], recovered * 1000. / ops);
+  }
+  g_free(steps);
+  g_rand_free(rand);
+  fecencoder_rem_path(encoder, 1);
+  g_object_unref(encoder);
+  g_object_unref(decoder);
+  g_object_unref(path);
+}
+
+static void _bench_fec_playout_inline_0(Bench* bench, guint32 ops)
+{
+  _run_fec_playout(bench, ops, 0, FALSE);
+}
+
+static void _bench_fec_playout_inline_5(Bench* bench, guint32 ops)
+{
+  _run_fec_playout(bench, ops, 50, FALSE);
+}
+
+static void _bench_fec_playout_inline_15(Bench* bench, guint32 ops)
+{
+  _run_fec_playout(bench, ops, 150, FALSE);
+}
+
+static void _bench_fec_playout_worker_0(Bench* bench, guint32 ops)
+{
+  _run_fec_playout(bench, ops, 0, TRUE);
+}
+
+static void _bench_fec_playout_worker_5(Bench* bench, guint32 ops)
+{
+  _run_fec_playout(bench, ops, 50, TRUE);
+}
+
+static void _bench_fec_playout_worker_15(Bench* bench, guint32 ops)
+{
+  _run_fec_playout(bench, ops, 150, TRUE);
+}
+
+//Receiver side regular report: RR, XR OWD, XR discarded RLE and bytes
+static void _bench_report_rr_xr(Bench* bench, guint32 ops)
+{
+  ReportProducer *producer;
+  ReportProcessor *processor;
+  GstMPRTCPReportSummary summary;
+  gboolean vector[16];
+  GstBuffer *report;
+  guint length;
+  guint32 i;
+
+  producer  = g_object_new(REPORTPRODUCER_TYPE, NULL);
+  processor = g_object_new(REPORTPROCESSOR_TYPE, NULL);
+  report_producer_set_ssrc(producer, BENCH_SSRC);
+  report_processor_set_ssrc(processor, BENCH_SSRC);
+  for(i = 0; i < 16; ++i){
+    vector[i] = i % 5 != 0;
+  }
+
+  _bench_resume(bench);
+  for(i = 0; i < ops; ++i){
+    report_producer_begin(producer, 1 + (i & 1));
+    report_producer_add_rr(producer, 12, i, 65536 + i, 100, i << 16, 1000);
+    report_producer_add_xr_owd(producer, RTCP_XR_RFC7243_I_FLAG_INTERVAL_DURATION, 5000, 1000, 9000);
+    report_producer_add_xr_discarded_rle(producer, FALSE, 0, i & 0xFFFF, (i + 16) & 0xFFFF, vector, 16);
+    report_producer_add_xr_discarded_bytes(producer, RTCP_XR_RFC7243_I_FLAG_INTERVAL_DURATION, FALSE, 1200);
+    report = report_producer_end(producer, &length);
+
+    memset(&summary, 0, sizeof(GstMPRTCPReportSummary));
+    report_processor_process_mprtcp(processor, report, &summary);
+    _sink += summary.RR.HSSN + length;
+    gst_buffer_unref(report);
+  }
+  _bench_pause(bench);
+
+  g_object_unref(producer);
+  g_object_unref(processor);
+}
+
+static void _bench_report_sr(Bench* bench, guint32 ops)
+{
+  ReportProducer *producer;
+  ReportProcessor *processor;
+  GstMPRTCPReportSummary summary;
+  GstBuffer *report;
+  guint length;
+  guint32 i;
+
+  producer  = g_object_new(REPORTPRODUCER_TYPE, NULL);
+  processor = g_object_new(REPORTPROCESSOR_TYPE, NULL);
+  report_producer_set_ssrc(producer, BENCH_SSRC);
+  report_processor_set_ssrc(processor, BENCH_SSRC);
+
+  _bench_resume(bench);
+  for(i = 0; i < ops; ++i){
+    report_producer_begin(producer, 1 + (i & 1));
+    report_producer_add_sr(producer, NTP_NOW, i * 3000, i, i * BENCH_PAYLOAD_LENGTH);
+    report = report_producer_end(producer, &length);
+
+    memset(&summary, 0, sizeof(GstMPRTCPReportSummary));
+    report_processor_process_mprtcp(processor, report, &summary);
+    _sink += summary.SR.packet_count + length;
+    gst_buffer_unref(report);
+  }
+  _bench_pause(bench);
+
+  g_object_unref(producer);
+  g_object_unref(processor);
+}
+
+static void _bench_mprtp_buffer_init(Bench* bench, guint32 ops)
+{
+  MPRTPSPath *path;
+  GstBuffer *pool[BENCH_POOL_LENGTH];
+  GstMpRTPBuffer mprtp;
+  guint32 i;
+
+  path = _make_sending_path(1);
+  for(i = 0; i < BENCH_POOL_LENGTH; ++i){
+    pool[i] = _make_rtp_packet(i, BENCH_PAYLOAD_LENGTH, path);
+  }
+
+  _bench_resume(bench);
+  for(i = 0; i < ops; ++i){
+    gst_mprtp_buffer_init(&mprtp,
+                          pool[i % BENCH_POOL_LENGTH],
+                          MPRTP_DEFAULT_EXTENSION_HEADER_ID,
+                          ABS_TIME_DEFAULT_EXTENSION_HEADER_ID,
+                          FEC_PAYLOAD_DEFAULT_ID);
+    _sink += mprtp.delay;
+  }
+  _bench_pause(bench);
+
+  for(i = 0; i < BENCH_POOL_LENGTH; ++i){
+    gst_buffer_unref(pool[i]);
+  }
+  g_object_unref(path);
+}
+
+static void _percentile_sink_pipe(gpointer udata, swpercentilecandidates_t* candidates)
+{
+  if(candidates->processed && candidates->left){
+    _sink += *(guint64*)candidates->left;
+  }
+}
+
+static void _quantile_sink_pipe(gpointer udata, swquantilestat_t* stat)
+{
+  _sink += (guint64) stat->value;
+}
+
+static void _minmax_sink_pipe(gpointer udata, swminmaxstat_t* stat)
+{
+  if(stat->max){
+    _sink += *(guint64*)stat->max;
+  }
+}
+
+static void _run_slidingwindow(Bench* bench, guint32 ops, SlidingWindow *sw)
+{
+  guint32 i;
+  //fills up the window, so every measured add is paired with a remove
+  for(i = 0; i < BENCH_VALUES_LENGTH; ++i){
+    slidingwindow_add_data(sw, &_values[i]);
+  }
+  _bench_resume(bench);
+  for(i = 0; i < ops; ++i){
+    slidingwindow_add_data(sw, &_values[i % BENCH_VALUES_LENGTH]);
+  }
+  _bench_pause(bench);
+  g_object_unref(sw);
+}
+
+static void _bench_swpercentile_600(Bench* bench, guint32 ops)
+{
+  SlidingWindow *sw = make_slidingwindow_uint64(600, 0);
+  slidingwindow_add_plugin(sw, make_swpercentile(80, bintree3cmp_uint64, _percentile_sink_pipe, NULL));
+  _run_slidingwindow(bench, ops, sw);
+}
+
+static void _bench_swpercentile_4096(Bench* bench, guint32 ops)
+{
+  SlidingWindow *sw = make_slidingwindow_uint64(BENCH_VALUES_LENGTH, 0);
+  slidingwindow_add_plugin(sw, make_swpercentile(50, bintree3cmp_uint64, _percentile_sink_pipe, NULL));
+  _run_slidingwindow(bench, ops, sw);
+}
+
+static void _bench_swquantile_600(Bench* bench, guint32 ops)
+{
+  SlidingWindow *sw = make_slidingwindow_uint64(600, 0);
+  slidingwindow_add_plugin(sw, make_swquantile(80, .01, 10. * GST_SECOND / GST_USECOND,
+      swquantile_value_uint64, _quantile_sink_pipe, NULL));
+  _run_slidingwindow(bench, ops, sw);
+}
+
+static void _bench_swquantile_4096(Bench* bench, guint32 ops)
+{
+  SlidingWindow *sw = make_slidingwindow_uint64(BENCH_VALUES_LENGTH, 0);
+  slidingwindow_add_plugin(sw, make_swquantile(50, .01, 10. * GST_SECOND / GST_USECOND,
+      swquantile_value_uint64, _quantile_sink_pipe, NULL));
+  _run_slidingwindow(bench, ops, sw);
+}
+
+static void _bench_swminmax_600(Bench* bench, guint32 ops)
+{
+  SlidingWindow *sw = make_slidingwindow_uint64(600, 0);
+  slidingwindow_add_plugin(sw, make_swminmax(bintree3cmp_uint64, _minmax_sink_pipe, NULL));
+  _run_slidingwindow(bench, ops, sw);
+}
+
+typedef struct _PathContention{
+  MPRTPSPath*    paths[BENCH_SUBFLOWS_NUM];
+  volatile gint  running;
+  guint64        ticks;
+}PathContention;
+
+//The controller ticks as fast as it can, setting and polling every path
+//the way the subflow controllers and the rate distributor do.
+static gpointer _path_controller(gpointer data)
+{
+  PathContention *contention = data;
+  MPRTPSPath *path;
+  guint32 packets, sink = 0;
+  guint i;
+
+  while(g_atomic_int_get(&contention->running)){
+    for(i = 0; i < BENCH_SUBFLOWS_NUM; ++i){
+      path = contention->paths[i];
+      mprtps_path_set_target_bitrate(path, 500000 + (contention->ticks % 1000) * 1000);
+      mprtps_path_set_monitored_bitrate(path, contention->ticks % 100000, contention->ticks % 100);
+      mprtps_path_set_state(path, MPRTPS_PATH_STATE_STABLE);
+      mprtps_path_set_non_congested(path);
+      sink += mprtps_path_get_total_sent_packets_num(path);
+      sink += mprtps_path_get_total_sent_payload_bytes(path);
+      sink += mprtps_path_get_monitored_bitrate(path, &packets) + packets;
+      sink += mprtps_path_has_expected_lost(path);
+    }
+    ++contention->ticks;
+  }
+  return GUINT_TO_POINTER(sink);
+}
+
+//The per packet reads of the splitter, the scheduler and the FEC encoder
+//on 4 subflows, while the controller thread keeps writing them.
+static void _bench_path_contention(Bench* bench, guint32 ops)
+{
+  PathContention contention;
+  GThread *controller;
+  MPRTPSPath *path;
+  guint32 i, j;
+
+  memset(&contention, 0, sizeof(contention));
+  for(j = 0; j < BENCH_SUBFLOWS_NUM; ++j){
+    contention.paths[j] = _make_sending_path(j + 1);
+    mprtps_path_set_keep_alive_period(contention.paths[j], GST_MSECOND);
+  }
+  contention.running = TRUE;
+  controller = g_thread_new("bench-controller", _path_controller, &contention);
+
+  _bench_resume(bench);
+  for(i = 0; i < ops; ++i){
+    for(j = 0; j < BENCH_SUBFLOWS_NUM; ++j){
+      path = contention.paths[j];
+      _sink += mprtps_path_get_flags(path);
+      _sink += mprtps_path_is_active(path);
+      _sink += mprtps_path_get_target_bitrate(path);
+      _sink += mprtps_path_get_total_sent_packets_num(path);
+      _sink += mprtps_path_is_monitoring(path);
+    }
+    _sink += mprtps_path_request_keep_alive(contention.paths[i % BENCH_SUBFLOWS_NUM]);
+  }
+  _bench_pause(bench);
+
+  g_atomic_int_set(&contention.running, FALSE);
+  _sink += GPOINTER_TO_UINT(g_thread_join(controller));
+  for(j = 0; j < BENCH_SUBFLOWS_NUM; ++j){
+    g_object_unref(contention.paths[j]);
+  }
+}
+
+typedef struct _SplitterRebuilds{
+  StreamSplitter* splitter;
+  volatile gint   running;
+  guint64         ticks;
+}SplitterRebuilds;
+
+//The rate distributor commits new targets as fast as it can
+static gpointer _splitter_controller(gpointer data)
+{
+  SplitterRebuilds *rebuilds = data;
+  guint i;
+
+  while(g_atomic_int_get(&rebuilds->running)){
+    for(i = 0; i < BENCH_SUBFLOWS_NUM; ++i){
+      stream_splitter_setup_sending_target(rebuilds->splitter, i + 1,
+          500000 + (rebuilds->ticks % 1000) * 1000 * (i + 1));
+    }
+    stream_splitter_commit_changes(rebuilds->splitter);
+    ++rebuilds->ticks;
+  }
+  return NULL;
+}
+
+//Packets approved on 4 subflows while the controller thread keeps
+//rebuilding the splitter, the rebuilds per run are reported as well.
+static void _bench_splitter_approve_rebuilds(Bench* bench, guint32 ops)
+{
+  SplitterRebuilds rebuilds;
+  PacketsSndQueue *sndqueue;
+  MPRTPSPath *paths[BENCH_SUBFLOWS_NUM];
+  MPRTPSPath *selected;
+  GstBuffer *pool[BENCH_POOL_LENGTH];
+  GThread *controller;
+  static const gchar *reported = NULL;
+  guint32 i;
+
+  memset(&rebuilds, 0, sizeof(rebuilds));
+  sndqueue = make_packetssndqueue();
+  rebuilds.splitter = make_stream_splitter(sndqueue);
+  for(i = 0; i < BENCH_SUBFLOWS_NUM; ++i){
+    paths[i] = _make_sending_path(i + 1);
+    stream_splitter_add_path(rebuilds.splitter, i + 1, paths[i], (i + 1) * 500000);
+  }
+  for(i = 0; i < BENCH_POOL_LENGTH; ++i){
+    pool[i] = _make_rtp_packet(i, BENCH_PAYLOAD_LENGTH, NULL);
+  }
+  rebuilds.running = TRUE;
+  controller = g_thread_new("bench-controller", _splitter_controller, &rebuilds);
+
+  _bench_resume(bench);
+  for(i = 0; i < ops; ++i){
+    stream_splitter_approve_buffer(rebuilds.splitter, pool[i % BENCH_POOL_LENGTH], &selected);
+    _sink += GPOINTER_TO_SIZE(selected);
+  }
+  _bench_pause(bench);
+
+  g_atomic_int_set(&rebuilds.running, FALSE);
+  g_thread_join(controller);
+  if(reported != bench->name && BENCH_POOL_LENGTH < ops){
+    reported = bench->name;
+    g_printerr("%-26s %10.1f rebuilds/kop\n", bench->name, rebuilds.ticks * 1000. / ops);
+  }
+  for(i = 0; i < BENCH_POOL_LENGTH; ++i){
+    gst_buffer_unref(pool[i]);
+  }
+  for(i = 0; i < BENCH_SUBFLOWS_NUM; ++i){
+    stream_splitter_rem_path(rebuilds.splitter, i + 1);
+    g_object_unref(paths[i]);
+  }
+  g_object_unref(rebuilds.splitter);
+  g_object_unref(sndqueue);
+}
+
+//Frames of 10 packets pushed twice as fast as they are sent, so the queue
+//keeps dropping the frames late at 100 Mbps, the dropped frames and the
+//bytes wasted on partially sent frames per run are reported as well.
+static void _bench_sndqueue_late_frames(Bench* bench, guint32 ops)
+{
+  static const gchar *reported = NULL;
+  PacketsSndQueue *sndqueue;
+  GstBuffer *pool[BENCH_POOL_LENGTH];
+  GstBuffer *sent;
+  guint32 i;
+
+  sndqueue = make_packetssndqueue();
+  packetssndqueue_set_obsolation_treshold(sndqueue, 20 * GST_MSECOND);
+  packetssndqueue_setup_stream_targets(sndqueue, 100000000);
+  for(i = 0; i < BENCH_POOL_LENGTH; ++i){
+    pool[i] = _make_rtp_packet(i, BENCH_PAYLOAD_LENGTH, NULL);
+  }
+
+  _bench_resume(bench);
+  for(i = 0; i < ops; ++i){
+    packetssndqueue_push(sndqueue, pool[i % BENCH_POOL_LENGTH]);
+    if(i & 1){
+      continue;
+    }
+    if(packetssndqueue_peek(sndqueue) && (sent = packetssndqueue_pop(sndqueue)) != NULL){
+      _sink += gst_buffer_get_size(sent);
+      gst_buffer_unref(sent);
+    }
+  }
+  _bench_pause(bench);
+
+  if(reported != bench->name && BENCH_POOL_LENGTH < ops){
+    reported = bench->name;
+    g_printerr("%-26s %10.1f dropped frames/kop %10.1f wasted bytes/op\n", bench->name,
+               sndqueue->dropped_frames * 1000. / ops, (gdouble) sndqueue->wasted_bytes / ops);
+  }
+  for(i = 0; i < BENCH_POOL_LENGTH; ++i){
+    gst_buffer_unref(pool[i]);
+  }
+  g_object_unref(sndqueue);
+}
+
+typedef struct{
+  guint8   payload[10];
+  guint    length;
+  gboolean keyframe;
+}BenchVP8Payload;
+
+//Beginnings of VP8 RTP payloads as libvpx and Chrome send them: the RFC 7741
+//payload descriptor followed by the first bytes of the VP8 frame header
+static const BenchVP8Payload _vp8_payloads[] = {
+    //S, PID 0, no extensions
+    {{0x10, 0x50, 0x2a, 0x00, 0x9d, 0x01, 0x2a}, 7, TRUE},
+    {{0x10, 0x51, 0x07, 0x00}, 4, FALSE},
+    //X, I with a 7 bits picture id
+    {{0x90, 0x80, 0x15, 0x50, 0x2a, 0x00}, 6, TRUE},
+    {{0x90, 0x80, 0x16, 0x31, 0x04, 0x00}, 6, FALSE},
+    //X, I with M, 15 bits picture id
+    {{0x90, 0x80, 0x81, 0x23, 0x50, 0x2a, 0x00}, 7, TRUE},
+    {{0x90, 0x80, 0x81, 0x24, 0x31, 0x04, 0x00}, 7, FALSE},
+    //X, I with M, L, T and K
+    {{0x90, 0xf0, 0x80, 0x01, 0x05, 0x40, 0x50, 0x2a, 0x00}, 9, TRUE},
+    {{0x90, 0xf0, 0x80, 0x02, 0x05, 0x80, 0x31, 0x04, 0x00}, 9, FALSE},
+    //X, T only, a keyframe of a higher layer
+    {{0x90, 0x20, 0xc0, 0x50, 0x2a, 0x00}, 6, TRUE},
+    //continuation of a keyframe and the start of a later partition,
+    //the first payload bytes are data, not a frame header
+    {{0x00, 0x50, 0x2a, 0x00}, 4, FALSE},
+    {{0x11, 0x50, 0x2a, 0x00}, 4, FALSE},
+    //truncated
+    {{0x90, 0xf0, 0x80}, 3, FALSE},
+};
+
+//Keyframe detection on VP8 payloads with every payload descriptor variant,
+//the misclassified payloads are reported as well.
+static void _bench_vp8_keyframe_detect(Bench* bench, guint32 ops)
+{
+  static const gchar *reported = NULL;
+  const guint payloads_num = G_N_ELEMENTS(_vp8_payloads);
+  GstBuffer *pool[G_N_ELEMENTS(_vp8_payloads)];
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  guint misclassified = 0;
+  guint32 i;
+
+  for(i = 0; i < payloads_num; ++i){
+    pool[i] = gst_rtp_buffer_new_allocate (_vp8_payloads[i].length, 0, 0);
+    gst_rtp_buffer_map (pool[i], GST_MAP_READWRITE, &rtp);
+    gst_rtp_buffer_set_seq (&rtp, i);
+    memcpy(gst_rtp_buffer_get_payload (&rtp), _vp8_payloads[i].payload, _vp8_payloads[i].length);
+    misclassified += !gst_mprtp_is_keyframe(&rtp, 1) != !_vp8_payloads[i].keyframe;
+    gst_rtp_buffer_unmap (&rtp);
+  }
+
+  _bench_resume(bench);
+  for(i = 0; i < ops; ++i){
+    gst_rtp_buffer_map (pool[i % payloads_num], GST_MAP_READ, &rtp);
+    _sink += gst_mprtp_is_keyframe(&rtp, 1);
+    gst_rtp_buffer_unmap (&rtp);
+  }
+  _bench_pause(bench);
+
+  if(reported != bench->name){
+    reported = bench->name;
+    g_printerr("%-26s %10u misclassified of %u payloads\n", bench->name,
+               misclassified, payloads_num);
+  }
+  for(i = 0; i < payloads_num; ++i){
+    gst_buffer_unref(pool[i]);
+  }
+}
+
+//Packets of one subflow sent to a loopback socket in paced bursts, the
+//receiver is not drained, the kernel drops what does not fit. Besides the
+//ns/op the syscalls per packet and the CPU time per Mbit are reported.
+static void _run_udp_egress(Bench* bench, guint32 ops, UDPEgressMode mode)
+{
+  static const gchar *reported = NULL;
+  UDPEgress *egress;
+  GSocket *receiver;
+  GInetAddress *loopback;
+  GSocketAddress *address;
+  GstBuffer *pool[BENCH_POOL_LENGTH];
+  guint64 syscalls, bytes, cpu_started;
+  struct timespec ts;
+  guint32 i, num;
+
+  loopback = g_inet_address_new_loopback(G_SOCKET_FAMILY_IPV4);
+  address  = g_inet_socket_address_new(loopback, 0);
+  receiver = g_socket_new(G_SOCKET_FAMILY_IPV4, G_SOCKET_TYPE_DATAGRAM, G_SOCKET_PROTOCOL_UDP, NULL);
+  g_socket_bind(receiver, address, TRUE, NULL);
+  g_object_unref(address);
+  address = g_socket_get_local_address(receiver, NULL);
+
+  egress = make_udpegress();
+  udpegress_set_mode(egress, mode);
+  udpegress_open(egress, "127.0.0.1",
+                 g_inet_socket_address_get_port(G_INET_SOCKET_ADDRESS(address)), 0, NULL);
+  for(i = 0; i < BENCH_POOL_LENGTH; ++i){
+    pool[i] = _make_rtp_packet(i, BENCH_PAYLOAD_LENGTH, NULL);
+  }
+
+  clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts);
+  cpu_started = (guint64) ts.tv_sec * GST_SECOND + ts.tv_nsec;
+  _bench_resume(bench);
+  for(i = 0; i < ops; i += num){
+    num = MIN(ops - i, BENCH_BURST_LENGTH);
+    _sink += udpegress_send(egress, pool + (i % BENCH_POOL_LENGTH), num);
+  }
+  _bench_pause(bench);
+  clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts);
+
+  udpegress_get_counters(egress, NULL, &bytes, &syscalls, NULL);
+  if(reported != bench->name && BENCH_POOL_LENGTH < ops){
+    reported = bench->name;
+    g_printerr("%-26s %10.3f syscalls/packet %7.1f cpu-us/Mbit\n", bench->name,
+               (gdouble) syscalls / ops,
+               bytes ? (gdouble) ((guint64) ts.tv_sec * GST_SECOND + ts.tv_nsec - cpu_started) /
+                       GST_USECOND / (bytes * 8. / 1000000.) : 0.);
+  }
+
+  for(i = 0; i < BENCH_POOL_LENGTH; ++i){
+    gst_buffer_unref(pool[i]);
+  }
+  g_object_unref(egress);
+  g_object_unref(receiver);
+  g_object_unref(address);
+  g_object_unref(loopback);
+}
+
+//One sendto per packet, what udpsink does
+static void _bench_udp_egress_single(Bench* bench, guint32 ops)
+{
+  _run_udp_egress(bench, ops, UDPEGRESS_MODE_SINGLE);
+}
+
+static void _bench_udp_egress_sendmmsg(Bench* bench, guint32 ops)
+{
+  _run_udp_egress(bench, ops, UDPEGRESS_MODE_SENDMMSG);
+}
+
+static void _bench_udp_egress_gso(Bench* bench, guint32 ops)
+{
+  _run_udp_egress(bench, ops, UDPEGRESS_MODE_GSO);
+}
+
+//Bursts sent by GSO to a loopback socket are read back, only the reading
+//is measured. Besides the ns/op the packets read per syscall are reported.
+static void _run_udp_ingress(Bench* bench, guint32 ops, UDPIngressMode mode)
+{
+  static const gchar *reported = NULL;
+  UDPIngress *ingress;
+  UDPEgress *egress;
+  GSocketAddress *address;
+  GstBufferList *list;
+  GstBuffer *pool[BENCH_POOL_LENGTH];
+  guint64 packets, syscalls;
+  guint32 i, num, got, received;
+
+  ingress = make_udpingress();
+  udpingress_set_mode(ingress, mode);
+  udpingress_open(ingress, "127.0.0.1", 0, NULL);
+  address = g_socket_get_local_address(ingress->socket, NULL);
+  egress  = make_udpegress();
+  udpegress_open(egress, "127.0.0.1",
+                 g_inet_socket_address_get_port(G_INET_SOCKET_ADDRESS(address)), 0, NULL);
+  for(i = 0; i < BENCH_POOL_LENGTH; ++i){
+    pool[i] = _make_rtp_packet(i, BENCH_PAYLOAD_LENGTH, NULL);
+  }
+
+  for(i = 0; i < ops; i += num){
+    num = MIN(ops - i, BENCH_BURST_LENGTH);
+    udpegress_send(egress, pool + (i % BENCH_POOL_LENGTH), num);
+    list = gst_buffer_list_new_sized(UDPINGRESS_BATCH_LENGTH);
+    _bench_resume(bench);
+    for(received = 0; received < num; received += got){
+      if(!(got = udpingress_receive(ingress, list))){
+        break;
+      }
+    }
+    _bench_pause(bench);
+    _sink += gst_buffer_list_length(list);
+    gst_buffer_list_unref(list);
+  }
+
+  udpingress_get_counters(ingress, &packets, NULL, &syscalls, NULL);
+  if(reported != bench->name && BENCH_POOL_LENGTH < ops){
+    reported = bench->name;
+    g_printerr("%-26s %10.3f packets/syscall\n", bench->name,
+               syscalls ? (gdouble) packets / syscalls : 0.);
+  }
+
+  for(i = 0; i < BENCH_POOL_LENGTH; ++i){
+    gst_buffer_unref(pool[i]);
+  }
+  g_object_unref(egress);
+  g_object_unref(ingress);
+  g_object_unref(address);
+}
+
+//One recvfrom per packet, what udpsrc does
+static void _bench_udp_ingress_single(Bench* bench, guint32 ops)
+{
+  _run_udp_ingress(bench, ops, UDPINGRESS_MODE_SINGLE);
+}
+
+static void _bench_udp_ingress_recvmmsg(Bench* bench, guint32 ops)
+{
+  _run_udp_ingress(bench, ops, UDPINGRESS_MODE_RECVMMSG);
+}
+
+static void _bench_udp_ingress_gro(Bench* bench, guint32 ops)
+{
+  _run_udp_ingress(bench, ops, UDPINGRESS_MODE_GRO);
+}
+
+typedef struct _PacingReceiver{
+  GSocket*       socket;
+  //departure times by RTP sequence, written before the packet is sent
+  GstClockTime   departures[65536];
+  volatile gint  running;
+  guint32        received;
+  gdouble        owd_sum;
+  gdouble        owd_sum2;
+}PacingReceiver;
+
+static gpointer _pacing_receiver(gpointer data)
+{
+  PacingReceiver *this = data;
+  gchar packet[BENCH_PAYLOAD_LENGTH + 64];
+  guint16 seq;
+  gdouble owd;
+
+  while(g_atomic_int_get(&this->running)){
+    if(g_socket_receive(this->socket, packet, sizeof(packet), NULL, NULL) < 4){
+      continue;
+    }
+    memcpy(&seq, packet + 2, 2);
+    owd = (gdouble) mprtp_txtime_now() - (gdouble) this->departures[g_ntohs(seq)];
+    this->owd_sum  += owd;
+    this->owd_sum2 += owd * owd;
+    ++this->received;
+  }
+  return NULL;
+}
+
+static void _sleep_until(GstClockTime deadline)
+{
+  struct timespec ts;
+  ts.tv_sec  = deadline / GST_SECOND;
+  ts.tv_nsec = deadline % GST_SECOND;
+  while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+}
+
+//Frames of BENCH_BURST_LENGTH packets are made at the target bitrate of a
+//path, which paces them. The user space pacing sleeps until the departure
+//of every packet and sends it alone, the offload sends the frame at once
+//with the departure times. The standard deviation and the mean of the one
+//way delay over loopback are reported. The kernel paces only if lo has the
+//fq qdisc (tc qdisc replace dev lo root fq), the packets handed over with a
+//departure time are reported as well.
+static void _run_udp_pacing(Bench* bench, guint32 ops, gboolean offload)
+{
+  static const gchar *reported = NULL;
+  PacingReceiver *receiver;
+  GThread *thread;
+  UDPEgress *egress;
+  MPRTPSPath *path;
+  GInetAddress *loopback;
+  GSocketAddress *address;
+  GstBuffer *burst[BENCH_BURST_LENGTH];
+  GstClockTime now, frame, interval;
+  gdouble mean, variance;
+  guint32 i, j, num;
+  guint16 seq;
+
+  receiver = g_malloc0(sizeof(PacingReceiver));
+  loopback = g_inet_address_new_loopback(G_SOCKET_FAMILY_IPV4);
+  address  = g_inet_socket_address_new(loopback, 0);
+  receiver->socket = g_socket_new(G_SOCKET_FAMILY_IPV4, G_SOCKET_TYPE_DATAGRAM, G_SOCKET_PROTOCOL_UDP, NULL);
+  g_socket_bind(receiver->socket, address, TRUE, NULL);
+  g_socket_set_timeout(receiver->socket, 1);
+  g_object_unref(address);
+  address = g_socket_get_local_address(receiver->socket, NULL);
+  receiver->running = TRUE;
+  thread = g_thread_new("pacing-receiver", _pacing_receiver, receiver);
+
+  egress = make_udpegress();
+  udpegress_set_mode(egress, UDPEGRESS_MODE_SENDMMSG);
+  udpegress_open(egress, "127.0.0.1",
+                 g_inet_socket_address_get_port(G_INET_SOCKET_ADDRESS(address)), 0, NULL);
+  if(offload){
+    udpegress_set_txtime(egress, TRUE);
+  }
+  path = _make_sending_path(1);
+  mprtps_path_set_target_bitrate(path, BENCH_PACING_BITRATE);
+  interval = gst_util_uint64_scale_int(BENCH_BURST_LENGTH * BENCH_PAYLOAD_LENGTH * 8,
+                                       GST_SECOND, BENCH_PACING_BITRATE);
+
+  _bench_resume(bench);
+  frame = mprtp_txtime_now();
+  for(i = 0; i < ops; i += num){
+    num = MIN(ops - i, BENCH_BURST_LENGTH);
+    now = mprtp_txtime_now();
+    for(j = 0; j < num; ++j){
+      seq = (guint16)(i + j);
+      burst[j] = _make_rtp_packet(seq, BENCH_PAYLOAD_LENGTH, NULL);
+      receiver->departures[seq] = mprtps_path_get_departure_time(path, now, gst_buffer_get_size(burst[j]));
+      if(offload){
+        gst_buffer_add_mprtp_txtime_meta(burst[j], receiver->departures[seq]);
+        continue;
+      }
+      _sleep_until(receiver->departures[seq]);
+      udpegress_send(egress, burst + j, 1);
+    }
+    if(offload){
+      udpegress_send(egress, burst, num);
+    }
+    for(j = 0; j < num; ++j){
+      gst_buffer_unref(burst[j]);
+    }
+    frame += interval;
+    _sleep_until(frame);
+  }
+  _bench_pause(bench);
+
+  //the last frame is still paced by the kernel
+  _sleep_until(mprtp_txtime_now() + MPRTPS_PATH_MAX_PACING_BACKLOG);
+  g_atomic_int_set(&receiver->running, FALSE);
+  g_thread_join(thread);
+
+  if(reported != bench->name && BENCH_POOL_LENGTH < ops){
+    reported = bench->name;
+    mean     = receiver->received ? receiver->owd_sum / receiver->received : 0.;
+    variance = receiver->received ? receiver->owd_sum2 / receiver->received - mean * mean : 0.;
+    g_printerr("%-26s %10.1f owd-stddev-us %10.1f owd-mean-us %7.3f received %7.3f txtime\n",
+               bench->name, sqrt(MAX(variance, 0.)) / GST_USECOND, mean / GST_USECOND,
+               (gdouble) receiver->received / ops, (gdouble) udpegress_get_txtime_packets(egress) / ops);
+  }
+
+  g_object_unref(path);
+  g_object_unref(egress);
+  g_object_unref(receiver->socket);
+  g_object_unref(address);
+  g_object_unref(loopback);
+  g_free(receiver);
+}
+
+static void _bench_udp_pacing_userspace(Bench* bench, guint32 ops)
+{
+  _run_udp_pacing(bench, ops, FALSE);
+}
+
+static void _bench_udp_pacing_txtime(Bench* bench, guint32 ops)
+{
+  _run_udp_pacing(bench, ops, TRUE);
+}
+
+static Bench benches[] = {
+    {"splitter_approve",        200000, _bench_splitter_approve},
+    {"splitter_approve_frames", 200000, _bench_splitter_approve_frames},
+    {"joiner_push_transfer",    100000, _bench_joiner_push_transfer},
+    {"fec_encode",              200000, _bench_fec_encode},
+    {"fec_repair",               50000, _bench_fec_repair},
+    {"fec_repair_multipath",     50000, _bench_fec_repair_multipath},
+    {"fec_playout_inline_0",     10000, _bench_fec_playout_inline_0},
+    {"fec_playout_inline_5",     10000, _bench_fec_playout_inline_5},
+    {"fec_playout_inline_15",    10000, _bench_fec_playout_inline_15},
+    {"fec_playout_worker_0",     10000, _bench_fec_playout_worker_0},
+    {"fec_playout_worker_5",     10000, _bench_fec_playout_worker_5},
+    {"fec_playout_worker_15",    10000, _bench_fec_playout_worker_15},
+    {"report_rr_xr_roundtrip",   50000, _bench_report_rr_xr},
+    {"report_sr_roundtrip",      50000, _bench_report_sr},
+    {"mprtp_buffer_init",       500000, _bench_mprtp_buffer_init},
+    {"swpercentile_600",        200000, _bench_swpercentile_600},
+    {"swpercentile_4096",       200000, _bench_swpercentile_4096},
+    {"swquantile_600",          200000, _bench_swquantile_600},
+    {"swquantile_4096",         200000, _bench_swquantile_4096},
+    {"swminmax_600",            200000, _bench_swminmax_600},
+    {"path_contention_4",      1000000, _bench_path_contention},
+    {"splitter_approve_rebuilds", 200000, _bench_splitter_approve_rebuilds},
+    {"sndqueue_late_frames",    200000, _bench_sndqueue_late_frames},
+    {"vp8_keyframe_detect",    1000000, _bench_vp8_keyframe_detect},
+    {"udp_egress_single",       100000, _bench_udp_egress_single},
+    {"udp_egress_sendmmsg",     100000, _bench_udp_egress_sendmmsg},
+    {"udp_egress_gso",          100000, _bench_udp_egress_gso},
+    {"udp_ingress_single",      100000, _bench_udp_ingress_single},
+    {"udp_ingress_recvmmsg",    100000, _bench_udp_ingress_recvmmsg},
+    {"udp_ingress_gro",         100000, _bench_udp_ingress_gro},
+    {"udp_pacing_userspace",      5000, _bench_udp_pacing_userspace},
+    {"udp_pacing_txtime",         5000, _bench_udp_pacing_txtime},
+    {NULL, 0, NULL},
+};
+
+//----------------------------------------------------------------------
+//------------------------------- Main ---------------------------------
+//----------------------------------------------------------------------
+
+static gint _cmp_uint64(gconstpointer a, gconstpointer b)
+{
+  guint64 ai = *(const guint64*)a, bi = *(const guint64*)b;
+  return ai < bi ? -1 : ai > bi ? 1 : 0;
+}
+
+static gboolean _selected(Bench* bench, gchar **filters)
+{
+  gint i;
+  if(!filters){
+    return TRUE;
+  }
+  for(i = 0; filters[i]; ++i){
+    if(strstr(bench->name, filters[i])){
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+static void _measure(Bench* bench, gint runs, gdouble scale, FILE* out)
+{
+  guint64 *elapsed;
+  guint64 allocs = 0, alloc_bytes = 0;
+  guint32 ops;
+  gint i;
+
+  ops     = MAX(1, (guint32)(bench->ops * scale));
+  elapsed = g_malloc0(sizeof(guint64) * runs);
+  //warm up caches and lazily initialized types
+  bench->run(bench, MIN(ops, BENCH_POOL_LENGTH));
+
+  for(i = 0; i < runs; ++i){
+    bench->elapsed = bench->allocs = bench->alloc_bytes = 0;
+    bench->run(bench, ops);
+    elapsed[i] = bench->elapsed;
+    if(i == 0 || bench->allocs < allocs){
+      allocs      = bench->allocs;
+      alloc_bytes = bench->alloc_bytes;
+    }
+  }
+  qsort(elapsed, runs, sizeof(guint64), _cmp_uint64);
+
+  if(BENCH_COUNTS_ALLOCS){
+    fprintf(out, "%s,%d,%u,%.1f,%.1f,%.3f,%.1f\n", bench->name, runs, ops,
+            (gdouble) elapsed[runs / 2] / ops, (gdouble) elapsed[0] / ops,
+            (gdouble) allocs / ops, (gdouble) alloc_bytes / ops);
+  }else{
+    fprintf(out, "%s,%d,%u,%.1f,%.1f,-1,-1\n", bench->name, runs, ops,
+            (gdouble) elapsed[runs / 2] / ops, (gdouble) elapsed[0] / ops);
+  }
+  fflush(out);
+  g_printerr("%-26s %10.1f ns/op %10.3f allocs/op\n", bench->name,
+             (gdouble) elapsed[runs / 2] / ops, (gdouble) allocs / ops);
+  g_free(elapsed);
+}
+
+int
+main (int argc, char **argv)
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  gint runs = BENCH_DEFAULT_RUNS;
+  gdouble scale = 1.;
+  gchar *output = NULL;
+  gboolean list = FALSE;
+  gchar **filters = NULL;
+  gchar *quantile_trace = NULL;
+  Bench accuracy = {"swquantile_accuracy", 0, NULL};
+  FILE *out = stdout;
+  GRand *rand;
+  gint i;
+  GOptionEntry entries[] = {
+      {"runs", 'r', 0, G_OPTION_ARG_INT, &runs, "Measured runs per benchmark, the median is reported", "N"},
+      {"scale", 's', 0, G_OPTION_ARG_DOUBLE, &scale, "Multiplier of the operations per run", "FACTOR"},
+      {"output", 'o', 0, G_OPTION_ARG_FILENAME, &output, "Write the CSV results into FILE", "FILE"},
+      {"list", 'l', 0, G_OPTION_ARG_NONE, &list, "List the benchmarks", NULL},
+      {"quantile-trace", 'q', 0, G_OPTION_ARG_FILENAME, &quantile_trace,
+          "OWD trace of swquantile_accuracy, a synthetic one is used without it", "FILE"},
+      {G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_STRING_ARRAY, &filters, NULL, "[NAME...]"},
+      {NULL}
+  };
+
+  context = g_option_context_new ("- MPRTP microbenchmarks");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gst_init_get_option_group ());
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    return 1;
+  }
+  g_option_context_free (context);
+  runs = MAX(1, runs);
+
+  if(list){
+    for(i = 0; benches[i].name; ++i){
+      g_print("%s\n", benches[i].name);
+    }
+    g_print("%s\n", accuracy.name);
+    return 0;
+  }
+  if(output && !(out = fopen(output, "w"))){
+    g_printerr ("Can not open %s\n", output);
+    return 1;
+  }
+
+  init_mprtp_logger();
+  rand = g_rand_new_with_seed(BENCH_SEED);
+  for(i = 0; i < BENCH_VALUES_LENGTH; ++i){
+    //one way delays in us between 10 and 300ms
+    _values[i] = g_rand_int_range(rand, 10000, 300000);
+  }
+  g_rand_free(rand);
+
+  fprintf(out, "benchmark,runs,ops,ns_per_op,ns_per_op_min,allocs_per_op,bytes_per_op\n");
+  for(i = 0; benches[i].name; ++i){
+    if(_selected(&benches[i], filters)){
+      _measure(&benches[i], runs, scale, out);
+    }
+  }
+  if(_selected(&accuracy, filters)){
+    swquantiletest(quantile_trace);
+  }
+
+  if(out != stdout){
+    fclose(out);
+  }
+  g_strfreev(filters);
+  g_free(output);
+  //keeps the compiler from dropping the measured results
+  return _sink == 1 ? 2 : 0;
+}
@@ -0,0 +1,227 @@
+/* GStreamer MPRTP clock provider
+ * Copyright (C) 2015 Balázs Kreith (contact: balazs.kreith@gmail.com)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "mprtpclock.h"
+#include "mprtpepoch.h"
+
+#define CLOCK_LOCK g_mutex_lock(&_clock_mutex)
+#define CLOCK_UNLOCK g_mutex_unlock(&_clock_mutex)
+
+//Seconds between the NTP (1900) and the unix (1970) epoch in us
+#define NTP_UNIX_OFFSET_US 2208988800000000LL
+
+struct _MPRTPClockProvider{
+  GstClock*      clock;
+  gboolean       system;
+  //Epoch time and clock time at the moment the provider was made
+  guint64        epoch_base;
+  GstClockTime   clock_base;
+};
+
+typedef struct{
+  gpointer             owner;
+  MPRTPClockProvider*  provider;
+}Registration;
+
+//Writers only, the readers go through the atomic pointers inside an epoch
+static GMutex _clock_mutex;
+static GQueue _registrations = G_QUEUE_INIT;
+static MpRTPEpoch _epoch;
+static MPRTPClockProvider* _default = NULL;
+static MPRTPClockProvider* _system = NULL;
+static GPrivate _binding;
+
+static guint64 _system_epoch_time(void)
+{
+  return (guint64)(g_get_real_time () + NTP_UNIX_OFFSET_US) * 1000;
+}
+
+static void _provider_dtor(gpointer data)
+{
+  MPRTPClockProvider* provider = data;
+  gst_object_unref (provider->clock);
+  g_slice_free(MPRTPClockProvider, provider);
+}
+
+static MPRTPClockProvider* _get_default(void)
+{
+  MPRTPClockProvider* result;
+  result = g_atomic_pointer_get(&_default);
+  if(G_LIKELY(result)){
+    return result;
+  }
+  if(g_once_init_enter(&_system)){
+    mprtp_epoch_init(&_epoch, _provider_dtor);
+    result         = g_slice_new0(MPRTPClockProvider);
+    result->clock  = gst_system_clock_obtain ();
+    result->system = TRUE;
+    g_once_init_leave(&_system, result);
+  }
+  //the system provider is never retired
+  g_atomic_pointer_compare_and_exchange(&_default, NULL, _system);
+  return g_atomic_pointer_get(&_default);
+}
+
+//must be called inside an epoch
+static MPRTPClockProvider* _get_provider(MPRTPClockProvider** slot)
+{
+  MPRTPClockProvider* result;
+  result = slot ? g_atomic_pointer_get(slot) : NULL;
+  return result ? result : _get_default();
+}
+
+//must be called under the lock
+static void _refresh_default(void)
+{
+  Registration* registration;
+  registration = g_queue_peek_head(&_registrations);
+  g_atomic_pointer_set(&_default, registration ? registration->provider : _system);
+}
+
+static MPRTPClockProvider* _make_provider(GstClock* clock)
+{
+  MPRTPClockProvider* result;
+  result             = g_slice_new0(MPRTPClockProvider);
+  result->epoch_base = mprtp_clock_provider_get_epoch_time(NULL);
+  result->clock      = gst_object_ref (clock);
+  result->clock_base = gst_clock_get_time (clock);
+  return result;
+}
+
+//must be called under the lock
+static void _register(gpointer owner, MPRTPClockProvider* provider)
+{
+  Registration* registration = NULL;
+  GList* it;
+
+  for(it = _registrations.head; it; it = it->next){
+    if(((Registration*) it->data)->owner == owner){
+      registration = it->data;
+      break;
+    }
+  }
+  if(!provider){
+    if(registration){
+      g_queue_remove(&_registrations, registration);
+      g_slice_free(Registration, registration);
+    }
+  }else if(registration){
+    registration->provider = provider;
+  }else{
+    registration           = g_slice_new0(Registration);
+    registration->owner    = owner;
+    registration->provider = provider;
+    g_queue_push_tail(&_registrations, registration);
+  }
+  _refresh_default();
+}
+
+void mprtp_clock_provide(gpointer owner, MPRTPClockProvider** provider, GstClock* clock)
+{
+  MPRTPClockProvider* old;
+  MPRTPClockProvider* made;
+
+  _get_default();
+  old = g_atomic_pointer_get(provider);
+  if(old && old->clock == clock){
+    return;
+  }
+  made = clock ? _make_provider(clock) : NULL;
+
+  CLOCK_LOCK;
+  _register(owner, made);
+  g_atomic_pointer_set(provider, made);
+  if(old){
+    //unpublished from both the slot and the default by now
+    mprtp_epoch_retire(&_epoch, old);
+  }
+  CLOCK_UNLOCK;
+}
+
+MPRTPClockProvider** mprtp_clock_bind(MPRTPClockProvider** provider)
+{
+  MPRTPClockProvider** result;
+  result = g_private_get(&_binding);
+  g_private_set(&_binding, provider);
+  return result;
+}
+
+MPRTPClockProvider** mprtp_clock_get_binding(void)
+{
+  return g_private_get(&_binding);
+}
+
+GstClockTime mprtp_clock_provider_get_time(MPRTPClockProvider** provider)
+{
+  GstClockTime result;
+  gint epoch;
+  _get_default();
+  epoch  = mprtp_epoch_enter(&_epoch);
+  result = gst_clock_get_time (_get_provider(provider)->clock);
+  mprtp_epoch_leave(&_epoch, epoch);
+  return result;
+}
+
+guint64 mprtp_clock_provider_get_epoch_time(MPRTPClockProvider** provider)
+{
+  MPRTPClockProvider* selected;
+  GstClockTime now;
+  guint64 result;
+  gint epoch;
+
+  _get_default();
+  epoch    = mprtp_epoch_enter(&_epoch);
+  selected = _get_provider(provider);
+  if(selected->system){
+    result = _system_epoch_time();
+  }else{
+    now    = gst_clock_get_time (selected->clock);
+    result = selected->epoch_base + (now < selected->clock_base ? 0 : now - selected->clock_base);
+  }
+  mprtp_epoch_leave(&_epoch, epoch);
+  return result;
+}
+
+GstClock* mprtp_clock_obtain(void)
+{
+  GstClock* result;
+  gint epoch;
+  _get_default();
+  epoch  = mprtp_epoch_enter(&_epoch);
+  result = gst_object_ref (_get_default()->clock);
+  mprtp_epoch_leave(&_epoch, epoch);
+  return result;
+}
+
+GstClockTime mprtp_clock_get_time(void)
+{
+  return mprtp_clock_provider_get_time(g_private_get(&_binding));
+}
+
+guint64 mprtp_clock_get_epoch_time(void)
+{
+  return mprtp_clock_provider_get_epoch_time(g_private_get(&_binding));
+}
+
+#undef CLOCK_LOCK
+#undef CLOCK_UNLOCK
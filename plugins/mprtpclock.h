@@ -0,0 +1,48 @@
+/*
+ * mprtpclock.h
+ *
+ *  Clock providers of the MPRTP elements. Every element makes its own
+ *  provider from the clock its pipeline hands over. The element binds
+ *  its threads to it, so the helper objects called on them read the time
+ *  of their owner. Unbound threads (the timer wheel itself, the logger)
+ *  read the process default, which is the provider of the earliest
+ *  element still registered, or the system clock if there is none.
+ *  Reads take no lock, replaced providers are reclaimed by epochs once
+ *  no reader can hold them.
+ */
+
+#ifndef MPRTPCLOCK_H_
+#define MPRTPCLOCK_H_
+
+#include <gst/gst.h>
+
+typedef struct _MPRTPClockProvider MPRTPClockProvider;
+
+//Replaces the provider of the owner element with one of the given clock,
+//NULL withdraws it. The wall clock (NTP) time continues from the current
+//default and moves with the clock afterwards.
+void mprtp_clock_provide(gpointer owner, MPRTPClockProvider** provider, GstClock* clock);
+
+//Binds the calling thread to the provider of an element, the time is read
+//from it until the returned previous binding is bound back.
+//NULL binds the process default.
+MPRTPClockProvider** mprtp_clock_bind(MPRTPClockProvider** provider);
+
+//The binding of the calling thread, so it can be carried to another thread
+MPRTPClockProvider** mprtp_clock_get_binding(void);
+
+//A NULL provider or an empty slot reads the process default
+GstClockTime mprtp_clock_provider_get_time(MPRTPClockProvider** provider);
+guint64 mprtp_clock_provider_get_epoch_time(MPRTPClockProvider** provider);
+
+//Returns a new reference to the clock of the process default
+GstClock* mprtp_clock_obtain(void);
+
+//The time of the provider the calling thread is bound to
+GstClockTime mprtp_clock_get_time(void);
+
+//Nanoseconds elapsed since the NTP epoch (1900) on the time base the
+//calling thread is bound to
+guint64 mprtp_clock_get_epoch_time(void);
+
+#endif /* MPRTPCLOCK_H_ */
@@ -12,6 +12,7 @@
 #define MPRTP_DEFAULT_EXTENSION_HEADER_ID 3
 #define ABS_TIME_DEFAULT_EXTENSION_HEADER_ID 8
 #define FEC_PAYLOAD_DEFAULT_ID 126
+#define RTX_PAYLOAD_DEFAULT_ID 125
 #define SUBFLOW_DEFAULT_SENDING_RATE 100000
 
 #define MPRTP_PLUGIN_MAX_SUBFLOW_NUM 32
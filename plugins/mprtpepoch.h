@@ -0,0 +1,92 @@
+/*
+ * mprtpepoch.h
+ *
+ *  Epoch based reclamation for objects published by an atomic pointer
+ *  swap. Readers announce the epoch they work in and never block, a
+ *  replaced object is reclaimed after every reader that could have seen
+ *  it left. Writers (retire, clear) must be serialized by the caller.
+ *
+ *  Readers of epoch e are counted in active[e & 1]. The epoch advances
+ *  from e to e + 1 only if no reader of e - 1 is left, so the objects
+ *  retired in e - 1 are not referenced anymore and are reclaimed.
+ */
+
+#ifndef MPRTPEPOCH_H_
+#define MPRTPEPOCH_H_
+
+#include <glib.h>
+
+typedef struct _MpRTPEpoch MpRTPEpoch;
+
+struct _MpRTPEpoch
+{
+  volatile gint   epoch;
+  volatile gint   active[2];
+  GSList*         retired[2];
+  GDestroyNotify  reclaim;
+};
+
+static inline void mprtp_epoch_init(MpRTPEpoch *this, GDestroyNotify reclaim)
+{
+  this->epoch      = 0;
+  this->active[0]  = this->active[1]  = 0;
+  this->retired[0] = this->retired[1] = NULL;
+  this->reclaim    = reclaim;
+}
+
+//Returns the epoch the reader has to leave
+static inline gint mprtp_epoch_enter(MpRTPEpoch *this)
+{
+  gint result;
+  for(;;){
+    result = g_atomic_int_get(&this->epoch);
+    g_atomic_int_inc(&this->active[result & 1]);
+    //the epoch advanced before the reader was counted
+    if(G_LIKELY(g_atomic_int_get(&this->epoch) == result)){
+      return result;
+    }
+    g_atomic_int_add(&this->active[result & 1], -1);
+  }
+}
+
+static inline void mprtp_epoch_leave(MpRTPEpoch *this, gint epoch)
+{
+  g_atomic_int_add(&this->active[epoch & 1], -1);
+}
+
+static inline void _mprtp_epoch_reclaim(MpRTPEpoch *this, guint slot)
+{
+  g_slist_free_full(this->retired[slot], this->reclaim);
+  this->retired[slot] = NULL;
+}
+
+static inline gboolean _mprtp_epoch_advance(MpRTPEpoch *this)
+{
+  gint epoch = g_atomic_int_get(&this->epoch);
+  if(g_atomic_int_get(&this->active[(epoch + 1) & 1])){
+    return FALSE;
+  }
+  _mprtp_epoch_reclaim(this, (epoch + 1) & 1);
+  g_atomic_int_set(&this->epoch, epoch + 1);
+  return TRUE;
+}
+
+//The object must be unpublished already. If no reader is inside it is
+//reclaimed at once, otherwise at a later retire or at clear.
+static inline void mprtp_epoch_retire(MpRTPEpoch *this, gpointer object)
+{
+  gint epoch = g_atomic_int_get(&this->epoch);
+  this->retired[epoch & 1] = g_slist_prepend(this->retired[epoch & 1], object);
+  if(_mprtp_epoch_advance(this)){
+    _mprtp_epoch_advance(this);
+  }
+}
+
+//Reclaims everything, no reader may be inside
+static inline void mprtp_epoch_clear(MpRTPEpoch *this)
+{
+  _mprtp_epoch_reclaim(this, 0);
+  _mprtp_epoch_reclaim(this, 1);
+}
+
+#endif /* MPRTPEPOCH_H_ */
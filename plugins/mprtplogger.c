@@ -24,6 +24,7 @@
 #include <gst/rtp/gstrtpbuffer.h>
 #include <gst/rtp/gstrtcpbuffer.h>
 #include "mprtplogger.h"
+#include "mprtpclock.h"
 #include <math.h>
 #include <string.h>
 #include <stdlib.h>
@@ -44,14 +45,17 @@
 #define LIST_WRITEUNLOCK g_rw_lock_writer_unlock(&list_mutex)
 
 #define DATABED_LENGTH 1400
+//records claimed but not written yet, must divide 2^32
+#define STATS_RING_LENGTH 4096
 
 GST_DEBUG_CATEGORY_STATIC (mprtp_logger_debug_category);
 #define GST_CAT_DEFAULT mprtp_logger_debug_category
 
-#define _now(this) (gst_clock_get_time (this->sysclock))
+#define _now(this) mprtp_clock_get_time()
 
 typedef struct{
   void             (*logging_fnc)(gpointer,gchar*);
+  void             (*stats_fnc)(gpointer);
   gpointer           data;
   gchar              path[255];
 }Subscription;
@@ -67,7 +71,25 @@ G_DEFINE_TYPE (MPRTPLogger, mprtp_logger, G_TYPE_OBJECT);
 static MPRTPLogger *this = NULL;
 static GRWLock list_mutex;
 static GList* subscriptions = NULL;
-static GstClock*  listclock = NULL;
+
+static const MPRTPStatsSchema stats_schemas[MPRTP_STATS_TYPES_NUM] = {
+    {MPRTP_STATS_SUBFLOW_RATES, 5, FALSE,
+     {MPRTP_STATS_INTEGER, MPRTP_STATS_INTEGER, MPRTP_STATS_INTEGER, MPRTP_STATS_INTEGER, MPRTP_STATS_INTEGER},
+     "snd_%u_ratestat.csv",
+     {"target_kbps", "goodput_kbps", "sending_kbps", "stage", "fec_kbps"}},
+    {MPRTP_STATS_OWD, 4, FALSE,
+     {MPRTP_STATS_INTEGER, MPRTP_STATS_INTEGER, MPRTP_STATS_INTEGER, MPRTP_STATS_INTEGER},
+     "owd_%u.csv",
+     {"owd_stt_us", "owd_ltt80_us", "rtt_us", "srtt_us"}},
+    {MPRTP_STATS_FEC, 3, FALSE,
+     {MPRTP_STATS_INTEGER, MPRTP_STATS_INTEGER, MPRTP_STATS_INTEGER},
+     "fecstat.csv",
+     {"rtp_packets", "missing_packets", "recovered_packets"}},
+    {MPRTP_STATS_SPLITTER_WEIGHT, 1, TRUE,
+     {MPRTP_STATS_REAL},
+     "streamsplitter.csv",
+     {"weight"}},
+};
 //----------------------------------------------------------------------
 //-------- Private functions belongs to Scheduler tree object ----------
 //----------------------------------------------------------------------
@@ -82,6 +104,15 @@ _caller_process(void *data);
 static void
 _writer_process(void *data);
 
+static void
+_open_stats(MPRTPLogger *this);
+
+static gboolean
+_open_stats_file(MPRTPLogger *this);
+
+static void
+_flush_stats(MPRTPLogger *this);
+
 //----------------------------------------------------------------------
 //--------- Private functions implementations to SchTree object --------
 //----------------------------------------------------------------------
@@ -115,8 +146,9 @@ void
 mprtp_logger_finalize (GObject * object)
 {
   MPRTPLogger *this = MPRTPLOGGER (object);
-  g_object_unref (this->sysclock);
-  g_object_unref(listclock);
+  if(this->timerwheel){
+    g_object_unref (this->timerwheel);
+  }
   g_list_free_full(subscriptions, mprtp_free);
 }
 
@@ -126,8 +158,6 @@ mprtp_logger_init (MPRTPLogger * this)
   g_mutex_init(&this->mutex);
   g_rw_lock_init (&list_mutex);
   this->enabled    = FALSE;
-  this->sysclock   = gst_system_clock_obtain ();
-  listclock        = gst_system_clock_obtain ();
   this->made       = _now(this);
   strcpy(this->path, "logs/");
   this->writer_queue = g_queue_new();
@@ -145,13 +175,22 @@ void init_mprtp_logger(void)
 
 void enable_mprtp_logger(void)
 {
+  MPRTPClockProvider** clock;
   THIS_LOCK(this);
   this->enabled = TRUE;
 
-  this->caller = gst_task_new (_caller_process, this, NULL);
-  g_rec_mutex_init (&this->caller_mutex);
-  gst_task_set_lock (this->caller, &this->caller_mutex);
-  gst_task_start (this->caller);
+  if(!this->timerwheel){
+    this->timerwheel = timerwheel_obtain();
+  }
+  if(!this->caller){
+    //the logger is shared by the elements, it ticks on the process default
+    clock = mprtp_clock_bind(NULL);
+    this->caller = timerwheel_add_periodic(this->timerwheel, 100 * GST_MSECOND,
+                                           _caller_process, this);
+    mprtp_clock_bind(clock);
+  }
+
+  _open_stats(this);
 
   g_cond_init(&this->writer_cond);
   this->writer = gst_task_new (_writer_process, this, NULL);
@@ -164,24 +203,47 @@ void enable_mprtp_logger(void)
 
 void disable_mprtp_logger(void)
 {
+  TimerWheelTimer *caller;
   THIS_LOCK(this);
   this->enabled = FALSE;
-  if(this->caller && gst_task_get_state(this->caller) == GST_TASK_STARTED){
-    gst_task_stop (this->caller);
-    gst_task_join (this->caller);
+  g_atomic_int_set(&this->stats_enabled, FALSE);
+  caller = this->caller;
+  this->caller = NULL;
+  THIS_UNLOCK(this);
+
+  //the caller takes THIS_LOCK, so it must be removed without holding it
+  if(caller){
+    timerwheel_remove(this->timerwheel, caller);
   }
 
+  THIS_LOCK(this);
+
   if(this->writer && gst_task_get_state(this->writer) == GST_TASK_STARTED){
     gst_task_stop (this->writer);
     gst_task_join (this->writer);
   }
+  if(this->stats_ring){
+    _flush_stats(this);
+  }
+  if(this->stats_file){
+    fclose(this->stats_file);
+    this->stats_file = NULL;
+  }
   THIS_UNLOCK(this);
 }
 
+//The stats file is opened at the first flush, so the directory can be set
+//after the logger is enabled. If it is open already, the records so far
+//stay in it and the next flush opens a new one in the given directory.
 void mprtp_logger_set_target_directory(const gchar *path)
 {
   THIS_LOCK(this);
   strcpy(this->path, path);
+  if(this->stats_file){
+    _flush_stats(this);
+    fclose(this->stats_file);
+    this->stats_file = NULL;
+  }
   THIS_UNLOCK(this);
 }
 
@@ -231,40 +293,156 @@ void mprtp_logger_add_logging_fnc(void(*logging_fnc)(gpointer,gchar*),gpointer d
   LIST_WRITEUNLOCK;
 }
 
+void mprtp_logger_add_stats_fnc(void(*stats_fnc)(gpointer), gpointer data)
+{
+  Subscription *subscription;
+  LIST_WRITELOCK;
+  subscription = mprtp_malloc(sizeof(Subscription));
+  subscription->stats_fnc = stats_fnc;
+  subscription->data      = data;
+  subscriptions = g_list_prepend(subscriptions, subscription);
+  LIST_WRITEUNLOCK;
+}
+
+void mprtp_logger_rem_stats_fnc(void(*stats_fnc)(gpointer), gpointer data)
+{
+  Subscription *subscription;
+  GList *it;
+  LIST_WRITELOCK;
+  for(it = subscriptions; it; it = it->next){
+    subscription = it->data;
+    if(subscription->stats_fnc == stats_fnc && subscription->data == data){
+      subscriptions = g_list_delete_link(subscriptions, it);
+      mprtp_free(subscription);
+      break;
+    }
+  }
+  LIST_WRITEUNLOCK;
+}
+
+MPRTPStatsRecord *mprtp_stats_begin(MPRTPStatsType type, guint8 subflow_id)
+{
+  MPRTPStatsRecord *result;
+  gint head;
+
+  if(G_LIKELY(!this || !g_atomic_int_get(&this->stats_enabled))){
+    return NULL;
+  }
+  do{
+    head = g_atomic_int_get(&this->stats_head);
+    if(STATS_RING_LENGTH <= (guint) head - (guint) g_atomic_int_get(&this->stats_tail)){
+      g_atomic_int_inc(&this->stats_dropped);
+      return NULL;
+    }
+  }while(!g_atomic_int_compare_and_exchange(&this->stats_head, head, (gint)((guint) head + 1)));
+
+  result = this->stats_ring + (guint) head % STATS_RING_LENGTH;
+  result->type       = type;
+  result->subflow_id = subflow_id;
+  result->values_num = stats_schemas[type].values_num;
+  result->tick       = g_atomic_int_get(&this->stats_tick);
+  result->time       = _now(this) - this->made;
+  return result;
+}
+
+void mprtp_stats_commit(MPRTPStatsRecord *record)
+{
+  g_atomic_int_set(this->stats_committed + (record - this->stats_ring), TRUE);
+}
+
+//The records are collected from here, the file is opened by the writer
+void _open_stats(MPRTPLogger *this)
+{
+  if(!this->stats_ring){
+    this->stats_ring      = g_malloc0(sizeof(MPRTPStatsRecord) * STATS_RING_LENGTH);
+    this->stats_committed = g_malloc0(sizeof(gint) * STATS_RING_LENGTH);
+  }
+  g_atomic_int_set(&this->stats_enabled, TRUE);
+}
+
+gboolean _open_stats_file(MPRTPLogger *this)
+{
+  MPRTPStatsHeader header;
+  gchar path[512];
+
+  sprintf(path, "%s%s", this->path, MPRTP_STATS_FILENAME);
+  this->stats_file = fopen(path, "wb");
+  if(!this->stats_file){
+    GST_WARNING("Can not open %s, the stats are not logged", path);
+    g_atomic_int_set(&this->stats_enabled, FALSE);
+    return FALSE;
+  }
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, MPRTP_STATS_MAGIC, sizeof(header.magic));
+  header.version     = MPRTP_STATS_VERSION;
+  header.record_size = sizeof(MPRTPStatsRecord);
+  header.schema_size = sizeof(MPRTPStatsSchema);
+  header.types_num   = MPRTP_STATS_TYPES_NUM;
+  fwrite(&header, sizeof(header), 1, this->stats_file);
+  fwrite(stats_schemas, sizeof(MPRTPStatsSchema), MPRTP_STATS_TYPES_NUM, this->stats_file);
+  return TRUE;
+}
+
+//It is called under THIS_LOCK, the records are written in the order they
+//were claimed, so a record not committed yet holds the later ones back
+void _flush_stats(MPRTPLogger *this)
+{
+  guint tail, index;
+
+  if(!this->stats_file && !_open_stats_file(this)){
+    return;
+  }
+
+  for(tail = g_atomic_int_get(&this->stats_tail); ; ++tail){
+    index = tail % STATS_RING_LENGTH;
+    if(!g_atomic_int_get(this->stats_committed + index)){
+      break;
+    }
+    fwrite(this->stats_ring + index, sizeof(MPRTPStatsRecord), 1, this->stats_file);
+    g_atomic_int_set(this->stats_committed + index, FALSE);
+    g_atomic_int_set(&this->stats_tail, (gint)(tail + 1));
+  }
+  fflush(this->stats_file);
+}
+
+//The subscribers are called without THIS_LOCK, they take their own locks
+//and those are held while mprtp_logger() is called, so THIS_LOCK must
+//never be taken before them. The list lock keeps a subscriber alive
+//until it is called, as it is removed in its finalize.
 void _caller_process(void *data)
 {
-  GstClockTime next_scheduler_time;
-  GstClockID clock_id;
   GList *it;
   Subscription *subscription;
   WriterQueueItem* item;
+  GQueue items = G_QUEUE_INIT;
 
-  THIS_LOCK(this);
-
+  LIST_READLOCK;
+  g_atomic_int_inc(&this->stats_tick);
   for(it = subscriptions; it; it = it->next){
       subscription = it->data;
       if(!subscription->data){
         g_warning("subscripted logging function data param is NULL. Potentional nightmare might ended up with segfault.");
         continue;
       }
+      if(subscription->stats_fnc){
+        subscription->stats_fnc(subscription->data);
+        continue;
+      }
       item = g_malloc0(sizeof(WriterQueueItem));
       subscription->logging_fnc(subscription->data, item->string);
       strcpy(item->path, subscription->path);
-      g_queue_push_tail(this->writer_queue, item);
+      g_queue_push_tail(&items, item);
+  }
+  LIST_READUNLOCK;
+
+  THIS_LOCK(this);
+  while((item = g_queue_pop_head(&items)) != NULL){
+    g_queue_push_tail(this->writer_queue, item);
   }
-  next_scheduler_time = gst_clock_get_time (listclock) + 100 * GST_MSECOND;
   if(this->writer_wait){
     g_cond_signal(&this->writer_cond);
   }
-
   THIS_UNLOCK(this);
-
-  clock_id = gst_clock_new_single_shot_id (this->sysclock, next_scheduler_time);
-
-  if (gst_clock_id_wait (clock_id, NULL) == GST_CLOCK_UNSCHEDULED) {
-    GST_WARNING_OBJECT (this, "The clock wait is interrupted");
-  }
-  gst_clock_id_unref (clock_id);
 }
 
 
@@ -280,6 +458,9 @@ void _writer_process(void *data)
 wait:
   this->writer_wait = TRUE;
   g_cond_wait (&this->writer_cond, &this->mutex);
+  if(this->stats_file || g_atomic_int_get(&this->stats_enabled)){
+    _flush_stats(this);
+  }
 
 again:
   if(g_queue_is_empty(this->writer_queue)){
@@ -9,6 +9,9 @@
 #define MPRTP_LOGGER_H_
 
 #include <gst/gst.h>
+#include <stdio.h>
+#include "timerwheel.h"
+#include "mprtpstats.h"
 
 typedef struct _MPRTPLogger MPRTPLogger;
 typedef struct _MPRTPLoggerClass MPRTPLoggerClass;
@@ -25,12 +28,11 @@ struct _MPRTPLogger
 {
   GObject           object;
   GMutex            mutex;
-  GstClock*         sysclock;
   GstClockTime      made;
 //  GHashTable*       reserves;
 
-  GstTask*          caller;
-  GRecMutex         caller_mutex;
+  TimerWheel*       timerwheel;
+  TimerWheelTimer*  caller;
 
   gchar             path[255];
   gboolean          enabled;
@@ -43,6 +45,17 @@ struct _MPRTPLogger
   GQueue*           writer_queue;
   GCond             writer_cond;
   gboolean          writer_wait;
+
+  //binary stats records, filled by the live threads and written by the
+  //writer in the order they are claimed
+  MPRTPStatsRecord* stats_ring;
+  volatile gint*    stats_committed;
+  volatile gint     stats_head;
+  volatile gint     stats_tail;
+  volatile gint     stats_tick;
+  volatile gint     stats_enabled;
+  volatile gint     stats_dropped;
+  FILE*             stats_file;
 };
 
 struct _MPRTPLoggerClass{
@@ -63,5 +76,15 @@ void mprtp_logger_set_target_directory(const gchar *path);
 void mprtp_logger_get_target_directory(gchar* result);
 void mprtp_logger(const gchar *filename, const gchar * format, ...);
 
+//The stats function is called in every 100ms to make its records
+void mprtp_logger_add_stats_fnc(void(*stats_fnc)(gpointer), gpointer data);
+//The stats function is not called after it returns
+void mprtp_logger_rem_stats_fnc(void(*stats_fnc)(gpointer), gpointer data);
+//Claims a record of the ring, NULL if the logger is disabled or the ring
+//is full. The values are filled by the caller and the record is written
+//after it is committed.
+MPRTPStatsRecord *mprtp_stats_begin(MPRTPStatsType type, guint8 subflow_id);
+void mprtp_stats_commit(MPRTPStatsRecord *record);
+
 GType mprtp_logger_get_type (void);
 #endif /* MPRTP_LOGGER_H_ */
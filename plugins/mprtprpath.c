@@ -9,6 +9,7 @@
 #include <string.h>
 #include <math.h>
 #include "mprtprpath.h"
+#include "mprtpclock.h"
 #include "mprtpspath.h"
 #include "gstmprtcpbuffer.h"
 #include "streamjoiner.h"
@@ -25,12 +26,13 @@ G_DEFINE_TYPE (MpRTPRPath, mprtpr_path, G_TYPE_OBJECT);
 #define THIS_WRITEUNLOCK(this) g_rw_lock_writer_unlock(&this->rwmutex)
 
 #define _actual_RLEBlock(this) ((RLEBlock*)(this->rle.blocks + this->rle.write_index))
-#define _now(this) (gst_clock_get_time(this->sysclock))
+#define _now(this) mprtp_clock_get_time()
 
 static void mprtpr_path_finalize (GObject * object);
 static void mprtpr_path_reset (MpRTPRPath * this);
 static gint _cmp_seq32 (guint32 x, guint32 y);
 static void _add_delay(MpRTPRPath *this, GstClockTime delay);
+static void _publish_stats(MpRTPRPath *this);
 
 void
 mprtpr_path_class_init (MpRTPRPathClass * klass)
@@ -62,7 +64,6 @@ void
 mprtpr_path_init (MpRTPRPath * this)
 {
   g_rw_lock_init (&this->rwmutex);
-  this->sysclock = gst_system_clock_obtain ();
   this->spike_var_treshold = 20 * GST_MSECOND;
   this->spike_delay_treshold = 375 * GST_MSECOND;
   mprtpr_path_reset (this);
@@ -78,7 +79,6 @@ mprtpr_path_finalize (GObject * object)
 {
   MpRTPRPath *this;
   this = MPRTPR_PATH_CAST (object);
-  g_object_unref (this->sysclock);
 //  g_object_unref(this->lt_low_delays);
 //  g_object_unref(this->lt_high_delays);
 //  g_object_unref(this->skews);
@@ -93,27 +93,20 @@ mprtpr_path_reset (MpRTPRPath * this)
   this->cycle_num = 0;
   this->highest_seq = 0;
   this->jitter = 0;
-
+  _publish_stats(this);
 }
 
+//The id is not changed after the path is made
 guint8
 mprtpr_path_get_id (MpRTPRPath * this)
 {
-  guint8 result;
-  THIS_READLOCK (this);
-  result = this->id;
-  THIS_READUNLOCK (this);
-  return result;
+  return this->id;
 }
 
 guint16
 mprtpr_path_get_HSSN (MpRTPRPath * this)
 {
-  guint16 result;
-  THIS_READLOCK (this);
-  result = this->highest_seq;
-  THIS_READUNLOCK (this);
-  return result;
+  return (guint16) g_atomic_int_get (&this->published_HSN);
 }
 
 void mprtpr_path_get_regular_stats(MpRTPRPath *this,
@@ -122,30 +115,41 @@ void mprtpr_path_get_regular_stats(MpRTPRPath *this,
                               guint32 *jitter,
                               guint32 *received_num)
 {
-  THIS_READLOCK (this);
-  if(HSN) *HSN = this->highest_seq;
-  if(cycle_num) *cycle_num = this->cycle_num;
-  if(jitter) *jitter = this->jitter;
-  if(received_num) *received_num = this->total_packets_received;
-  THIS_READUNLOCK (this);
+  guint highest_seq, cycles, received;
+  gint jitter_value;
+  gint sequence;
+  do{
+    sequence     = mprtp_seqlock_read_begin (&this->published_seqlock);
+    highest_seq  = g_atomic_int_get (&this->published_HSN);
+    cycles       = g_atomic_int_get (&this->published_cycle_num);
+    jitter_value = g_atomic_int_get (&this->published_jitter);
+    received     = g_atomic_int_get (&this->published_packets_received);
+  }while(mprtp_seqlock_read_retry (&this->published_seqlock, sequence));
+  if(HSN) *HSN = highest_seq;
+  if(cycle_num) *cycle_num = cycles;
+  if(jitter) *jitter = jitter_value;
+  if(received_num) *received_num = received;
 }
 
 void mprtpr_path_get_total_receivements (MpRTPRPath * this,
                                               guint32 *total_packets_received,
                                               guint32 *total_payload_received)
 {
-  if(total_packets_received) *total_packets_received = this->total_packets_received;
-  if(total_payload_received) *total_payload_received = this->total_payload_received;
+  guint packets, payload;
+  gint sequence;
+  do{
+    sequence = mprtp_seqlock_read_begin (&this->published_seqlock);
+    packets  = g_atomic_int_get (&this->published_packets_received);
+    payload  = g_atomic_int_get (&this->published_payload_received);
+  }while(mprtp_seqlock_read_retry (&this->published_seqlock, sequence));
+  if(total_packets_received) *total_packets_received = packets;
+  if(total_payload_received) *total_payload_received = payload;
 }
 
 gboolean
 mprtpr_path_is_in_spike_mode(MpRTPRPath *this)
 {
-  gboolean result;
-  THIS_READLOCK (this);
-  result = this->spike_mode;
-  THIS_READUNLOCK (this);
-  return result;
+  return g_atomic_int_get (&this->published_spike_mode);
 }
 
 void
@@ -198,6 +202,7 @@ void mprtpr_path_add_delay(MpRTPRPath *this, GstClockTime delay)
 {
   THIS_WRITELOCK (this);
   _add_delay(this, delay);
+  _publish_stats(this);
   THIS_WRITEUNLOCK (this);
 }
 
@@ -250,6 +255,7 @@ mprtpr_path_process_rtp_packet (MpRTPRPath * this, GstMpRTPBuffer *mprtp)
   this->highest_seq = mprtp->subflow_seq;
 
 done:
+  _publish_stats(this);
   THIS_WRITEUNLOCK(this);
 }
 
@@ -292,6 +298,19 @@ void _add_delay(MpRTPRPath *this, GstClockTime delay)
   this->last_added_delay = delay;
 }
 
+//Called under the write lock, so writers are serialized
+void _publish_stats(MpRTPRPath *this)
+{
+  mprtp_seqlock_write_begin (&this->published_seqlock);
+  g_atomic_int_set (&this->published_HSN, this->highest_seq);
+  g_atomic_int_set (&this->published_cycle_num, this->cycle_num);
+  g_atomic_int_set (&this->published_jitter, this->jitter);
+  g_atomic_int_set (&this->published_packets_received, this->total_packets_received);
+  g_atomic_int_set (&this->published_payload_received, this->total_payload_received);
+  g_atomic_int_set (&this->published_spike_mode, this->spike_mode);
+  mprtp_seqlock_write_end (&this->published_seqlock);
+}
+
 
 
 #undef THIS_READLOCK
@@ -14,6 +14,7 @@
 #include <gst/base/gstqueuearray.h>
 #include "gstmprtcpbuffer.h"
 #include "gstmprtpbuffer.h"
+#include "mprtpseqlock.h"
 
 G_BEGIN_DECLS
 
@@ -34,7 +35,6 @@ struct _MpRTPReceiverPath
   GObject                   object;
   guint8                    id;
   GRWLock                   rwmutex;
-  GstClock*                 sysclock;
 
   gboolean                  seq_initialized;
   guint16                   cycle_num;
@@ -58,6 +58,18 @@ struct _MpRTPReceiverPath
 
   void                    (*packetstracker)(gpointer, GstMpRTPBuffer*);
   gpointer                  packetstracker_data;
+
+  MPRTP_CACHELINE_PAD(published_pad);
+
+  //Copy of the stats published by the receiving thread after every
+  //packet, the controllers and the joiner read it without locking.
+  MpRTPSeqLock              published_seqlock;
+  volatile guint            published_HSN;
+  volatile guint            published_cycle_num;
+  volatile gint             published_jitter;
+  volatile guint            published_packets_received;
+  volatile guint            published_payload_received;
+  volatile gint             published_spike_mode;
 };
 
 struct _MpRTPReceiverPathClass
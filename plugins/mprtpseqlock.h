@@ -0,0 +1,50 @@
+/*
+ * mprtpseqlock.h
+ *
+ *  Sequence lock for values read together by other threads on the hot
+ *  path. Readers never block and never write the shared state, they only
+ *  retry if a writer was in progress. Writers must be serialized by the
+ *  caller (the object's write lock) and the protected fields have to be
+ *  accessed by g_atomic_int_get() / g_atomic_int_set(), so the reads can
+ *  not be reordered around the sequence checks.
+ */
+
+#ifndef MPRTPSEQLOCK_H_
+#define MPRTPSEQLOCK_H_
+
+#include <glib.h>
+
+//Keeps the fields written by one thread off the cache line of the others
+#define MPRTP_CACHELINE_SIZE 64
+#define MPRTP_CACHELINE_PAD(name) gchar name[MPRTP_CACHELINE_SIZE]
+
+typedef struct _MpRTPSeqLock MpRTPSeqLock;
+
+struct _MpRTPSeqLock
+{
+  volatile gint sequence;
+};
+
+static inline void mprtp_seqlock_write_begin(MpRTPSeqLock *lock)
+{
+  g_atomic_int_inc(&lock->sequence);
+}
+
+static inline void mprtp_seqlock_write_end(MpRTPSeqLock *lock)
+{
+  g_atomic_int_inc(&lock->sequence);
+}
+
+static inline gint mprtp_seqlock_read_begin(MpRTPSeqLock *lock)
+{
+  gint result;
+  while((result = g_atomic_int_get(&lock->sequence)) & 1);
+  return result;
+}
+
+static inline gboolean mprtp_seqlock_read_retry(MpRTPSeqLock *lock, gint sequence)
+{
+  return g_atomic_int_get(&lock->sequence) != sequence;
+}
+
+#endif /* MPRTPSEQLOCK_H_ */
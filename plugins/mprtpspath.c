@@ -25,6 +25,7 @@
 #include <gst/rtp/gstrtcpbuffer.h>
 #include <string.h>
 #include "mprtpspath.h"
+#include "mprtpclock.h"
 #include "gstmprtcpbuffer.h"
 
 
@@ -33,7 +34,7 @@
 #define THIS_WRITELOCK(this) g_rw_lock_writer_lock(&this->rwmutex)
 #define THIS_WRITEUNLOCK(this) g_rw_lock_writer_unlock(&this->rwmutex)
 
-#define _now(this) (gst_clock_get_time(this->sysclock))
+#define _now(this) mprtp_clock_get_time()
 
 GST_DEBUG_CATEGORY_STATIC (gst_mprtps_path_category);
 #define GST_CAT_DEFAULT gst_mprtps_path_category
@@ -44,6 +45,7 @@ static void mprtps_path_finalize (GObject * object);
 static void mprtps_path_reset (MPRTPSPath * this);
 static guint16 _setup_rtp2mprtp (MPRTPSPath * this, GstRTPBuffer *rtp);
 static void _refresh_stat(MPRTPSPath * this, GstRTPBuffer *rtp, guint16 sn);
+static GstClockTime _pace(MPRTPSPath * this, GstClockTime now, guint bytes);
 //static void _send_mprtp_packet(MPRTPSPath * this,
 //                               GstBuffer *buffer);
 //static GstBuffer* _create_monitor_packet(MPRTPSPath * this);
@@ -87,10 +89,11 @@ mprtps_path_reset (MPRTPSPath * this)
 {
   this->seq = 0;
   this->cycle_num = 0;
-  this->flags = MPRTPS_PATH_FLAG_ACTIVE |
-      MPRTPS_PATH_FLAG_NON_CONGESTED | MPRTPS_PATH_FLAG_NON_LOSSY;
+  g_atomic_int_set (&this->flags, MPRTPS_PATH_FLAG_ACTIVE |
+      MPRTPS_PATH_FLAG_NON_CONGESTED | MPRTPS_PATH_FLAG_NON_LOSSY);
 
-  this->monitoring_interval = 0;
+  g_atomic_int_set (&this->monitoring_interval, 0);
+  g_atomic_int_set (&this->protection_interval, 0);
 
 }
 
@@ -99,7 +102,6 @@ void
 mprtps_path_init (MPRTPSPath * this)
 {
   g_rw_lock_init (&this->rwmutex);
-  this->sysclock = gst_system_clock_obtain ();
   this->packetstracker = NULL;
   mprtps_path_reset (this);
 }
@@ -109,40 +111,28 @@ void
 mprtps_path_finalize (GObject * object)
 {
   MPRTPSPath *this = MPRTPS_PATH_CAST (object);
-  g_object_unref (this->sysclock);
 }
 
 
+//The id is not changed after the path is made
 guint8
 mprtps_path_get_id (MPRTPSPath * this)
 {
-  guint16 result;
-  THIS_READLOCK (this);
-  result = this->id;
-  THIS_READUNLOCK (this);
-  return result;
+  return this->id;
 }
 
 
 guint8
 mprtps_path_get_flags (MPRTPSPath * this)
 {
-  guint8 result;
-  THIS_READLOCK (this);
-  result = this->flags;
-  THIS_READUNLOCK (this);
-  return result;
+  return (guint8) g_atomic_int_get (&this->flags);
 }
 
 
 gboolean
 mprtps_path_is_active (MPRTPSPath * this)
 {
-  gboolean result;
-  THIS_READLOCK (this);
-  result = (this->flags & (guint8) MPRTPS_PATH_FLAG_ACTIVE) ? TRUE : FALSE;
-  THIS_READUNLOCK (this);
-  return result;
+  return (g_atomic_int_get (&this->flags) & MPRTPS_PATH_FLAG_ACTIVE) ? TRUE : FALSE;
 }
 
 
@@ -151,8 +141,8 @@ mprtps_path_set_active (MPRTPSPath * this)
 {
   g_return_if_fail (this);
   THIS_WRITELOCK (this);
-  this->flags |= (guint8) MPRTPS_PATH_FLAG_ACTIVE;
-  this->sent_active = gst_clock_get_time (this->sysclock);
+  g_atomic_int_or (&this->flags, MPRTPS_PATH_FLAG_ACTIVE);
+  this->sent_active = _now(this);
   this->sent_passive = 0;
   THIS_WRITEUNLOCK (this);
 }
@@ -163,8 +153,8 @@ mprtps_path_set_passive (MPRTPSPath * this)
 {
   g_return_if_fail (this);
   THIS_WRITELOCK (this);
-  this->flags &= (guint8) 255 ^ (guint8) MPRTPS_PATH_FLAG_ACTIVE;
-  this->sent_passive = gst_clock_get_time (this->sysclock);
+  g_atomic_int_and (&this->flags, ~(guint) MPRTPS_PATH_FLAG_ACTIVE);
+  this->sent_passive = _now(this);
   this->sent_active = 0;
   THIS_WRITEUNLOCK (this);
 }
@@ -191,10 +181,23 @@ void mprtps_path_set_monitoring_interval(MPRTPSPath *this, guint monitoring_inte
 {
   g_return_if_fail (this);
   THIS_WRITELOCK (this);
-  this->monitoring_interval = monitoring_interval;
+  g_atomic_int_set (&this->monitoring_interval, monitoring_interval);
+  THIS_WRITEUNLOCK (this);
+}
+
+void mprtps_path_set_protection_interval(MPRTPSPath *this, guint protection_interval)
+{
+  g_return_if_fail (this);
+  THIS_WRITELOCK (this);
+  g_atomic_int_set (&this->protection_interval, protection_interval);
   THIS_WRITEUNLOCK (this);
 }
 
+guint mprtps_path_get_protection_interval(MPRTPSPath *this)
+{
+  return g_atomic_int_get (&this->protection_interval);
+}
+
 void mprtps_path_set_mprtp_ext_header_id(MPRTPSPath *this, guint ext_header_id)
 {
   g_return_if_fail (this);
@@ -206,12 +209,7 @@ void mprtps_path_set_mprtp_ext_header_id(MPRTPSPath *this, guint ext_header_id)
 gboolean
 mprtps_path_is_non_lossy (MPRTPSPath * this)
 {
-  gboolean result;
-  THIS_READLOCK (this);
-  result = (this->flags & (guint8) MPRTPS_PATH_FLAG_NON_LOSSY) ? TRUE : FALSE;
-  THIS_READUNLOCK (this);
-  return result;
-
+  return (g_atomic_int_get (&this->flags) & MPRTPS_PATH_FLAG_NON_LOSSY) ? TRUE : FALSE;
 }
 
 void
@@ -219,8 +217,8 @@ mprtps_path_set_lossy (MPRTPSPath * this)
 {
   g_return_if_fail (this);
   THIS_WRITELOCK (this);
-  this->flags &= (guint8) 255 ^ (guint8) MPRTPS_PATH_FLAG_NON_LOSSY;
-  this->sent_lossy = gst_clock_get_time (this->sysclock);
+  g_atomic_int_and (&this->flags, ~(guint) MPRTPS_PATH_FLAG_NON_LOSSY);
+  this->sent_lossy = _now(this);
   THIS_WRITEUNLOCK (this);
 }
 
@@ -231,7 +229,7 @@ mprtps_path_set_non_lossy (MPRTPSPath * this)
 {
   g_return_if_fail (this);
   THIS_WRITELOCK (this);
-  this->flags |= (guint8) MPRTPS_PATH_FLAG_NON_LOSSY;
+  g_atomic_int_or (&this->flags, MPRTPS_PATH_FLAG_NON_LOSSY);
   THIS_WRITEUNLOCK (this);
 }
 
@@ -239,66 +237,75 @@ mprtps_path_set_non_lossy (MPRTPSPath * this)
 gboolean
 mprtps_path_is_non_congested (MPRTPSPath * this)
 {
-  gboolean result;
-  THIS_READLOCK (this);
-  result =
-      (this->flags & (guint8) MPRTPS_PATH_FLAG_NON_CONGESTED) ? TRUE : FALSE;
-  THIS_READUNLOCK (this);
-  return result;
-
+  return (g_atomic_int_get (&this->flags) & MPRTPS_PATH_FLAG_NON_CONGESTED) ? TRUE : FALSE;
 }
 
 void mprtps_path_set_target_bitrate(MPRTPSPath * this, gint32 target_bitrate)
 {
   g_return_if_fail (this);
-  THIS_WRITELOCK (this);
-  this->target_bitrate = target_bitrate;
-  THIS_WRITEUNLOCK (this);
+  g_atomic_int_set (&this->target_bitrate, target_bitrate);
 }
 
 gint32 mprtps_path_get_target_bitrate(MPRTPSPath * this)
 {
-  gint32 result;
-  THIS_READLOCK (this);
-  result = this->target_bitrate;
-  THIS_READUNLOCK (this);
-  return result;
+  return g_atomic_int_get (&this->target_bitrate);
 }
 
 
 void mprtps_path_set_state(MPRTPSPath * this, MPRTPSPathState new_state)
 {
   g_return_if_fail (this);
-  THIS_WRITELOCK (this);
-  this->actual_state = new_state;
-  THIS_WRITEUNLOCK (this);
+  g_atomic_int_set (&this->actual_state, new_state);
 }
 
 MPRTPSPathState mprtps_path_get_state(MPRTPSPath * this)
 {
-  MPRTPSPathState result;
-  THIS_READLOCK (this);
-  result = this->actual_state;
-  THIS_READUNLOCK (this);
-  return result;
+  return (MPRTPSPathState) g_atomic_int_get (&this->actual_state);
+}
+
+void mprtps_path_set_rtt(MPRTPSPath * this, GstClockTime rtt)
+{
+  g_return_if_fail (this);
+  g_atomic_int_set (&this->rtt_in_us, (guint) MAX(1, GST_TIME_AS_USECONDS(rtt)));
+}
+
+GstClockTime mprtps_path_get_rtt(MPRTPSPath * this)
+{
+  return (GstClockTime) g_atomic_int_get (&this->rtt_in_us) * GST_USECOND;
+}
+
+void mprtps_path_set_owd(MPRTPSPath * this, GstClockTime owd)
+{
+  g_return_if_fail (this);
+  g_atomic_int_set (&this->owd_in_us, (guint) MAX(1, GST_TIME_AS_USECONDS(owd)));
+}
+
+GstClockTime mprtps_path_get_owd(MPRTPSPath * this)
+{
+  return (GstClockTime) g_atomic_int_get (&this->owd_in_us) * GST_USECOND;
 }
 
 void mprtps_path_set_monitored_bitrate(MPRTPSPath * this, gint32 monitored_bitrate, gint32 monitored_packets)
 {
   g_return_if_fail (this);
   THIS_WRITELOCK (this);
-  this->monitored_bitrate = monitored_bitrate;
-  this->monitored_packets = monitored_packets;
+  mprtp_seqlock_write_begin (&this->monitored_seqlock);
+  g_atomic_int_set (&this->monitored_bitrate, monitored_bitrate);
+  g_atomic_int_set (&this->monitored_packets, monitored_packets);
+  mprtp_seqlock_write_end (&this->monitored_seqlock);
   THIS_WRITEUNLOCK (this);
 }
 
 gint32 mprtps_path_get_monitored_bitrate(MPRTPSPath * this, guint32 *packets_num)
 {
-  gint32 result;
-  THIS_READLOCK (this);
-  result = this->monitored_bitrate;
-  if(packets_num) *packets_num = this->monitored_packets;
-  THIS_READUNLOCK (this);
+  gint32 result, packets;
+  gint sequence;
+  do{
+    sequence = mprtp_seqlock_read_begin (&this->monitored_seqlock);
+    result   = g_atomic_int_get (&this->monitored_bitrate);
+    packets  = g_atomic_int_get (&this->monitored_packets);
+  }while(mprtp_seqlock_read_retry (&this->monitored_seqlock, sequence));
+  if(packets_num) *packets_num = packets;
   return result;
 }
 
@@ -307,8 +314,8 @@ mprtps_path_set_congested (MPRTPSPath * this)
 {
   g_return_if_fail (this);
   THIS_WRITELOCK (this);
-  this->flags &= (guint8) 255 ^ (guint8) MPRTPS_PATH_FLAG_NON_CONGESTED;
-  this->sent_congested = gst_clock_get_time (this->sysclock);
+  g_atomic_int_and (&this->flags, ~(guint) MPRTPS_PATH_FLAG_NON_CONGESTED);
+  this->sent_congested = _now(this);
   THIS_WRITEUNLOCK (this);
 }
 
@@ -318,8 +325,8 @@ mprtps_path_set_non_congested (MPRTPSPath * this)
 {
   g_return_if_fail (this);
   THIS_WRITELOCK (this);
-  this->flags |= (guint8) MPRTPS_PATH_FLAG_NON_CONGESTED;
-  this->sent_non_congested = gst_clock_get_time (this->sysclock);
+  g_atomic_int_or (&this->flags, MPRTPS_PATH_FLAG_NON_CONGESTED);
+  this->sent_non_congested = _now(this);
   THIS_WRITEUNLOCK (this);
 }
 
@@ -327,29 +334,18 @@ mprtps_path_set_non_congested (MPRTPSPath * this)
 gboolean
 mprtps_path_is_monitoring (MPRTPSPath * this)
 {
-  gboolean result;
-  THIS_READLOCK (this);
-  result = this->monitoring_interval > 0;
-  THIS_READUNLOCK (this);
-  return result;
+  return g_atomic_int_get (&this->monitoring_interval) > 0;
 }
 
 gboolean mprtps_path_has_expected_lost(MPRTPSPath * this)
 {
-  gboolean result;
-  THIS_WRITELOCK (this);
-  result = this->expected_lost;
-  this->expected_lost = FALSE;
-  THIS_WRITEUNLOCK (this);
-  return result;
+  return g_atomic_int_compare_and_exchange (&this->expected_lost, TRUE, FALSE);
 }
 
 void
 mprtps_path_set_keep_alive_period(MPRTPSPath *this, GstClockTime period)
 {
-  THIS_WRITELOCK (this);
-  this->keep_alive_period = period;
-  THIS_WRITEUNLOCK (this);
+  g_atomic_int_set (&this->keep_alive_period_in_ms, (guint) GST_TIME_AS_MSECONDS(period));
 }
 
 void
@@ -361,6 +357,8 @@ mprtps_path_set_approval_process(MPRTPSPath *this, gpointer data, gboolean(*appr
   THIS_WRITEUNLOCK (this);
 }
 
+//The read lock is kept here, the setter waits for the running approvals
+//before the approval data can be released.
 gboolean mprtps_path_approve_request(MPRTPSPath *this, GstRTPBuffer *rtp)
 {
   gboolean result;
@@ -371,7 +369,7 @@ gboolean mprtps_path_approve_request(MPRTPSPath *this, GstRTPBuffer *rtp)
 }
 
 
-void mprtps_path_set_packetstracker(MPRTPSPath *this, void(*packetstracker)(gpointer,  guint, guint16), gpointer data)
+void mprtps_path_set_packetstracker(MPRTPSPath *this, void(*packetstracker)(gpointer,  guint, guint16, guint32), gpointer data)
 {
   THIS_WRITELOCK(this);
   this->packetstracker = packetstracker;
@@ -380,56 +378,66 @@ void mprtps_path_set_packetstracker(MPRTPSPath *this, void(*packetstracker)(gpoi
 }
 
 
+//Only one of the concurrent callers wins the keep alive of a period
 gboolean
 mprtps_path_request_keep_alive(MPRTPSPath *this)
 {
-  gboolean result = FALSE;
-  THIS_WRITELOCK (this);
-  if(!this->keep_alive_period){
-    goto done;
+  guint period, last_sent, now;
+  period = g_atomic_int_get (&this->keep_alive_period_in_ms);
+  if(!period){
+    return FALSE;
   }
-  if(this->last_sent < _now(this) - this->keep_alive_period){
-    this->last_sent = _now(this);
-    result = TRUE;
+  now       = (guint) GST_TIME_AS_MSECONDS(_now(this));
+  last_sent = g_atomic_int_get (&this->last_sent_in_ms);
+  if(now - last_sent <= period){
+    return FALSE;
   }
-done:
+  return g_atomic_int_compare_and_exchange (&this->last_sent_in_ms, last_sent, now);
+}
+
+GstClockTime
+mprtps_path_get_departure_time(MPRTPSPath *this, GstClockTime now, guint bytes)
+{
+  GstClockTime result;
+  THIS_WRITELOCK (this);
+  result = _pace(this, now, bytes);
   THIS_WRITEUNLOCK (this);
   return result;
 }
 
+guint32
+mprtps_path_get_pacing_overflows(MPRTPSPath *this)
+{
+  return g_atomic_int_get (&this->pacing_overflows);
+}
+
 guint32
 mprtps_path_get_total_sent_packets_num (MPRTPSPath * this)
 {
-  guint32 result;
-  THIS_READLOCK (this);
-  result = this->total_sent_packets_num;
-  THIS_READUNLOCK (this);
-  return result;
+  return g_atomic_int_get (&this->total_sent_packets_num);
 }
 
 
 guint32
 mprtps_path_get_total_sent_payload_bytes (MPRTPSPath * this)
 {
-  guint32 result;
-  THIS_READLOCK (this);
-  result = this->total_sent_payload_bytes;
-  THIS_READUNLOCK (this);
-  return result;
+  return g_atomic_int_get (&this->total_sent_payload_bytes);
 }
 
 
 void
 mprtps_path_process_rtp_packet(MPRTPSPath * this,
                                GstBuffer * rtppacket,
-                               gboolean *monitoring_request)
+                               gboolean *monitoring_request,
+                               GstClockTime now,
+                               GstClockTime *departure)
 {
   GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
   THIS_WRITELOCK (this);
 
   if(0 < this->skip_until){
     if(_now(this) < this->skip_until){
-      this->expected_lost|=TRUE;
+      g_atomic_int_set (&this->expected_lost, TRUE);
       gst_buffer_unref(rtppacket);
       goto done;
     }
@@ -438,11 +446,19 @@ mprtps_path_process_rtp_packet(MPRTPSPath * this,
   gst_rtp_buffer_map(rtppacket, GST_MAP_READWRITE, &rtp);
   _refresh_stat(this, &rtp, _setup_rtp2mprtp (this, &rtp));
   gst_rtp_buffer_unmap(&rtp);
+  if(departure){
+    *departure = _pace(this, now, gst_buffer_get_size(rtppacket));
+  }
 
-  this->last_sent = _now(this);
+  g_atomic_int_set (&this->last_sent_in_ms, (guint) GST_TIME_AS_MSECONDS(_now(this)));
 
-  if(!monitoring_request || !this->monitoring_interval) goto done;
-  *monitoring_request = this->total_sent_packets_num % this->monitoring_interval == 0;
+  if(!monitoring_request) goto done;
+  if(this->monitoring_interval){
+    *monitoring_request |= this->total_sent_packets_num % this->monitoring_interval == 0;
+  }
+  if(this->protection_interval){
+    *monitoring_request |= this->total_sent_packets_num % this->protection_interval == 0;
+  }
 done:
   THIS_WRITEUNLOCK (this);
 }
@@ -474,16 +490,38 @@ _refresh_stat(MPRTPSPath * this,
 
   payload_bytes = gst_rtp_buffer_get_payload_len (rtp);
 
-  ++this->total_sent_packets_num;
-  this->total_sent_payload_bytes += payload_bytes;
+  //single writer, no read-modify-write is needed
+  g_atomic_int_set (&this->total_sent_packets_num, this->total_sent_packets_num + 1);
+  g_atomic_int_set (&this->total_sent_payload_bytes, this->total_sent_payload_bytes + payload_bytes);
 
   if(this->packetstracker){
-    this->packetstracker(this->packetstracker_data, payload_bytes, sn);
+    this->packetstracker(this->packetstracker_data, payload_bytes, sn, gst_rtp_buffer_get_timestamp (rtp));
   }
 
 }
 
 
+//must be called under write lock
+GstClockTime
+_pace(MPRTPSPath * this, GstClockTime now, guint bytes)
+{
+  GstClockTime result;
+  gint32 target_bitrate;
+
+  target_bitrate = g_atomic_int_get (&this->target_bitrate);
+  result = MAX(now, this->next_departure);
+  if(now + MPRTPS_PATH_MAX_PACING_BACKLOG < result){
+    result = now + MPRTPS_PATH_MAX_PACING_BACKLOG;
+    g_atomic_int_inc (&this->pacing_overflows);
+  }
+  this->next_departure = result;
+  if(0 < target_bitrate){
+    this->next_departure += gst_util_uint64_scale_int ((guint64) bytes * 8, GST_SECOND, target_bitrate);
+  }
+  return result;
+}
+
+
 
 #undef THIS_READLOCK
 #undef THIS_READUNLOCK
@@ -16,6 +16,7 @@
 #include "gstmprtcpbuffer.h"
 #include "packetssndqueue.h"
 #include "reportproc.h"
+#include "mprtpseqlock.h"
 
 G_BEGIN_DECLS
 
@@ -29,6 +30,10 @@ typedef struct _MPRTPSPathClass MPRTPSPathClass;
 #define MPRTPS_PATH_IS_SOURCE_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE((klass),MPRTPS_PATH_TYPE))
 #define MPRTPS_PATH_CAST(src)        ((MPRTPSPath *)(src))
 
+//The pace of a path running behind its target bitrate is not
+//carried further ahead of the actual time than this
+#define MPRTPS_PATH_MAX_PACING_BACKLOG (100 * GST_MSECOND)
+
 
 
 typedef enum
@@ -49,18 +54,23 @@ struct _MPRTPSPath
 {
   GObject   object;
 
-  GRWLock                 rwmutex;
-  GstClock*               sysclock;
   guint8                  id;
-  guint16                 seq;
-  guint16                 cycle_num;
-  guint8                  flags;
   guint                   abs_time_ext_header_id;
   guint                   mprtp_ext_header_id;
 
-  gint32                  target_bitrate;
-  gint32                  monitored_bitrate;
-  gint32                  monitored_packets;
+  //Read by the splitter, the FEC encoder and the controllers without
+  //locking. Changed by g_atomic_* under the write lock.
+  volatile guint          flags;
+  volatile gint           target_bitrate;
+  volatile gint           actual_state;
+  volatile guint          monitoring_interval;
+  volatile guint          protection_interval;
+  volatile guint          keep_alive_period_in_ms;
+  volatile guint          rtt_in_us;
+  volatile guint          owd_in_us;
+  MpRTPSeqLock            monitored_seqlock;
+  volatile gint           monitored_bitrate;
+  volatile gint           monitored_packets;
 
   GstClockTime            sent_passive;
   GstClockTime            sent_active;
@@ -68,22 +78,22 @@ struct _MPRTPSPath
   GstClockTime            sent_lossy;
   GstClockTime            sent_congested;
 
-  GstClockTime            last_sent;
+  MPRTP_CACHELINE_PAD(sending_pad);
 
+  //Written by the sending thread for every packet, the counters are only
+  //ever increased by it, so readers get them by an atomic load.
+  GRWLock                 rwmutex;
+  guint16                 seq;
+  guint16                 cycle_num;
   GstClockTime            skip_until;
-
-  guint32                 monitoring_interval;
-
-  guint32                 total_sent_packets_num;
-  guint32                 total_sent_payload_bytes;
-
-  MPRTPSPathState         actual_state;
-
-  gboolean                expected_lost;
-
-  GstClockTime            keep_alive_period;
-
-  void                  (*packetstracker)(gpointer, guint, guint16);
+  GstClockTime            next_departure;
+  volatile guint          pacing_overflows;
+  volatile gint           expected_lost;
+  volatile guint          last_sent_in_ms;
+  volatile guint          total_sent_packets_num;
+  volatile guint          total_sent_payload_bytes;
+
+  void                  (*packetstracker)(gpointer, guint, guint16, guint32);
   gpointer                packetstracker_data;
 
   gpointer                approval_data;
@@ -121,6 +131,14 @@ gint32 mprtps_path_get_target_bitrate(MPRTPSPath * this);
 void mprtps_path_set_state(MPRTPSPath * this, MPRTPSPathState new_state);
 MPRTPSPathState mprtps_path_get_state(MPRTPSPath * this);
 
+void mprtps_path_set_rtt(MPRTPSPath * this, GstClockTime rtt);
+//0 until the first receiver report
+GstClockTime mprtps_path_get_rtt(MPRTPSPath * this);
+
+void mprtps_path_set_owd(MPRTPSPath * this, GstClockTime owd);
+//The smoothed one way delay of the feedbacks, 0 until the first one
+GstClockTime mprtps_path_get_owd(MPRTPSPath * this);
+
 void mprtps_path_set_monitored_bitrate(MPRTPSPath * this, gint32 monitored_bitrate, gint32 monitored_packets);
 gint32 mprtps_path_get_monitored_bitrate(MPRTPSPath * this, guint32 *packets_num);
 
@@ -130,16 +148,27 @@ void mprtps_path_set_non_congested (MPRTPSPath * this);
 gboolean mprtps_path_is_monitoring (MPRTPSPath * this);
 gboolean mprtps_path_has_expected_lost(MPRTPSPath * this);
 
-void mprtps_path_process_rtp_packet(MPRTPSPath * this, GstBuffer * buffer, gboolean *monitoring_request);
+//If departure is not NULL the packet is paced in the same pass, see
+//mprtps_path_get_departure_time
+void mprtps_path_process_rtp_packet(MPRTPSPath * this, GstBuffer * buffer, gboolean *monitoring_request,
+                                    GstClockTime now, GstClockTime *departure);
 
 void mprtps_path_set_keep_alive_period(MPRTPSPath *this, GstClockTime period);
 void mprtps_path_set_approval_process(MPRTPSPath *this, gpointer data, gboolean(*approval)(gpointer, GstRTPBuffer *));
 gboolean mprtps_path_approve_request(MPRTPSPath *this, GstRTPBuffer *buf);
 
-void mprtps_path_set_packetstracker(MPRTPSPath *this, void(*packetstracker)(gpointer,  guint, guint16), gpointer data);
+//The tracker gets the payload length, the subflow sequence and the RTP timestamp of the sent packets
+void mprtps_path_set_packetstracker(MPRTPSPath *this, void(*packetstracker)(gpointer,  guint, guint16, guint32), gpointer data);
 
 gboolean mprtps_path_request_keep_alive(MPRTPSPath *this);
 
+//Earliest departure time of a packet paced at the target bitrate of the
+//path, on the time base of now. Packets of an idle path leave at once,
+//none is held back more than MPRTPS_PATH_MAX_PACING_BACKLOG.
+GstClockTime mprtps_path_get_departure_time(MPRTPSPath *this, GstClockTime now, guint bytes);
+//Packets the backlog limit let leave earlier than their pace
+guint32 mprtps_path_get_pacing_overflows(MPRTPSPath *this);
+
 guint32 mprtps_path_get_total_sent_packets_num (MPRTPSPath * this);
 guint32 mprtps_path_get_total_sent_payload_bytes (MPRTPSPath * this);
 
@@ -148,5 +177,9 @@ guint16 mprtps_path_get_actual_seq(MPRTPSPath * this);
 void mprtps_path_set_skip_duration(MPRTPSPath * this, GstClockTime duration);
 void mprtps_path_set_mprtp_ext_header_id(MPRTPSPath *this, guint ext_header_id);
 void mprtps_path_set_monitoring_interval(MPRTPSPath *this, guint monitoring_interval);
+//A FEC packet is requested after every protection_interval packets of
+//the path besides the monitoring ones, 0 disables it
+void mprtps_path_set_protection_interval(MPRTPSPath *this, guint protection_interval);
+guint mprtps_path_get_protection_interval(MPRTPSPath *this);
 G_END_DECLS
 #endif /* MPRTPSPATH_H_ */
@@ -0,0 +1,80 @@
+/*
+ * mprtpstats.h
+ *
+ *  Binary stats log of the elements. Samples are fixed size records the
+ *  live threads fill in a preallocated ring, the logger writer appends
+ *  them to mprtpstats.bin in the logs directory. The file starts with a
+ *  header and the schema of every record type, so mprtpstatsconv turns
+ *  it into the CSV files the plotting scripts read without knowing the
+ *  types. Everything is in the byte order of the host writing it.
+ */
+
+#ifndef MPRTPSTATS_H_
+#define MPRTPSTATS_H_
+
+#include <glib.h>
+
+#define MPRTP_STATS_MAGIC "MPRTPSTA"
+#define MPRTP_STATS_VERSION 1
+#define MPRTP_STATS_FILENAME "mprtpstats.bin"
+#define MPRTP_STATS_MAX_VALUES 6
+#define MPRTP_STATS_NAME_LENGTH 24
+#define MPRTP_STATS_CSV_LENGTH 32
+
+typedef enum{
+  //target, goodput, sending, FEC rate of a subflow in kbps and the stage
+  //of its controller
+  MPRTP_STATS_SUBFLOW_RATES   = 0,
+  //short and long term one way delay, RTT and smoothed RTT in us
+  MPRTP_STATS_OWD             = 1,
+  //RTP, missing and recovered packets in the last second at the receiver
+  MPRTP_STATS_FEC             = 2,
+  //the weight of a subflow in the splitter, one record per subflow
+  MPRTP_STATS_SPLITTER_WEIGHT = 3,
+  MPRTP_STATS_TYPES_NUM       = 4,
+}MPRTPStatsType;
+
+typedef enum{
+  MPRTP_STATS_INTEGER = 0,
+  MPRTP_STATS_REAL    = 1,
+}MPRTPStatsKind;
+
+typedef union{
+  gint64                integer;
+  gdouble               real;
+}MPRTPStatsValue;
+
+//64 bytes, so a record is one cache line in the ring
+typedef struct _MPRTPStatsRecord{
+  guint16               type;
+  guint8                subflow_id;
+  guint8                values_num;
+  //the logger round (100ms) the record was made in
+  guint32               tick;
+  //ns since the logger is made
+  guint64               time;
+  MPRTPStatsValue       values[MPRTP_STATS_MAX_VALUES];
+}MPRTPStatsRecord;
+
+typedef struct _MPRTPStatsSchema{
+  guint32               type;
+  guint32               values_num;
+  //records of one round are written in one CSV line, every value closed
+  //by a comma, used for the per subflow splitter weights
+  guint32               joined;
+  guint32               kinds[MPRTP_STATS_MAX_VALUES];
+  //the CSV file the records go to, %u is replaced by the subflow id
+  gchar                 csv[MPRTP_STATS_CSV_LENGTH];
+  gchar                 names[MPRTP_STATS_MAX_VALUES][MPRTP_STATS_NAME_LENGTH];
+}MPRTPStatsSchema;
+
+typedef struct _MPRTPStatsHeader{
+  gchar                 magic[8];
+  guint32               version;
+  guint32               record_size;
+  guint32               schema_size;
+  guint32               types_num;
+  //followed by types_num schemas and then the records
+}MPRTPStatsHeader;
+
+#endif /* MPRTPSTATS_H_ */
@@ -0,0 +1,230 @@
+/* GStreamer MPRTP binary stats converter
+ * Copyright (C) 2015 Balázs Kreith (contact: balazs.kreith@gmail.com)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Converts the binary stats log (mprtpstats.bin) into the CSV files the
+ * plotting scripts under tests/tests/scripts read:
+ *
+ *   mprtpstatsconv logs/mprtpstats.bin
+ *
+ * The files are written next to the log unless -o is given. The record
+ * types are taken from the schema at the head of the log, --list prints
+ * them with their columns.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include "mprtpstats.h"
+
+typedef struct{
+  FILE*                 fp;
+  //the round of the line a joined record type is written into
+  guint32               tick;
+  gboolean              line_open;
+}Output;
+
+static void _close_output(gpointer data)
+{
+  Output *output = data;
+  if(output->line_open){
+    fputc('\n', output->fp);
+  }
+  fclose(output->fp);
+  g_free(output);
+}
+
+static Output *_get_output(GHashTable *outputs, const gchar *dir,
+                           const MPRTPStatsSchema *schema, guint8 subflow_id)
+{
+  Output *result;
+  gchar csv[MPRTP_STATS_CSV_LENGTH + 1];
+  gchar *filename, *path, *placeholder;
+
+  memcpy(csv, schema->csv, MPRTP_STATS_CSV_LENGTH);
+  csv[MPRTP_STATS_CSV_LENGTH] = 0;
+  //the only placeholder the schema may have
+  placeholder = strstr(csv, "%u");
+  if(placeholder){
+    *placeholder = 0;
+    filename = g_strdup_printf("%s%u%s", csv, subflow_id, placeholder + 2);
+  }else{
+    filename = g_strdup(csv);
+  }
+
+  result = g_hash_table_lookup(outputs, filename);
+  if(result){
+    g_free(filename);
+    return result;
+  }
+  path = g_build_filename(dir, filename, NULL);
+  result = g_malloc0(sizeof(Output));
+  result->fp = fopen(path, "w");
+  if(!result->fp){
+    g_printerr("Can not open %s\n", path);
+    g_free(result);
+    g_free(filename);
+    result = NULL;
+  }else{
+    g_hash_table_insert(outputs, filename, result);
+  }
+  g_free(path);
+  return result;
+}
+
+static void _write_value(FILE *fp, guint32 kind, MPRTPStatsValue *value)
+{
+  if(kind == MPRTP_STATS_REAL){
+    fprintf(fp, "%f", value->real);
+  }else{
+    fprintf(fp, "%"G_GINT64_FORMAT, value->integer);
+  }
+}
+
+static void _write_record(Output *output, const MPRTPStatsSchema *schema, MPRTPStatsRecord *record)
+{
+  guint i, values_num;
+
+  values_num = MIN(MIN(record->values_num, schema->values_num), MPRTP_STATS_MAX_VALUES);
+  if(!schema->joined){
+    for(i = 0; i < values_num; ++i){
+      if(i){
+        fputc(',', output->fp);
+      }
+      _write_value(output->fp, schema->kinds[i], record->values + i);
+    }
+    fputc('\n', output->fp);
+    return;
+  }
+  if(output->line_open && output->tick != record->tick){
+    fputc('\n', output->fp);
+  }
+  for(i = 0; i < values_num; ++i){
+    _write_value(output->fp, schema->kinds[i], record->values + i);
+    fputc(',', output->fp);
+  }
+  output->tick      = record->tick;
+  output->line_open = TRUE;
+}
+
+static void _list_schemas(MPRTPStatsSchema *schemas, guint32 types_num)
+{
+  guint32 i, j;
+  for(i = 0; i < types_num; ++i){
+    g_print("%u %.*s:", schemas[i].type, MPRTP_STATS_CSV_LENGTH, schemas[i].csv);
+    for(j = 0; j < schemas[i].values_num && j < MPRTP_STATS_MAX_VALUES; ++j){
+      g_print("%s%.*s", j ? "," : " ", MPRTP_STATS_NAME_LENGTH, schemas[i].names[j]);
+    }
+    g_print("%s\n", schemas[i].joined ? " (one line per round)" : "");
+  }
+}
+
+int
+main (int argc, char **argv)
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  gchar *output_dir = NULL;
+  gboolean list = FALSE;
+  gchar **inputs = NULL;
+  GHashTable *outputs;
+  MPRTPStatsHeader header;
+  MPRTPStatsSchema *schemas, *schema;
+  MPRTPStatsRecord record;
+  Output *output;
+  guint64 converted = 0, skipped = 0;
+  guint32 i;
+  FILE *fp;
+  GOptionEntry entries[] = {
+      {"output", 'o', 0, G_OPTION_ARG_FILENAME, &output_dir, "Write the CSV files into DIR", "DIR"},
+      {"list", 'l', 0, G_OPTION_ARG_NONE, &list, "List the record types of the log", NULL},
+      {G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &inputs, NULL, "FILE"},
+      {NULL}
+  };
+
+  context = g_option_context_new ("- converts MPRTP binary stats logs to CSV files");
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    return 1;
+  }
+  g_option_context_free (context);
+  if(!inputs || !inputs[0]){
+    g_printerr ("No stats log is given\n");
+    return 1;
+  }
+  if(!(fp = fopen(inputs[0], "rb"))){
+    g_printerr ("Can not open %s\n", inputs[0]);
+    return 1;
+  }
+  if(fread(&header, sizeof(header), 1, fp) != 1 ||
+     memcmp(header.magic, MPRTP_STATS_MAGIC, sizeof(header.magic)) ||
+     header.version != MPRTP_STATS_VERSION ||
+     header.record_size != sizeof(MPRTPStatsRecord) ||
+     header.schema_size != sizeof(MPRTPStatsSchema)){
+    g_printerr ("%s is not an MPRTP stats log of this version\n", inputs[0]);
+    fclose(fp);
+    return 1;
+  }
+  schemas = g_malloc0(sizeof(MPRTPStatsSchema) * MAX(1, header.types_num));
+  if(fread(schemas, sizeof(MPRTPStatsSchema), header.types_num, fp) != header.types_num){
+    g_printerr ("The schema of %s is truncated\n", inputs[0]);
+    fclose(fp);
+    return 1;
+  }
+  if(list){
+    _list_schemas(schemas, header.types_num);
+    fclose(fp);
+    return 0;
+  }
+
+  if(!output_dir){
+    output_dir = g_path_get_dirname(inputs[0]);
+  }
+  outputs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, _close_output);
+  while(fread(&record, sizeof(record), 1, fp) == 1){
+    schema = NULL;
+    for(i = 0; i < header.types_num; ++i){
+      if(schemas[i].type == record.type){
+        schema = schemas + i;
+        break;
+      }
+    }
+    output = schema ? _get_output(outputs, output_dir, schema, record.subflow_id) : NULL;
+    if(!output){
+      ++skipped;
+      continue;
+    }
+    _write_record(output, schema, &record);
+    ++converted;
+  }
+  g_print("%"G_GUINT64_FORMAT" records converted into %u files, %"G_GUINT64_FORMAT" skipped\n",
+          converted, g_hash_table_size(outputs), skipped);
+
+  g_hash_table_destroy(outputs);
+  fclose(fp);
+  g_free(schemas);
+  g_free(output_dir);
+  g_strfreev(inputs);
+  return 0;
+}
@@ -0,0 +1,94 @@
+/* GStreamer MPRTP departure time meta
+ * Copyright (C) 2015 Balázs Kreith (contact: balazs.kreith@gmail.com)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "mprtptxtime.h"
+#include <time.h>
+
+static gboolean
+_txtime_meta_init (GstMeta * meta, gpointer params, GstBuffer * buffer)
+{
+  ((MpRTPTxTimeMeta *) meta)->txtime = 0;
+  return TRUE;
+}
+
+//Copies keep the departure time, resent packets are stamped again
+static gboolean
+_txtime_meta_transform (GstBuffer * dest, GstMeta * meta, GstBuffer * buffer,
+    GQuark type, gpointer data)
+{
+  if (!GST_META_TRANSFORM_IS_COPY (type)) {
+    return FALSE;
+  }
+  gst_buffer_add_mprtp_txtime_meta (dest, ((MpRTPTxTimeMeta *) meta)->txtime);
+  return TRUE;
+}
+
+GType
+mprtp_txtime_meta_api_get_type (void)
+{
+  static volatile GType type = 0;
+  static const gchar *tags[] = { NULL };
+
+  if (g_once_init_enter (&type)) {
+    GType _type = gst_meta_api_type_register ("MpRTPTxTimeMetaAPI", tags);
+    g_once_init_leave (&type, _type);
+  }
+  return type;
+}
+
+const GstMetaInfo *
+mprtp_txtime_meta_get_info (void)
+{
+  static const GstMetaInfo *meta_info = NULL;
+
+  if (g_once_init_enter ((GstMetaInfo **) & meta_info)) {
+    const GstMetaInfo *info = gst_meta_register (MPRTP_TXTIME_META_API_TYPE,
+        "MpRTPTxTimeMeta", sizeof (MpRTPTxTimeMeta),
+        _txtime_meta_init, NULL, _txtime_meta_transform);
+    g_once_init_leave ((GstMetaInfo **) & meta_info, (GstMetaInfo *) info);
+  }
+  return meta_info;
+}
+
+MpRTPTxTimeMeta *
+gst_buffer_add_mprtp_txtime_meta (GstBuffer * buffer, GstClockTime txtime)
+{
+  MpRTPTxTimeMeta *result;
+
+  result = gst_buffer_get_mprtp_txtime_meta (buffer);
+  if (!result) {
+    result = (MpRTPTxTimeMeta *) gst_buffer_add_meta (buffer,
+        MPRTP_TXTIME_META_INFO, NULL);
+  }
+  result->txtime = txtime;
+  return result;
+}
+
+GstClockTime
+mprtp_txtime_now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (GstClockTime) ts.tv_sec * GST_SECOND + ts.tv_nsec;
+}
@@ -0,0 +1,37 @@
+/*
+ * mprtptxtime.h
+ *
+ *  Earliest departure time of an outgoing packet, attached by the
+ *  scheduler as a buffer meta and handed to the kernel by the egress
+ *  sockets (SO_TXTIME). The time is on the CLOCK_MONOTONIC time base the
+ *  fq qdisc paces on, not on the pipeline clock.
+ */
+
+#ifndef MPRTPTXTIME_H_
+#define MPRTPTXTIME_H_
+
+#include <gst/gst.h>
+
+typedef struct _MpRTPTxTimeMeta MpRTPTxTimeMeta;
+
+struct _MpRTPTxTimeMeta
+{
+  GstMeta                  meta;
+  GstClockTime             txtime;
+};
+
+GType mprtp_txtime_meta_api_get_type (void);
+const GstMetaInfo *mprtp_txtime_meta_get_info (void);
+#define MPRTP_TXTIME_META_API_TYPE (mprtp_txtime_meta_api_get_type())
+#define MPRTP_TXTIME_META_INFO (mprtp_txtime_meta_get_info())
+
+#define gst_buffer_get_mprtp_txtime_meta(buffer) \
+  ((MpRTPTxTimeMeta*) gst_buffer_get_meta ((buffer), MPRTP_TXTIME_META_API_TYPE))
+
+//Attaches the departure time or updates the one already attached
+MpRTPTxTimeMeta *gst_buffer_add_mprtp_txtime_meta (GstBuffer *buffer, GstClockTime txtime);
+
+//The current time on the time base of the departure times
+GstClockTime mprtp_txtime_now (void);
+
+#endif /* MPRTPTXTIME_H_ */
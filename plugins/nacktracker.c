@@ -0,0 +1,246 @@
+/* GStreamer NACK tracker
+ * Copyright (C) 2015 Balázs Kreith (contact: balazs.kreith@gmail.com)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "nacktracker.h"
+#include "mprtpclock.h"
+#include <string.h>
+
+#define THIS_LOCK(this) g_mutex_lock(&this->mutex)
+#define THIS_UNLOCK(this) g_mutex_unlock(&this->mutex)
+
+#define _now(this) mprtp_clock_get_time()
+
+GST_DEBUG_CATEGORY_STATIC (nacktracker_debug_category);
+#define GST_CAT_DEFAULT nacktracker_debug_category
+
+G_DEFINE_TYPE (NACKTracker, nacktracker, G_TYPE_OBJECT);
+
+typedef struct _Missed{
+  guint16      seq;
+  GstClockTime detected;
+}Missed;
+
+//----------------------------------------------------------------------
+//-------- Private functions belongs to the object ----------
+//----------------------------------------------------------------------
+
+static void nacktracker_finalize (GObject * object);
+static void _clear(NACKTrackerSubflow *subflow);
+static void _add_missed(NACKTrackerSubflow *subflow, guint16 seq, GstClockTime now);
+static void _remove_missed(NACKTrackerSubflow *subflow, guint16 seq);
+
+//----------------------------------------------------------------------
+//--------- Private functions implementations to the object --------
+//----------------------------------------------------------------------
+
+void
+nacktracker_class_init (NACKTrackerClass * klass)
+{
+  GObjectClass *gobject_class;
+
+  gobject_class = (GObjectClass *) klass;
+
+  gobject_class->finalize = nacktracker_finalize;
+
+  GST_DEBUG_CATEGORY_INIT (nacktracker_debug_category, "nacktracker", 0,
+      "MpRTP NACK Tracker");
+}
+
+void
+nacktracker_finalize (GObject * object)
+{
+  NACKTracker *this = NACKTRACKER (object);
+  guint i;
+  for(i = 0; i < MPRTP_PLUGIN_MAX_SUBFLOW_NUM; ++i){
+    _clear(this->subflows + i);
+    g_queue_free(this->subflows[i].missed);
+  }
+  g_mutex_clear(&this->mutex);
+}
+
+void
+nacktracker_init (NACKTracker * this)
+{
+  guint i;
+  g_mutex_init(&this->mutex);
+  this->reorder_treshold = 0;
+  for(i = 0; i < MPRTP_PLUGIN_MAX_SUBFLOW_NUM; ++i){
+    this->subflows[i].missed = g_queue_new();
+  }
+}
+
+NACKTracker *make_nacktracker(void)
+{
+  return g_object_new (NACKTRACKER_TYPE, NULL);
+}
+
+void nacktracker_set_reorder_treshold(NACKTracker *this, GstClockTime treshold)
+{
+  guint i;
+  THIS_LOCK(this);
+  this->reorder_treshold = treshold;
+  if(!treshold){
+    for(i = 0; i < MPRTP_PLUGIN_MAX_SUBFLOW_NUM; ++i){
+      _clear(this->subflows + i);
+    }
+  }
+  THIS_UNLOCK(this);
+}
+
+GstClockTime nacktracker_get_reorder_treshold(NACKTracker *this)
+{
+  GstClockTime result;
+  THIS_LOCK(this);
+  result = this->reorder_treshold;
+  THIS_UNLOCK(this);
+  return result;
+}
+
+void nacktracker_add(NACKTracker *this, guint8 subflow_id, guint16 subflow_seq)
+{
+  NACKTrackerSubflow *subflow;
+  GstClockTime now;
+  guint16 diff, seq;
+
+  if(G_LIKELY(!this->reorder_treshold) || MPRTP_PLUGIN_MAX_SUBFLOW_NUM <= subflow_id){
+    return;
+  }
+  now = _now(this);
+  THIS_LOCK(this);
+  subflow = this->subflows + subflow_id;
+  if(!subflow->initialized){
+    subflow->initialized = TRUE;
+    subflow->HSN = subflow_seq;
+    goto done;
+  }
+  diff = subflow_seq - subflow->HSN;
+  if(!diff){
+    goto done;
+  }
+  if(32768 <= diff){
+    //reordered or retransmitted
+    _remove_missed(subflow, subflow_seq);
+    goto done;
+  }
+  if(NACKTRACKER_MAX_GAP < diff){
+    _clear(subflow);
+    subflow->initialized = TRUE;
+  }else{
+    for(seq = subflow->HSN + 1; seq != subflow_seq; ++seq){
+      _add_missed(subflow, seq, now);
+    }
+  }
+  subflow->HSN = subflow_seq;
+done:
+  THIS_UNLOCK(this);
+}
+
+guint nacktracker_get_nacks(NACKTracker *this, guint8 subflow_id, guint16 *seqs, guint max)
+{
+  NACKTrackerSubflow *subflow;
+  Missed *missed;
+  GstClockTime now;
+  guint result = 0;
+
+  if(G_LIKELY(!this->reorder_treshold) || MPRTP_PLUGIN_MAX_SUBFLOW_NUM <= subflow_id){
+    return 0;
+  }
+  now = _now(this);
+  THIS_LOCK(this);
+  subflow = this->subflows + subflow_id;
+  while(result < max && (missed = g_queue_peek_head(subflow->missed)) != NULL){
+    if(now < missed->detected + this->reorder_treshold){
+      break;
+    }
+    seqs[result++] = missed->seq;
+    g_slice_free(Missed, g_queue_pop_head(subflow->missed));
+  }
+  this->nacked += result;
+  THIS_UNLOCK(this);
+  return result;
+}
+
+void nacktracker_add_recovered(NACKTracker *this, gboolean in_time)
+{
+  THIS_LOCK(this);
+  if(in_time){
+    ++this->recovered_in_time;
+  }else{
+    ++this->recovered_late;
+  }
+  THIS_UNLOCK(this);
+}
+
+gchar *nacktracker_get_stats(NACKTracker *this)
+{
+  gchar *result;
+  THIS_LOCK(this);
+  result = g_strdup_printf("nacked,recovered_in_time,recovered_late,recovered_in_time_ratio\n%u,%u,%u,%.3f\n",
+                           this->nacked,
+                           this->recovered_in_time,
+                           this->recovered_late,
+                           this->nacked ? (gdouble) this->recovered_in_time / this->nacked : 0.);
+  THIS_UNLOCK(this);
+  return result;
+}
+
+void _clear(NACKTrackerSubflow *subflow)
+{
+  Missed *missed;
+  while((missed = g_queue_pop_head(subflow->missed)) != NULL){
+    g_slice_free(Missed, missed);
+  }
+  subflow->initialized = FALSE;
+}
+
+void _add_missed(NACKTrackerSubflow *subflow, guint16 seq, GstClockTime now)
+{
+  Missed *missed;
+  if(NACKTRACKER_MAX_MISSED <= subflow->missed->length){
+    g_slice_free(Missed, g_queue_pop_head(subflow->missed));
+  }
+  missed = g_slice_new0(Missed);
+  missed->seq      = seq;
+  missed->detected = now;
+  g_queue_push_tail(subflow->missed, missed);
+}
+
+void _remove_missed(NACKTrackerSubflow *subflow, guint16 seq)
+{
+  GList *it;
+  Missed *missed;
+  for(it = subflow->missed->head; it; it = it->next){
+    missed = it->data;
+    if(missed->seq != seq){
+      continue;
+    }
+    g_slice_free(Missed, missed);
+    g_queue_delete_link(subflow->missed, it);
+    return;
+  }
+}
+
+#undef _now
+#undef THIS_LOCK
+#undef THIS_UNLOCK
@@ -0,0 +1,72 @@
+/*
+ * nacktracker.h
+ *
+ *  Receiver side loss detection for retransmission requests. The subflow
+ *  sequence numbers are tracked per subflow like in PacketsRcvTracker: a
+ *  gap is noted as missing when a later packet arrives, and it is reported
+ *  as lost if it is not filled by a reordered packet within the reorder
+ *  treshold. Every missing packet is reported once. A disabled tracker
+ *  returns at the first check.
+ */
+
+#ifndef NACKTRACKER_H_
+#define NACKTRACKER_H_
+
+#include <gst/gst.h>
+#include "gstmprtpbuffer.h"
+
+typedef struct _NACKTracker NACKTracker;
+typedef struct _NACKTrackerClass NACKTrackerClass;
+typedef struct _NACKTrackerSubflow NACKTrackerSubflow;
+
+#define NACKTRACKER_TYPE             (nacktracker_get_type())
+#define NACKTRACKER(src)             (G_TYPE_CHECK_INSTANCE_CAST((src),NACKTRACKER_TYPE,NACKTracker))
+#define NACKTRACKER_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST((klass),NACKTRACKER_TYPE,NACKTrackerClass))
+#define NACKTRACKER_IS_SOURCE(src)          (G_TYPE_CHECK_INSTANCE_TYPE((src),NACKTRACKER_TYPE))
+#define NACKTRACKER_IS_SOURCE_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE((klass),NACKTRACKER_TYPE))
+#define NACKTRACKER_CAST(src)        ((NACKTracker *)(src))
+
+#define NACKTRACKER_MAX_MISSED 512
+//Larger jumps are taken as the restart of the subflow, not as losses
+#define NACKTRACKER_MAX_GAP 256
+
+struct _NACKTrackerSubflow
+{
+  gboolean                 initialized;
+  guint16                  HSN;
+  GQueue*                  missed;
+};
+
+struct _NACKTracker
+{
+  GObject                  object;
+  GMutex                   mutex;
+  GstClockTime             reorder_treshold;
+
+  NACKTrackerSubflow       subflows[MPRTP_PLUGIN_MAX_SUBFLOW_NUM];
+
+  guint32                  nacked;
+  guint32                  recovered_in_time;
+  guint32                  recovered_late;
+};
+
+struct _NACKTrackerClass{
+  GObjectClass parent_class;
+};
+
+GType nacktracker_get_type (void);
+
+NACKTracker *make_nacktracker(void);
+//0 disables the tracking and forgets the missing packets
+void nacktracker_set_reorder_treshold(NACKTracker *this, GstClockTime treshold);
+GstClockTime nacktracker_get_reorder_treshold(NACKTracker *this);
+
+void nacktracker_add(NACKTracker *this, guint8 subflow_id, guint16 subflow_seq);
+//Fills seqs with at most max subflow sequence numbers to be NACKed
+guint nacktracker_get_nacks(NACKTracker *this, guint8 subflow_id, guint16 *seqs, guint max);
+void nacktracker_add_recovered(NACKTracker *this, gboolean in_time);
+
+//CSV: nacked,recovered_in_time,recovered_late,recovered_in_time_ratio
+gchar *nacktracker_get_stats(NACKTracker *this);
+
+#endif /* NACKTRACKER_H_ */
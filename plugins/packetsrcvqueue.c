@@ -24,23 +24,26 @@
 #include <gst/rtp/gstrtpbuffer.h>
 #include <gst/rtp/gstrtcpbuffer.h>
 #include "packetsrcvqueue.h"
+#include "mprtpclock.h"
 #include "gstmprtcpbuffer.h"
 #include <math.h>
 #include <string.h>
 #include "mprtpspath.h"
 #include "rtpfecbuffer.h"
 
-//#define THIS_READLOCK(this) g_rw_lock_reader_lock(&this->rwmutex)
-//#define THIS_READUNLOCK(this) g_rw_lock_reader_unlock(&this->rwmutex)
-//#define THIS_WRITELOCK(this) g_rw_lock_writer_lock(&this->rwmutex)
-//#define THIS_WRITEUNLOCK(this) g_rw_lock_writer_unlock(&this->rwmutex)
+//The receiving thread pushes and the playout thread pops, and both of
+//them move the timestamp extension and the playout offset, even the
+//wait query does, so there is one lock for everything
+#define THIS_LOCK(this) g_mutex_lock(&this->mutex)
+#define THIS_UNLOCK(this) g_mutex_unlock(&this->mutex)
 
-#define _now(this) gst_clock_get_time (this->sysclock)
+#define _now(this) mprtp_clock_get_time()
 
-#define THIS_READLOCK(this)
-#define THIS_READUNLOCK(this)
-#define THIS_WRITELOCK(this)
-#define THIS_WRITEUNLOCK(this)
+//Arrivals further from the expected time than this restart the playout
+//timing, the stream has been paused or the timestamps jumped
+#define PLAYOUT_REBASE_TRESHOLD (2 * GST_SECOND)
+//The part of an increased arrival offset the playout timing follows
+#define PLAYOUT_OFFSET_CREEP 1024
 
 
 static gint
@@ -76,6 +79,10 @@ G_DEFINE_TYPE (PacketsRcvQueue, packetsrcvqueue, G_TYPE_OBJECT);
 //----------------------------------------------------------------------
 
 static void packetsrcvqueue_finalize (GObject * object);
+static gint64 _extend_timestamp(PacketsRcvQueue *this, guint32 timestamp);
+static gint64 _media_time(PacketsRcvQueue *this, guint32 timestamp);
+static void _refresh_playout_offset(PacketsRcvQueue *this, GstMpRTPBuffer *mprtp);
+static gboolean _is_due(PacketsRcvQueue *this, GstMpRTPBuffer *mprtp, GstClockTime *wait);
 //----------------------------------------------------------------------
 //--------- Private functions implementations to SchTree object --------
 //----------------------------------------------------------------------
@@ -99,23 +106,22 @@ packetsrcvqueue_finalize (GObject * object)
 {
   PacketsRcvQueue *this;
   this = PACKETSRCVQUEUE(object);
-  g_object_unref(this->sysclock);
   g_object_unref(this->discarded);
   g_object_unref(this->packets);
+  g_mutex_clear(&this->mutex);
 }
 
 
 void
 packetsrcvqueue_init (PacketsRcvQueue * this)
 {
-  g_rw_lock_init (&this->rwmutex);
-  this->sysclock = gst_system_clock_obtain();
+  g_mutex_init (&this->mutex);
   this->discarded = g_queue_new();
   this->packets = g_queue_new();
 
   this->desired_framenum = 1;
-  this->high_watermark = .01 * GST_SECOND;
-  this->low_watermark =  .04 * GST_SECOND;
+  this->high_watermark = .2 * GST_SECOND;
+  this->low_watermark =  0;
   this->spread_factor = 2.;
 
 }
@@ -123,9 +129,9 @@ packetsrcvqueue_init (PacketsRcvQueue * this)
 
 void packetsrcvqueue_reset(PacketsRcvQueue *this)
 {
-  THIS_WRITELOCK(this);
+  THIS_LOCK(this);
 
-  THIS_WRITEUNLOCK(this);
+  THIS_UNLOCK(this);
 }
 
 
@@ -140,42 +146,65 @@ PacketsRcvQueue *make_packetsrcvqueue(void)
 void
 packetsrcvqueue_set_playout_allowed(PacketsRcvQueue *this, gboolean playout_permission)
 {
-  THIS_WRITELOCK (this);
+  THIS_LOCK (this);
   this->playout_allowed = playout_permission;
-  THIS_WRITEUNLOCK (this);
+  THIS_UNLOCK (this);
 }
 
 void
 packetsrcvqueue_set_desired_framenum(PacketsRcvQueue *this, guint desired_framenum)
 {
-  THIS_WRITELOCK (this);
+  THIS_LOCK (this);
   this->desired_framenum = desired_framenum;
-  THIS_WRITEUNLOCK (this);
+  THIS_UNLOCK (this);
 }
 
 
 void
 packetsrcvqueue_set_high_watermark(PacketsRcvQueue *this, GstClockTime high_watermark)
 {
-  THIS_WRITELOCK (this);
+  THIS_LOCK (this);
   this->high_watermark = high_watermark;
-  THIS_WRITEUNLOCK (this);
+  THIS_UNLOCK (this);
 }
 
 void
 packetsrcvqueue_set_low_watermark(PacketsRcvQueue *this, GstClockTime low_watermark)
 {
-  THIS_WRITELOCK (this);
+  THIS_LOCK (this);
   this->low_watermark = low_watermark;
-  THIS_WRITEUNLOCK (this);
+  THIS_UNLOCK (this);
+}
+
+void
+packetsrcvqueue_set_clock_rate(PacketsRcvQueue *this, guint32 clock_rate)
+{
+  THIS_LOCK (this);
+  if(this->clock_rate != clock_rate){
+    this->offset_initialized = FALSE;
+  }
+  this->clock_rate = clock_rate;
+  THIS_UNLOCK (this);
+}
+
+void
+packetsrcvqueue_set_target_delay(PacketsRcvQueue *this, GstClockTime target_delay)
+{
+  THIS_LOCK (this);
+  //0 high watermark does not bound the delay
+  if(this->high_watermark){
+    target_delay = MIN(this->high_watermark, target_delay);
+  }
+  this->target_delay = MAX(this->low_watermark, target_delay);
+  THIS_UNLOCK (this);
 }
 
 void
 packetsrcvqueue_flush(PacketsRcvQueue *this)
 {
-  THIS_WRITELOCK (this);
+  THIS_LOCK (this);
   this->flush = TRUE;
-  THIS_WRITEUNLOCK (this);
+  THIS_UNLOCK (this);
 }
 
 static gint _mprtp_queue_sort_helper(gconstpointer a, gconstpointer b, gpointer user_data)
@@ -188,7 +217,7 @@ static gint _mprtp_queue_sort_helper(gconstpointer a, gconstpointer b, gpointer
 void packetsrcvqueue_push_discarded(PacketsRcvQueue *this, GstMpRTPBuffer *mprtp)
 {
   GstMpRTPBuffer *head;
-  THIS_WRITELOCK(this);
+  THIS_LOCK(this);
   if(g_queue_is_empty(this->packets)){
     g_queue_push_tail(this->packets, mprtp);
     goto done;
@@ -199,63 +228,137 @@ void packetsrcvqueue_push_discarded(PacketsRcvQueue *this, GstMpRTPBuffer *mprtp
     goto done;
   }
   g_queue_insert_sorted(this->packets, mprtp, _mprtp_queue_sort_helper, NULL);
+  _refresh_playout_offset(this, mprtp);
 done:
-  THIS_WRITEUNLOCK(this);
+  THIS_UNLOCK(this);
 }
 
 
 void packetsrcvqueue_push(PacketsRcvQueue *this, GstMpRTPBuffer *mprtp)
 {
-  THIS_WRITELOCK(this);
+  THIS_LOCK(this);
 //  g_print("%hu is transferred at %d\n", mprtp->abs_seq, mprtp->subflow_id);
   g_queue_push_tail(this->packets, mprtp);
-  THIS_WRITEUNLOCK(this);
+  _refresh_playout_offset(this, mprtp);
+  THIS_UNLOCK(this);
 }
 
+//Packets of the same frame share the timestamp, so they are due together
 GstMpRTPBuffer* packetsrcvqueue_pop(PacketsRcvQueue *this)
 {
   GstMpRTPBuffer *result = NULL;
-  gint32 packets_num = 0;
-  THIS_WRITELOCK(this);
+  THIS_LOCK(this);
   if(!this->playout_allowed || g_queue_is_empty(this->packets)){
     goto done;
   }
-  if(!this->low_watermark || !this->high_watermark){
-    result = g_queue_pop_head(this->packets);
+  if(!this->flush && !_is_due(this, g_queue_peek_head(this->packets), NULL)){
     goto done;
   }
+  result = g_queue_pop_head(this->packets);
+done:
+  THIS_UNLOCK(this);
+  return result;
+}
 
-  packets_num = g_queue_get_length(this->packets);
-  if(!this->hwmark_reached){
-    if(this->high_watermark < packets_num){
-       this->hwmark_reached = TRUE;
-    }
+GstClockTime packetsrcvqueue_get_playout_wait(PacketsRcvQueue *this)
+{
+  GstClockTime result = GST_CLOCK_TIME_NONE;
+  THIS_LOCK(this);
+  if(!this->playout_allowed || g_queue_is_empty(this->packets)){
     goto done;
   }
-  if(packets_num < this->low_watermark){
-    this->hwmark_reached = FALSE;
+  result = 0;
+  if(this->flush){
+    goto done;
   }
-  result = g_queue_pop_head(this->packets);
+  _is_due(this, g_queue_peek_head(this->packets), &result);
 done:
-  THIS_WRITEUNLOCK(this);
+  THIS_UNLOCK(this);
   return result;
 }
 
 GstMpRTPBuffer* packetsrcvqueue_pop_discarded(PacketsRcvQueue *this)
 {
   GstMpRTPBuffer *result = NULL;
-  THIS_WRITELOCK(this);
+  THIS_LOCK(this);
   if(!this->playout_allowed || g_queue_is_empty(this->discarded)){
     goto done;
   }
   result = g_queue_pop_head(this->discarded);
 done:
-  THIS_WRITEUNLOCK(this);
+  THIS_UNLOCK(this);
+  return result;
+}
+
+gboolean packetsrcvqueue_is_empty(PacketsRcvQueue *this)
+{
+  gboolean result;
+  THIS_LOCK(this);
+  result = g_queue_is_empty(this->packets) && g_queue_is_empty(this->discarded);
+  THIS_UNLOCK(this);
   return result;
 }
 
+//Extends the 32 bit RTP timestamps relative to the first one
+gint64 _extend_timestamp(PacketsRcvQueue *this, guint32 timestamp)
+{
+  gint64 result;
+  if(!this->ts_initialized){
+    this->ts_initialized = TRUE;
+    this->last_ts = timestamp;
+    this->ext_ts = 0;
+  }
+  result = this->ext_ts + (gint32)(timestamp - this->last_ts);
+  if(this->ext_ts < result){
+    this->ext_ts = result;
+    this->last_ts = timestamp;
+  }
+  return result;
+}
+
+gint64 _media_time(PacketsRcvQueue *this, guint32 timestamp)
+{
+  gint64 ext_ts = _extend_timestamp(this, timestamp);
+  if(ext_ts < 0){
+    return -(gint64) gst_util_uint64_scale_int(-ext_ts, GST_SECOND, this->clock_rate);
+  }
+  return gst_util_uint64_scale_int(ext_ts, GST_SECOND, this->clock_rate);
+}
+
+void _refresh_playout_offset(PacketsRcvQueue *this, GstMpRTPBuffer *mprtp)
+{
+  gint64 offset;
+  if(!this->clock_rate){
+    return;
+  }
+  offset = (gint64) get_epoch_time_from_ntp_in_ns(mprtp->abs_rcv_ntp_time) -
+           _media_time(this, mprtp->timestamp);
+  if(!this->offset_initialized || PLAYOUT_REBASE_TRESHOLD < ABS(offset - this->playout_offset)){
+    this->playout_offset = offset;
+    this->offset_initialized = TRUE;
+  }else if(offset < this->playout_offset){
+    this->playout_offset = offset;
+  }else{
+    this->playout_offset += (offset - this->playout_offset) / PLAYOUT_OFFSET_CREEP;
+  }
+}
+
+gboolean _is_due(PacketsRcvQueue *this, GstMpRTPBuffer *mprtp, GstClockTime *wait)
+{
+  gint64 deadline, now;
+  if(!this->clock_rate || !this->offset_initialized){
+    return TRUE;
+  }
+  deadline = _media_time(this, mprtp->timestamp) + this->playout_offset + (gint64) this->target_delay;
+  now      = (gint64) epoch_now_in_ns;
+  if(deadline <= now){
+    return TRUE;
+  }
+  if(wait){
+    *wait = deadline - now;
+  }
+  return FALSE;
+}
 
-#undef THIS_WRITELOCK
-#undef THIS_WRITEUNLOCK
-#undef THIS_READLOCK
-#undef THIS_READUNLOCK
+#undef THIS_LOCK
+#undef THIS_UNLOCK
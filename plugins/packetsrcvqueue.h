@@ -26,9 +26,8 @@ typedef struct _PacketsRcvQueueClass PacketsRcvQueueClass;
 struct _PacketsRcvQueue
 {
   GObject                    object;
-  GstClock*                  sysclock;
   GstClockTime               made;
-  GRWLock                    rwmutex;
+  GMutex                     mutex;
 
   GQueue*                    discarded;
   GQueue*                    packets;
@@ -36,11 +35,21 @@ struct _PacketsRcvQueue
   gboolean                   playout_allowed;
 
   gint                       desired_framenum;
+  //bounds of the playout delay
   GstClockTime               high_watermark;
   GstClockTime               low_watermark;
   gdouble                    spread_factor;
 
-  gboolean                   hwmark_reached;
+  //Packets are played out at the time their RTP timestamp is due plus
+  //the target delay. The offset between the arrival and the media time
+  //is the smallest one seen, following the clock drift slowly.
+  guint32                    clock_rate;
+  GstClockTime               target_delay;
+  gboolean                   ts_initialized;
+  guint32                    last_ts;
+  gint64                     ext_ts;
+  gboolean                   offset_initialized;
+  gint64                     playout_offset;
 
   guint32                    playout_ts;
   guint16                    HSSN;
@@ -69,10 +78,16 @@ void packetsrcvqueue_set_desired_framenum(PacketsRcvQueue *this, guint desired_f
 void packetsrcvqueue_flush(PacketsRcvQueue *this);
 void packetsrcvqueue_set_high_watermark(PacketsRcvQueue *this, GstClockTime min_playoutrate);
 void packetsrcvqueue_set_low_watermark(PacketsRcvQueue *this, GstClockTime max_playoutrate);
+void packetsrcvqueue_set_clock_rate(PacketsRcvQueue *this, guint32 clock_rate);
+void packetsrcvqueue_set_target_delay(PacketsRcvQueue *this, GstClockTime target_delay);
 void packetsrcvqueue_push_discarded(PacketsRcvQueue *this, GstMpRTPBuffer *mprtp);
 void packetsrcvqueue_push(PacketsRcvQueue *this, GstMpRTPBuffer* buffer);
 GstMpRTPBuffer *packetsrcvqueue_pop(PacketsRcvQueue *this);
 GstMpRTPBuffer *packetsrcvqueue_pop_discarded(PacketsRcvQueue *this);
+gboolean packetsrcvqueue_is_empty(PacketsRcvQueue *this);
+//Time until the head packet is due, 0 if it is due already and
+//GST_CLOCK_TIME_NONE if there is nothing to play out
+GstClockTime packetsrcvqueue_get_playout_wait(PacketsRcvQueue *this);
 
 
 #endif /* PACKETSRCVQUEUE_H_ */
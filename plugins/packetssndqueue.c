@@ -24,12 +24,14 @@
 #include <gst/rtp/gstrtpbuffer.h>
 #include <gst/rtp/gstrtcpbuffer.h>
 #include "packetssndqueue.h"
+#include "mprtpclock.h"
 #include "gstmprtcpbuffer.h"
 #include <math.h>
 #include <string.h>
 #include "mprtpspath.h"
 #include "rtpfecbuffer.h"
 #include "lib_swplugins.h"
+#include "gstmprtpbuffer.h"
 
 //#define THIS_READLOCK(this) g_rw_lock_reader_lock(&this->rwmutex)
 //#define THIS_READUNLOCK(this) g_rw_lock_reader_unlock(&this->rwmutex)
@@ -41,7 +43,7 @@
 #define THIS_WRITELOCK(this) g_mutex_lock(&this->mutex)
 #define THIS_WRITEUNLOCK(this) g_mutex_unlock(&this->mutex)
 
-#define _now(this) gst_clock_get_time (this->sysclock)
+#define _now(this) mprtp_clock_get_time()
 
 //#define THIS_READLOCK(this)
 //#define THIS_READUNLOCK(this)
@@ -71,6 +73,21 @@ G_DEFINE_TYPE (PacketsSndQueue, packetssndqueue, G_TYPE_OBJECT);
 //----------------------------------------------------------------------
 
 static void packetssndqueue_finalize (GObject * object);
+static PacketsSndStream *_stream_ctor(guint32 ssrc, guint priority, guint weight, gboolean lowdelay);
+static void _stream_dtor(gpointer data);
+static PacketsSndStream *_get_stream(PacketsSndQueue *this, guint32 ssrc);
+static gint _cmp_stream_priority(gconstpointer a, gconstpointer b);
+static PacketsSndStream *_select_stream(PacketsSndQueue *this);
+static GList *_frame_end(GList *link, gint32 *bytes);
+static gboolean _misses_deadline(PacketsSndQueue *this, PacketsSndStream *stream,
+                                 GList *link, gint32 bytes, GstClockTime now);
+static GList *_drop_frame(PacketsSndQueue *this, PacketsSndStream *stream, GList *link);
+static gint32 _drop_discardable_frames(PacketsSndQueue *this, PacketsSndStream *stream, GList *until);
+static void _drop_late_frames(PacketsSndQueue *this, PacketsSndStream *stream);
+
+//Streams of the higher priorities are targeted to this multiple of their
+//measured rate, so they can increase
+#define STREAM_TARGET_HEADROOM 1.25
 
 //#define _trash_node(this, node) g_slice_free(PacketsSndQueueNode, node)
 #define _trash_node(this, node) g_free(node)
@@ -98,8 +115,9 @@ packetssndqueue_finalize (GObject * object)
 {
   PacketsSndQueue *this;
   this = PACKETSSNDQUEUE(object);
-  g_object_unref(this->sysclock);
-  g_object_unref(this->items);
+  g_ptr_array_free(this->ordered_streams, TRUE);
+  g_hash_table_destroy(this->streams);
+  _stream_dtor(this->default_stream);
 }
 
 void
@@ -108,9 +126,11 @@ packetssndqueue_init (PacketsSndQueue * this)
 //  g_rw_lock_init (&this->rwmutex);
   g_mutex_init(&this->mutex);
   g_cond_init(&this->cond);
-  this->sysclock = gst_system_clock_obtain();
   this->obsolation_treshold = GST_SECOND;
-  this->items = g_queue_new();
+  this->streams = g_hash_table_new_full (NULL, NULL, NULL, _stream_dtor);
+  this->ordered_streams = g_ptr_array_new();
+  this->default_stream = _stream_ctor(0, G_MAXUINT, 1, FALSE);
+  g_ptr_array_add(this->ordered_streams, this->default_stream);
 
 }
 
@@ -137,6 +157,7 @@ PacketsSndQueue *make_packetssndqueue(void)
   PacketsSndQueue *result;
   result = g_object_new (PACKETSSNDQUEUE_TYPE, NULL);
   result->made = _now(result);
+  result->targets_updated = result->made;
   return result;
 }
 
@@ -176,10 +197,19 @@ GstClockTime packetssndqueue_get_obsolation_treshold(PacketsSndQueue *this)
   return result;
 }
 
+void packetssndqueue_set_keyframe_filtering(PacketsSndQueue *this, guint keyframe_filtering)
+{
+  THIS_WRITELOCK(this);
+  this->keyframe_filtering = keyframe_filtering;
+  THIS_WRITEUNLOCK(this);
+}
+
 void packetssndqueue_push(PacketsSndQueue *this, GstBuffer *buffer)
 {
   GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
   PacketsSndQueueItem *item;
+  PacketsSndStream *stream;
+  gboolean new_frame;
   THIS_WRITELOCK(this);
   item = g_slice_new0(PacketsSndQueueItem);
   item->added = _now(this);
@@ -188,10 +218,32 @@ void packetssndqueue_push(PacketsSndQueue *this, GstBuffer *buffer)
   gst_rtp_buffer_map(buffer, GST_MAP_READ, &rtp);
   item->size      = gst_rtp_buffer_get_payload_len(&rtp);
   item->timestamp = gst_rtp_buffer_get_timestamp(&rtp);
+  item->marker    = gst_rtp_buffer_get_marker(&rtp);
+  stream          = _get_stream(this, gst_rtp_buffer_get_ssrc(&rtp));
+  new_frame       = stream->pushed_marker || item->timestamp != stream->pushed_timestamp;
+  //the frame type is known from its first packet only
+  item->keyframe  = new_frame ? gst_mprtp_is_keyframe(&rtp, this->keyframe_filtering) : stream->pushed_keyframe;
+  //the deadline of a partially sent frame runs from its first packet
+  item->frame_added = new_frame ? item->added : stream->pushed_frame_added;
   gst_rtp_buffer_unmap(&rtp);
 
+  stream->pushed_timestamp   = item->timestamp;
+  stream->pushed_frame_added = item->frame_added;
+  stream->pushed_keyframe  = item->keyframe;
+  stream->pushed_marker    = item->marker;
+  //the frames queued earlier are checked against the backlog as a new
+  //one begins
+  if(new_frame && 0 < this->obsolation_treshold){
+    _drop_late_frames(this, stream);
+  }
+
+  //an idle stream does not save up sending time for a burst
+  if(g_queue_is_empty(stream->items)){
+    stream->vtime = MAX(stream->vtime, this->vclock);
+  }
   this->bytes+=item->size;
-  g_queue_push_tail(this->items, item);
+  stream->bytes+=item->size;
+  g_queue_push_tail(stream->items, item);
   g_cond_signal(&this->cond);
   THIS_WRITEUNLOCK(this);
 }
@@ -200,13 +252,31 @@ GstBuffer * packetssndqueue_pop(PacketsSndQueue *this)
 {
   GstBuffer *result = NULL;
   PacketsSndQueueItem *item;
+  PacketsSndStream *stream;
+  GstClockTime delay;
   THIS_WRITELOCK(this);
-  if(!g_queue_is_empty(this->items)){
-    item = g_queue_pop_head(this->items);
-    this->bytes-=item->size;
-    result = item->buffer;
-    g_slice_free(PacketsSndQueueItem, item);
+  stream = this->selected ? this->selected : _select_stream(this);
+  this->selected = NULL;
+  if(!stream || g_queue_is_empty(stream->items)){
+    goto done;
+  }
+  item = g_queue_pop_head(stream->items);
+  this->bytes-=item->size;
+  stream->bytes-=item->size;
+  stream->sent_bytes+=item->size;
+  if(item->timestamp != stream->sending_timestamp){
+    stream->sending_timestamp = item->timestamp;
+    stream->sending_bytes     = 0;
   }
+  stream->sending_bytes += item->size;
+  delay = _now(this) - item->added;
+  this->queueing_delay += ((gdouble) delay - this->queueing_delay) / 16.;
+  this->max_queueing_delay = MAX(this->max_queueing_delay, delay);
+  stream->vtime += (gdouble) item->size / (gdouble) stream->weight;
+  this->vclock = stream->vtime;
+  result = item->buffer;
+  g_slice_free(PacketsSndQueueItem, item);
+done:
   THIS_WRITEUNLOCK(this);
   return result;
 }
@@ -214,38 +284,376 @@ GstBuffer * packetssndqueue_pop(PacketsSndQueue *this)
 void packetssndqueue_wait_until_item(PacketsSndQueue *this)
 {
   THIS_READLOCK(this);
-  if(!g_queue_is_empty(this->items)){
+  if(0 < this->bytes || _select_stream(this)){
     goto done;
   }
   g_cond_wait(&this->cond, &this->mutex);
 done:
-  THIS_READLOCK(this);
+  THIS_READUNLOCK(this);
 }
 
 GstBuffer * packetssndqueue_peek(PacketsSndQueue *this)
 {
   GstBuffer *result = NULL;
   PacketsSndQueueItem *item;
+  PacketsSndStream *stream;
+  gint32 bytes;
   THIS_WRITELOCK(this);
 again:
-  if(g_queue_is_empty(this->items)){
+  stream = this->selected = _select_stream(this);
+  if(!stream){
     goto done;
   }
-  item = g_queue_peek_head(this->items);
-  if(0 < this->obsolation_treshold && item->added < _now(this) - this->obsolation_treshold){
-    item = g_queue_pop_head(this->items);
-    this->bytes-=item->size;
-    gst_buffer_unref(item->buffer);
-    g_slice_free(PacketsSndQueueItem, item);
-    this->expected_lost = TRUE;
-    goto again;
+  //the rest of a frame late already is not sent
+  if(0 < this->obsolation_treshold){
+    bytes = 0;
+    _frame_end(stream->items->head, &bytes);
+    if(_misses_deadline(this, stream, stream->items->head, bytes, _now(this))){
+      _drop_frame(this, stream, stream->items->head);
+      goto again;
+    }
   }
+  item = g_queue_peek_head(stream->items);
   result = item->buffer;
 done:
   THIS_WRITEUNLOCK(this);
   return result;
 }
 
+void packetssndqueue_setup_streams(PacketsSndQueue *this, PacketsSndStreamSetup *setups, guint setups_num)
+{
+  PacketsSndStream *stream;
+  PacketsSndStreamSetup *setup;
+  guint i, j;
+  THIS_WRITELOCK(this);
+  for(i = 0; i < this->ordered_streams->len; ){
+    stream = g_ptr_array_index(this->ordered_streams, i);
+    for(j = 0; j < setups_num && setups[j].ssrc != stream->ssrc; ++j);
+    if(stream == this->default_stream || j < setups_num){
+      ++i;
+      continue;
+    }
+    //the queued packets are kept for the default stream
+    while(!g_queue_is_empty(stream->items)){
+      g_queue_push_tail(this->default_stream->items, g_queue_pop_head(stream->items));
+    }
+    this->default_stream->bytes += stream->bytes;
+    stream->bytes = 0;
+    g_ptr_array_remove_index_fast(this->ordered_streams, i);
+    g_hash_table_remove(this->streams, GUINT_TO_POINTER(stream->ssrc));
+  }
+  for(i = 0; i < setups_num; ++i){
+    setup  = setups + i;
+    stream = g_hash_table_lookup(this->streams, GUINT_TO_POINTER(setup->ssrc));
+    if(!stream){
+      stream = _stream_ctor(setup->ssrc, setup->priority, setup->weight, setup->lowdelay);
+      g_hash_table_insert(this->streams, GUINT_TO_POINTER(setup->ssrc), stream);
+      g_ptr_array_add(this->ordered_streams, stream);
+    }
+    stream->priority = setup->priority;
+    stream->weight   = MAX(1, setup->weight);
+    stream->lowdelay = setup->lowdelay;
+  }
+  g_ptr_array_sort(this->ordered_streams, _cmp_stream_priority);
+  this->selected = NULL;
+  THIS_WRITEUNLOCK(this);
+}
+
+guint packetssndqueue_get_streams_num(PacketsSndQueue *this)
+{
+  guint result;
+  THIS_READLOCK(this);
+  result = g_hash_table_size(this->streams);
+  THIS_READUNLOCK(this);
+  return result;
+}
+
+gboolean packetssndqueue_has_stream(PacketsSndQueue *this, guint32 ssrc)
+{
+  gboolean result;
+  THIS_READLOCK(this);
+  result = g_hash_table_contains(this->streams, GUINT_TO_POINTER(ssrc));
+  THIS_READUNLOCK(this);
+  return result;
+}
+
+gboolean packetssndqueue_is_lowdelay_stream(PacketsSndQueue *this, guint32 ssrc)
+{
+  gboolean result;
+  THIS_READLOCK(this);
+  result = _get_stream(this, ssrc)->lowdelay;
+  THIS_READUNLOCK(this);
+  return result;
+}
+
+void packetssndqueue_setup_stream_targets(PacketsSndQueue *this, gint32 target_bitrate)
+{
+  PacketsSndStream *stream;
+  GstClockTime now, elapsed;
+  gdouble budget, class_budget, class_weights, measured;
+  guint i, j, class_end, len;
+  gboolean last_class;
+  PacketsSndStream *excluded;
+
+  THIS_WRITELOCK(this);
+  now     = _now(this);
+  elapsed = now - this->targets_updated;
+  this->targets_updated = now;
+  budget  = MAX(0, target_bitrate);
+  len     = this->ordered_streams->len;
+  //the default stream is only for the SSRCs left out of a stream table
+  excluded = g_hash_table_size(this->streams) ? this->default_stream : NULL;
+  if(excluded){
+    excluded->target_bitrate = 0;
+    excluded->sent_bytes     = 0;
+  }
+  for(i = 0; i < len; i = class_end){
+    class_weights = 0.;
+    for(class_end = i; class_end < len; ++class_end){
+      stream = g_ptr_array_index(this->ordered_streams, class_end);
+      if(stream->priority != ((PacketsSndStream*) g_ptr_array_index(this->ordered_streams, i))->priority){
+        break;
+      }
+      if(stream != excluded){
+        class_weights += stream->weight;
+      }
+    }
+    last_class = TRUE;
+    for(j = class_end; j < len && last_class; ++j){
+      last_class = g_ptr_array_index(this->ordered_streams, j) == excluded;
+    }
+    class_budget = budget;
+    for(j = i; j < class_end; ++j){
+      stream = g_ptr_array_index(this->ordered_streams, j);
+      if(stream == excluded){
+        continue;
+      }
+      stream->target_bitrate = class_budget * stream->weight / class_weights;
+      //a stream not sent yet keeps its share, so it can start
+      if(!last_class && 0 < elapsed && 0 < stream->sent_bytes){
+        measured = (gdouble) stream->sent_bytes * 8. * GST_SECOND / elapsed;
+        stream->target_bitrate = MIN(stream->target_bitrate, measured * STREAM_TARGET_HEADROOM);
+      }
+      stream->sent_bytes = 0;
+      budget -= stream->target_bitrate;
+    }
+  }
+  THIS_WRITEUNLOCK(this);
+}
+
+gchar *packetssndqueue_get_streams_string(PacketsSndQueue *this)
+{
+  GString *result;
+  PacketsSndStream *stream;
+  guint i;
+  result = g_string_new("");
+  THIS_READLOCK(this);
+  for(i = 0; i < this->ordered_streams->len; ++i){
+    stream = g_ptr_array_index(this->ordered_streams, i);
+    if(stream == this->default_stream && g_hash_table_size(this->streams)){
+      continue;
+    }
+    g_string_append_printf(result, "%u:%u:%u:%d\n",
+        stream->ssrc, stream->priority, stream->weight, stream->target_bitrate);
+  }
+  THIS_READUNLOCK(this);
+  return g_string_free(result, FALSE);
+}
+
+gchar *packetssndqueue_get_stats(PacketsSndQueue *this)
+{
+  gchar *result;
+  THIS_READLOCK(this);
+  result = g_strdup_printf("queueing_delay_ms,max_queueing_delay_ms,dropped_frames,dropped_keyframes,"
+                           "dropped_bytes,wasted_bytes\n%.3f,%.3f,%u,%u,%"G_GUINT64_FORMAT",%"G_GUINT64_FORMAT"\n",
+                           this->queueing_delay / (gdouble) GST_MSECOND,
+                           (gdouble) this->max_queueing_delay / (gdouble) GST_MSECOND,
+                           this->dropped_frames,
+                           this->dropped_keyframes,
+                           this->dropped_bytes,
+                           this->wasted_bytes);
+  THIS_READUNLOCK(this);
+  return result;
+}
+
+PacketsSndStream *_stream_ctor(guint32 ssrc, guint priority, guint weight, gboolean lowdelay)
+{
+  PacketsSndStream *result;
+  result = g_slice_new0(PacketsSndStream);
+  result->ssrc     = ssrc;
+  result->priority = priority;
+  result->weight   = MAX(1, weight);
+  result->lowdelay = lowdelay;
+  result->items    = g_queue_new();
+  return result;
+}
+
+void _stream_dtor(gpointer data)
+{
+  PacketsSndStream *stream = data;
+  PacketsSndQueueItem *item;
+  while(!g_queue_is_empty(stream->items)){
+    item = g_queue_pop_head(stream->items);
+    gst_buffer_unref(item->buffer);
+    g_slice_free(PacketsSndQueueItem, item);
+  }
+  g_queue_free(stream->items);
+  g_slice_free(PacketsSndStream, stream);
+}
+
+PacketsSndStream *_get_stream(PacketsSndQueue *this, guint32 ssrc)
+{
+  PacketsSndStream *result;
+  result = g_hash_table_lookup(this->streams, GUINT_TO_POINTER(ssrc));
+  return result ? result : this->default_stream;
+}
+
+gint _cmp_stream_priority(gconstpointer a, gconstpointer b)
+{
+  const PacketsSndStream *ai = *(PacketsSndStream * const *) a;
+  const PacketsSndStream *bi = *(PacketsSndStream * const *) b;
+  if(ai->priority == bi->priority) return 0;
+  return ai->priority < bi->priority ? -1 : 1;
+}
+
+//The first priority having queued packets is served, and in it the
+//stream being behind the most by its weight
+PacketsSndStream *_select_stream(PacketsSndQueue *this)
+{
+  PacketsSndStream *stream, *result = NULL;
+  guint i;
+  for(i = 0; i < this->ordered_streams->len; ++i){
+    stream = g_ptr_array_index(this->ordered_streams, i);
+    if(result && result->priority != stream->priority){
+      break;
+    }
+    if(g_queue_is_empty(stream->items)){
+      continue;
+    }
+    if(!result || stream->vtime < result->vtime){
+      result = stream;
+    }
+  }
+  return result;
+}
+
+//Returns the first packet of the next frame, the bytes of the frame
+//starting at link are added to bytes
+GList *_frame_end(GList *link, gint32 *bytes)
+{
+  PacketsSndQueueItem *item, *first;
+  first = link->data;
+  for(; link; link = link->next){
+    item = link->data;
+    if(item->timestamp != first->timestamp){
+      break;
+    }
+    *bytes += item->size;
+    if(item->marker){
+      return link->next;
+    }
+  }
+  return link;
+}
+
+//A frame misses its deadline if the stream can not send it at its target
+//bitrate before the frame is older than the obsolation treshold, bytes are
+//queued ahead of it and in it. A stream without a target only checks the
+//age of the frame.
+gboolean _misses_deadline(PacketsSndQueue *this, PacketsSndStream *stream,
+                          GList *link, gint32 bytes, GstClockTime now)
+{
+  PacketsSndQueueItem *first = link->data;
+  GstClockTime sent = now;
+  if(0 < stream->target_bitrate){
+    sent += gst_util_uint64_scale(MAX(0, bytes), 8 * GST_SECOND, stream->target_bitrate);
+  }
+  return first->frame_added + this->obsolation_treshold < sent;
+}
+
+//Returns the first packet of the next frame
+GList *_drop_frame(PacketsSndQueue *this, PacketsSndStream *stream, GList *link)
+{
+  PacketsSndQueueItem *item, *first;
+  GList *next, *end;
+  gint32 bytes = 0;
+
+  first = link->data;
+  //the bytes of a frame dropped in the middle are sent for nothing
+  if(link == stream->items->head && stream->sending_timestamp == first->timestamp){
+    this->wasted_bytes   += stream->sending_bytes;
+    stream->sending_bytes = 0;
+  }
+  ++this->dropped_frames;
+  if(first->keyframe){
+    ++this->dropped_keyframes;
+  }
+  end = _frame_end(link, &bytes);
+  for(; link != end; link = next){
+    next = link->next;
+    item = link->data;
+    this->bytes         -= item->size;
+    stream->bytes       -= item->size;
+    this->dropped_bytes += item->size;
+    gst_buffer_unref(item->buffer);
+    g_slice_free(PacketsSndQueueItem, item);
+    g_queue_delete_link(stream->items, link);
+  }
+  this->expected_lost = TRUE;
+  return end;
+}
+
+//Drops the frames not being keyframes ahead of until, returns their bytes
+gint32 _drop_discardable_frames(PacketsSndQueue *this, PacketsSndStream *stream, GList *until)
+{
+  PacketsSndQueueItem *first;
+  GList *link;
+  gint32 result = 0, bytes;
+  for(link = stream->items->head; link && link != until; ){
+    first = link->data;
+    bytes = 0;
+    if(first->keyframe){
+      link = _frame_end(link, &bytes);
+      continue;
+    }
+    _frame_end(link, &bytes);
+    result += bytes;
+    link    = _drop_frame(this, stream, link);
+  }
+  return result;
+}
+
+//Frames not sent until their deadline at the target bitrate of the stream
+//are dropped as a whole. A late keyframe replaces the frames ahead of it,
+//so they are dropped first and the keyframe only if it is still late.
+void _drop_late_frames(PacketsSndQueue *this, PacketsSndStream *stream)
+{
+  PacketsSndQueueItem *first;
+  GList *link, *end;
+  GstClockTime now;
+  gint32 ahead = 0, bytes;
+
+  now = _now(this);
+  for(link = stream->items->head; link; ){
+    first = link->data;
+    bytes = 0;
+    end   = _frame_end(link, &bytes);
+    if(!_misses_deadline(this, stream, link, ahead + bytes, now)){
+      ahead += bytes;
+      link   = end;
+      continue;
+    }
+    if(first->keyframe && 0 < ahead){
+      ahead -= _drop_discardable_frames(this, stream, link);
+      if(!_misses_deadline(this, stream, link, ahead + bytes, now)){
+        ahead += bytes;
+        link   = end;
+        continue;
+      }
+    }
+    link = _drop_frame(this, stream, link);
+  }
+}
 
 
 #undef DEBUG_PRINT_TOOLS
@@ -25,27 +25,87 @@ typedef struct _PacketsSndQueueItem PacketsSndQueueItem;
 struct _PacketsSndQueueItem
 {
   GstClockTime         added;
+  //when the first packet of the frame was queued
+  GstClockTime         frame_added;
   GstBuffer*           buffer;
   guint32              timestamp;
   gint32               size;
+  //the packets of a frame have the same timestamp, the last one has the
+  //marker bit
+  gboolean             marker;
+  gboolean             keyframe;
 };
 
 #define PACKETSSNDQUEUE_MAX_ITEMS_NUM 100
 
+typedef struct _PacketsSndStream PacketsSndStream;
+
+//A media stream identified by its SSRC. Streams with a lower priority
+//value are served first, streams with the same priority share the
+//sending by their weights.
+struct _PacketsSndStream
+{
+  guint32              ssrc;
+  guint                priority;
+  guint                weight;
+  //sent on the path having the lowest RTT
+  gboolean             lowdelay;
+
+  GQueue*              items;
+  gint32               bytes;
+  //bytes dequeued divided by the weight
+  gdouble              vtime;
+  guint64              sent_bytes;
+  gint32               target_bitrate;
+
+  //the frame of the last pushed packet
+  guint32              pushed_timestamp;
+  GstClockTime         pushed_frame_added;
+  gboolean             pushed_keyframe;
+  gboolean             pushed_marker;
+  //the frame of the last popped packet and its bytes sent so far
+  guint32              sending_timestamp;
+  gint32               sending_bytes;
+};
+
+//An entry of the stream table
+typedef struct _PacketsSndStreamSetup
+{
+  guint32              ssrc;
+  guint                priority;
+  guint                weight;
+  gboolean             lowdelay;
+}PacketsSndStreamSetup;
+
 struct _PacketsSndQueue
 {
   GObject                    object;
-  GstClock*                  sysclock;
   GstClockTime               made;
 //  GRWLock                    rwmutex;
   GMutex                     mutex;
   GCond                      cond;
 
+  //the deadline of a frame from its first packet queued, 0 disables it
   GstClockTime               obsolation_treshold;
   gboolean                   expected_lost;
   gint32                     bytes;
-
-  GQueue*                    items;
+  guint                      keyframe_filtering;
+
+  gdouble                    queueing_delay;
+  GstClockTime               max_queueing_delay;
+  guint32                    dropped_frames;
+  guint32                    dropped_keyframes;
+  guint64                    dropped_bytes;
+  //bytes sent of the frames dropped later
+  guint64                    wasted_bytes;
+
+  //Packets of SSRCs not in the table go to the default stream
+  GHashTable*                streams;
+  GPtrArray*                 ordered_streams;
+  PacketsSndStream*          default_stream;
+  PacketsSndStream*          selected;
+  gdouble                    vclock;
+  GstClockTime               targets_updated;
 
 };
 
@@ -67,9 +127,27 @@ gint32 packetssndqueue_get_bytes_in_queue(PacketsSndQueue *this);
 void packetssndqueue_push(PacketsSndQueue *this, GstBuffer* buffer);
 void packetssndqueue_set_obsolation_treshold(PacketsSndQueue *this, GstClockTime treshold);
 GstClockTime packetssndqueue_get_obsolation_treshold(PacketsSndQueue *this);
+//Frames of keyframes detected by the mpath-keyframe-filtering mode are
+//dropped after the discardable frames
+void packetssndqueue_set_keyframe_filtering(PacketsSndQueue *this, guint keyframe_filtering);
 void packetssndqueue_wait_until_item(PacketsSndQueue *this);
 GstBuffer * packetssndqueue_peek(PacketsSndQueue *this);
 GstBuffer * packetssndqueue_pop(PacketsSndQueue *this);
 
+//Replaces the stream table at once, the packets of the streams left out
+//are kept for the default stream
+void packetssndqueue_setup_streams(PacketsSndQueue *this, PacketsSndStreamSetup *setups, guint setups_num);
+guint packetssndqueue_get_streams_num(PacketsSndQueue *this);
+gboolean packetssndqueue_has_stream(PacketsSndQueue *this, guint32 ssrc);
+gboolean packetssndqueue_is_lowdelay_stream(PacketsSndQueue *this, guint32 ssrc);
+//Shares the target bitrate of the subflows between the streams, higher
+//priorities get their measured rate with headroom first, the lowest one
+//gets the rest. With a stream table the default stream gets no share.
+void packetssndqueue_setup_stream_targets(PacketsSndQueue *this, gint32 target_bitrate);
+//"ssrc:priority:weight:target_bitrate" lines
+gchar *packetssndqueue_get_streams_string(PacketsSndQueue *this);
+//CSV of the queueing delays and the dropped frames
+gchar *packetssndqueue_get_stats(PacketsSndQueue *this);
+
 
 #endif /* PACKETSSNDQUEUE_H_ */
@@ -24,6 +24,7 @@
 #include <gst/rtp/gstrtpbuffer.h>
 #include <gst/rtp/gstrtcpbuffer.h>
 #include "rcvctrler.h"
+#include "mprtpclock.h"
 #include "streamsplitter.h"
 #include "gstmprtcpbuffer.h"
 #include "mprtprpath.h"
@@ -45,7 +46,7 @@
 
 #define MIN_MEDIA_RATE 50000
 
-#define _now(this) (gst_clock_get_time (this->sysclock))
+#define _now(this) mprtp_clock_get_time()
 
 GST_DEBUG_CATEGORY_STATIC (rcvctrler_debug_category);
 #define GST_CAT_DEFAULT rcvctrler_debug_category
@@ -87,7 +88,6 @@ struct _Subflow
 {
   guint8                        id;
   MpRTPRPath*                   path;
-  GstClock*                     sysclock;
   GstClockTime                  joined_time;
   ReportIntervalCalculator*     ricalcer;
 
@@ -147,6 +147,12 @@ _orp_add_rr(
 static void
 _FECStat(RcvController * this);
 
+static void
+_log_fecstat(
+    guint32 total_rtp_rate,
+    guint32 missing_rate,
+    guint32 recovered_rate);
+
 //----------------------------- System Notifier ------------------------------
 static void
 _system_notifier_main(RcvController * this);
@@ -237,6 +243,22 @@ rcvctrler_setup (RcvController *this, StreamJoiner * joiner, FECDecoder* fecdeco
   THIS_WRITEUNLOCK (this);
 }
 
+void
+rcvctrler_setup_nack_tracker (RcvController *this, NACKTracker* nacktracker)
+{
+  THIS_WRITELOCK (this);
+  this->nacktracker = nacktracker;
+  THIS_WRITEUNLOCK (this);
+}
+
+void
+rcvctrler_setup_owd_accuracy (RcvController *this, gdouble owd_rel_accuracy)
+{
+  THIS_WRITELOCK (this);
+  this->owd_rel_accuracy = owd_rel_accuracy;
+  THIS_WRITEUNLOCK (this);
+}
+
 void rcvctrler_change_interval_type(RcvController * this, guint8 subflow_id, guint type)
 {
   Subflow *subflow;
@@ -296,7 +318,9 @@ static void _change_controlling_mode(RcvController *this, Subflow *subflow, guin
       GST_DEBUG_OBJECT(subflow, "subflow %d set to only report processing mode", subflow->id);
       break;
     case 2:
-      subflow->fbproducer = make_fbrafbproducer(this->ssrc, subflow->id);
+    //SCReAM is fed from the same XR OWD and discard RLE reports FBRA uses
+    case 3:
+      subflow->fbproducer = make_fbrafbproducer(this->ssrc, subflow->id, this->owd_rel_accuracy);
       subflow->do_fb     = fbrafbproducer_do_fb;
       subflow->fb_sent   = fbrafbproducer_fb_sent;
       subflow->setup_fb  = fbrafbproducer_setup_feedback;
@@ -335,11 +359,10 @@ void
 rcvctrler_finalize (GObject * object)
 {
   RcvController *this = RCVCTRLER (object);
+  timerwheel_remove (this->timerwheel, this->ticker);
+  g_object_unref (this->timerwheel);
   g_hash_table_destroy (this->subflows);
-  gst_task_stop (this->thread);
-  gst_task_join (this->thread);
 //  g_object_unref (this->ricalcer);
-  g_object_unref (this->sysclock);
   g_object_unref(this->report_producer);
   g_object_unref(this->fecstat);
 
@@ -348,7 +371,6 @@ rcvctrler_finalize (GObject * object)
 void
 rcvctrler_init (RcvController * this)
 {
-  this->sysclock           = gst_system_clock_obtain ();
   this->subflows           = g_hash_table_new_full (NULL, NULL,NULL, (GDestroyNotify) _ruin_subflow);
   this->ssrc               = g_random_int ();
   this->report_is_flowable = FALSE;
@@ -362,19 +384,16 @@ rcvctrler_init (RcvController * this)
   report_processor_set_logfile(this->report_processor, "rcv_reports.log");
   report_producer_set_logfile(this->report_producer, "rcv_produced_reports.log");
   g_rw_lock_init (&this->rwmutex);
-  g_rec_mutex_init (&this->thread_mutex);
-  this->thread = gst_task_new (refctrler_ticker, this, NULL);
-  gst_task_set_lock (this->thread, &this->thread_mutex);
-  gst_task_start (this->thread);
+  this->timerwheel = timerwheel_obtain ();
+  this->ticker     = timerwheel_add_periodic (this->timerwheel, 10 * GST_MSECOND,
+                                              refctrler_ticker, this);
 
 }
 
 void
 refctrler_ticker (void *data)
 {
-  GstClockTime next_scheduler_time;
   RcvController *this;
-  GstClockID clock_id;
 
   this = RCVCTRLER (data);
   THIS_WRITELOCK (this);
@@ -385,16 +404,7 @@ refctrler_ticker (void *data)
   _FECStat(this);
   _system_notifier_main(this);
 
-
-  next_scheduler_time = _now(this) + 10 * GST_MSECOND;
   THIS_WRITEUNLOCK (this);
-
-  clock_id = gst_clock_new_single_shot_id (this->sysclock, next_scheduler_time);
-
-  if (gst_clock_id_wait (clock_id, NULL) == GST_CLOCK_UNSCHEDULED) {
-    GST_WARNING_OBJECT (this, "The playout clock wait is interrupted");
-  }
-  gst_clock_id_unref (clock_id);
 }
 
 
@@ -506,6 +516,8 @@ _orp_main(RcvController * this)
   GstBuffer *buffer;
   gchar interval_logfile[255];
   GstClockTime elapsed_x, elapsed_y, now;
+  guint16 nacks[REPORT_PRODUCER_MAX_NACK_FCIS];
+  guint nacks_num;
 
   now = _now(this);
 
@@ -554,6 +566,19 @@ _orp_main(RcvController * this)
       report_created = TRUE;
     }
 
+    //losses are reported as soon as they outlive the reorder treshold
+    nacks_num = 0;
+    if(this->nacktracker && this->report_is_flowable){
+      nacks_num = nacktracker_get_nacks(this->nacktracker, subflow->id, nacks, REPORT_PRODUCER_MAX_NACK_FCIS);
+    }
+    if(0 < nacks_num){
+      if(!report_created){
+        report_producer_begin(this->report_producer, subflow->id);
+      }
+      report_producer_add_nack(this->report_producer, this->ssrc, nacks, nacks_num);
+      report_created = TRUE;
+    }
+
     if(!report_created){
         continue;
     }
@@ -590,6 +615,7 @@ void _orp_add_rr(RcvController * this, Subflow *subflow)
   guint16 HSSN;
   guint32 LSR;
   guint32 DLSR;
+  guint32 recovered;
 
   mprtpr_path_get_regular_stats(subflow->path,
                              &HSSN,
@@ -631,12 +657,36 @@ void _orp_add_rr(RcvController * this, Subflow *subflow)
                          DLSR
                          );
 
+  //the losses of the subflow the FEC packets did not repair, the sender
+  //adapts the protection of the subflow to it. Subflows without FEC
+  //packets are not protected, the block is not sent for them.
+  if(this->fecdecoder && 0 < fecdecoder_get_subflow_fec_packets(this->fecdecoder, subflow->id)){
+    recovered = fecdecoder_get_subflow_recovered(this->fecdecoder, subflow->id);
+    report_producer_add_xr_discarded_packets(this->report_producer,
+                                             RTCP_XR_RFC7243_I_FLAG_CUMULATIVE_DURATION,
+                                             FALSE,
+                                             recovered < subflow->total_lost ? subflow->total_lost - recovered : 0);
+  }
+
   ricalcer_refresh_packets_rate(subflow->ricalcer, received, lost, lost);
 
 }
 
 
 //----------------------------- Logging service ------------------------------
+void _log_fecstat(guint32 total_rtp_rate, guint32 missing_rate, guint32 recovered_rate)
+{
+  MPRTPStatsRecord *record;
+  record = mprtp_stats_begin(MPRTP_STATS_FEC, 0);
+  if(!record){
+    return;
+  }
+  record->values[0].integer = total_rtp_rate;
+  record->values[1].integer = missing_rate;
+  record->values[2].integer = recovered_rate;
+  mprtp_stats_commit(record);
+}
+
 void
 _FECStat(RcvController * this)
 {
@@ -654,14 +704,14 @@ _FECStat(RcvController * this)
   oldest = slidingwindow_peek_oldest(this->fecstat);
   latest = slidingwindow_peek_latest(this->fecstat);
   if(!latest || !oldest){
-    mprtp_logger("fecstat.csv", "%u,%u,%u\n", 0, 0, 0);
+    _log_fecstat(0, 0, 0);
     return;
   }
 
   missing_rate   = latest->total_missing_packets - oldest->total_missing_packets;
   recovered_rate = latest->total_recovered_packets - oldest->total_recovered_packets;
   total_rtp_rate = latest->total_rtp_packets - oldest->total_rtp_packets;
-  mprtp_logger("fecstat.csv", "%u,%u,%u\n", total_rtp_rate, missing_rate, recovered_rate);
+  _log_fecstat(total_rtp_rate, missing_rate, recovered_rate);
   this->last_fecstat = _now(this);
 }
 
@@ -698,10 +748,9 @@ Subflow *
 _make_subflow (guint8 id, MpRTPRPath * path)
 {
   Subflow *result                   = _subflow_ctor ();
-  result->sysclock                  = gst_system_clock_obtain ();
   result->path                      = g_object_ref (path);;
   result->id                        = id;
-  result->joined_time               = gst_clock_get_time (result->sysclock);
+  result->joined_time               = mprtp_clock_get_time();
   result->ricalcer                  = make_ricalcer(FALSE);
   result->LRR                       = _now(result);
   result->do_fb                     = _default_do_fb;
@@ -717,7 +766,6 @@ _ruin_subflow (gpointer * subflow)
   Subflow *this;
   g_return_if_fail (subflow);
   this = (Subflow *) subflow;
-  g_object_unref (this->sysclock);
   g_object_unref (this->path);
   g_object_unref (this->ricalcer);
   _subflow_dtor (this);
@@ -18,6 +18,8 @@
 #include "reportprod.h"
 #include "reportproc.h"
 #include "fecdec.h"
+#include "nacktracker.h"
+#include "timerwheel.h"
 
 typedef struct _RcvController RcvController;
 typedef struct _RcvControllerClass RcvControllerClass;
@@ -34,13 +36,12 @@ struct _RcvController
 {
   GObject          object;
 
-  GstTask*          thread;
-  GRecMutex         thread_mutex;
+  TimerWheel*       timerwheel;
+  TimerWheelTimer*  ticker;
 
   GHashTable*       subflows;
   GRWLock           rwmutex;
   GstClockTime      made;
-  GstClock*         sysclock;
   StreamJoiner*     joiner;
   guint32           ssrc;
   void            (*send_mprtcp_packet_func)(gpointer,GstBuffer*);
@@ -51,7 +52,9 @@ struct _RcvController
   ReportProcessor*  report_processor;
 
   FECDecoder*       fecdecoder;
+  NACKTracker*      nacktracker;
   guint             orp_tick;
+  gdouble           owd_rel_accuracy;
 
   SlidingWindow*    fecstat;
   GstClockTime      last_fecstat;
@@ -70,6 +73,14 @@ void rcvctrler_setup(RcvController *this,
                      StreamJoiner* splitter,
                      FECDecoder*   fecdecoder);
 
+void rcvctrler_setup_nack_tracker(RcvController *this,
+                                  NACKTracker*   nacktracker);
+
+//The relative error the feedback producers track the OWD median with,
+//0 tracks the exact one. The producers made afterwards use it.
+void rcvctrler_setup_owd_accuracy(RcvController *this,
+                                  gdouble owd_rel_accuracy);
+
 void
 rcvctrler_change_interval_type(
     RcvController * this,
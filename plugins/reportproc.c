@@ -24,6 +24,7 @@
 #include <gst/rtp/gstrtpbuffer.h>
 #include <gst/rtp/gstrtcpbuffer.h>
 #include "reportproc.h"
+#include "mprtpclock.h"
 #include "gstmprtcpbuffer.h"
 #include "mprtprpath.h"
 #include <math.h>
@@ -47,7 +48,7 @@ GST_DEBUG_CATEGORY_STATIC (report_processor_debug_category);
 
 G_DEFINE_TYPE (ReportProcessor, report_processor, G_TYPE_OBJECT);
 
-#define _now(this) (gst_clock_get_time (this->sysclock))
+#define _now(this) mprtp_clock_get_time()
 
 //----------------------------------------------------------------------
 //-------- Private functions belongs to Scheduler tree object ----------
@@ -85,6 +86,11 @@ _processing_afb (ReportProcessor *this,
                  GstRTCPFB *afb,
                  GstMPRTCPReportSummary* summary);
 
+static void
+_processing_nack (ReportProcessor *this,
+                  GstRTCPNACK *nack,
+                  GstMPRTCPReportSummary* summary);
+
 static void
 _processing_xr_owd_block (
     ReportProcessor *this,
@@ -145,7 +151,6 @@ void
 report_processor_finalize (GObject * object)
 {
   ReportProcessor *this = REPORTPROCESSOR (object);
-  g_object_unref (this->sysclock);
 }
 
 void
@@ -153,7 +158,6 @@ report_processor_init (ReportProcessor * this)
 {
   g_rw_lock_init (&this->rwmutex);
 
-  this->sysclock   = gst_system_clock_obtain ();
   this->ssrc       = g_random_int();
   this->made       = _now(this);
 
@@ -232,6 +236,9 @@ again:
       if(rsvd == GST_RTCP_PSFB_TYPE_AFB){
         GstRTCPFB *afb = (GstRTCPFB*) header;
         _processing_afb(this, afb, summary);
+      }else if(rsvd == GST_RTCP_RTPFB_TYPE_NACK){
+        GstRTCPNACK *nack = (GstRTCPNACK*) header;
+        _processing_nack(this, nack, summary);
       }
       break;
     case GST_RTCP_TYPE_RR:
@@ -339,6 +346,31 @@ _processing_afb (ReportProcessor *this,
                                 &summary->AFB.fci_length);
 }
 
+void
+_processing_nack (ReportProcessor *this,
+                  GstRTCPNACK *nack,
+                  GstMPRTCPReportSummary* summary)
+{
+  guint i, fcis_num, bit;
+  guint16 pid, blp;
+
+  summary->NACK.processed = TRUE;
+  gst_rtcp_nack_getdown(nack, NULL, &summary->NACK.media_source_ssrc);
+  fcis_num = gst_rtcp_nack_get_fcis_num(nack);
+  for(i = 0; i < fcis_num; ++i){
+    gst_rtcp_nack_getdown_fci(nack, i, &pid, &blp);
+    if(MPRTCP_NACK_MAX_SEQS <= summary->NACK.seqs_num){
+      break;
+    }
+    summary->NACK.seqs[summary->NACK.seqs_num++] = pid;
+    for(bit = 0; bit < 16 && summary->NACK.seqs_num < MPRTCP_NACK_MAX_SEQS; ++bit){
+      if(blp & (1 << bit)){
+        summary->NACK.seqs[summary->NACK.seqs_num++] = pid + bit + 1;
+      }
+    }
+  }
+}
+
 
 void
 _processing_xr_owd_block (ReportProcessor *this,
@@ -61,6 +61,9 @@ typedef struct _GstMPRTCPXRReportSummary{
   }DiscardedPackets;
 }GstMPRTCPXRReportSummary;
 
+//A generic NACK item identifies at most 17 packets
+#define MPRTCP_NACK_MAX_SEQS 544
+
 struct _GstMPRTCPReportSummary{
   GstClockTime        created;
   GstClockTime        updated;
@@ -93,6 +96,14 @@ struct _GstMPRTCPReportSummary{
     gchar             fci_data[1400];
     guint             fci_length;
   }AFB;
+
+  //subflow sequence numbers of the packets the receiver lost
+  struct{
+    gboolean          processed;
+    guint32           media_source_ssrc;
+    guint16           seqs[MPRTCP_NACK_MAX_SEQS];
+    guint             seqs_num;
+  }NACK;
 };
 
 
@@ -101,7 +112,6 @@ struct _ReportProcessor
 {
   GObject                  object;
   GRWLock                  rwmutex;
-  GstClock*                sysclock;
   GstClockTime             made;
   guint32                  ssrc;
   gsize                    length;
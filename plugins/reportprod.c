@@ -24,6 +24,7 @@
 #include <gst/rtp/gstrtpbuffer.h>
 #include <gst/rtp/gstrtcpbuffer.h>
 #include "reportprod.h"
+#include "mprtpclock.h"
 #include "gstmprtcpbuffer.h"
 #include "mprtprpath.h"
 #include "streamjoiner.h"
@@ -49,7 +50,7 @@ GST_DEBUG_CATEGORY_STATIC (report_producer_debug_category);
 
 G_DEFINE_TYPE (ReportProducer, report_producer, G_TYPE_OBJECT);
 
-#define _now(this) (gst_clock_get_time (this->sysclock))
+#define _now(this) mprtp_clock_get_time()
 
 //----------------------------------------------------------------------
 //-------- Private functions belongs to Scheduler tree object ----------
@@ -101,7 +102,6 @@ void
 report_producer_finalize (GObject * object)
 {
   ReportProducer *this = REPORTPRODUCER (object);
-  g_object_unref (this->sysclock);
   mprtp_free(this->databed);
   mprtp_free(this->xr.databed);
 }
@@ -111,7 +111,6 @@ report_producer_init (ReportProducer * this)
 {
   g_rw_lock_init (&this->rwmutex);
 
-  this->sysclock        = gst_system_clock_obtain ();
   this->ssrc            = g_random_int();
   this->report          = this->databed = mprtp_malloc(DATABED_LENGTH);
   this->made            = _now(this);
@@ -321,6 +320,37 @@ void report_producer_add_afb_reps(
 }
 
 
+void report_producer_add_nack(ReportProducer *this,
+                              guint32 media_source_ssrc,
+                              guint16 *seqs,
+                              guint seqs_num)
+{
+  GstRTCPNACK *nack;
+  guint16 length, pid, blp, diff;
+  guint i;
+
+  THIS_WRITELOCK(this);
+  nack = this->actual;
+  gst_rtcp_nack_init(nack);
+  gst_rtcp_nack_change(nack, &this->ssrc, &media_source_ssrc);
+  for(i = 0; i < seqs_num && gst_rtcp_nack_get_fcis_num(nack) < REPORT_PRODUCER_MAX_NACK_FCIS; ){
+    pid = seqs[i++];
+    blp = 0;
+    //the following lost packets within 16 are in the bitmask of the pid
+    for(; i < seqs_num; ++i){
+      diff = seqs[i] - pid;
+      if(diff < 1 || 16 < diff){
+        break;
+      }
+      blp |= 1 << (diff - 1);
+    }
+    gst_rtcp_nack_add_fci(nack, pid, blp);
+  }
+  gst_rtcp_header_getdown (&nack->header, NULL, NULL, NULL, NULL, &length, NULL);
+  _add_length(this, length);
+  THIS_WRITEUNLOCK(this);
+}
+
 
 void report_producer_add_sr(ReportProducer *this,
                                 guint64 ntp_timestamp,
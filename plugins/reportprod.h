@@ -31,7 +31,6 @@ struct _ReportProducer
   GObject                  object;
   GRWLock                  rwmutex;
   GstClockTime             made;
-  GstClock*                sysclock;
   guint32                  ssrc;
   gpointer                 databed;
   gchar                    logfile[255];
@@ -107,6 +106,14 @@ void report_producer_add_afb_reps(ReportProducer *this,
                                   guint8 sampling_num,
                                   gfloat float_num);
 
+//The sequence numbers are packed into at most
+//REPORT_PRODUCER_MAX_NACK_FCIS generic NACK items, the rest is dropped
+#define REPORT_PRODUCER_MAX_NACK_FCIS 32
+void report_producer_add_nack(ReportProducer *this,
+                              guint32 media_source_ssrc,
+                              guint16 *seqs,
+                              guint seqs_num);
+
 void report_producer_add_sr(ReportProducer *this,
                                 guint64 ntp_timestamp,
                                 guint32 rtp_timestamp,
@@ -24,6 +24,7 @@
 #include <gst/rtp/gstrtpbuffer.h>
 #include <gst/rtp/gstrtcpbuffer.h>
 #include "ricalcer.h"
+#include "mprtpclock.h"
 //#include "mprtpspath.h"
 #include <math.h>
 #include <gst/gst.h>
@@ -37,7 +38,7 @@
 GST_DEBUG_CATEGORY_STATIC (ricalcer_debug_category);
 #define GST_CAT_DEFAULT ricalcer_debug_category
 
-#define _now(this) (gst_clock_get_time (this->sysclock))
+#define _now(this) mprtp_clock_get_time()
 
 #define THIS_READLOCK(this) g_rw_lock_reader_lock(&this->rwmutex)
 #define THIS_READUNLOCK(this) g_rw_lock_reader_unlock(&this->rwmutex)
@@ -89,7 +90,6 @@ ricalcer_finalize (GObject * object)
 {
   ReportIntervalCalculator * this;
   this = RICALCER(object);
-  g_object_unref(this->sysclock);
 }
 
 void ricalcer_set_mode(ReportIntervalCalculator *this, RTCPIntervalMode mode)
@@ -120,7 +120,6 @@ ricalcer_init (ReportIntervalCalculator * this)
   this->max_interval = 1.5;
   this->base_interval = 1.5;
   this->min_interval = .5;
-  this->sysclock = gst_system_clock_obtain();
   g_rw_lock_init (&this->rwmutex);
 }
 
@@ -40,7 +40,6 @@ struct _ReportIntervalCalculator
   gdouble          max_interval;
   gdouble          min_interval;
   gdouble          base_interval;
-  GstClock*        sysclock;
   gdouble          actual_interval;
   GstClockTime     urgent_time;
 
@@ -0,0 +1,294 @@
+/* GStreamer Retransmission history
+ * Copyright (C) 2015 Balázs Kreith (contact: balazs.kreith@gmail.com)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "rtxhistory.h"
+#include "mprtpclock.h"
+#include <gst/rtp/gstrtpbuffer.h>
+#include <string.h>
+
+#define THIS_LOCK(this) g_mutex_lock(&this->mutex)
+#define THIS_UNLOCK(this) g_mutex_unlock(&this->mutex)
+
+#define _now(this) mprtp_clock_get_time()
+#define _item_of(this, subflow_id, seq) (this->items[subflow_id] + ((seq) % RTXHISTORY_LENGTH))
+
+GST_DEBUG_CATEGORY_STATIC (rtxhistory_debug_category);
+#define GST_CAT_DEFAULT rtxhistory_debug_category
+
+G_DEFINE_TYPE (RTXHistory, rtxhistory, G_TYPE_OBJECT);
+
+//----------------------------------------------------------------------
+//-------- Private functions belongs to the object ----------
+//----------------------------------------------------------------------
+
+static void rtxhistory_finalize (GObject * object);
+static void _clear(RTXHistory *this);
+
+//----------------------------------------------------------------------
+//--------- Private functions implementations to the object --------
+//----------------------------------------------------------------------
+
+void
+rtxhistory_class_init (RTXHistoryClass * klass)
+{
+  GObjectClass *gobject_class;
+
+  gobject_class = (GObjectClass *) klass;
+
+  gobject_class->finalize = rtxhistory_finalize;
+
+  GST_DEBUG_CATEGORY_INIT (rtxhistory_debug_category, "rtxhistory", 0,
+      "MpRTP Retransmission History");
+}
+
+void
+rtxhistory_finalize (GObject * object)
+{
+  RTXHistory *this = RTXHISTORY (object);
+  guint i;
+  _clear(this);
+  for(i = 0; i < MPRTP_PLUGIN_MAX_SUBFLOW_NUM; ++i){
+    g_free(this->items[i]);
+  }
+  g_mutex_clear(&this->mutex);
+}
+
+void
+rtxhistory_init (RTXHistory * this)
+{
+  g_mutex_init(&this->mutex);
+  this->payload_type = RTX_PAYLOAD_DEFAULT_ID;
+  this->deadline     = 0;
+}
+
+RTXHistory *make_rtxhistory(void)
+{
+  return g_object_new (RTXHISTORY_TYPE, NULL);
+}
+
+void rtxhistory_set_payload_type(RTXHistory *this, guint8 payload_type)
+{
+  THIS_LOCK(this);
+  this->payload_type = payload_type;
+  THIS_UNLOCK(this);
+}
+
+void rtxhistory_set_deadline(RTXHistory *this, GstClockTime deadline)
+{
+  THIS_LOCK(this);
+  this->deadline = deadline;
+  if(!deadline){
+    _clear(this);
+  }
+  THIS_UNLOCK(this);
+}
+
+gboolean rtxhistory_is_enabled(RTXHistory *this)
+{
+  return 0 < this->deadline;
+}
+
+void rtxhistory_add(RTXHistory *this, guint8 subflow_id, guint16 subflow_seq,
+                    GstBuffer *buffer, GstClockTime sent)
+{
+  RTXHistoryItem *item;
+  if(G_LIKELY(!this->deadline) || MPRTP_PLUGIN_MAX_SUBFLOW_NUM <= subflow_id){
+    return;
+  }
+  THIS_LOCK(this);
+  if(!this->items[subflow_id]){
+    this->items[subflow_id] = g_malloc0(sizeof(RTXHistoryItem) * RTXHISTORY_LENGTH);
+  }
+  item = _item_of(this, subflow_id, subflow_seq);
+  if(item->buffer){
+    gst_buffer_unref(item->buffer);
+  }
+  item->buffer      = gst_buffer_ref(buffer);
+  item->subflow_seq = subflow_seq;
+  item->sent        = sent;
+  THIS_UNLOCK(this);
+}
+
+void rtxhistory_request(RTXHistory *this, guint8 subflow_id, guint16 *seqs, guint seqs_num)
+{
+  guint i;
+  if(!this->deadline){
+    return;
+  }
+  THIS_LOCK(this);
+  for(i = 0; i < seqs_num; ++i){
+    ++this->requested;
+    if(this->requests_write - this->requests_read == RTXHISTORY_MAX_REQUESTS){
+      //the oldest request would most likely expire anyway
+      ++this->requests_read;
+      ++this->expired;
+    }
+    this->requests[this->requests_write++ % RTXHISTORY_MAX_REQUESTS] = (guint32) subflow_id << 16 | seqs[i];
+  }
+  THIS_UNLOCK(this);
+}
+
+gboolean rtxhistory_has_requests(RTXHistory *this)
+{
+  gboolean result;
+  THIS_LOCK(this);
+  result = this->requests_read != this->requests_write;
+  THIS_UNLOCK(this);
+  return result;
+}
+
+GstBuffer *rtxhistory_pop(RTXHistory *this, GstClockTime *sent)
+{
+  RTXHistoryItem *item;
+  GstBuffer *result = NULL;
+  guint32 request;
+  guint8 subflow_id;
+  guint16 subflow_seq;
+  GstClockTime now;
+
+  now = _now(this);
+  THIS_LOCK(this);
+  while(!result && this->requests_read != this->requests_write){
+    request     = this->requests[this->requests_read++ % RTXHISTORY_MAX_REQUESTS];
+    subflow_id  = request >> 16;
+    subflow_seq = request & 0xFFFF;
+    if(MPRTP_PLUGIN_MAX_SUBFLOW_NUM <= subflow_id || !this->items[subflow_id]){
+      ++this->missing;
+      continue;
+    }
+    item = _item_of(this, subflow_id, subflow_seq);
+    if(!item->buffer || item->subflow_seq != subflow_seq){
+      ++this->missing;
+      continue;
+    }
+    if(item->sent + this->deadline < now){
+      ++this->expired;
+      continue;
+    }
+    result = gst_buffer_ref(item->buffer);
+    *sent  = item->sent;
+  }
+  THIS_UNLOCK(this);
+  return result;
+}
+
+GstBuffer *rtxhistory_make_rtx_packet(RTXHistory *this, GstBuffer *buffer)
+{
+  GstRTPBuffer src = GST_RTP_BUFFER_INIT;
+  GstRTPBuffer dst = GST_RTP_BUFFER_INIT;
+  GstBuffer *result;
+  guint8 *payload;
+  guint payload_len, csrc_count, i;
+  guint16 osn;
+
+  if (G_UNLIKELY (!gst_rtp_buffer_map (buffer, GST_MAP_READ, &src))) {
+    GST_WARNING_OBJECT (this, "The RTP packet is not readable");
+    return NULL;
+  }
+  payload_len = gst_rtp_buffer_get_payload_len(&src);
+  csrc_count  = gst_rtp_buffer_get_csrc_count(&src);
+  result = gst_rtp_buffer_new_allocate(payload_len + 2, 0, csrc_count);
+  gst_rtp_buffer_map(result, GST_MAP_WRITE, &dst);
+
+  //the SSRC and the sequence number are kept, see rtxhistory.h
+  osn = gst_rtp_buffer_get_seq(&src);
+  gst_rtp_buffer_set_payload_type(&dst, this->payload_type);
+  gst_rtp_buffer_set_seq(&dst, osn);
+  gst_rtp_buffer_set_ssrc(&dst, gst_rtp_buffer_get_ssrc(&src));
+  gst_rtp_buffer_set_timestamp(&dst, gst_rtp_buffer_get_timestamp(&src));
+  gst_rtp_buffer_set_marker(&dst, gst_rtp_buffer_get_marker(&src));
+  for(i = 0; i < csrc_count; ++i){
+    gst_rtp_buffer_set_csrc(&dst, i, gst_rtp_buffer_get_csrc(&src, i));
+  }
+  payload = gst_rtp_buffer_get_payload(&dst);
+  osn = g_htons(osn);
+  memcpy(payload, &osn, 2);
+  memcpy(payload + 2, gst_rtp_buffer_get_payload(&src), payload_len);
+
+  gst_rtp_buffer_unmap(&dst);
+  gst_rtp_buffer_unmap(&src);
+  GST_BUFFER_PTS(result) = GST_BUFFER_PTS(buffer);
+  GST_BUFFER_DTS(result) = GST_BUFFER_DTS(buffer);
+  return result;
+}
+
+gboolean rtxhistory_approve(RTXHistory *this, GstClockTime sent, GstClockTime owd)
+{
+  gboolean result = FALSE;
+  GstClockTime now;
+
+  now = _now(this);
+  THIS_LOCK(this);
+  if(!GST_CLOCK_TIME_IS_VALID(owd)){
+    ++this->refused;
+    goto done;
+  }
+  result = now + owd <= sent + this->deadline;
+  if(result){
+    ++this->retransmitted;
+  }else{
+    ++this->expired;
+  }
+done:
+  THIS_UNLOCK(this);
+  return result;
+}
+
+gchar *rtxhistory_get_stats(RTXHistory *this)
+{
+  gchar *result;
+  THIS_LOCK(this);
+  result = g_strdup_printf("requested,retransmitted,missing,expired,refused\n%u,%u,%u,%u,%u\n",
+                           this->requested,
+                           this->retransmitted,
+                           this->missing,
+                           this->expired,
+                           this->refused);
+  THIS_UNLOCK(this);
+  return result;
+}
+
+void _clear(RTXHistory *this)
+{
+  RTXHistoryItem *item;
+  guint i, j;
+  for(i = 0; i < MPRTP_PLUGIN_MAX_SUBFLOW_NUM; ++i){
+    if(!this->items[i]){
+      continue;
+    }
+    for(j = 0; j < RTXHISTORY_LENGTH; ++j){
+      item = this->items[i] + j;
+      if(item->buffer){
+        gst_buffer_unref(item->buffer);
+        item->buffer = NULL;
+      }
+    }
+  }
+  this->requests_read = this->requests_write;
+}
+
+#undef _item_of
+#undef _now
+#undef THIS_LOCK
+#undef THIS_UNLOCK
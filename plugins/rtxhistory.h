@@ -0,0 +1,99 @@
+/*
+ * rtxhistory.h
+ *
+ *  Sender side history of the sent packets for retransmissions. The packets
+ *  are kept in a ring per subflow indexed by their subflow sequence number,
+ *  so a generic NACK of the receiver can be resolved without searching.
+ *  Retransmissions are RFC 4588 RTX packets: the payload starts with the
+ *  original sequence number. Unlike RFC 4588 the RTX packets keep the SSRC
+ *  and the sequence number of the original packet and are told apart by
+ *  their payload type only. They travel as MPRTP packets with a subflow
+ *  sequence number of their own, the NACKs and the receiver statistics use
+ *  that one, and the playouter restores or drops them, so no RTP element
+ *  sees them. An own SSRC would need the association to the media stream
+ *  signalled out of band (ssrc-group:FID) and would be dropped by the
+ *  pivot SSRC filter of the playouter. A disabled history does not hold
+ *  any packet.
+ */
+
+#ifndef RTXHISTORY_H_
+#define RTXHISTORY_H_
+
+#include <gst/gst.h>
+#include "gstmprtpbuffer.h"
+
+typedef struct _RTXHistory RTXHistory;
+typedef struct _RTXHistoryClass RTXHistoryClass;
+typedef struct _RTXHistoryItem RTXHistoryItem;
+
+#define RTXHISTORY_TYPE             (rtxhistory_get_type())
+#define RTXHISTORY(src)             (G_TYPE_CHECK_INSTANCE_CAST((src),RTXHISTORY_TYPE,RTXHistory))
+#define RTXHISTORY_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST((klass),RTXHISTORY_TYPE,RTXHistoryClass))
+#define RTXHISTORY_IS_SOURCE(src)          (G_TYPE_CHECK_INSTANCE_TYPE((src),RTXHISTORY_TYPE))
+#define RTXHISTORY_IS_SOURCE_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE((klass),RTXHISTORY_TYPE))
+#define RTXHISTORY_CAST(src)        ((RTXHistory *)(src))
+
+//Packets kept per subflow, older ones are overwritten
+#define RTXHISTORY_LENGTH 1024
+#define RTXHISTORY_MAX_REQUESTS 1024
+
+struct _RTXHistoryItem
+{
+  GstBuffer*               buffer;
+  guint16                  subflow_seq;
+  GstClockTime             sent;
+};
+
+struct _RTXHistory
+{
+  GObject                  object;
+  GMutex                   mutex;
+
+  guint8                   payload_type;
+  GstClockTime             deadline;
+
+  RTXHistoryItem*          items[MPRTP_PLUGIN_MAX_SUBFLOW_NUM];
+
+  //subflow_id << 16 | subflow_seq of the requested packets
+  guint32                  requests[RTXHISTORY_MAX_REQUESTS];
+  guint                    requests_read;
+  guint                    requests_write;
+
+  guint32                  requested;
+  guint32                  retransmitted;
+  guint32                  missing;
+  guint32                  expired;
+  guint32                  refused;
+};
+
+struct _RTXHistoryClass{
+  GObjectClass parent_class;
+};
+
+GType rtxhistory_get_type (void);
+
+RTXHistory *make_rtxhistory(void);
+void rtxhistory_set_payload_type(RTXHistory *this, guint8 payload_type);
+//The time a retransmission must arrive in after the original was sent,
+//0 disables the retransmissions and releases the kept packets
+void rtxhistory_set_deadline(RTXHistory *this, GstClockTime deadline);
+gboolean rtxhistory_is_enabled(RTXHistory *this);
+
+//Keeps a reference of the original packet sent at the given time
+void rtxhistory_add(RTXHistory *this, guint8 subflow_id, guint16 subflow_seq,
+                    GstBuffer *buffer, GstClockTime sent);
+void rtxhistory_request(RTXHistory *this, guint8 subflow_id, guint16 *seqs, guint seqs_num);
+gboolean rtxhistory_has_requests(RTXHistory *this);
+
+//Returns a reference to the original packet of the next request which is
+//kept and is not expired yet, or NULL if no request is left.
+GstBuffer *rtxhistory_pop(RTXHistory *this, GstClockTime *sent);
+GstBuffer *rtxhistory_make_rtx_packet(RTXHistory *this, GstBuffer *buffer);
+//Decides whether the retransmission arrives before the deadline over a path
+//having the given one way delay, GST_CLOCK_TIME_NONE means no path took it.
+gboolean rtxhistory_approve(RTXHistory *this, GstClockTime sent, GstClockTime owd);
+
+//CSV: requested,retransmitted,missing,expired,refused
+gchar *rtxhistory_get_stats(RTXHistory *this);
+
+#endif /* RTXHISTORY_H_ */
@@ -24,7 +24,9 @@
 #include <gst/rtp/gstrtpbuffer.h>
 #include <gst/rtp/gstrtcpbuffer.h>
 #include "screamsubctrler.h"
+#include "mprtpclock.h"
 #include "gstmprtcpbuffer.h"
+#include "mprtplogger.h"
 #include <math.h>
 #include <string.h>
 #include <stdio.h>
@@ -46,92 +48,16 @@ GST_DEBUG_CATEGORY_STATIC (screamsubctrler_debug_category);
 
 G_DEFINE_TYPE (SCREAMSubController, screamsubctrler, G_TYPE_OBJECT);
 
-/* Timestamp sampling rate for SCReAM feedback*/
-#define TIMESTAMP_RATE 1000.0f
+//The congestion window and the pacing itself is implemented by
+//GstScreamController. This object only translates the subflow
+//reports and the path events into the calls it expects.
 
-/*
- * A few switches to make debugging easier
- * Open a full congestion window
- */
-#define OPEN_CWND FALSE
-
-/*
- * Some good to have features, SCReAM works also with these disabled
- * Enable shared bottleneck detection and OWD target adjustement
- * good if SCReAM needs to compete with e.g FTP but
- * Can in some cases cause self-inflicted congestion
- */
-#define ENABLE_SBD TRUE
-/* Fast start can resume if little or no congestion detected */
-#define ENABLE_CONSECUTIVE_FAST_START TRUE
-/* Packet pacing reduces jitter */
-#define ENABLE_PACKET_PACING TRUE
-
-/*
- * ==== Main tuning parameters (if tuning necessary) ====
- * Most important parameters first
- * Typical frame period
- */
-#define FRAME_PERIOD 0.040f
-/* Max video rampup speed in bps/s (bits per second increase per second) */
-#define RAMP_UP_SPEED 200000.0f // bps/s
-/* CWND scale factor upon loss event */
-#define LOSS_BETA 0.6f
-/*
- * Compensation factor for RTP queue size
- * A higher value such as 0.2 gives less jitter esp. in wireless (LTE)
- * but potentially also lower link utilization
- */
-#define TX_QUEUE_SIZE_FACTOR 1.0f
-/*
- * Compensation factor for detected congestion in rate computation
- * A higher value such as 0.2 gives less jitter esp. in wireless (LTE)
- * but potentially also lower link utilization
- */
-#define OWD_GUARD 0.2f
-
-/* Video rate scaling due to loss events */
-#define LOSS_EVENT_RATE_SCALE 0.9f
-/*
- * Additional send window slack (if no or little congestion detected)
- * An increased value such as 0.5 can improve transmission of Key frames
- * however with a higher risk of unstable behavior in
- * sudden congestion situations
- */
-#define BYTES_IN_FLIGHT_SLACK 0.0f
-/* Rate adjust interval */
-#define RATE_ADJUST_INTERVAL 200000 /* us */
-
-/* ==== Less important tuning parameters ==== */
-/* Min pacing interval and min pacing rate*/
-#define MIN_PACE_INTERVAL 0.00f    /* s */
-#define MINIMUM_PACE_BANDWIDTH 50000.0f /* bps */
-/* Initial MSS */
-#define INIT_MSS 100
-/* Initial CWND */
-#define INIT_CWND 5000
-/* CWND up and down gain factors */
-#define CWND_GAIN_UP 1.0f
-#define CWND_GAIN_DOWN 1.0f
-/* Min and max OWD target */
-#define OWD_TARGET_MIN 0.1f /* ms */
-#define OWD_TARGET_MAX 0.4f /* ms */
-/* Congestion window validation */
-#define BYTES_IN_FLIGHT_HIST_INTERVAL 1000000 /* Time (us) between stores */
-#define MAX_BYTES_IN_FLIGHT_HEADROOM 1.0f
-/* OWD trend and shared bottleneck detection */
-#define OWD_FRACTION_HIST_INTERVAL 50000 /* us */
-/* Max video rate estimation update period */
-#define RATE_UPDATE_INTERVAL 50000  /* us */
-
-/*
- * When the queued time is > than MAX_RTP_QUEUE_TIME the queue time is emptied. This allow for faster
- * "catching up" when the throughput drops from a very high to a very low value
- */
-#define MAX_RTP_QUEUE_TIME 0.5f
+//Bounds of the target bitrate SCReAM may request for one subflow
+#define SCREAM_MIN_BITRATE 64000
+#define SCREAM_MAX_BITRATE 20000000
+#define SCREAM_PRIORITY 1.0f
+#define SCREAM_LOG_INTERVAL GST_SECOND
 
-/* Just a high timer.. */
-#define DONT_APPROVE_TRANSMIT_TIME 10000000
 
 
 typedef struct _Private{
@@ -139,6 +65,9 @@ typedef struct _Private{
 }Private;
 
 #define _priv(this) ((Private*)this->priv)
+#define _now_us(this) (GST_TIME_AS_USECONDS(_now(this)))
+#define SCREAM_LOCK(this) g_mutex_lock(&this->scream->lock)
+#define SCREAM_UNLOCK(this) g_mutex_unlock(&this->scream->lock)
 
 //----------------------------------------------------------------------
 //-------- Private functions belongs to Scheduler tree object ----------
@@ -146,14 +75,16 @@ typedef struct _Private{
 
  void screamsubctrler_finalize (GObject * object);
 
+static void _on_bitrate_change(guint bitrate, guint stream_id, gpointer data);
+static guint _get_next_packet_size(guint stream_id, gpointer data);
+static void _approve_transmit(guint stream_id, gpointer data);
+static void _clear_queue(guint stream_id, gpointer data);
+static void _packet_sent(gpointer data, guint payload_len, guint16 sn, guint32 rtp_timestamp);
+static guint _get_feedback_timestamp(SCREAMSubController *this,
+                                     GstMPRTCPReportSummary *summary,
+                                     guint16 highest_seq);
 
-// const gdouble ST_ = 1.1; //Stable treshold
-// const gdouble OT_ = 2.;  //Overused treshold
-// const gdouble DT_ = 1.5; //Down Treshold
-
-
-
-#define _now(this) (gst_clock_get_time(this->sysclock))
+#define _now(this) mprtp_clock_get_time()
 
 //----------------------------------------------------------------------
 //--------- Private functions implementations to SchTree object --------
@@ -178,8 +109,8 @@ screamsubctrler_finalize (GObject * object)
 {
   SCREAMSubController *this;
   this = SCREAMSUBCTRLER(object);
+  g_object_unref(this->scream);
   mprtp_free(this->priv);
-  g_object_unref(this->sysclock);
   g_object_unref(this->path);
 }
 
@@ -187,16 +118,36 @@ void
 screamsubctrler_init (SCREAMSubController * this)
 {
   this->priv = mprtp_malloc(sizeof(Private));
-  this->sysclock = gst_system_clock_obtain();
+  this->scream = g_object_new(GST_SCREAM_TYPE_CONTROLLER, NULL);
   g_rw_lock_init (&this->rwmutex);
 
 }
 
 
-gboolean screamsubctrler_path_approver(gpointer data, GstBuffer *buffer)
+gboolean screamsubctrler_path_approver(gpointer data, GstRTPBuffer *rtp)
 {
-//  SCREAMSubController *this = data;
-  return TRUE;
+  SCREAMSubController *this = data;
+  gboolean result;
+
+  if(!this->enabled){
+    return TRUE;
+  }
+
+  SCREAM_LOCK(this);
+  this->pending_size = gst_rtp_buffer_get_payload_len(rtp);
+  this->approved = FALSE;
+  //The bytes in queue are not known at the path level,
+  //so the packet we are asked about stands for the queue.
+  //It is accounted only when it is sent, the splitter
+  //may ask again or pick another path.
+  gst_scream_controller_set_bytes_in_queue(this->scream,
+                                           this->id,
+                                           this->pending_size);
+  gst_scream_controller_approve_transmits(this->scream, _now_us(this));
+  result = this->approved;
+  this->approved = FALSE;
+  SCREAM_UNLOCK(this);
+  return result;
 }
 
 SCREAMSubController *make_screamsubctrler(MPRTPSPath *path)
@@ -208,39 +159,169 @@ SCREAMSubController *make_screamsubctrler(MPRTPSPath *path)
   result->made                = _now(result);
   mprtps_path_set_state(result->path, MPRTPS_PATH_STATE_STABLE);
 
+  gst_scream_controller_register_new_stream(result->scream,
+                                            result->id,
+                                            SCREAM_PRIORITY,
+                                            SCREAM_MIN_BITRATE,
+                                            SCREAM_MAX_BITRATE,
+                                            _on_bitrate_change,
+                                            _get_next_packet_size,
+                                            _approve_transmit,
+                                            _clear_queue,
+                                            result);
+
   return result;
 }
 
 void screamsubctrler_enable(SCREAMSubController *this)
 {
-
+  this->enabled = TRUE;
+  this->last_log = _now(this);
+  mprtps_path_set_packetstracker(this->path, _packet_sent, this);
 }
 
 void screamsubctrler_disable(SCREAMSubController *this)
 {
-
+  mprtps_path_set_state(this->path, MPRTPS_PATH_STATE_STABLE);
+  mprtps_path_set_packetstracker(this->path, NULL, NULL);
+  this->enabled = FALSE;
 }
 
 void screamsubctrler_time_update(SCREAMSubController *this)
 {
+  if(!this->enabled || _now(this) < this->last_log + SCREAM_LOG_INTERVAL){
+    goto done;
+  }
+  this->last_log = _now(this);
+
+  SCREAM_LOCK(this);
+  mprtp_logger("screamsubctrler.log",
+               "sub: %-2d|TR: %-7d|cwnd: %-7u|BiF: %-7u|owd: %-3.3f|srtt: %-5" G_GUINT64_FORMAT "|fast start: %d\n",
+               this->id,
+               mprtps_path_get_target_bitrate(this->path),
+               this->scream->cwnd,
+               this->scream->bytes_in_flight,
+               this->scream->owd,
+               this->scream->srtt_us / 1000,
+               this->scream->in_fast_start);
+  SCREAM_UNLOCK(this);
+
+done:
+  return;
+}
 
+void screamsubctrler_report_update(
+                         SCREAMSubController *this,
+                         GstMPRTCPReportSummary *summary)
+{
+  guint16 highest_seq;
+  guint timestamp;
+
+  if(!this->enabled){
+    goto done;
+  }
+
+  //The losses are only known from the receiver reports,
+  //the XR discard RLE tells the newest acknowledged sequence faster.
+  if(summary->RR.processed){
+    this->last_cum_packet_lost = summary->RR.cum_packet_lost;
+  }
+
+  if(summary->XR.DiscardedRLE.processed){
+    highest_seq = summary->XR.DiscardedRLE.end_seq;
+  }else if(summary->RR.processed){
+    highest_seq = summary->RR.HSSN;
+  }else{
+    goto done;
+  }
+
+  SCREAM_LOCK(this);
+  timestamp = _get_feedback_timestamp(this, summary, highest_seq);
+  gst_scream_controller_incoming_feedback(this->scream,
+                                          this->id,
+                                          _now_us(this),
+                                          timestamp,
+                                          highest_seq,
+                                          this->last_cum_packet_lost,
+                                          0,
+                                          FALSE);
+  SCREAM_UNLOCK(this);
+
+done:
+  return;
 }
 
-void screamsubctrler_signal_update(SCREAMSubController *this, MPRTPSubflowFECBasedRateAdaption *params)
+//SCReAM expects the receive time of the acknowledged packet in ms
+//on the sender clock. The subflow reports carry the one way delay
+//instead, so the send time of the packet is shifted by it.
+guint _get_feedback_timestamp(SCREAMSubController *this,
+                              GstMPRTCPReportSummary *summary,
+                              guint16 highest_seq)
 {
+  guint64 sent_us;
+  GstClockTime owd;
+
+  if(summary->XR.OWD.processed && summary->XR.OWD.median_delay){
+    owd = summary->XR.OWD.median_delay;
+  }else if(summary->RR.processed){
+    owd = summary->RR.RTT>>1;
+  }else{
+    owd = 0;
+  }
+
+  if(!gst_scream_controller_get_transmit_time(this->scream, this->id, highest_seq, &sent_us)){
+    sent_us = _now_us(this) - GST_TIME_AS_USECONDS(owd);
+  }
+  return (guint)((sent_us + GST_TIME_AS_USECONDS(owd)) / 1000);
+}
 
+void _on_bitrate_change(guint bitrate, guint stream_id, gpointer data)
+{
+  SCREAMSubController *this = data;
+  mprtps_path_set_target_bitrate(this->path, bitrate);
 }
 
-void screamsubctrler_signal_request(SCREAMSubController *this, MPRTPSubflowFECBasedRateAdaption *result)
+guint _get_next_packet_size(guint stream_id, gpointer data)
 {
+  SCREAMSubController *this = data;
+  return this->approved ? 0 : this->pending_size;
+}
 
+void _approve_transmit(guint stream_id, gpointer data)
+{
+  SCREAMSubController *this = data;
+  this->approved = TRUE;
 }
 
-void screamsubctrler_report_update(
-                         SCREAMSubController *this,
-                         GstMPRTCPReportSummary *summary)
+void _clear_queue(guint stream_id, gpointer data)
 {
+  //The packets are queued by the scheduler, not by the subflow
+}
 
+void _packet_sent(gpointer data, guint payload_len, guint16 sn, guint32 rtp_timestamp)
+{
+  SCREAMSubController *this = data;
+  SCREAM_LOCK(this);
+  gst_scream_controller_new_rtp_packet(this->scream,
+                                       this->id,
+                                       rtp_timestamp,
+                                       _now_us(this),
+                                       payload_len,
+                                       payload_len);
+  this->last_rtp_timestamp = rtp_timestamp;
+  gst_scream_controller_packet_transmitted(this->scream,
+                                           this->id,
+                                           payload_len,
+                                           sn,
+                                           _now_us(this));
+  SCREAM_UNLOCK(this);
 }
 
 
+#undef SCREAM_LOCK
+#undef SCREAM_UNLOCK
+#undef _now_us
+#undef THIS_READLOCK
+#undef THIS_READUNLOCK
+#undef THIS_WRITELOCK
+#undef THIS_WRITEUNLOCK
@@ -72,6 +72,8 @@ typedef struct _MPRTPSubflowUtilizationSignalData{
   guint                      controlling_mode;
   gint8                      path_state;
   gint32                     target_bitrate;
+  //packets left earlier than their pace, as the backlog got too long
+  guint32                    pacing_overflows;
   MPRTPSubflowRateController ratectrler;
 }MPRTPSubflowUtilizationSignalData;
 
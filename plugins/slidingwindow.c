@@ -24,10 +24,11 @@
 #include <gst/rtp/gstrtpbuffer.h>
 #include <gst/rtp/gstrtcpbuffer.h>
 #include "slidingwindow.h"
+#include "mprtpclock.h"
 #include <math.h>
 #include <string.h>
 
-#define _now(this) (gst_clock_get_time (this->sysclock))
+#define _now(this) mprtp_clock_get_time()
 
 GST_DEBUG_CATEGORY_STATIC (slidingwindow_debug_category);
 #define GST_CAT_DEFAULT coslidingwindow_debug_category
@@ -233,7 +234,6 @@ SlidingWindow* make_slidingwindow(guint32 num_limit, GstClockTime obsolation_tre
   }
 
   result->items            = datapuffer_ctor(num_limit);
-  result->sysclock         = gst_system_clock_obtain();
   result->treshold         = obsolation_treshold;
   result->num_limit        = result->num_act_limit = num_limit;
   result->allocator.active = FALSE;
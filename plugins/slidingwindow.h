@@ -44,7 +44,6 @@ struct _SlidingWindow
   GObject                  object;
   datapuffer_t*            items;
   gint                     min_itemnum;
-  GstClock*                sysclock;
   GstClockTime             treshold;
   gint32                   num_limit;
   gint32                   num_act_limit;
@@ -24,6 +24,7 @@
 #include <gst/rtp/gstrtpbuffer.h>
 #include <gst/rtp/gstrtcpbuffer.h>
 #include "sndctrler.h"
+#include "mprtpclock.h"
 #include "streamsplitter.h"
 #include "gstmprtcpbuffer.h"
 #include <math.h>
@@ -35,6 +36,7 @@
 #endif
 #include "ricalcer.h"
 #include "subratectrler.h"
+#include "fecsubctrler.h"
 #include <stdlib.h>
 
 #define THIS_READLOCK(this) g_rw_lock_reader_lock(&this->rwmutex)
@@ -51,7 +53,7 @@
 GST_DEBUG_CATEGORY_STATIC (sndctrler_debug_category);
 #define GST_CAT_DEFAULT sndctrler_debug_category
 
-#define _now(this) (gst_clock_get_time (this->sysclock))
+#define _now(this) mprtp_clock_get_time()
 
 G_DEFINE_TYPE (SndController, sndctrler, G_TYPE_OBJECT);
 
@@ -91,6 +93,7 @@ struct _Subflow
   MPRTPSPath*                path;
   ReportIntervalCalculator*  ricalcer;
   SubflowRateController*     rate_controller;
+  FECSubController*          fec_controller;
 
   GstClockTime               joined_time;
   GstClockTime               last_SR_report_sent;
@@ -215,11 +218,10 @@ void
 sefctrler_finalize (GObject * object)
 {
   SndController *this = SNDCTRLER (object);
+  timerwheel_remove (this->timerwheel, this->ticker);
+  g_object_unref (this->timerwheel);
   g_hash_table_destroy (this->subflows);
-  gst_task_stop (this->thread);
-  gst_task_join (this->thread);
 
-  g_object_unref (this->sysclock);
 
   mprtp_free(this->mprtp_signal_data);
 }
@@ -227,23 +229,21 @@ sefctrler_finalize (GObject * object)
 void
 sndctrler_init (SndController * this)
 {
-  this->sysclock = gst_system_clock_obtain ();
   this->subflows = g_hash_table_new_full (NULL, NULL,
       NULL, (GDestroyNotify) _ruin_subflow);
   this->subflow_num = 0;
   this->report_is_flowable = FALSE;
   this->report_producer    = g_object_new(REPORTPRODUCER_TYPE, NULL);
   this->report_processor   = g_object_new(REPORTPROCESSOR_TYPE, NULL);
-  this->thread             = gst_task_new (sndctrler_ticker_run, this, NULL);
+  this->timerwheel         = timerwheel_obtain ();
   this->made               = _now(this);
   this->mprtp_signal_data  = mprtp_malloc(sizeof(MPRTPPluginSignalData));
 
   report_processor_set_logfile(this->report_processor, "snd_reports.log");
   report_producer_set_logfile(this->report_producer, "snd_produced_reports.log");
   g_rw_lock_init (&this->rwmutex);
-  g_rec_mutex_init (&this->thread_mutex);
-  gst_task_set_lock (this->thread, &this->thread_mutex);
-  gst_task_start (this->thread);
+  this->ticker = timerwheel_add_periodic (this->timerwheel, 100 * GST_MSECOND,
+                                          sndctrler_ticker_run, this);
 
 
 }
@@ -296,6 +296,9 @@ static void _change_controlling_mode(Subflow *this, guint controlling_mode)
     case 2:
       subratectrler_change(this->rate_controller, SUBRATECTRLER_FBRA);
       break;
+    case 3:
+      subratectrler_change(this->rate_controller, SUBRATECTRLER_SCREAM);
+      break;
     default:
       g_warning("Unknown controlling mode requested for subflow %d", this->id);
       break;
@@ -343,6 +346,37 @@ void sndctrler_setup_report_timeout(SndController * this, guint8 subflow_id, Gst
 }
 
 
+void sndctrler_setup_fec_budget(SndController * this, guint fec_budget)
+{
+  Subflow *subflow;
+  GHashTableIter iter;
+  gpointer key, val;
+
+  THIS_WRITELOCK (this);
+  this->fec_budget = fec_budget;
+  g_hash_table_iter_init (&iter, this->subflows);
+  while (g_hash_table_iter_next (&iter, (gpointer) & key, (gpointer) & val)) {
+    subflow = (Subflow *) val;
+    fecsubctrler_set_budget(subflow->fec_controller, fec_budget);
+  }
+  THIS_WRITEUNLOCK (this);
+}
+
+void sndctrler_setup_owd_accuracy(SndController * this, gdouble owd_rel_accuracy)
+{
+  Subflow *subflow;
+  GHashTableIter iter;
+  gpointer key, val;
+
+  THIS_WRITELOCK (this);
+  this->owd_rel_accuracy = owd_rel_accuracy;
+  g_hash_table_iter_init (&iter, this->subflows);
+  while (g_hash_table_iter_next (&iter, (gpointer) & key, (gpointer) & val)) {
+    subflow = (Subflow *) val;
+    subratectrler_set_owd_accuracy(subflow->rate_controller, owd_rel_accuracy);
+  }
+  THIS_WRITEUNLOCK (this);
+}
 
 static void _fec_rate_refresh_per_subflow(Subflow *subflow, gpointer data)
 {
@@ -428,6 +462,14 @@ sndctrler_setup (SndController   *this,
   THIS_WRITEUNLOCK (this);
 }
 
+void
+sndctrler_setup_rtx_history (SndController *this, RTXHistory *rtxhistory)
+{
+  THIS_WRITELOCK (this);
+  this->rtxhistory = rtxhistory;
+  THIS_WRITEUNLOCK (this);
+}
+
 
 void
 sndctrler_setup_callbacks(SndController *this,
@@ -470,9 +512,7 @@ sndctrler_report_can_flow (SndController *this)
 void
 sndctrler_ticker_run (void *data)
 {
-  GstClockTime next_scheduler_time;
   SndController *this;
-  GstClockID clock_id;
 
   this = SNDCTRLER (data);
 
@@ -488,19 +528,8 @@ sndctrler_ticker_run (void *data)
   _emit_signal(this);//<-This usually takes 1-10ms
 //  _system_notifier_main(this);
 
-  next_scheduler_time = _now(this) + 100 * GST_MSECOND;
   ++this->ticknum;
   THIS_WRITEUNLOCK (this);
-
-
-  clock_id = gst_clock_new_single_shot_id (this->sysclock, next_scheduler_time);
-
-  if (gst_clock_id_wait (clock_id, NULL) == GST_CLOCK_UNSCHEDULED) {
-    GST_WARNING_OBJECT (this, "The playout clock wait is interrupted");
-  }
-  gst_clock_id_unref (clock_id);
-
-  //clockshot;
 }
 //----------------------------------------------------------------------------
 
@@ -560,6 +589,7 @@ _time_update (Subflow * subflow, gpointer data)
   subratectrler_signal_request(subflow->rate_controller, &subsignal->ratectrler);
   subsignal->path_state     = mprtps_path_get_state(subflow->path);
   subsignal->target_bitrate = mprtps_path_get_target_bitrate(subflow->path);
+  subsignal->pacing_overflows = mprtps_path_get_pacing_overflows(subflow->path);
 }
 
 
@@ -599,6 +629,15 @@ sndctrler_receive_mprtcp (SndController *this, GstBuffer * buf)
     goto done;
   }
 
+  //retransmissions are requested regardless of the controlling mode
+  if(summary->NACK.processed && this->rtxhistory){
+    rtxhistory_request(this->rtxhistory, summary->subflow_id,
+                       summary->NACK.seqs, summary->NACK.seqs_num);
+  }
+
+  //the FEC protection follows the losses regardless of the controlling mode
+  fecsubctrler_report_update(subflow->fec_controller, summary);
+
   if(!subflow->controlling_mode){
     goto done;
   }
@@ -737,6 +776,7 @@ void _process_regular_reports(SndController* this, Subflow *subflow, GstMPRTCPRe
     report = &subflowdata->receiver_report;
     report->HSSN = summary->RR.HSSN;
     report->RTT = summary->RR.RTT;
+    mprtps_path_set_rtt(subflow->path, summary->RR.RTT);
     report->cum_packet_lost = summary->RR.cum_packet_lost;
     report->cycle_num = summary->RR.cycle_num;
     report->lost_rate = summary->RR.lost_rate;
@@ -796,6 +836,7 @@ _ruin_subflow (gpointer subflow)
   this = (Subflow *) subflow;
   g_object_unref (this->path);
   g_object_unref(this->rate_controller);
+  g_object_unref(this->fec_controller);
   _subflow_dtor (this);
 }
 
@@ -810,6 +851,9 @@ _make_subflow (SndController * this, guint8 id, MPRTPSPath * path)
   result->joined_time     = _now(this);
   result->ricalcer        = make_ricalcer(TRUE);
   result->rate_controller = make_subratectrler(path);
+  subratectrler_set_owd_accuracy(result->rate_controller, this->owd_rel_accuracy);
+  result->fec_controller  = make_fecsubctrler(path);
+  fecsubctrler_set_budget(result->fec_controller, this->fec_budget);
   _reset_subflow (result);
   return result;
 }
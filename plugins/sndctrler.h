@@ -18,7 +18,9 @@
 #include "reportprod.h"
 #include "reportproc.h"
 #include "fecenc.h"
+#include "rtxhistory.h"
 #include "signalreport.h"
+#include "timerwheel.h"
 
 typedef struct _SndController SndController;
 typedef struct _SndControllerClass SndControllerClass;
@@ -37,14 +39,13 @@ struct _SndController
 {
   GObject                    object;
 
-  GstTask*                   thread;
+  TimerWheel*                timerwheel;
+  TimerWheelTimer*           ticker;
   GstClockTime               made;
-  GRecMutex                  thread_mutex;
   GHashTable*                subflows;
   GRWLock                    rwmutex;
   ReportProcessor*           report_processor;
   ReportProducer*            report_producer;
-  GstClock*                  sysclock;
   GstClockTime               expected_lost_detected;
   guint64                    ticknum;
   guint                      subflow_num;
@@ -59,6 +60,10 @@ struct _SndController
   FECEncoder*                fecencoder;
   guint32                    fec_sum_bitrate;
   guint32                    fec_sum_packetsrate;
+  guint                      fec_budget;
+  gdouble                    owd_rel_accuracy;
+
+  RTXHistory*                rtxhistory;
 
   gint32                     target_bitrate_t1;
   gint32                     target_bitrate;
@@ -81,6 +86,9 @@ void sndctrler_setup(SndController* this,
                      SendingRateDistributor *pacer,
                      FECEncoder* fecencoder);
 
+void sndctrler_setup_rtx_history(SndController* this,
+                                 RTXHistory* rtxhistory);
+
 void
 sndctrler_setup_callbacks(SndController *this,
                           gpointer mprtcp_send_data,
@@ -106,6 +114,18 @@ void sndctrler_setup_report_timeout(
     guint8 subflow_id,
     GstClockTime report_timeout);
 
+//The FEC overhead the subflows may spend against their losses in the
+//percent of their target bitrate, 0 disables the loss adaptive FEC
+void sndctrler_setup_fec_budget(
+    SndController * this,
+    guint fec_budget);
+
+//The relative error the subflow controllers track the long term OWD with,
+//0 tracks the exact percentile. The controllers made afterwards use it.
+void sndctrler_setup_owd_accuracy(
+    SndController * this,
+    gdouble owd_rel_accuracy);
+
 void
 sndctrler_rem_path (SndController *controller_ptr, guint8 subflow_id);
 void
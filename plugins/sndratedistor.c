@@ -24,6 +24,7 @@
 #include <gst/rtp/gstrtpbuffer.h>
 #include <gst/rtp/gstrtcpbuffer.h>
 #include "sndratedistor.h"
+#include "mprtpclock.h"
 #include <math.h>
 #include <gst/gst.h>
 #include <stdlib.h>
@@ -40,7 +41,7 @@ GST_DEBUG_CATEGORY_STATIC (sndrate_distor_debug_category);
 #define THIS_WRITELOCK(this) g_rw_lock_writer_lock(&this->rwmutex)
 #define THIS_WRITEUNLOCK(this) g_rw_lock_writer_unlock(&this->rwmutex)
 
-#define _now(this) gst_clock_get_time (this->sysclock)
+#define _now(this) mprtp_clock_get_time()
 
 G_DEFINE_TYPE (SendingRateDistributor, sndrate_distor, G_TYPE_OBJECT);
 
@@ -102,7 +103,6 @@ sndrate_distor_finalize (GObject * object)
 {
   SendingRateDistributor * this;
   this = SNDRATEDISTOR(object);
-  g_object_unref(this->sysclock);
   mprtp_free(this->subflows);
 }
 
@@ -110,7 +110,6 @@ sndrate_distor_finalize (GObject * object)
 void
 sndrate_distor_init (SendingRateDistributor * this)
 {
-  this->sysclock = gst_system_clock_obtain();
   this->subflows = g_hash_table_new_full (NULL, NULL, NULL, _ruin_subflow);
   g_rw_lock_init (&this->rwmutex);
 
@@ -28,7 +28,6 @@ struct _SendingRateDistributor
 {
   GObject                   object;
   GRWLock                   rwmutex;
-  GstClock*                 sysclock;
   GHashTable*               subflows;
 
   StreamSplitter*           splitter;
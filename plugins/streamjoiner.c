@@ -24,6 +24,7 @@
 #include <gst/rtp/gstrtpbuffer.h>
 #include <gst/rtp/gstrtcpbuffer.h>
 #include "streamjoiner.h"
+#include "mprtpclock.h"
 #include "gstmprtpbuffer.h"
 #include <math.h>
 #include <stdlib.h>
@@ -54,7 +55,7 @@ GST_DEBUG_CATEGORY_STATIC (stream_joiner_debug_category);
 #define THIS_WRITELOCK(this) g_rw_lock_writer_lock(&this->rwmutex)
 #define THIS_WRITEUNLOCK(this) g_rw_lock_writer_unlock(&this->rwmutex)
 
-#define _now(this) gst_clock_get_time (this->sysclock)
+#define _now(this) mprtp_clock_get_time()
 
 #define MAX_TRESHOLD_TIME 200 * GST_MSECOND
 #define MIN_TRESHOLD_TIME 10 * GST_MSECOND
@@ -137,8 +138,10 @@ stream_joiner_finalize (GObject * object)
 {
   StreamJoiner *this = STREAM_JOINER (object);
   g_hash_table_destroy (this->subflows);
-  g_object_unref (this->sysclock);
   g_object_unref(this->rcvqueue);
+  if(this->tracer){
+    g_object_unref(this->tracer);
+  }
 }
 //
 //static void _iterate_subflows(StreamJoiner *this, void(*iterator)(Subflow *, gpointer), gpointer data)
@@ -181,7 +184,6 @@ static void _delays_stat_pipe(gpointer udata, swpercentilecandidates_t* candidat
 void
 stream_joiner_init (StreamJoiner * this)
 {
-  this->sysclock           = gst_system_clock_obtain ();
   this->subflows           = g_hash_table_new_full (NULL, NULL, NULL, _ruin_subflow);
   this->made               = _now(this);
   this->join_delay         = 0;
@@ -244,11 +246,23 @@ transfer:
     g_slice_free(Packet, packet);
     this->HFSN = mprtp->abs_seq;
     this->HFSN_initialized = TRUE;
+    if(this->tracer){
+      latencytracer_stamp(this->tracer, mprtp->abs_seq, this->tracer_stage);
+    }
     packetsrcvqueue_push(this->rcvqueue, mprtp);
   }
   THIS_WRITEUNLOCK (this);
 }
 
+gboolean stream_joiner_is_empty(StreamJoiner *this)
+{
+  gboolean result;
+  THIS_READLOCK (this);
+  result = g_queue_is_empty(this->packets_by_seq);
+  THIS_READUNLOCK (this);
+  return result;
+}
+
 static gint _packets_queue_sort_helper(gconstpointer a, gconstpointer b, gpointer user_data)
 {
   const Packet *ai = a;
@@ -256,10 +270,11 @@ static gint _packets_queue_sort_helper(gconstpointer a, gconstpointer b, gpointe
   return _cmp_seq(ai->mprtp->abs_seq, bi->mprtp->abs_seq);
 }
 
-void stream_joiner_push(StreamJoiner * this, GstMpRTPBuffer *mprtp)
+gboolean stream_joiner_push(StreamJoiner * this, GstMpRTPBuffer *mprtp)
 {
   Subflow *subflow;
   Packet* packet;
+  gboolean result = TRUE;
 
   THIS_WRITELOCK(this);
   mprtp->buffer = gst_buffer_ref(mprtp->buffer);
@@ -276,6 +291,7 @@ void stream_joiner_push(StreamJoiner * this, GstMpRTPBuffer *mprtp)
 //  g_print("%d bytes: %u\n", subflow->id, subflow->payload_bytes);
   if(this->HFSN_initialized && _cmp_seq(mprtp->abs_seq, this->HFSN) < 0){
     packetsrcvqueue_push_discarded(this->rcvqueue, mprtp);
+    result = FALSE;
     goto done;
   }
   packet = g_slice_new0(Packet);
@@ -283,6 +299,10 @@ void stream_joiner_push(StreamJoiner * this, GstMpRTPBuffer *mprtp)
   packet->mprtp    = mprtp;
   g_queue_push_tail(this->packets_by_arrival, packet);
   g_queue_insert_sorted(this->packets_by_seq, packet, _packets_queue_sort_helper, NULL);
+  this->held_sum       += this->packets_by_seq->length;
+  this->held_max        = MAX(this->held_max, this->packets_by_seq->length);
+  this->join_delay_sum += this->join_delay;
+  ++this->samples_num;
 
   if(!mprtpr_path_is_in_spike_mode(subflow->path)){
 //      g_print("path not in spike mode: %d\n", subflow->id);
@@ -293,6 +313,7 @@ void stream_joiner_push(StreamJoiner * this, GstMpRTPBuffer *mprtp)
 
 done:
   THIS_WRITEUNLOCK(this);
+  return result;
 }
 
 void
@@ -330,6 +351,47 @@ stream_joiner_set_betha_factor (StreamJoiner * this, gdouble betha)
   THIS_WRITEUNLOCK (this);
 }
 
+GstClockTime
+stream_joiner_get_join_delay (StreamJoiner * this)
+{
+  GstClockTime result;
+  THIS_READLOCK (this);
+  result = this->join_delay;
+  THIS_READUNLOCK (this);
+  return result;
+}
+
+gchar*
+stream_joiner_get_stats (StreamJoiner * this)
+{
+  gchar *result;
+  gdouble samples_num;
+  THIS_WRITELOCK (this);
+  samples_num = MAX(1, this->samples_num);
+  result = g_strdup_printf("join_delay_us,held_packets_avg,held_packets_max,samples\n"
+                           "%.1f,%.2f,%u,%u\n",
+                           (gdouble) this->join_delay_sum / samples_num / GST_USECOND,
+                           (gdouble) this->held_sum / samples_num,
+                           this->held_max,
+                           this->samples_num);
+  this->held_sum = this->join_delay_sum = 0;
+  this->held_max = this->samples_num = 0;
+  THIS_WRITEUNLOCK (this);
+  return result;
+}
+
+void
+stream_joiner_set_tracer (StreamJoiner * this, LatencyTracer *tracer, guint stage)
+{
+  THIS_WRITELOCK (this);
+  if(this->tracer){
+    g_object_unref(this->tracer);
+  }
+  this->tracer       = tracer ? g_object_ref(tracer) : NULL;
+  this->tracer_stage = stage;
+  THIS_WRITEUNLOCK (this);
+}
+
 void
 stream_joiner_add_path (StreamJoiner * this, guint8 subflow_id,
     MpRTPRPath * path)
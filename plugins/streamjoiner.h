@@ -16,6 +16,7 @@ typedef struct _StreamJoiner StreamJoiner;
 typedef struct _StreamJoinerClass StreamJoinerClass;
 
 #include "mprtprpath.h"
+#include "latencytracer.h"
 
 #define STREAM_JOINER_TYPE             (stream_joiner_get_type())
 #define STREAM_JOINER(src)             (G_TYPE_CHECK_INSTANCE_CAST((src),STREAM_JOINER_TYPE,StreamJoiner))
@@ -34,7 +35,6 @@ typedef struct _StreamJoinerClass StreamJoinerClass;
 struct _StreamJoiner
 {
   GObject              object;
-  GstClock*            sysclock;
   GstClockTime         made;
   GHashTable*          subflows;
   gint                 subflow_num;
@@ -51,11 +51,18 @@ struct _StreamJoiner
   GQueue*              packets_by_arrival;
 
   PacketsRcvQueue*     rcvqueue;
+  LatencyTracer*       tracer;
+  guint                tracer_stage;
 
   gboolean             flush;
   gboolean             HFSN_initialized;
   guint16              HFSN;
 
+  //occupancy sampled at every push since the last stream_joiner_get_stats()
+  guint64              held_sum;
+  guint                held_max;
+  guint64              join_delay_sum;
+  guint32              samples_num;
 };
 struct _StreamJoinerClass{
   GObjectClass parent_class;
@@ -84,6 +91,23 @@ stream_joiner_set_betha_factor (
     StreamJoiner * this,
     gdouble betha);
 
+GstClockTime
+stream_joiner_get_join_delay (
+    StreamJoiner * this);
+
+//CSV lines of join_delay_us,held_packets_avg,held_packets_max,samples
+//averaged over the pushes since the last call
+gchar*
+stream_joiner_get_stats (
+    StreamJoiner * this);
+
+//Packets are stamped at the given stage when they are joined
+void
+stream_joiner_set_tracer (
+    StreamJoiner * this,
+    LatencyTracer *tracer,
+    guint stage);
+
 void
 stream_joiner_add_path(
     StreamJoiner * this,
@@ -95,7 +119,8 @@ stream_joiner_rem_path(
     StreamJoiner * this,
     guint8 subflow_id);
 
-void
+//Returns FALSE if the packet arrived too late to be joined
+gboolean
 stream_joiner_push(
     StreamJoiner * this,
     GstMpRTPBuffer *mprtp);
@@ -104,6 +129,10 @@ void
 stream_joiner_transfer(
     StreamJoiner *this);
 
+gboolean
+stream_joiner_is_empty(
+    StreamJoiner *this);
+
 
 void
 stream_joiner_set_playout_halt_time(
@@ -24,7 +24,9 @@
 #include <gst/rtp/gstrtpbuffer.h>
 #include <gst/rtp/gstrtcpbuffer.h>
 #include "streamsplitter.h"
+#include "mprtpclock.h"
 #include "mprtpspath.h"
+#include "gstmprtpbuffer.h"
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
@@ -38,18 +40,20 @@ GST_DEBUG_CATEGORY_STATIC (stream_splitter_debug_category);
 #define THIS_READUNLOCK(this) g_rw_lock_reader_unlock(&this->rwmutex)
 #define THIS_WRITELOCK(this) g_rw_lock_writer_lock(&this->rwmutex)
 #define THIS_WRITEUNLOCK(this) g_rw_lock_writer_unlock(&this->rwmutex)
-
-/* Evaluates to a mask with n bits set */
-#define BITS_MASK(n) ((1<<(n))-1)
-
-/* Returns len bits, with the LSB at position bit */
-#define BITS_GET(val, bit, len) (((val)>>(bit))&BITS_MASK(len))
+#define PACKET_LOCK(this) g_mutex_lock(&this->packet_mutex)
+#define PACKET_UNLOCK(this) g_mutex_unlock(&this->packet_mutex)
 
 /* class initialization */
 G_DEFINE_TYPE (StreamSplitter, stream_splitter, G_TYPE_OBJECT);
 
 typedef struct _Subflow Subflow;
 
+//Packets are not queued on a path for longer than this in the earliest
+//delivery mode, so it does not send above its target
+#define EARLIEST_DELIVERY_MAX_BACKLOG (100 * GST_MSECOND)
+//The one way delay of paths not having feedbacks yet
+#define EARLIEST_DELIVERY_DEFAULT_OWD (100 * GST_MSECOND)
+
 #define SUBFLOW_SCHEDULED_BYTES_LENGTH 100
 struct _Subflow
 {
@@ -60,7 +64,38 @@ struct _Subflow
   gint        weight_for_tree;
   gdouble     weight;
   gboolean    valid;
+};
 
+//The path the actual frame of a stream is sent on
+typedef struct _Frame
+{
+  guint32     timestamp;
+  //the node belongs to the snapshot of this version
+  guint32     version;
+  SchNode*    node;
+  guint       bytes;
+  //the frame type of the last packet restricted, it is detected from the
+  //first packet of the frame and the rest of the frame follows it
+  gboolean    key_seen;
+  guint16     key_seq;
+  guint32     key_timestamp;
+  gboolean    key_marker;
+  gboolean    keyframe;
+}Frame;
+
+//Not changed after it is published, except the byte counters of the tree
+//nodes the packet path writes under the packet lock
+struct _StreamSplitterSnapshot
+{
+  guint32     version;
+  guint       subflows_num;
+  //the tree nodes refer to these, every one holds a reference on its path
+  Subflow     subflows[MPRTP_PLUGIN_MAX_SUBFLOW_NUM];
+  SchNode*    tree;
+  guint8      max_flag;
+  guint       keyframe_filtering;
+  guint       frame_chunk_size;
+  gboolean    earliest_delivery;
 };
 
 struct _SchNode
@@ -90,7 +125,7 @@ typedef struct{
   SchNode *root;
 }CreateData;
 
-#define _now(this) gst_clock_get_time (this->sysclock)
+#define _now(this) mprtp_clock_get_time()
 //----------------------------------------------------------------------
 //-------- Private functions belongs to Scheduler tree object ----------
 //----------------------------------------------------------------------
@@ -102,7 +137,7 @@ stream_splitter_finalize (
 
 static void
 _iterate_subflows(
-    StreamSplitter *this,
+    StreamSplitterSnapshot *snapshot,
     void(*iterator)(Subflow *, gpointer),
     gpointer data);
 
@@ -135,7 +170,7 @@ _create_nodes(
 
 static SchNode *
 _tree_ctor (
-    StreamSplitter *this);
+    StreamSplitterSnapshot *snapshot);
 
 
 //Functions related to tree
@@ -163,7 +198,6 @@ _make_schnode(
 
 static void
 _schnode_rdtor (
-    StreamSplitter *this,
     SchNode * node);
 
 
@@ -173,6 +207,20 @@ _schtree_select_next (
     GstRTPBuffer * rtp,
     guint8 flag_restriction);
 
+static SchNode *
+_select_next (
+    StreamSplitter *this,
+    StreamSplitterSnapshot *snapshot,
+    GstRTPBuffer * rtp,
+    guint8 flag_restriction);
+
+static Subflow *
+_select_earliest_delivery (
+    StreamSplitter *this,
+    StreamSplitterSnapshot *snapshot,
+    GstRTPBuffer * rtp,
+    guint8 flag_restriction);
+
 
 static Subflow *
 _schtree_get_next (
@@ -185,37 +233,50 @@ _schtree_approve_next (
     SchNode * selected,
     guint bytes_to_send);
 
+static void
+_schtree_charge (
+    SchNode * root,
+    Subflow * subflow,
+    guint bytes_to_send);
+
 static void
 _refresh_splitter (
     StreamSplitter *this);
 
+static void
+_snapshot_dtor (
+    gpointer data);
+
 
 static Subflow *
 _make_subflow (
     MPRTPSPath * path);
 
+static Frame *
+_get_frame(
+    StreamSplitter * this,
+    guint32 ssrc);
+
 static guint8
 _get_key_restriction(
-    StreamSplitter *this,
-    GstRTPBuffer *rtp);
-
-static gboolean
-_vp8_keyframe_filter(
+    StreamSplitter * this,
+    StreamSplitterSnapshot *snapshot,
     GstRTPBuffer *rtp);
 
 static MPRTPSPath *
 _get_next_path (
     StreamSplitter * this,
+    StreamSplitterSnapshot *snapshot,
     GstRTPBuffer * rtp);
 
 static void
-_logging_csv(
-    gpointer data,
-    gchar *string);
+_logging_stats(
+    gpointer data);
 
 static void
 _logging(
-    gpointer data);
+    StreamSplitter *this,
+    StreamSplitterSnapshot *snapshot);
 
 
 
@@ -249,20 +310,28 @@ void
 stream_splitter_finalize (GObject * object)
 {
   StreamSplitter *this = STREAM_SPLITTER (object);
+  mprtp_logger_rem_stats_fnc(_logging_stats, this);
+  if(this->snapshot){
+    _snapshot_dtor(this->snapshot);
+  }
+  mprtp_epoch_clear(&this->epoch);
   g_hash_table_destroy (this->subflows);
-  g_object_unref (this->sysclock);
+  g_hash_table_destroy (this->frames);
+  g_mutex_clear(&this->packet_mutex);
 }
 
 
 void
 stream_splitter_init (StreamSplitter * this)
 {
-  this->sysclock = gst_system_clock_obtain ();
   this->subflows               = g_hash_table_new_full (NULL, NULL, NULL, mprtp_free);
+  this->frames                 = g_hash_table_new_full (NULL, NULL, NULL, mprtp_free);
   this->made                   = _now(this);
 
   g_rw_lock_init (&this->rwmutex);
-  mprtp_logger_add_logging_fnc(_logging_csv, this, "streamsplitter.csv");
+  g_mutex_init (&this->packet_mutex);
+  mprtp_epoch_init (&this->epoch, _snapshot_dtor);
+  mprtp_logger_add_stats_fnc(_logging_stats, this);
 }
 
 void
@@ -356,29 +425,35 @@ done:
 
 gdouble stream_splitter_get_sending_weight(StreamSplitter* this, guint8 subflow_id)
 {
-  Subflow *subflow;
+  StreamSplitterSnapshot *snapshot;
   gdouble result = 0.;
+  guint i;
+  //snapshots are replaced under the write lock only
   THIS_READLOCK(this);
-  subflow =
-        (Subflow *) g_hash_table_lookup (this->subflows,
-        GINT_TO_POINTER (subflow_id));
-  if(!subflow) goto done;
-  result = subflow->weight;
-done:
+  snapshot = this->snapshot;
+  for(i = 0; snapshot && i < snapshot->subflows_num; ++i){
+    if(snapshot->subflows[i].id == subflow_id){
+      result = snapshot->subflows[i].weight;
+      break;
+    }
+  }
   THIS_READUNLOCK(this);
   return result;
 }
 
-static void _refresh_targets(Subflow *subflow, gpointer data)
-{
-  subflow->sending_target = mprtps_path_get_target_bitrate(subflow->path);
-}
-
 void
 stream_splitter_refresh_targets (StreamSplitter * this)
 {
+  GHashTableIter iter;
+  gpointer key, val;
+  Subflow *subflow;
+
   THIS_WRITELOCK (this);
-  _iterate_subflows(this, _refresh_targets, NULL);
+  g_hash_table_iter_init (&iter, this->subflows);
+  while (g_hash_table_iter_next (&iter, (gpointer) & key, (gpointer) & val)) {
+    subflow = (Subflow *) val;
+    subflow->sending_target = mprtps_path_get_target_bitrate(subflow->path);
+  }
   _refresh_splitter(this);
   THIS_WRITEUNLOCK (this);
 }
@@ -396,6 +471,26 @@ stream_splitter_set_mpath_keyframe_filtering(StreamSplitter * this, guint keyfra
 {
   THIS_WRITELOCK (this);
   this->keyframe_filtering = keyframe_filtering;
+  _refresh_splitter(this);
+  THIS_WRITEUNLOCK (this);
+}
+
+void
+stream_splitter_set_frame_chunk_size(StreamSplitter * this, guint frame_chunk_size)
+{
+  THIS_WRITELOCK (this);
+  //the frames followed so far belong to the previous snapshot
+  this->frame_chunk_size = frame_chunk_size;
+  _refresh_splitter(this);
+  THIS_WRITEUNLOCK (this);
+}
+
+void
+stream_splitter_set_earliest_delivery(StreamSplitter * this, gboolean earliest_delivery)
+{
+  THIS_WRITELOCK (this);
+  this->earliest_delivery = earliest_delivery;
+  _refresh_splitter(this);
   THIS_WRITEUNLOCK (this);
 }
 
@@ -406,12 +501,16 @@ stream_splitter_approve_buffer(StreamSplitter * this, GstBuffer *buffer, MPRTPSP
   gboolean result;
   guint8 flag_restriction;
   SchNode *selected;
+  Subflow *subflow;
+  StreamSplitterSnapshot *snapshot;
+  gint epoch;
 
   result = FALSE;
   *path = NULL;
 
-  THIS_WRITELOCK (this);
-  if (this->tree == NULL) {
+  epoch    = mprtp_epoch_enter (&this->epoch);
+  snapshot = g_atomic_pointer_get (&this->snapshot);
+  if (snapshot == NULL || snapshot->tree == NULL) {
     GST_WARNING_OBJECT (this, "No active subflow");
     goto done;
   }
@@ -420,102 +519,209 @@ stream_splitter_approve_buffer(StreamSplitter * this, GstBuffer *buffer, MPRTPSP
     goto done;
   }
 
-  flag_restriction = _get_key_restriction(this, &rtp);
-  selected = _schtree_select_next(this->tree, &rtp, flag_restriction);
+  PACKET_LOCK (this);
+  flag_restriction = _get_key_restriction(this, snapshot, &rtp);
+  if(snapshot->earliest_delivery){
+    subflow = _select_earliest_delivery(this, snapshot, &rtp, flag_restriction);
+    result = subflow != NULL;
+    *path  = subflow ? subflow->path : NULL;
+    goto unmap;
+  }
+  selected = _select_next(this, snapshot, &rtp, flag_restriction);
   if(!selected){
-    gst_rtp_buffer_unmap (&rtp);
-    goto done;
+    goto unmap;
   }
 
   result = TRUE;
   *path = ((Subflow*)selected->subflows->data)->path;
 
   _schtree_approve_next(selected, gst_rtp_buffer_get_payload_len(&rtp));
+unmap:
+  PACKET_UNLOCK (this);
   gst_rtp_buffer_unmap (&rtp);
 done:
-  THIS_WRITEUNLOCK (this);
+  mprtp_epoch_leave (&this->epoch, epoch);
   return result;
 }
 
+gboolean
+stream_splitter_approve_lowdelay_buffer(StreamSplitter * this, GstBuffer *buffer, MPRTPSPath **path)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  Subflow *subflow, *selected = NULL;
+  GstClockTime rtt, selected_rtt = GST_CLOCK_TIME_NONE;
+  StreamSplitterSnapshot *snapshot;
+  gint epoch;
+  guint i;
+
+  *path = NULL;
+  epoch    = mprtp_epoch_enter (&this->epoch);
+  snapshot = g_atomic_pointer_get (&this->snapshot);
+  if (G_UNLIKELY (!gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp))) {
+    GST_WARNING_OBJECT (this, "The RTP packet is not readable");
+    mprtp_epoch_leave (&this->epoch, epoch);
+    return FALSE;
+  }
+  for (i = 0; snapshot && i < snapshot->subflows_num; ++i) {
+    subflow = snapshot->subflows + i;
+    if(!mprtps_path_is_active(subflow->path) || !mprtps_path_is_non_congested(subflow->path)){
+      continue;
+    }
+    //paths not reported yet come after the measured ones
+    rtt = mprtps_path_get_rtt(subflow->path);
+    rtt = rtt ? rtt : GST_CLOCK_TIME_NONE - 1;
+    if(selected_rtt <= rtt){
+      continue;
+    }
+    selected     = subflow;
+    selected_rtt = rtt;
+  }
+  if(selected && !mprtps_path_approve_request(selected->path, &rtp)){
+    selected = NULL;
+  }
+  if(selected){
+    *path = selected->path;
+    if(snapshot->tree){
+      PACKET_LOCK (this);
+      _schtree_charge(snapshot->tree, selected, gst_rtp_buffer_get_payload_len(&rtp));
+      PACKET_UNLOCK (this);
+    }
+  }
+  gst_rtp_buffer_unmap (&rtp);
+  mprtp_epoch_leave (&this->epoch, epoch);
+  if(!*path){
+    return stream_splitter_approve_buffer(this, buffer, path);
+  }
+  return TRUE;
+}
+
 GstBuffer *
 stream_splitter_pop(StreamSplitter * this, MPRTPSPath **out_path)
 {
   GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
   MPRTPSPath *path = NULL;
   GstBuffer *buffer = NULL;
-  THIS_WRITELOCK (this);
-  if (this->tree == NULL) {
+  StreamSplitterSnapshot *snapshot;
+  gint epoch;
+
+  epoch    = mprtp_epoch_enter (&this->epoch);
+  snapshot = g_atomic_pointer_get (&this->snapshot);
+  if (snapshot == NULL || snapshot->tree == NULL) {
     //Somewhere, over the rainbow a path may exist
     GST_WARNING_OBJECT (this, "No active subflow");
     goto done;
   }
+  PACKET_LOCK (this);
   buffer = packetssndqueue_peek(this->sndqueue);
   if(!buffer){
-    goto done;
+    goto unlock;
   }
   if (G_UNLIKELY (!gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp))) {
     GST_WARNING_OBJECT (this, "The RTP packet is not readable");
-    goto done;
+    goto unlock;
   }
 
-  path = _get_next_path (this, &rtp);
+  path = _get_next_path (this, snapshot, &rtp);
   gst_rtp_buffer_unmap (&rtp);
   *out_path = path;
   buffer = path ? packetssndqueue_pop(this->sndqueue) : NULL;
+unlock:
+  PACKET_UNLOCK (this);
 done:
-  THIS_WRITEUNLOCK (this);
+  mprtp_epoch_leave (&this->epoch, epoch);
   return buffer;
 }
 
 
+//Builds a new snapshot from the actual settings and publishes it. The
+//packets already in the splitter finish on the previous one, which is
+//reclaimed when the last of them left.
 void
 _refresh_splitter (StreamSplitter *this)
 {
-  if(this->tree){
-    _schnode_rdtor(this, this->tree);
-    this->tree = NULL;
+  StreamSplitterSnapshot *snapshot, *prev;
+  GHashTableIter iter;
+  gpointer key, val;
+  Subflow *subflow;
+
+  snapshot = mprtp_malloc(sizeof(StreamSplitterSnapshot));
+  snapshot->version            = ++this->version;
+  snapshot->keyframe_filtering = this->keyframe_filtering;
+  snapshot->frame_chunk_size   = this->frame_chunk_size;
+  snapshot->earliest_delivery  = this->earliest_delivery;
+
+  g_hash_table_iter_init (&iter, this->subflows);
+  while (g_hash_table_iter_next (&iter, (gpointer) & key, (gpointer) & val) &&
+         snapshot->subflows_num < MPRTP_PLUGIN_MAX_SUBFLOW_NUM) {
+    subflow = snapshot->subflows + snapshot->subflows_num++;
+    memcpy(subflow, val, sizeof(Subflow));
+    g_object_ref(subflow->path);
+  }
+  if(snapshot->subflows_num){
+    snapshot->tree = _tree_ctor(snapshot);
   }
 
-  if(!this->active_subflow_num){
-    goto done;
+  prev = this->snapshot;
+  g_atomic_pointer_set(&this->snapshot, snapshot);
+  if(prev){
+    mprtp_epoch_retire(&this->epoch, prev);
   }
+  _logging(this, snapshot);
+}
 
-  this->tree = _tree_ctor(this);
-  _logging(this);
-done:
-  return;
+void
+_snapshot_dtor (gpointer data)
+{
+  StreamSplitterSnapshot *snapshot = data;
+  guint i;
+  _schnode_rdtor(snapshot->tree);
+  for(i = 0; i < snapshot->subflows_num; ++i){
+    g_object_unref(snapshot->subflows[i].path);
+  }
+  mprtp_free(snapshot);
 }
 
 
-void _iterate_subflows(StreamSplitter *this, void(*iterator)(Subflow *, gpointer), gpointer data)
+void _iterate_subflows(StreamSplitterSnapshot *snapshot, void(*iterator)(Subflow *, gpointer), gpointer data)
 {
-  GHashTableIter iter;
-  gpointer key, val;
-  Subflow *subflow;
-
-  g_hash_table_iter_init (&iter, this->subflows);
-  while (g_hash_table_iter_next (&iter, (gpointer) & key, (gpointer) & val)) {
-    subflow = (Subflow *) val;
-    iterator(subflow, data);
+  guint i;
+  for(i = 0; i < snapshot->subflows_num; ++i){
+    iterator(snapshot->subflows + i, data);
   }
 }
 
 void _refresh_flags(Subflow *subflow, gpointer data)
 {
-  StreamSplitter * this = data;
+  StreamSplitterSnapshot *snapshot = data;
   subflow->flags_value = mprtps_path_get_flags(subflow->path);
-  this->max_flag = MAX(this->max_flag, subflow->flags_value);
+  snapshot->max_flag = MAX(snapshot->max_flag, subflow->flags_value);
 }
 
 MPRTPSPath *
-_get_next_path (StreamSplitter * this, GstRTPBuffer * rtp)
+_get_next_path (StreamSplitter * this, StreamSplitterSnapshot *snapshot, GstRTPBuffer * rtp)
 {
   Subflow *subflow = NULL;
 
+  SchNode *selected;
   guint8 flag_restriction;
-  flag_restriction = _get_key_restriction(this, rtp);
+  flag_restriction = _get_key_restriction(this, snapshot, rtp);
 
-  subflow = _schtree_get_next(this->tree, rtp, flag_restriction);
+  if(snapshot->earliest_delivery){
+    subflow = _select_earliest_delivery(this, snapshot, rtp, flag_restriction);
+    return subflow ? subflow->path : NULL;
+  }
+
+  if(snapshot->frame_chunk_size){
+    selected = _select_next(this, snapshot, rtp, flag_restriction);
+    if(!selected){
+      return NULL;
+    }
+    _schtree_approve_next(selected, gst_rtp_buffer_get_payload_len(rtp));
+    subflow = selected->subflows->data;
+    return subflow->path;
+  }
+
+  subflow = _schtree_get_next(snapshot->tree, rtp, flag_restriction);
   return subflow ? subflow->path : NULL;
 }
 
@@ -560,7 +766,7 @@ void _create_nodes(Subflow *subflow, gpointer data)
 }
 
 SchNode *
-_tree_ctor (StreamSplitter *this)
+_tree_ctor (StreamSplitterSnapshot *snapshot)
 {
   CreateData cdata;
   WeightData wdata;
@@ -569,30 +775,31 @@ _tree_ctor (StreamSplitter *this)
   sdata.valid = wdata.total_weight = 0;
   cdata.root = NULL;
   sdata.total = 0;
-  this->max_flag = 0;
-  _iterate_subflows(this, _refresh_flags, this);
-  _iterate_subflows(this, _summarize_sending_rates, &sdata);
+  snapshot->max_flag = 0;
+  _iterate_subflows(snapshot, _refresh_flags, snapshot);
+  _iterate_subflows(snapshot, _summarize_sending_rates, &sdata);
   sdata.valid = 0;
-  _iterate_subflows(this, _validate_sending_rates, &sdata);
+  _iterate_subflows(snapshot, _validate_sending_rates, &sdata);
   wdata.valid_sum = sdata.valid;
-  _iterate_subflows(this, _setup_sending_weights, &wdata);
+  _iterate_subflows(snapshot, _setup_sending_weights, &wdata);
   cdata.remained = SCHTREE_MAX_VALUE - wdata.total_weight;
   cdata.root = _make_schnode(SCHTREE_MAX_VALUE);
-  _iterate_subflows(this, _create_nodes, &cdata);
+  _iterate_subflows(snapshot, _create_nodes, &cdata);
   return cdata.root;
 }
 
 void
-_schnode_rdtor (StreamSplitter *this,SchNode * node)
+_schnode_rdtor (SchNode * node)
 {
   if (node == NULL) {
     return;
   }
-  _schnode_rdtor (this, node->left);
-  _schnode_rdtor (this, node->right);
+  _schnode_rdtor (node->left);
+  _schnode_rdtor (node->right);
 //  pointerpool_add(this->pointerpool, node);
 //  g_slice_free(SchNode, node);
 
+  g_list_free(node->subflows);
   mprtp_free(node);
 }
 
@@ -711,6 +918,110 @@ done:
 }
 
 
+//Packets of a frame follow the first one of the frame (or of the chunk)
+//while the path allows it. The tree still accounts every byte, so the next
+//frame goes to the path lagging behind its weight and the long run split
+//stays at the weights.
+SchNode *
+_select_next (StreamSplitter *this, StreamSplitterSnapshot *snapshot, GstRTPBuffer * rtp, guint8 flag_restriction)
+{
+  SchNode *selected;
+  Frame *frame;
+  guint32 ssrc, timestamp;
+
+  if(!snapshot->frame_chunk_size){
+    return _schtree_select_next(snapshot->tree, rtp, flag_restriction);
+  }
+  ssrc      = gst_rtp_buffer_get_ssrc(rtp);
+  timestamp = gst_rtp_buffer_get_timestamp(rtp);
+  frame     = _get_frame(this, ssrc);
+
+  //the node of a previous snapshot may be reclaimed already
+  if(frame->node && frame->version == snapshot->version &&
+     frame->timestamp == timestamp &&
+     frame->bytes < snapshot->frame_chunk_size &&
+     _allowed(frame->node, rtp, flag_restriction)){
+    selected = frame->node;
+    goto done;
+  }
+  selected = _schtree_select_next(snapshot->tree, rtp, flag_restriction);
+  if(!selected){
+    //retried later on the same path if that becomes allowed first
+    return NULL;
+  }
+  frame->timestamp = timestamp;
+  frame->version   = snapshot->version;
+  frame->bytes     = 0;
+done:
+  frame->bytes += gst_rtp_buffer_get_payload_len(rtp);
+  frame->node   = gst_rtp_buffer_get_marker(rtp) ? NULL : selected;
+  return selected;
+}
+
+
+static GstClockTime _owd_of(Subflow *subflow)
+{
+  GstClockTime owd;
+  owd = mprtps_path_get_owd(subflow->path);
+  if(!owd){
+    owd = mprtps_path_get_rtt(subflow->path) >> 1;
+  }
+  return owd ? owd : EARLIEST_DELIVERY_DEFAULT_OWD;
+}
+
+//Predicts the arrival of the packet on every path allowed for it as the
+//time the bytes already assigned to the path are sent by its target rate,
+//plus the time the packet itself takes, plus the OWD of the path. The path
+//having the earliest arrival is asked to approve the packet, the next
+//one if it refuses.
+Subflow *
+_select_earliest_delivery (StreamSplitter *this, StreamSplitterSnapshot *snapshot,
+    GstRTPBuffer * rtp, guint8 flag_restriction)
+{
+  Subflow *subflow, *candidates[MPRTP_PLUGIN_MAX_SUBFLOW_NUM];
+  GstClockTime now, start, arrivals[MPRTP_PLUGIN_MAX_SUBFLOW_NUM];
+  GstClockTime transmissions[MPRTP_PLUGIN_MAX_SUBFLOW_NUM];
+  guint i, selected, candidates_num = 0;
+  guint bytes;
+
+  now   = _now(this);
+  bytes = gst_rtp_buffer_get_payload_len(rtp);
+  for (i = 0; i < snapshot->subflows_num; ++i) {
+    subflow = snapshot->subflows + i;
+    if(subflow->sending_target <= 0 || subflow->flags_value < flag_restriction ||
+       !mprtps_path_is_active(subflow->path)){
+      continue;
+    }
+    start = MAX(now, this->busy_until[subflow->id]);
+    if(now + EARLIEST_DELIVERY_MAX_BACKLOG < start){
+      continue;
+    }
+    transmissions[candidates_num] = gst_util_uint64_scale(bytes * 8, GST_SECOND, subflow->sending_target);
+    arrivals[candidates_num]      = start + transmissions[candidates_num] + _owd_of(subflow);
+    candidates[candidates_num++]  = subflow;
+  }
+
+  while(candidates_num){
+    selected = 0;
+    for(i = 1; i < candidates_num; ++i){
+      if(arrivals[i] < arrivals[selected]){
+        selected = i;
+      }
+    }
+    subflow = candidates[selected];
+    if(mprtps_path_approve_request(subflow->path, rtp)){
+      this->busy_until[subflow->id] = MAX(now, this->busy_until[subflow->id]) + transmissions[selected];
+      return subflow;
+    }
+    --candidates_num;
+    candidates[selected]    = candidates[candidates_num];
+    arrivals[selected]      = arrivals[candidates_num];
+    transmissions[selected] = transmissions[candidates_num];
+  }
+  return NULL;
+}
+
+
 void
 _schtree_approve_next (SchNode * selected, guint bytes_to_send)
 {
@@ -720,6 +1031,27 @@ _schtree_approve_next (SchNode * selected, guint bytes_to_send)
   }
 }
 
+//Packets sent on a subflow past the tree are charged to the leaf of the
+//subflow being behind the most, so the tree keeps the shares of the others
+void
+_schtree_charge (SchNode * root, Subflow * subflow, guint bytes_to_send)
+{
+  SchNode *node, *left, *right;
+
+  node = root;
+  while (node->left != NULL || node->right != NULL) {
+    left  = node->left && g_list_find(node->left->subflows, subflow) ? node->left : NULL;
+    right = node->right && g_list_find(node->right->subflows, subflow) ? node->right : NULL;
+    if(!left && !right){
+      return;
+    }
+    node = !right ? left : !left ? right : left->sent_bytes <= right->sent_bytes ? left : right;
+  }
+  if(g_list_find(node->subflows, subflow)){
+    _schtree_approve_next(node, bytes_to_send);
+  }
+}
+
 
 Subflow *
 _schtree_get_next (SchNode * root, GstRTPBuffer * rtp, guint8 flag_restriction)
@@ -770,31 +1102,46 @@ _make_subflow (MPRTPSPath * path)
   return result;
 }
 
-guint8 _get_key_restriction(StreamSplitter *this, GstRTPBuffer *rtp)
+//Must be called under the packet lock
+Frame *_get_frame(StreamSplitter * this, guint32 ssrc)
 {
-  switch(this->keyframe_filtering){
-    case 1:
-      return _vp8_keyframe_filter(rtp) ? this->max_flag : 0;
-    case 0:
-    default:
-      return 0;
+  Frame *result;
+  result = g_hash_table_lookup(this->frames, GUINT_TO_POINTER(ssrc));
+  if(!result){
+    result = mprtp_malloc(sizeof(Frame));
+    g_hash_table_insert(this->frames, GUINT_TO_POINTER(ssrc), result);
   }
-  return 0;
+  return result;
 }
 
-gboolean
-_vp8_keyframe_filter(GstRTPBuffer *rtp)
+//Every packet of a keyframe is restricted, but the type is known from
+//the first packet of the frame only, so it is carried per SSRC as
+//packetssndqueue_push() does. A packet retried after no path approved it
+//gets the restriction it had. Must be called under the packet lock.
+guint8 _get_key_restriction(StreamSplitter * this, StreamSplitterSnapshot *snapshot, GstRTPBuffer *rtp)
 {
-  guint8 *p;
-  gboolean is_keyframe;
-  unsigned long raw;
-  p = gst_rtp_buffer_get_payload(rtp);
-  /* The frame header is defined as a three byte little endian
-  * value
-  */
-  raw = p[0] | (p[1] << 8) | (p[2] << 16);
-  is_keyframe     = !BITS_GET(raw, 0, 1);
-  return is_keyframe;
+  Frame *frame;
+  guint16 seq;
+  guint32 timestamp;
+
+  if(!snapshot->keyframe_filtering){
+    return 0;
+  }
+  frame     = _get_frame(this, gst_rtp_buffer_get_ssrc(rtp));
+  seq       = gst_rtp_buffer_get_seq(rtp);
+  timestamp = gst_rtp_buffer_get_timestamp(rtp);
+  if(frame->key_seen && frame->key_seq == seq){
+    goto done;
+  }
+  if(!frame->key_seen || frame->key_marker || frame->key_timestamp != timestamp){
+    frame->keyframe = gst_mprtp_is_keyframe(rtp, snapshot->keyframe_filtering);
+  }
+  frame->key_seen      = TRUE;
+  frame->key_seq       = seq;
+  frame->key_timestamp = timestamp;
+  frame->key_marker    = gst_rtp_buffer_get_marker(rtp);
+done:
+  return frame->keyframe ? snapshot->max_flag : 0;
 }
 
 
@@ -840,23 +1187,33 @@ static void _log_subflow(Subflow *subflow, gpointer data)
 
 }
 
-static void _log_subflow_csv(Subflow *subflow, gpointer data)
+static void _log_subflow_stats(Subflow *subflow, gpointer data)
 {
-  gchar appendum[255];
-  sprintf(appendum, "%f,", subflow->weight);
-  strcat((gchar*)data, appendum);
+  MPRTPStatsRecord *record;
+  record = mprtp_stats_begin(MPRTP_STATS_SPLITTER_WEIGHT, subflow->id);
+  if(!record){
+    return;
+  }
+  record->values[0].real = subflow->weight;
+  mprtp_stats_commit(record);
 }
 
-void _logging_csv(gpointer data, gchar* string)
+void _logging_stats(gpointer data)
 {
   StreamSplitter *this = data;
-  _iterate_subflows(this, _log_subflow_csv, string);
-  strcat(string, "\n");
+  StreamSplitterSnapshot *snapshot;
+  gint epoch;
+
+  epoch    = mprtp_epoch_enter (&this->epoch);
+  snapshot = g_atomic_pointer_get (&this->snapshot);
+  if(snapshot){
+    _iterate_subflows(snapshot, _log_subflow_stats, NULL);
+  }
+  mprtp_epoch_leave (&this->epoch, epoch);
 }
 
-void _logging(gpointer data)
+void _logging(StreamSplitter *this, StreamSplitterSnapshot *snapshot)
 {
-  StreamSplitter *this = data;
   mprtp_logger("streamsplitter.log",
                "###############################################################\n"
                "Seconds: %lu\n"
@@ -866,8 +1223,8 @@ void _logging(gpointer data)
                this->active_subflow_num
                );
 
-  _iterate_subflows(this, _log_subflow, this);
-  _log_tree(this->tree, SCHTREE_MAX_VALUE, 0);
+  _iterate_subflows(snapshot, _log_subflow, this);
+  _log_tree(snapshot->tree, SCHTREE_MAX_VALUE, 0);
 }
 
 
@@ -875,4 +1232,6 @@ void _logging(gpointer data)
 #undef THIS_READUNLOCK
 #undef THIS_WRITELOCK
 #undef THIS_WRITEUNLOCK
+#undef PACKET_LOCK
+#undef PACKET_UNLOCK
 #undef SCHTREE_MAX_VALUE
@@ -10,10 +10,12 @@
 
 #include <gst/gst.h>
 #include "mprtpspath.h"
+#include "mprtpepoch.h"
 
 typedef struct _StreamSplitter StreamSplitter;
 typedef struct _StreamSplitterClass StreamSplitterClass;
 typedef struct _StreamSplitterPrivate StreamSplitterPrivate;
+typedef struct _StreamSplitterSnapshot StreamSplitterSnapshot;
 typedef struct _SchNode SchNode;
 
 #define STREAM_SPLITTER_TYPE             (stream_splitter_get_type())
@@ -28,16 +30,35 @@ typedef struct _SchNode SchNode;
 struct _StreamSplitter
 {
   GObject              object;
+  //serializes the control threads and protects the settings below
   GRWLock              rwmutex;
-  GstClock*            sysclock;
   GstClockTime         made;
   GHashTable*          subflows;
-  SchNode*             tree;
   PacketsSndQueue*     sndqueue;
 
   guint                active_subflow_num;
-  guint8               max_flag;
   guint                keyframe_filtering;
+
+  //0 splits packet by packet, otherwise packets of one frame are sent on
+  //the same path in chunks of at most frame_chunk_size payload bytes
+  guint                frame_chunk_size;
+
+  //selects the path a packet is predicted to arrive first on instead of
+  //the scheduling tree
+  gboolean             earliest_delivery;
+
+  //the routing state the packets are split by, control threads build a
+  //new one for every change and publish it by swapping the pointer, so
+  //the packet path never waits for a rebuild
+  StreamSplitterSnapshot* volatile snapshot;
+  guint32              version;
+  MpRTPEpoch           epoch;
+
+  //the state only the packet path changes, control threads never take it
+  GMutex               packet_mutex;
+  GHashTable*          frames;
+  //indexed by the subflow id
+  GstClockTime         busy_until[G_MAXUINT8 + 1];
 };
 
 struct _StreamSplitterClass{
@@ -63,12 +84,30 @@ stream_splitter_set_mpath_keyframe_filtering(
     StreamSplitter * this,
     guint keyframe_filtering);
 
+void
+stream_splitter_set_frame_chunk_size(
+    StreamSplitter * this,
+    guint frame_chunk_size);
+
+void
+stream_splitter_set_earliest_delivery(
+    StreamSplitter * this,
+    gboolean earliest_delivery);
+
 gboolean
 stream_splitter_approve_buffer(
     StreamSplitter * this,
     GstBuffer *buf,
     MPRTPSPath **path);
 
+//Selects the active path having the lowest RTT instead of the
+//scheduling tree, falls back to the tree if that path does not approve.
+gboolean
+stream_splitter_approve_lowdelay_buffer(
+    StreamSplitter * this,
+    GstBuffer *buf,
+    MPRTPSPath **path);
+
 GstBuffer *
 stream_splitter_pop(
     StreamSplitter * this,
@@ -24,7 +24,9 @@
 #include <gst/rtp/gstrtpbuffer.h>
 #include <gst/rtp/gstrtcpbuffer.h>
 #include "subratectrler.h"
+#include "mprtpclock.h"
 #include "fbrasubctrler.h"
+#include "screamsubctrler.h"
 #include <math.h>
 #include <string.h>
 #include <stdio.h>
@@ -52,7 +54,7 @@ static void _enable(SubflowRateController *this);
 static void _disable(SubflowRateController *this);
 
 
-#define _now(this) (gst_clock_get_time(this->sysclock))
+#define _now(this) mprtp_clock_get_time()
 
 //----------------------------------------------------------------------
 //--------- Private functions implementations to SchTree object --------
@@ -77,14 +79,12 @@ subratectrler_finalize (GObject * object)
 {
   SubflowRateController *this;
   this = SUBRATECTRLER(object);
-  g_object_unref(this->sysclock);
   g_object_unref(this->path);
 }
 
 void
 subratectrler_init (SubflowRateController * this)
 {
-  this->sysclock = gst_system_clock_obtain();
   g_rw_lock_init (&this->rwmutex);
 
 }
@@ -100,6 +100,13 @@ SubflowRateController *make_subratectrler(MPRTPSPath *path)
   return result;
 }
 
+void subratectrler_set_owd_accuracy(SubflowRateController *this, gdouble owd_rel_accuracy)
+{
+  THIS_WRITELOCK(this);
+  this->owd_rel_accuracy = owd_rel_accuracy;
+  THIS_WRITEUNLOCK(this);
+}
+
 void subratectrler_time_update(SubflowRateController *this)
 {
   THIS_WRITELOCK(this);
@@ -111,6 +118,9 @@ void subratectrler_time_update(SubflowRateController *this)
     case SUBRATECTRLER_FBRA:
       fbrasubctrler_time_update(this->controller);
       break;
+    case SUBRATECTRLER_SCREAM:
+      screamsubctrler_time_update(this->controller);
+      break;
     default:
     case SUBRATECTRLER_NO_CTRL:
       goto done;
@@ -191,6 +201,9 @@ void subratectrler_report_update(
     case SUBRATECTRLER_FBRA:
       fbrasubctrler_report_update(this->controller, summary);
       break;
+    case SUBRATECTRLER_SCREAM:
+      screamsubctrler_report_update(this->controller, summary);
+      break;
     default:
     case SUBRATECTRLER_NO_CTRL:
       goto done;
@@ -217,6 +230,9 @@ gboolean subratectrler_packet_approver(
     case SUBRATECTRLER_FBRA:
       result = fbrasubctrler_path_approver(this->controller, rtp);
       break;
+    case SUBRATECTRLER_SCREAM:
+      result = screamsubctrler_path_approver(this->controller, rtp);
+      break;
     default:
     case SUBRATECTRLER_NO_CTRL:
       result = TRUE;
@@ -235,9 +251,15 @@ void _enable(SubflowRateController *this)
 {
   switch(this->type){
     case SUBRATECTRLER_FBRA:
-      this->controller = make_fbrasubctrler(this->path);
+      this->controller = make_fbrasubctrler(this->path, this->owd_rel_accuracy);
       fbrasubctrler_enable(this->controller);
       break;
+    case SUBRATECTRLER_SCREAM:
+      this->controller = make_screamsubctrler(this->path);
+      screamsubctrler_enable(this->controller);
+      //FBRA detaches the approval process when it is disabled
+      mprtps_path_set_approval_process(this->path, this, subratectrler_packet_approver);
+      break;
     default:
     case SUBRATECTRLER_NO_CTRL:
       break;
@@ -253,6 +275,10 @@ void _disable(SubflowRateController *this)
       fbrasubctrler_disable(this->controller);
       g_object_unref(this->controller);
       break;
+    case SUBRATECTRLER_SCREAM:
+      screamsubctrler_disable(this->controller);
+      g_object_unref(this->controller);
+      break;
     default:
     case SUBRATECTRLER_NO_CTRL:
       break;
@@ -20,6 +20,7 @@ typedef struct _SubflowRateControllerClass SubflowRateControllerClass;
 typedef enum{
   SUBRATECTRLER_NO_CTRL     = 0,
   SUBRATECTRLER_FBRA   = 2,
+  SUBRATECTRLER_SCREAM = 3,
 }SubRateControllerType;
 
 
@@ -27,12 +28,12 @@ struct _SubflowRateController
 {
   GObject                   object;
   GRWLock                   rwmutex;
-  GstClock*                 sysclock;
   gpointer                  controller;
   MPRTPSPath*               path;
   guint8                    id;
   gboolean                  enabled;
   SubRateControllerType     type;
+  gdouble                   owd_rel_accuracy;
 };
 
 struct _SubflowRateControllerClass{
@@ -43,6 +44,9 @@ GType subratectrler_get_type (void);
 SubflowRateController *make_subratectrler(MPRTPSPath *path);
 
 void subratectrler_change(SubflowRateController *this, SubRateControllerType type);
+//The relative error of the long term OWD the controllers track, it is used
+//by the controllers made after it is set. 0 tracks the exact percentile.
+void subratectrler_set_owd_accuracy(SubflowRateController *this, gdouble owd_rel_accuracy);
 void subratectrler_report_update(SubflowRateController *this, GstMPRTCPReportSummary *summary);
 void subratectrler_time_update(SubflowRateController *this);
 void subratectrler_signal_update(SubflowRateController *this, MPRTPSubflowRateController *ratectrler_params);
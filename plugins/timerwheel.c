@@ -0,0 +1,530 @@
+/* GStreamer Timer wheel
+ * Copyright (C) 2015 Balázs Kreith (contact: balazs.kreith@gmail.com)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "timerwheel.h"
+#include "mprtpclock.h"
+#include <string.h>
+
+#define THIS_LOCK(this) g_mutex_lock(&this->mutex)
+#define THIS_UNLOCK(this) g_mutex_unlock(&this->mutex)
+
+GST_DEBUG_CATEGORY_STATIC (timerwheel_debug_category);
+#define GST_CAT_DEFAULT timerwheel_debug_category
+
+#define _now(this) (gst_clock_get_time (this->sysclock))
+
+//Index mask of one level and the farthest tick the outermost level can hold.
+#define SLOT_MASK (TIMERWHEEL_SLOTS_NUM - 1)
+#define MAX_TICKS_AHEAD ((G_GUINT64_CONSTANT(1) << (TIMERWHEEL_SLOT_BITS * TIMERWHEEL_LEVELS_NUM)) - 1)
+#define DEFAULT_MISS_TRESHOLD (GST_MSECOND)
+#define NO_WAKEUP_TICK G_MAXUINT64
+
+G_DEFINE_TYPE (TimerWheel, timerwheel, G_TYPE_OBJECT);
+
+static TimerWheel* _shared_wheel = NULL;
+static GMutex _shared_wheel_mutex;
+
+//----------------------------------------------------------------------
+//-------- Private functions belongs to the object ----------
+//----------------------------------------------------------------------
+
+static void
+timerwheel_finalize (GObject * object);
+
+static void
+_timerwheel_process_run (void *data);
+
+static void _refresh_clock(TimerWheel* this);
+
+static guint64 _tick_of(TimerWheel* this, GstClockTime time);
+static GstClockTime _time_of(TimerWheel* this, guint64 tick);
+static void _link(TimerWheel* this, TimerWheelTimer* timer, guint64 earliest);
+static void _unlink(TimerWheel* this, TimerWheelTimer* timer);
+static void _cascade(TimerWheel* this, gint level, gint index);
+static void _process_tick(TimerWheel* this);
+static void _fire(TimerWheel* this, TimerWheelTimer* timer);
+static guint64 _next_wakeup_tick(TimerWheel* this);
+static void _wakeup_if_earlier(TimerWheel* this, TimerWheelTimer* timer);
+static TimerWheelTimer* _make_timer(TimerWheel* this, TimerWheelFunc callback, gpointer udata);
+static void _dispose_timer(TimerWheel* this, TimerWheelTimer* timer);
+
+//----------------------------------------------------------------------
+//--------- Private functions implementations to the object --------
+//----------------------------------------------------------------------
+
+
+void
+timerwheel_class_init (TimerWheelClass * klass)
+{
+  GObjectClass *gobject_class;
+
+  gobject_class = (GObjectClass *) klass;
+
+  gobject_class->finalize = timerwheel_finalize;
+
+  GST_DEBUG_CATEGORY_INIT (timerwheel_debug_category, "timerwheel", 0,
+      "MpRTP Shared Timer Wheel");
+
+}
+
+void
+timerwheel_finalize (GObject * object)
+{
+  TimerWheel *this = TIMERWHEEL (object);
+  gst_task_stop (this->thread);
+  THIS_LOCK(this);
+  g_cond_signal(&this->idle_cond);
+  if(this->waiting){
+    gst_clock_id_unschedule(this->clock_id);
+  }
+  THIS_UNLOCK(this);
+  gst_task_join (this->thread);
+  gst_object_unref (this->thread);
+  gst_clock_id_unref (this->clock_id);
+  g_object_unref (this->sysclock);
+}
+
+void
+timerwheel_init (TimerWheel * this)
+{
+  this->sysclock       = mprtp_clock_obtain ();
+  this->made           = _now(this);
+  this->clock_id       = gst_clock_new_single_shot_id (this->sysclock, this->made);
+  this->current_tick   = 0;
+  this->wakeup_tick    = NO_WAKEUP_TICK;
+  this->miss_treshold  = DEFAULT_MISS_TRESHOLD;
+  this->thread         = gst_task_new (_timerwheel_process_run, this, NULL);
+  memset(this->slots, 0, sizeof(this->slots));
+  memset(this->occupied, 0, sizeof(this->occupied));
+  memset(&this->stats, 0, sizeof(TimerWheelStats));
+
+  g_mutex_init (&this->mutex);
+  g_cond_init (&this->running_cond);
+  g_cond_init (&this->idle_cond);
+  g_rec_mutex_init (&this->thread_mutex);
+  gst_task_set_lock (this->thread, &this->thread_mutex);
+  gst_task_start (this->thread);
+}
+
+
+TimerWheel* timerwheel_obtain(void)
+{
+  TimerWheel* result;
+  g_mutex_lock(&_shared_wheel_mutex);
+  if(!_shared_wheel){
+    //the shared instance keeps one reference for the lifetime of the process
+    _shared_wheel = g_object_new(TIMERWHEEL_TYPE, NULL);
+  }
+  result = g_object_ref(_shared_wheel);
+  g_mutex_unlock(&_shared_wheel_mutex);
+  return result;
+}
+
+TimerWheelTimer* timerwheel_add_oneshot(TimerWheel* this,
+                                        GstClockTime deadline,
+                                        TimerWheelFunc callback,
+                                        gpointer udata)
+{
+  TimerWheelTimer* result;
+  THIS_LOCK(this);
+  result = _make_timer(this, callback, udata);
+  if(GST_CLOCK_TIME_IS_VALID(deadline)){
+    result->deadline = deadline;
+    _link(this, result, this->current_tick + 1);
+    _wakeup_if_earlier(this, result);
+  }
+  THIS_UNLOCK(this);
+  return result;
+}
+
+TimerWheelTimer* timerwheel_add_periodic(TimerWheel* this,
+                                         GstClockTime period,
+                                         TimerWheelFunc callback,
+                                         gpointer udata)
+{
+  TimerWheelTimer* result;
+  THIS_LOCK(this);
+  result = _make_timer(this, callback, udata);
+  result->period   = period;
+  result->deadline = _now(this) + period;
+  _link(this, result, this->current_tick + 1);
+  _wakeup_if_earlier(this, result);
+  THIS_UNLOCK(this);
+  return result;
+}
+
+void timerwheel_rearm(TimerWheel* this, TimerWheelTimer* timer, GstClockTime deadline)
+{
+  THIS_LOCK(this);
+  if(timer->removed){
+    goto done;
+  }
+  if(timer->armed){
+    _unlink(this, timer);
+  }
+  timer->deadline = deadline;
+  _link(this, timer, this->current_tick + 1);
+  _wakeup_if_earlier(this, timer);
+done:
+  THIS_UNLOCK(this);
+}
+
+void timerwheel_rearm_in(TimerWheel* this, TimerWheelTimer* timer, GstClockTime delay)
+{
+  THIS_LOCK(this);
+  if(timer->removed){
+    goto done;
+  }
+  if(timer->armed){
+    _unlink(this, timer);
+  }
+  timer->deadline = _now(this) + delay;
+  _link(this, timer, this->current_tick + 1);
+  _wakeup_if_earlier(this, timer);
+done:
+  THIS_UNLOCK(this);
+}
+
+void timerwheel_disarm(TimerWheel* this, TimerWheelTimer* timer)
+{
+  THIS_LOCK(this);
+  if(timer->armed){
+    _unlink(this, timer);
+  }
+  timer->period = 0;
+  THIS_UNLOCK(this);
+}
+
+GstClockTime timerwheel_get_remaining(TimerWheel* this, TimerWheelTimer* timer)
+{
+  GstClockTime result = GST_CLOCK_TIME_NONE;
+  GstClockTime now;
+  THIS_LOCK(this);
+  if(timer->armed){
+    now = _now(this);
+    result = now < timer->deadline ? timer->deadline - now : 0;
+  }
+  THIS_UNLOCK(this);
+  return result;
+}
+
+void timerwheel_remove(TimerWheel* this, TimerWheelTimer* timer)
+{
+  THIS_LOCK(this);
+  if(timer->armed){
+    _unlink(this, timer);
+  }
+  timer->removed = TRUE;
+  timer->period  = 0;
+  if(this->running == timer){
+    if(this->running_thread == g_thread_self()){
+      //removed from its own callback, _fire disposes it on return
+      timer->dispose_on_return = TRUE;
+      goto done;
+    }
+    while(this->running == timer){
+      g_cond_wait(&this->running_cond, &this->mutex);
+    }
+  }
+  _dispose_timer(this, timer);
+done:
+  THIS_UNLOCK(this);
+}
+
+void timerwheel_set_miss_treshold(TimerWheel* this, GstClockTime treshold)
+{
+  THIS_LOCK(this);
+  this->miss_treshold = treshold;
+  THIS_UNLOCK(this);
+}
+
+void timerwheel_get_stats(TimerWheel* this, TimerWheelStats* result)
+{
+  THIS_LOCK(this);
+  memcpy(result, &this->stats, sizeof(TimerWheelStats));
+  THIS_UNLOCK(this);
+}
+
+
+void
+_timerwheel_process_run (void *data)
+{
+  TimerWheel *this;
+  guint64 now_tick;
+  GstClockTime now;
+
+  this = TIMERWHEEL (data);
+  THIS_LOCK(this);
+  _refresh_clock(this);
+  now = _now(this);
+  now_tick = now <= this->made ? 0 : (now - this->made) / TIMERWHEEL_TICK;
+  while(this->current_tick < now_tick){
+    ++this->current_tick;
+    _process_tick(this);
+  }
+  ++this->stats.wakeups;
+
+  this->wakeup_tick = _next_wakeup_tick(this);
+  if(this->wakeup_tick == NO_WAKEUP_TICK){
+    GstTaskState state = gst_task_get_state(this->thread);
+    if(state == GST_TASK_STARTED){
+      this->idle = TRUE;
+      g_cond_wait(&this->idle_cond, &this->mutex);
+      this->idle = FALSE;
+    }
+    THIS_UNLOCK(this);
+    return;
+  }
+
+  gst_clock_single_shot_id_reinit(this->sysclock, this->clock_id,
+                                  _time_of(this, this->wakeup_tick));
+  this->waiting = TRUE;
+  THIS_UNLOCK(this);
+
+  gst_clock_id_wait (this->clock_id, NULL);
+
+  THIS_LOCK(this);
+  this->waiting = FALSE;
+  THIS_UNLOCK(this);
+}
+
+//Follows the clock provider. Ticks are kept, only the time base is moved,
+//so armed timers keep their distance from the current tick.
+void _refresh_clock(TimerWheel* this)
+{
+  GstClock* clock;
+  clock = mprtp_clock_obtain();
+  if(clock == this->sysclock){
+    gst_object_unref(clock);
+    return;
+  }
+  g_object_unref(this->sysclock);
+  gst_clock_id_unref(this->clock_id);
+  this->sysclock = clock;
+  this->made     = _now(this) - MIN(_now(this), this->current_tick * TIMERWHEEL_TICK);
+  this->clock_id = gst_clock_new_single_shot_id(this->sysclock, _now(this));
+  GST_DEBUG("Timerwheel follows a new clock at tick %"G_GUINT64_FORMAT, this->current_tick);
+}
+
+//Rounds up, so a timer never fires before its deadline.
+guint64 _tick_of(TimerWheel* this, GstClockTime time)
+{
+  if(time <= this->made){
+    return 0;
+  }
+  return (time - this->made + TIMERWHEEL_TICK - 1) / TIMERWHEEL_TICK;
+}
+
+GstClockTime _time_of(TimerWheel* this, guint64 tick)
+{
+  return this->made + tick * TIMERWHEEL_TICK;
+}
+
+//The timer is linked at the earliest to the given tick, the ticks before
+//it are processed already.
+void _link(TimerWheel* this, TimerWheelTimer* timer, guint64 earliest)
+{
+  guint64 expires, delta;
+  gint level, index;
+  TimerWheelTimer** slot;
+
+  timer->expires = _tick_of(this, timer->deadline);
+  expires = MAX(timer->expires, earliest);
+  delta = expires - this->current_tick;
+  if(MAX_TICKS_AHEAD < delta){
+    //parked on the outermost level, it is cascaded down again later.
+    delta   = MAX_TICKS_AHEAD;
+    expires = this->current_tick + delta;
+  }
+  for(level = 0; level < TIMERWHEEL_LEVELS_NUM - 1; ++level){
+    if(delta < (G_GUINT64_CONSTANT(1) << (TIMERWHEEL_SLOT_BITS * (level + 1)))){
+      break;
+    }
+  }
+  index = (expires >> (TIMERWHEEL_SLOT_BITS * level)) & SLOT_MASK;
+  slot  = &this->slots[level][index];
+
+  timer->prev = NULL;
+  timer->next = *slot;
+  if(*slot){
+    (*slot)->prev = timer;
+  }
+  *slot = timer;
+  timer->slot  = slot;
+  timer->armed = TRUE;
+  this->occupied[level] |= G_GUINT64_CONSTANT(1) << index;
+}
+
+void _unlink(TimerWheel* this, TimerWheelTimer* timer)
+{
+  gint offset;
+  if(timer->prev){
+    timer->prev->next = timer->next;
+  }else{
+    *timer->slot = timer->next;
+  }
+  if(timer->next){
+    timer->next->prev = timer->prev;
+  }
+  if(*timer->slot == NULL){
+    offset = timer->slot - &this->slots[0][0];
+    this->occupied[offset / TIMERWHEEL_SLOTS_NUM] &=
+        ~(G_GUINT64_CONSTANT(1) << (offset % TIMERWHEEL_SLOTS_NUM));
+  }
+  timer->next  = timer->prev = NULL;
+  timer->slot  = NULL;
+  timer->armed = FALSE;
+}
+
+void _cascade(TimerWheel* this, gint level, gint index)
+{
+  TimerWheelTimer *timer, *next;
+  timer = this->slots[level][index];
+  this->slots[level][index] = NULL;
+  this->occupied[level] &= ~(G_GUINT64_CONSTANT(1) << index);
+  for(; timer; timer = next){
+    next = timer->next;
+    //the slot of the current tick is processed after the cascade
+    _link(this, timer, this->current_tick);
+  }
+}
+
+void _process_tick(TimerWheel* this)
+{
+  gint level, index;
+  TimerWheelTimer* timer;
+
+  index = this->current_tick & SLOT_MASK;
+  for(level = 1; index == 0 && level < TIMERWHEEL_LEVELS_NUM; ++level){
+    index = (this->current_tick >> (TIMERWHEEL_SLOT_BITS * level)) & SLOT_MASK;
+    _cascade(this, level, index);
+  }
+
+  index = this->current_tick & SLOT_MASK;
+  //timers rearmed from a callback for this tick land on the next slot
+  while((timer = this->slots[0][index]) != NULL){
+    _unlink(this, timer);
+    _fire(this, timer);
+  }
+}
+
+void _fire(TimerWheel* this, TimerWheelTimer* timer)
+{
+  GstClockTime now, lateness;
+  MPRTPClockProvider** clock;
+
+  now = _now(this);
+  lateness = timer->deadline < now ? now - timer->deadline : 0;
+  ++this->stats.fired;
+  this->stats.total_lateness += lateness;
+  this->stats.max_lateness = MAX(this->stats.max_lateness, lateness);
+  if(this->miss_treshold < lateness){
+    ++this->stats.missed;
+    ++timer->missed;
+    GST_DEBUG_OBJECT(this, "timer %p fired %" GST_TIME_FORMAT " late",
+                     timer, GST_TIME_ARGS(lateness));
+  }
+
+  this->running        = timer;
+  this->running_thread = g_thread_self();
+  THIS_UNLOCK(this);
+  clock = mprtp_clock_bind(timer->clock);
+  timer->callback(timer->udata);
+  mprtp_clock_bind(clock);
+  THIS_LOCK(this);
+  this->running        = NULL;
+  this->running_thread = NULL;
+  g_cond_broadcast(&this->running_cond);
+
+  if(timer->removed){
+    if(timer->dispose_on_return){
+      _dispose_timer(this, timer);
+    }
+    return;
+  }
+  if(timer->armed || !timer->period){
+    return;
+  }
+  //keep the phase, but do not replay the periods lost in a stall
+  timer->deadline += timer->period;
+  if(timer->deadline < now){
+    timer->deadline = now + timer->period;
+  }
+  _link(this, timer, this->current_tick + 1);
+}
+
+guint64 _next_wakeup_tick(TimerWheel* this)
+{
+  gint level, offset, index;
+  guint64 result = NO_WAKEUP_TICK;
+
+  for(level = 1; level < TIMERWHEEL_LEVELS_NUM; ++level){
+    if(this->occupied[level]){
+      //wake up on the boundary where the next cascade happens
+      result = (this->current_tick | SLOT_MASK) + 1;
+      break;
+    }
+  }
+  if(!this->occupied[0]){
+    return result;
+  }
+  for(offset = 1; offset < TIMERWHEEL_SLOTS_NUM; ++offset){
+    index = (this->current_tick + offset) & SLOT_MASK;
+    if(this->occupied[0] & (G_GUINT64_CONSTANT(1) << index)){
+      return MIN(result, this->current_tick + offset);
+    }
+  }
+  return result;
+}
+
+void _wakeup_if_earlier(TimerWheel* this, TimerWheelTimer* timer)
+{
+  if(this->idle){
+    g_cond_signal(&this->idle_cond);
+    return;
+  }
+  if(this->waiting && timer->expires < this->wakeup_tick){
+    gst_clock_id_unschedule(this->clock_id);
+  }
+}
+
+TimerWheelTimer* _make_timer(TimerWheel* this, TimerWheelFunc callback, gpointer udata)
+{
+  TimerWheelTimer* result;
+  result = g_slice_new0(TimerWheelTimer);
+  result->callback = callback;
+  result->udata    = udata;
+  result->clock    = mprtp_clock_get_binding();
+  result->deadline = GST_CLOCK_TIME_NONE;
+  ++this->stats.timers_num;
+  return result;
+}
+
+void _dispose_timer(TimerWheel* this, TimerWheelTimer* timer)
+{
+  --this->stats.timers_num;
+  g_slice_free(TimerWheelTimer, timer);
+}
+
+#undef THIS_LOCK
+#undef THIS_UNLOCK
@@ -0,0 +1,122 @@
+/*
+ * timerwheel.h
+ *
+ *  Hierarchical timer wheel shared by every MPRTP element in the process.
+ *  Components register one-shot or periodic deadlines on it instead of
+ *  running their own polling GstTask.
+ */
+
+#ifndef TIMERWHEEL_H_
+#define TIMERWHEEL_H_
+
+#include <gst/gst.h>
+#include "mprtpclock.h"
+
+typedef struct _TimerWheel TimerWheel;
+typedef struct _TimerWheelClass TimerWheelClass;
+typedef struct _TimerWheelTimer TimerWheelTimer;
+typedef struct _TimerWheelStats TimerWheelStats;
+
+#define TIMERWHEEL_TYPE             (timerwheel_get_type())
+#define TIMERWHEEL(src)             (G_TYPE_CHECK_INSTANCE_CAST((src),TIMERWHEEL_TYPE,TimerWheel))
+#define TIMERWHEEL_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST((klass),TIMERWHEEL_TYPE,TimerWheelClass))
+#define TIMERWHEEL_IS_SOURCE(src)          (G_TYPE_CHECK_INSTANCE_TYPE((src),TIMERWHEEL_TYPE))
+#define TIMERWHEEL_IS_SOURCE_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE((klass),TIMERWHEEL_TYPE))
+#define TIMERWHEEL_CAST(src)        ((TimerWheel *)(src))
+
+//Resolution of the innermost wheel. Deadlines are rounded up to it.
+#define TIMERWHEEL_TICK (250 * GST_USECOND)
+#define TIMERWHEEL_LEVELS_NUM 4
+#define TIMERWHEEL_SLOT_BITS 6
+#define TIMERWHEEL_SLOTS_NUM (1<<TIMERWHEEL_SLOT_BITS)
+
+typedef void (*TimerWheelFunc)(gpointer udata);
+
+struct _TimerWheelTimer
+{
+  TimerWheelTimer*         next;
+  TimerWheelTimer*         prev;
+  TimerWheelTimer**        slot;
+
+  GstClockTime             deadline;
+  GstClockTime             period;
+  guint64                  expires;
+  gboolean                 armed;
+  gboolean                 removed;
+  gboolean                 dispose_on_return;
+
+  TimerWheelFunc           callback;
+  gpointer                 udata;
+  //the clock binding of the thread the timer was added on
+  MPRTPClockProvider**     clock;
+
+  guint32                  missed;
+};
+
+struct _TimerWheelStats
+{
+  guint64                  fired;
+  guint64                  missed;
+  GstClockTime             max_lateness;
+  GstClockTime             total_lateness;
+  guint32                  timers_num;
+  guint64                  wakeups;
+};
+
+struct _TimerWheel
+{
+  GObject                  object;
+  GMutex                   mutex;
+  GCond                    running_cond;
+  GstClock*                sysclock;
+  GstClockTime             made;
+
+  GstTask*                 thread;
+  GRecMutex                thread_mutex;
+  GstClockID               clock_id;
+  GCond                    idle_cond;
+  gboolean                 idle;
+  gboolean                 waiting;
+  guint64                  wakeup_tick;
+
+  guint64                  current_tick;
+  TimerWheelTimer*         slots[TIMERWHEEL_LEVELS_NUM][TIMERWHEEL_SLOTS_NUM];
+  guint64                  occupied[TIMERWHEEL_LEVELS_NUM];
+
+  TimerWheelTimer*         running;
+  GThread*                 running_thread;
+  GstClockTime             miss_treshold;
+
+  TimerWheelStats          stats;
+};
+
+struct _TimerWheelClass{
+  GObjectClass parent_class;
+};
+
+GType timerwheel_get_type (void);
+
+TimerWheel* timerwheel_obtain(void);
+
+TimerWheelTimer* timerwheel_add_oneshot(TimerWheel* this,
+                                        GstClockTime deadline,
+                                        TimerWheelFunc callback,
+                                        gpointer udata);
+
+TimerWheelTimer* timerwheel_add_periodic(TimerWheel* this,
+                                         GstClockTime period,
+                                         TimerWheelFunc callback,
+                                         gpointer udata);
+
+void timerwheel_rearm(TimerWheel* this, TimerWheelTimer* timer, GstClockTime deadline);
+//Deadlines are on the time base of the wheel, the callers on another
+//clock arm their timers relative to now
+void timerwheel_rearm_in(TimerWheel* this, TimerWheelTimer* timer, GstClockTime delay);
+void timerwheel_disarm(TimerWheel* this, TimerWheelTimer* timer);
+//Time until the timer fires, GST_CLOCK_TIME_NONE if it is not armed
+GstClockTime timerwheel_get_remaining(TimerWheel* this, TimerWheelTimer* timer);
+void timerwheel_remove(TimerWheel* this, TimerWheelTimer* timer);
+void timerwheel_set_miss_treshold(TimerWheel* this, GstClockTime treshold);
+void timerwheel_get_stats(TimerWheel* this, TimerWheelStats* result);
+
+#endif /* TIMERWHEEL_H_ */
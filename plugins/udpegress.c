@@ -0,0 +1,519 @@
+/* GStreamer UDP egress
+ * Copyright (C) 2015 Balázs Kreith (contact: balazs.kreith@gmail.com)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+//sendmmsg() is a GNU extension
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "udpegress.h"
+#include "mprtptxtime.h"
+#include <string.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <time.h>
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef SO_TXTIME
+#define SO_TXTIME 61
+#define SCM_TXTIME SO_TXTIME
+#endif
+//struct sock_txtime of linux/net_tstamp.h
+typedef struct{
+  clockid_t clockid;
+  guint32   flags;
+}UDPEgressTxTimeConfig;
+#endif
+
+#define THIS_LOCK(this) g_mutex_lock(&this->mutex)
+#define THIS_UNLOCK(this) g_mutex_unlock(&this->mutex)
+
+GST_DEBUG_CATEGORY_STATIC (udpegress_debug_category);
+#define GST_CAT_DEFAULT udpegress_debug_category
+
+G_DEFINE_TYPE (UDPEgress, udpegress, G_TYPE_OBJECT);
+
+//----------------------------------------------------------------------
+//-------- Private functions belongs to the object ----------
+//----------------------------------------------------------------------
+
+static void udpegress_finalize (GObject * object);
+static void _close(UDPEgress *this);
+static guint _send_single(UDPEgress *this, GstMapInfo *maps, GstClockTime *txtimes, guint length);
+#ifdef __linux__
+static guint _send_mmsg(UDPEgress *this, GstMapInfo *maps, GstClockTime *txtimes, guint length);
+static guint _send_gso(UDPEgress *this, GstMapInfo *maps, GstClockTime *txtimes, guint length);
+#endif
+
+//----------------------------------------------------------------------
+//--------- Private functions implementations to the object --------
+//----------------------------------------------------------------------
+
+void
+udpegress_class_init (UDPEgressClass * klass)
+{
+  GObjectClass *gobject_class;
+
+  gobject_class = (GObjectClass *) klass;
+
+  gobject_class->finalize = udpegress_finalize;
+
+  GST_DEBUG_CATEGORY_INIT (udpegress_debug_category, "udpegress", 0,
+      "MpRTP UDP Egress");
+}
+
+void
+udpegress_finalize (GObject * object)
+{
+  UDPEgress *this = UDPEGRESS (object);
+  _close(this);
+  g_mutex_clear(&this->mutex);
+}
+
+void
+udpegress_init (UDPEgress * this)
+{
+  g_mutex_init(&this->mutex);
+  this->mode = UDPEGRESS_MODE_GSO;
+}
+
+UDPEgress *make_udpegress(void)
+{
+  return g_object_new (UDPEGRESS_TYPE, NULL);
+}
+
+gboolean udpegress_open(UDPEgress *this, const gchar *host, guint16 port,
+                        guint16 bind_port, GError **error)
+{
+  GInetAddress *inet_address, *any;
+  GSocketAddress *bind_address;
+  GSocketFamily family;
+  GResolver *resolver;
+  GList *addresses;
+  gboolean result = FALSE;
+
+  THIS_LOCK(this);
+  _close(this);
+  inet_address = g_inet_address_new_from_string(host);
+  if(!inet_address){
+    resolver  = g_resolver_get_default();
+    addresses = g_resolver_lookup_by_name(resolver, host, NULL, error);
+    g_object_unref(resolver);
+    if(!addresses){
+      goto done;
+    }
+    inet_address = g_object_ref(addresses->data);
+    g_resolver_free_addresses(addresses);
+  }
+  family = g_inet_address_get_family(inet_address);
+  this->address = g_inet_socket_address_new(inet_address, port);
+  g_object_unref(inet_address);
+
+  this->socket = g_socket_new(family, G_SOCKET_TYPE_DATAGRAM, G_SOCKET_PROTOCOL_UDP, error);
+  if(!this->socket){
+    goto failed;
+  }
+  if(bind_port){
+    any          = g_inet_address_new_any(family);
+    bind_address = g_inet_socket_address_new(any, bind_port);
+    g_object_unref(any);
+    result = g_socket_bind(this->socket, bind_address, TRUE, error);
+    g_object_unref(bind_address);
+    if(!result){
+      goto failed;
+    }
+  }
+  this->sockaddr_len = g_socket_address_get_native_size(this->address);
+  this->sockaddr     = g_malloc0(this->sockaddr_len);
+  if(!g_socket_address_to_native(this->address, this->sockaddr, this->sockaddr_len, error)){
+    goto failed;
+  }
+  this->gso_supported = TRUE;
+  result = TRUE;
+  goto done;
+failed:
+  result = FALSE;
+  _close(this);
+done:
+  THIS_UNLOCK(this);
+  return result;
+}
+
+void udpegress_close(UDPEgress *this)
+{
+  THIS_LOCK(this);
+  _close(this);
+  THIS_UNLOCK(this);
+}
+
+void udpegress_set_mode(UDPEgress *this, UDPEgressMode mode)
+{
+  THIS_LOCK(this);
+  this->mode = mode;
+  THIS_UNLOCK(this);
+}
+
+gboolean udpegress_set_txtime(UDPEgress *this, gboolean enabled)
+{
+#ifdef __linux__
+  UDPEgressTxTimeConfig config;
+#endif
+  gboolean result = !enabled;
+
+  THIS_LOCK(this);
+  this->txtime_enabled = FALSE;
+  if(!this->socket || !enabled){
+    goto done;
+  }
+#ifdef __linux__
+  memset(&config, 0, sizeof(config));
+  config.clockid = CLOCK_MONOTONIC;
+  if(setsockopt(g_socket_get_fd(this->socket), SOL_SOCKET, SO_TXTIME, &config, sizeof(config)) < 0){
+    GST_WARNING_OBJECT(this, "SO_TXTIME is not supported: %s", g_strerror(errno));
+    goto done;
+  }
+  this->txtime_enabled = result = TRUE;
+#endif
+done:
+  THIS_UNLOCK(this);
+  return result;
+}
+
+guint udpegress_send(UDPEgress *this, GstBuffer **buffers, guint length)
+{
+  GstMapInfo maps[UDPEGRESS_BATCH_LENGTH];
+  GstClockTime txtimes[UDPEGRESS_BATCH_LENGTH];
+  GstBuffer *mapped[UDPEGRESS_BATCH_LENGTH];
+  MpRTPTxTimeMeta *meta;
+  guint i, num, mapped_num, result = 0;
+
+  THIS_LOCK(this);
+  if(!this->socket){
+    goto done;
+  }
+  for(; 0 < length; length -= num, buffers += num){
+    num = MIN(length, UDPEGRESS_BATCH_LENGTH);
+    for(i = 0, mapped_num = 0; i < num; ++i){
+      if(!gst_buffer_map(buffers[i], maps + mapped_num, GST_MAP_READ)){
+        ++this->errors;
+        continue;
+      }
+      meta = this->txtime_enabled ? gst_buffer_get_mprtp_txtime_meta(buffers[i]) : NULL;
+      txtimes[mapped_num] = meta ? meta->txtime : 0;
+      mapped[mapped_num++] = buffers[i];
+    }
+#ifdef __linux__
+    if(this->mode == UDPEGRESS_MODE_GSO && this->gso_supported){
+      result += _send_gso(this, maps, txtimes, mapped_num);
+    }else if(this->mode != UDPEGRESS_MODE_SINGLE){
+      result += _send_mmsg(this, maps, txtimes, mapped_num);
+    }else
+#endif
+    {
+      result += _send_single(this, maps, txtimes, mapped_num);
+    }
+    for(i = 0; i < mapped_num; ++i){
+      gst_buffer_unmap(mapped[i], maps + i);
+    }
+  }
+done:
+  THIS_UNLOCK(this);
+  return result;
+}
+
+void udpegress_get_counters(UDPEgress *this, guint64 *packets, guint64 *bytes,
+                            guint64 *syscalls, guint64 *errors)
+{
+  THIS_LOCK(this);
+  if(packets){
+    *packets = this->packets;
+  }
+  if(bytes){
+    *bytes = this->bytes;
+  }
+  if(syscalls){
+    *syscalls = this->syscalls;
+  }
+  if(errors){
+    *errors = this->errors;
+  }
+  THIS_UNLOCK(this);
+}
+
+guint64 udpegress_get_txtime_packets(UDPEgress *this)
+{
+  guint64 result;
+  THIS_LOCK(this);
+  result = this->txtime_packets;
+  THIS_UNLOCK(this);
+  return result;
+}
+
+void _close(UDPEgress *this)
+{
+  if(this->socket){
+    g_socket_close(this->socket, NULL);
+    g_object_unref(this->socket);
+    this->socket = NULL;
+  }
+  if(this->address){
+    g_object_unref(this->address);
+    this->address = NULL;
+  }
+  g_free(this->sockaddr);
+  this->sockaddr = NULL;
+  this->sockaddr_len = 0;
+  this->txtime_enabled = FALSE;
+}
+
+#ifndef __linux__
+
+//One syscall per packet, the same udpsink makes
+guint _send_single(UDPEgress *this, GstMapInfo *maps, GstClockTime *txtimes, guint length)
+{
+  GError *error = NULL;
+  gssize sent;
+  guint i, result = 0;
+  for(i = 0; i < length; ++i){
+    ++this->syscalls;
+    sent = g_socket_send_to(this->socket, this->address, (const gchar*) maps[i].data,
+                            maps[i].size, NULL, &error);
+    if(sent < 0){
+      GST_DEBUG_OBJECT(this, "Sending failed: %s", error->message);
+      g_clear_error(&error);
+      ++this->errors;
+      continue;
+    }
+    ++this->packets;
+    this->bytes += sent;
+    ++result;
+  }
+  return result;
+}
+
+#else
+
+//Control messages of one sendmsg: the GSO segment size and the departure time
+typedef union{
+  gchar buf[CMSG_SPACE(sizeof(guint16)) + CMSG_SPACE(sizeof(guint64))];
+  struct cmsghdr align;
+}UDPEgressControl;
+
+static void _setup_control(struct msghdr *msg, UDPEgressControl *control,
+                           guint16 gso_size, GstClockTime txtime)
+{
+  struct cmsghdr *cmsg;
+  guint64 value = txtime;
+
+  msg->msg_control    = control->buf;
+  msg->msg_controllen = sizeof(control->buf);
+  cmsg = CMSG_FIRSTHDR(msg);
+  msg->msg_controllen = 0;
+  if(gso_size){
+    cmsg->cmsg_level = SOL_UDP;
+    cmsg->cmsg_type  = UDP_SEGMENT;
+    cmsg->cmsg_len   = CMSG_LEN(sizeof(guint16));
+    memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(guint16));
+    msg->msg_controllen += CMSG_SPACE(sizeof(guint16));
+    cmsg = (struct cmsghdr*)(control->buf + msg->msg_controllen);
+  }
+  if(txtime){
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type  = SCM_TXTIME;
+    cmsg->cmsg_len   = CMSG_LEN(sizeof(guint64));
+    memcpy(CMSG_DATA(cmsg), &value, sizeof(guint64));
+    msg->msg_controllen += CMSG_SPACE(sizeof(guint64));
+  }
+  if(!msg->msg_controllen){
+    msg->msg_control = NULL;
+  }
+}
+
+//Waits for the socket if the send buffer is full, returns FALSE if the
+//error is not recoverable
+static gboolean _recoverable(UDPEgress *this)
+{
+  if(errno == EINTR){
+    return TRUE;
+  }
+  if(errno == EAGAIN || errno == EWOULDBLOCK){
+    g_socket_condition_wait(this->socket, G_IO_OUT, NULL, NULL);
+    return TRUE;
+  }
+  return FALSE;
+}
+
+//Sends the packets as one datagram, or as one the kernel segments if
+//gso_size is given. Returns -1 if the kernel does not support GSO.
+static gint _send_msg(UDPEgress *this, GstMapInfo *maps, guint length,
+                      guint16 gso_size, GstClockTime txtime)
+{
+  struct msghdr msg;
+  struct iovec iovs[UDPEGRESS_BATCH_LENGTH];
+  UDPEgressControl control;
+  gssize ret;
+  guint i;
+
+  memset(&msg, 0, sizeof(msg));
+  memset(&control, 0, sizeof(control));
+  for(i = 0; i < length; ++i){
+    iovs[i].iov_base = maps[i].data;
+    iovs[i].iov_len  = maps[i].size;
+  }
+  msg.msg_name    = this->sockaddr;
+  msg.msg_namelen = this->sockaddr_len;
+  msg.msg_iov     = iovs;
+  msg.msg_iovlen  = length;
+  _setup_control(&msg, &control, gso_size, txtime);
+
+again:
+  ++this->syscalls;
+  ret = sendmsg(g_socket_get_fd(this->socket), &msg, 0);
+  if(ret < 0){
+    if(_recoverable(this)){
+      goto again;
+    }
+    if(gso_size && (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT || errno == EOPNOTSUPP)){
+      return -1;
+    }
+    GST_DEBUG_OBJECT(this, "sendmsg failed: %s", g_strerror(errno));
+    this->errors += gso_size ? length : 1;
+    return 0;
+  }
+  length = gso_size ? length : 1;
+  this->packets += length;
+  this->bytes   += ret;
+  if(txtime){
+    this->txtime_packets += length;
+  }
+  return length;
+}
+
+//One syscall per packet, the same udpsink makes
+guint _send_single(UDPEgress *this, GstMapInfo *maps, GstClockTime *txtimes, guint length)
+{
+  guint i, result = 0;
+  for(i = 0; i < length; ++i){
+    result += _send_msg(this, maps + i, 1, 0, txtimes[i]);
+  }
+  return result;
+}
+
+guint _send_mmsg(UDPEgress *this, GstMapInfo *maps, GstClockTime *txtimes, guint length)
+{
+  struct mmsghdr msgs[UDPEGRESS_BATCH_LENGTH];
+  struct iovec iovs[UDPEGRESS_BATCH_LENGTH];
+  UDPEgressControl controls[UDPEGRESS_BATCH_LENGTH];
+  gint fd, ret;
+  guint i, sent = 0, result = 0;
+
+  if(!length){
+    return 0;
+  }
+  memset(msgs, 0, sizeof(struct mmsghdr) * length);
+  for(i = 0; i < length; ++i){
+    iovs[i].iov_base = maps[i].data;
+    iovs[i].iov_len  = maps[i].size;
+    msgs[i].msg_hdr.msg_name    = this->sockaddr;
+    msgs[i].msg_hdr.msg_namelen = this->sockaddr_len;
+    msgs[i].msg_hdr.msg_iov     = iovs + i;
+    msgs[i].msg_hdr.msg_iovlen  = 1;
+    if(txtimes[i]){
+      memset(controls + i, 0, sizeof(UDPEgressControl));
+      _setup_control(&msgs[i].msg_hdr, controls + i, 0, txtimes[i]);
+    }
+  }
+  fd = g_socket_get_fd(this->socket);
+  while(sent < length){
+    ++this->syscalls;
+    ret = sendmmsg(fd, msgs + sent, length - sent, 0);
+    if(ret < 0){
+      if(_recoverable(this)){
+        continue;
+      }
+      //the first packet of the rest is dropped
+      GST_DEBUG_OBJECT(this, "sendmmsg failed: %s", g_strerror(errno));
+      ++this->errors;
+      ++sent;
+      continue;
+    }
+    for(i = sent; i < sent + ret; ++i){
+      this->bytes += msgs[i].msg_len;
+      this->txtime_packets += txtimes[i] ? 1 : 0;
+    }
+    this->packets += ret;
+    result += ret;
+    sent += ret;
+  }
+  return result;
+}
+
+//Runs of equal sized packets are sent as one datagram the kernel segments,
+//the last packet of a run may be shorter. The segments of a datagram leave
+//together, so packets paced to different departure times are not merged.
+guint _send_gso(UDPEgress *this, GstMapInfo *maps, GstClockTime *txtimes, guint length)
+{
+  guint i, j, bytes, pending = 0, result = 0;
+  gint sent;
+
+  for(i = 0; i < length; i = j){
+    bytes = maps[i].size;
+    for(j = i + 1; j < length && maps[j].size <= maps[i].size && txtimes[j] == txtimes[i]; ++j){
+      if(UDPEGRESS_MAX_GSO_BYTES < bytes + maps[j].size){
+        break;
+      }
+      bytes += maps[j].size;
+      if(maps[j].size < maps[i].size){
+        ++j;
+        break;
+      }
+    }
+    if(j - i < 2){
+      continue;
+    }
+    //the packets before the run keep their order
+    result += _send_mmsg(this, maps + pending, txtimes + pending, i - pending);
+    sent = _send_msg(this, maps + i, j - i, maps[i].size, txtimes[i]);
+    if(sent < 0){
+      GST_INFO_OBJECT(this, "UDP GSO is not supported, sendmmsg is used");
+      this->gso_supported = FALSE;
+      return result + _send_mmsg(this, maps + i, txtimes + i, length - i);
+    }
+    result += sent;
+    pending = j;
+  }
+  return result + _send_mmsg(this, maps + pending, txtimes + pending, length - pending);
+}
+
+#endif
+
+#undef THIS_LOCK
+#undef THIS_UNLOCK
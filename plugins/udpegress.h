@@ -0,0 +1,82 @@
+/*
+ * udpegress.h
+ *
+ *  UDP socket of one subflow sending packets in batches. Lists of packets
+ *  are flushed by sendmmsg, and runs of equal sized packets can be sent
+ *  as one UDP_SEGMENT (GSO) super datagram the kernel segments. Without
+ *  kernel support the egress falls back to one sendto per packet, which
+ *  is what udpsink does. Syscalls are counted to compare the modes.
+ *  With SO_TXTIME enabled the departure times the scheduler attached to
+ *  the packets are passed to the kernel, and the fq qdisc paces them.
+ */
+
+#ifndef UDPEGRESS_H_
+#define UDPEGRESS_H_
+
+#include <gst/gst.h>
+#include <gio/gio.h>
+
+typedef struct _UDPEgress UDPEgress;
+typedef struct _UDPEgressClass UDPEgressClass;
+
+#define UDPEGRESS_TYPE             (udpegress_get_type())
+#define UDPEGRESS(src)             (G_TYPE_CHECK_INSTANCE_CAST((src),UDPEGRESS_TYPE,UDPEgress))
+#define UDPEGRESS_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST((klass),UDPEGRESS_TYPE,UDPEgressClass))
+#define UDPEGRESS_IS_SOURCE(src)          (G_TYPE_CHECK_INSTANCE_TYPE((src),UDPEGRESS_TYPE))
+#define UDPEGRESS_IS_SOURCE_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE((klass),UDPEGRESS_TYPE))
+#define UDPEGRESS_CAST(src)        ((UDPEgress *)(src))
+
+//Packets sent by one syscall at most, also the GSO segments limit of Linux
+#define UDPEGRESS_BATCH_LENGTH 64
+#define UDPEGRESS_MAX_GSO_BYTES 65000
+
+typedef enum{
+  UDPEGRESS_MODE_SINGLE   = 0,
+  UDPEGRESS_MODE_SENDMMSG = 1,
+  UDPEGRESS_MODE_GSO      = 2,
+}UDPEgressMode;
+
+struct _UDPEgress
+{
+  GObject                  object;
+  GMutex                   mutex;
+  GSocket*                 socket;
+  GSocketAddress*          address;
+  gpointer                 sockaddr;
+  gsize                    sockaddr_len;
+  UDPEgressMode            mode;
+  gboolean                 gso_supported;
+  gboolean                 txtime_enabled;
+
+  guint64                  packets;
+  guint64                  bytes;
+  guint64                  syscalls;
+  guint64                  errors;
+  guint64                  txtime_packets;
+};
+
+struct _UDPEgressClass{
+  GObjectClass parent_class;
+};
+
+GType udpegress_get_type (void);
+
+UDPEgress *make_udpegress(void);
+//Opens the socket bound to bind_port (0 - any) sending to host:port
+gboolean udpegress_open(UDPEgress *this, const gchar *host, guint16 port,
+                        guint16 bind_port, GError **error);
+void udpegress_close(UDPEgress *this);
+void udpegress_set_mode(UDPEgress *this, UDPEgressMode mode);
+//Enables SO_TXTIME on the opened socket, returns FALSE if the kernel
+//refuses it. Packets without a departure time leave immediately.
+gboolean udpegress_set_txtime(UDPEgress *this, gboolean enabled);
+
+//Sends the packets in order, returns the number of packets sent
+guint udpegress_send(UDPEgress *this, GstBuffer **buffers, guint length);
+
+void udpegress_get_counters(UDPEgress *this, guint64 *packets, guint64 *bytes,
+                            guint64 *syscalls, guint64 *errors);
+//The number of packets handed to the kernel with a departure time
+guint64 udpegress_get_txtime_packets(UDPEgress *this);
+
+#endif /* UDPEGRESS_H_ */
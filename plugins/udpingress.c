@@ -0,0 +1,388 @@
+/* GStreamer UDP ingress
+ * Copyright (C) 2015 Balázs Kreith (contact: balazs.kreith@gmail.com)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+//recvmmsg() is a GNU extension
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "udpingress.h"
+#include <string.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#endif
+
+#define THIS_LOCK(this) g_mutex_lock(&this->mutex)
+#define THIS_UNLOCK(this) g_mutex_unlock(&this->mutex)
+
+GST_DEBUG_CATEGORY_STATIC (udpingress_debug_category);
+#define GST_CAT_DEFAULT udpingress_debug_category
+
+G_DEFINE_TYPE (UDPIngress, udpingress, G_TYPE_OBJECT);
+
+//----------------------------------------------------------------------
+//-------- Private functions belongs to the object ----------
+//----------------------------------------------------------------------
+
+static void udpingress_finalize (GObject * object);
+static void _close(UDPIngress *this);
+static void _setup_gro(UDPIngress *this);
+static gboolean _setup_pool(UDPIngress *this);
+static guint _receive_single(UDPIngress *this, GstBufferList *list);
+#ifdef __linux__
+static guint _receive_mmsg(UDPIngress *this, GstBufferList *list);
+#endif
+
+//----------------------------------------------------------------------
+//--------- Private functions implementations to the object --------
+//----------------------------------------------------------------------
+
+void
+udpingress_class_init (UDPIngressClass * klass)
+{
+  GObjectClass *gobject_class;
+
+  gobject_class = (GObjectClass *) klass;
+
+  gobject_class->finalize = udpingress_finalize;
+
+  GST_DEBUG_CATEGORY_INIT (udpingress_debug_category, "udpingress", 0,
+      "MpRTP UDP Ingress");
+}
+
+void
+udpingress_finalize (GObject * object)
+{
+  UDPIngress *this = UDPINGRESS (object);
+  _close(this);
+  g_mutex_clear(&this->mutex);
+}
+
+void
+udpingress_init (UDPIngress * this)
+{
+  g_mutex_init(&this->mutex);
+  this->mode = UDPINGRESS_MODE_GRO;
+}
+
+UDPIngress *make_udpingress(void)
+{
+  return g_object_new (UDPINGRESS_TYPE, NULL);
+}
+
+void udpingress_set_mode(UDPIngress *this, UDPIngressMode mode)
+{
+  THIS_LOCK(this);
+  if(this->mode == mode){
+    goto done;
+  }
+  this->mode = mode;
+  if(this->socket){
+    _setup_gro(this);
+    _setup_pool(this);
+  }
+done:
+  THIS_UNLOCK(this);
+}
+
+gboolean udpingress_open(UDPIngress *this, const gchar *address, guint16 port, GError **error)
+{
+  GInetAddress *inet_address;
+  GSocketAddress *bind_address;
+  gboolean result = FALSE;
+
+  THIS_LOCK(this);
+  _close(this);
+  if(address && *address){
+    inet_address = g_inet_address_new_from_string(address);
+  }else{
+    inet_address = g_inet_address_new_any(G_SOCKET_FAMILY_IPV4);
+  }
+  if(!inet_address){
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "Invalid address %s", address);
+    goto done;
+  }
+  this->socket = g_socket_new(g_inet_address_get_family(inet_address), G_SOCKET_TYPE_DATAGRAM,
+                              G_SOCKET_PROTOCOL_UDP, error);
+  if(!this->socket){
+    g_object_unref(inet_address);
+    goto done;
+  }
+  g_socket_set_blocking(this->socket, FALSE);
+  bind_address = g_inet_socket_address_new(inet_address, port);
+  g_object_unref(inet_address);
+  result = g_socket_bind(this->socket, bind_address, TRUE, error);
+  g_object_unref(bind_address);
+  if(!result){
+    _close(this);
+    goto done;
+  }
+  _setup_gro(this);
+  _setup_pool(this);
+done:
+  THIS_UNLOCK(this);
+  return result;
+}
+
+void udpingress_close(UDPIngress *this)
+{
+  THIS_LOCK(this);
+  _close(this);
+  THIS_UNLOCK(this);
+}
+
+gint udpingress_get_fd(UDPIngress *this)
+{
+  gint result;
+  THIS_LOCK(this);
+  result = this->socket ? g_socket_get_fd(this->socket) : -1;
+  THIS_UNLOCK(this);
+  return result;
+}
+
+guint udpingress_receive(UDPIngress *this, GstBufferList *list)
+{
+  guint result = 0;
+  THIS_LOCK(this);
+  if(!this->socket || !this->pool){
+    goto done;
+  }
+#ifdef __linux__
+  if(this->mode != UDPINGRESS_MODE_SINGLE){
+    result = _receive_mmsg(this, list);
+    goto done;
+  }
+#endif
+  result = _receive_single(this, list);
+done:
+  THIS_UNLOCK(this);
+  return result;
+}
+
+void udpingress_get_counters(UDPIngress *this, guint64 *packets, guint64 *bytes,
+                             guint64 *syscalls, guint64 *errors)
+{
+  THIS_LOCK(this);
+  if(packets){
+    *packets = this->packets;
+  }
+  if(bytes){
+    *bytes = this->bytes;
+  }
+  if(syscalls){
+    *syscalls = this->syscalls;
+  }
+  if(errors){
+    *errors = this->errors;
+  }
+  THIS_UNLOCK(this);
+}
+
+void _close(UDPIngress *this)
+{
+  if(this->pool){
+    gst_buffer_pool_set_active(this->pool, FALSE);
+    gst_object_unref(this->pool);
+    this->pool = NULL;
+  }
+  if(this->socket){
+    g_socket_close(this->socket, NULL);
+    g_object_unref(this->socket);
+    this->socket = NULL;
+  }
+  this->gro_enabled = FALSE;
+}
+
+void _setup_gro(UDPIngress *this)
+{
+#ifdef __linux__
+  gint value = this->mode == UDPINGRESS_MODE_GRO ? 1 : 0;
+  this->gro_enabled = FALSE;
+  if(setsockopt(g_socket_get_fd(this->socket), SOL_UDP, UDP_GRO, &value, sizeof(value)) < 0){
+    if(value){
+      GST_INFO_OBJECT(this, "UDP GRO is not supported, recvmmsg is used");
+    }
+    return;
+  }
+  this->gro_enabled = value;
+#endif
+}
+
+//GRO reads need room for the coalesced segments, otherwise one datagram
+//fits into a buffer
+gboolean _setup_pool(UDPIngress *this)
+{
+  GstStructure *config;
+
+  if(this->pool){
+    gst_buffer_pool_set_active(this->pool, FALSE);
+    gst_object_unref(this->pool);
+  }
+  this->pool = gst_buffer_pool_new();
+  config = gst_buffer_pool_get_config(this->pool);
+  gst_buffer_pool_config_set_params(config, NULL,
+      this->gro_enabled ? UDPINGRESS_GRO_BUFFER_SIZE : UDPINGRESS_BUFFER_SIZE,
+      UDPINGRESS_BATCH_LENGTH, 0);
+  if(!gst_buffer_pool_set_config(this->pool, config) ||
+     !gst_buffer_pool_set_active(this->pool, TRUE)){
+    GST_WARNING_OBJECT(this, "The buffer pool can not be activated");
+    gst_object_unref(this->pool);
+    this->pool = NULL;
+    return FALSE;
+  }
+  return TRUE;
+}
+
+//One syscall per datagram, the same udpsrc makes
+guint _receive_single(UDPIngress *this, GstBufferList *list)
+{
+  GError *error = NULL;
+  GstBuffer *buffer;
+  GstMapInfo map;
+  gssize received;
+  guint result = 0;
+
+  while(result < UDPINGRESS_BATCH_LENGTH){
+    if(gst_buffer_pool_acquire_buffer(this->pool, &buffer, NULL) != GST_FLOW_OK){
+      break;
+    }
+    gst_buffer_map(buffer, &map, GST_MAP_WRITE);
+    ++this->syscalls;
+    received = g_socket_receive(this->socket, (gchar*) map.data, map.size, NULL, &error);
+    gst_buffer_unmap(buffer, &map);
+    if(received < 0){
+      if(!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK)){
+        GST_DEBUG_OBJECT(this, "Receiving failed: %s", error->message);
+        ++this->errors;
+      }
+      g_clear_error(&error);
+      gst_buffer_unref(buffer);
+      break;
+    }
+    gst_buffer_resize(buffer, 0, received);
+    gst_buffer_list_add(list, buffer);
+    ++this->packets;
+    this->bytes += received;
+    ++result;
+  }
+  return result;
+}
+
+#ifdef __linux__
+
+//Splits a GRO read into its segments, the last one may be shorter
+static guint _add_segments(GstBufferList *list, GstBuffer *buffer, gsize size, gsize segment_size)
+{
+  gsize offset;
+  guint result = 0;
+  if(!segment_size || size <= segment_size){
+    gst_buffer_list_add(list, buffer);
+    return 1;
+  }
+  for(offset = 0; offset < size; offset += segment_size, ++result){
+    gst_buffer_list_add(list, gst_buffer_copy_region(buffer, GST_BUFFER_COPY_MEMORY,
+                                                     offset, MIN(segment_size, size - offset)));
+  }
+  gst_buffer_unref(buffer);
+  return result;
+}
+
+guint _receive_mmsg(UDPIngress *this, GstBufferList *list)
+{
+  struct mmsghdr msgs[UDPINGRESS_BATCH_LENGTH];
+  struct iovec iovs[UDPINGRESS_BATCH_LENGTH];
+  GstBuffer *buffers[UDPINGRESS_BATCH_LENGTH];
+  GstMapInfo maps[UDPINGRESS_BATCH_LENGTH];
+  union{
+    gchar buf[CMSG_SPACE(sizeof(gint))];
+    struct cmsghdr align;
+  }controls[UDPINGRESS_BATCH_LENGTH];
+  struct cmsghdr *cmsg;
+  gint ret, segment_size;
+  guint i, num, result = 0;
+
+  for(num = 0; num < UDPINGRESS_BATCH_LENGTH; ++num){
+    if(gst_buffer_pool_acquire_buffer(this->pool, buffers + num, NULL) != GST_FLOW_OK){
+      break;
+    }
+    gst_buffer_map(buffers[num], maps + num, GST_MAP_WRITE);
+  }
+  memset(msgs, 0, sizeof(struct mmsghdr) * num);
+  for(i = 0; i < num; ++i){
+    iovs[i].iov_base = maps[i].data;
+    iovs[i].iov_len  = maps[i].size;
+    msgs[i].msg_hdr.msg_iov    = iovs + i;
+    msgs[i].msg_hdr.msg_iovlen = 1;
+    if(this->gro_enabled){
+      msgs[i].msg_hdr.msg_control    = controls[i].buf;
+      msgs[i].msg_hdr.msg_controllen = sizeof(controls[i].buf);
+    }
+  }
+
+  do{
+    ++this->syscalls;
+    ret = recvmmsg(g_socket_get_fd(this->socket), msgs, num, MSG_DONTWAIT, NULL);
+  }while(ret < 0 && errno == EINTR);
+  if(ret < 0){
+    if(errno != EAGAIN && errno != EWOULDBLOCK){
+      GST_DEBUG_OBJECT(this, "recvmmsg failed: %s", g_strerror(errno));
+      ++this->errors;
+    }
+    ret = 0;
+  }
+
+  for(i = 0; i < num; ++i){
+    gst_buffer_unmap(buffers[i], maps + i);
+    if((guint) ret <= i){
+      gst_buffer_unref(buffers[i]);
+      continue;
+    }
+    segment_size = 0;
+    for(cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cmsg; cmsg = CMSG_NXTHDR(&msgs[i].msg_hdr, cmsg)){
+      if(cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO){
+        memcpy(&segment_size, CMSG_DATA(cmsg), sizeof(gint));
+      }
+    }
+    gst_buffer_resize(buffers[i], 0, msgs[i].msg_len);
+    this->bytes += msgs[i].msg_len;
+    result += _add_segments(list, buffers[i], msgs[i].msg_len, segment_size);
+  }
+  this->packets += result;
+  return result;
+}
+
+#endif
+
+#undef THIS_LOCK
+#undef THIS_UNLOCK
@@ -0,0 +1,76 @@
+/*
+ * udpingress.h
+ *
+ *  UDP socket of one subflow receiving packets in batches. Datagrams are
+ *  read into pooled buffers by recvmmsg, or with UDP GRO the kernel
+ *  coalesces the datagrams of a flow into one read, which is split into
+ *  sub-buffers sharing its memory. Without kernel support the ingress
+ *  falls back to one recvfrom per packet, which is what udpsrc does.
+ *  Syscalls are counted to compare the modes.
+ */
+
+#ifndef UDPINGRESS_H_
+#define UDPINGRESS_H_
+
+#include <gst/gst.h>
+#include <gio/gio.h>
+
+typedef struct _UDPIngress UDPIngress;
+typedef struct _UDPIngressClass UDPIngressClass;
+
+#define UDPINGRESS_TYPE             (udpingress_get_type())
+#define UDPINGRESS(src)             (G_TYPE_CHECK_INSTANCE_CAST((src),UDPINGRESS_TYPE,UDPIngress))
+#define UDPINGRESS_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST((klass),UDPINGRESS_TYPE,UDPIngressClass))
+#define UDPINGRESS_IS_SOURCE(src)          (G_TYPE_CHECK_INSTANCE_TYPE((src),UDPINGRESS_TYPE))
+#define UDPINGRESS_IS_SOURCE_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE((klass),UDPINGRESS_TYPE))
+#define UDPINGRESS_CAST(src)        ((UDPIngress *)(src))
+
+//Datagrams read by one syscall at most
+#define UDPINGRESS_BATCH_LENGTH 64
+#define UDPINGRESS_BUFFER_SIZE 2048
+//A GRO read holds up to 64 coalesced segments
+#define UDPINGRESS_GRO_BUFFER_SIZE 65535
+
+typedef enum{
+  UDPINGRESS_MODE_SINGLE   = 0,
+  UDPINGRESS_MODE_RECVMMSG = 1,
+  UDPINGRESS_MODE_GRO      = 2,
+}UDPIngressMode;
+
+struct _UDPIngress
+{
+  GObject                  object;
+  GMutex                   mutex;
+  GSocket*                 socket;
+  UDPIngressMode           mode;
+  gboolean                 gro_enabled;
+  GstBufferPool*           pool;
+
+  guint64                  packets;
+  guint64                  bytes;
+  guint64                  syscalls;
+  guint64                  errors;
+};
+
+struct _UDPIngressClass{
+  GObjectClass parent_class;
+};
+
+GType udpingress_get_type (void);
+
+UDPIngress *make_udpingress(void);
+void udpingress_set_mode(UDPIngress *this, UDPIngressMode mode);
+//Opens the socket bound to address:port, address NULL means any
+gboolean udpingress_open(UDPIngress *this, const gchar *address, guint16 port, GError **error);
+void udpingress_close(UDPIngress *this);
+//Native descriptor for polling the socket, -1 if it is closed
+gint udpingress_get_fd(UDPIngress *this);
+
+//Reads the datagrams ready on the socket without blocking and adds them
+//to the list, returns the number of packets added
+guint udpingress_receive(UDPIngress *this, GstBufferList *list);
+
+void udpingress_get_counters(UDPIngress *this, guint64 *packets, guint64 *bytes,
+                             guint64 *syscalls, guint64 *errors);
+
+#endif /* UDPINGRESS_H_ */
@@ -50,6 +50,8 @@ echo "debug is 1"
   set -x
 fi
 
+scripts/statsconv.sh "$SRCDIR"
+
 DURFEC=160
 DURRCVQUEUE=160
 DURRCVTHROUGHPUTS=160
@@ -50,6 +50,8 @@ echo "debug is 1"
   set -x
 fi
 
+scripts/statsconv.sh "$SRCDIR"
+
 DURFEC=100
 DURRCVQUEUE=100
 DURRCVTHROUGHPUTS=100
@@ -55,6 +55,8 @@ echo "debug is 1"
   set -x
 fi
 
+scripts/statsconv.sh "$SRCDIR" "$SRCDIR2"
+
 DURFEC=125
 DURRCVQUEUE=125
 DURRCVTHROUGHPUTS=125
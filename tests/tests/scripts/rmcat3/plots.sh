@@ -55,6 +55,8 @@ echo "debug is 1"
   set -x
 fi
 
+scripts/statsconv.sh "$SRCDIR" "$SRCDIR2"
+
 DURRCVTHROUGHPUTS=100
 DURSNDTHROUGHPUTS=100
 DURRTCPINTVALS=100
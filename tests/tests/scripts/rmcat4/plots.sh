@@ -52,6 +52,8 @@ echo "debug is 1"
   set -x
 fi
 
+scripts/statsconv.sh "$SRCDIR" "$SRCDIR2" "$SRCDIR3"
+
 DURRCVTHROUGHPUTS=120
 DURSNDTHROUGHPUTS=120
 
@@ -54,6 +54,8 @@ echo "debug is 1"
   set -x
 fi
 
+scripts/statsconv.sh "$SRCDIR" "$SRCDIR2" "$SRCDIR3" "$SRCDIR4" "$SRCDIR5"
+
 DURRCVTHROUGHPUTS=1200
 DURSNDTHROUGHPUTS=1200
 
@@ -0,0 +1,13 @@
+#!/bin/bash
+#Makes the CSV files of the given log directories from the binary stats
+#log the elements write (mprtpstats.bin), so the plots read them as before.
+#The converter is taken from STATSCONV, built in the plugins directory.
+
+STATSCONV=${STATSCONV:-../../plugins/mprtpstatsconv}
+
+for dir in "$@"
+do
+  if [ -f "$dir/mprtpstats.bin" ]; then
+    $STATSCONV "$dir/mprtpstats.bin"
+  fi
+done
@@ -50,6 +50,8 @@ echo "debug is 1"
   set -x
 fi
 
+scripts/statsconv.sh "$SRCDIR"
+
 DURFEC=3000
 DURRCVQUEUE=3000
 DURAUTOCORRS=2400